@@ -1,5 +1,34 @@
 #!/bin/bash
 
+# Binary telemetry (built with USE_TELEMETRY): export series directly
+TELEMETRY=$(ls -t telemetry-*.bin 2> /dev/null | head -n 1)
+if [ -n "$TELEMETRY" ] && command -v pacer-telemetry > /dev/null; then
+  pacer-telemetry "$TELEMETRY" \
+    "u=u.mat" \
+    "uff=uff.mat" \
+    "ufb=ufb.mat" \
+    "qdd=qdd.mat" \
+    "generalized_qd=qd.mat" \
+    "q=q.mat" \
+    "qdd_des=qdd_des.mat" \
+    "qd_des=qd_des.mat" \
+    "q_des=q_des.mat" \
+    "CoM_x=com.mat" \
+    "CoM_xd=comxd.mat" \
+    "??_FOOT_x=x.mat" \
+    "??_FOOT_x_des=x_des.mat" \
+    "??_FOOT_x_err=x_err.mat" \
+    "??_FOOT_xd=xd.mat" \
+    "??_FOOT_xd_des=xd_des.mat" \
+    "??_FOOT_xd_err=xd_err.mat" \
+    "roll_pitch_yaw=rpy.mat" \
+    "idyn_timing=t_idyn.mat" \
+    "num_contacts=nc.mat" \
+    "cf_moby=cf_moby.mat" \
+    "cf_id=cf_id.mat"
+  exit $?
+fi
+
 grep "u = " out.log > u.mat
 grep "uff = " out.log > uff.mat
 grep "ufb = " out.log > ufb.mat
@@ -22,5 +51,3 @@ grep "idyn_timing = " out.log > t_idyn.mat
 grep "num_contacts = " out.log > nc.mat
 grep "cf_moby = " out.log > cf_moby.mat
 grep "cf_id = " out.log > cf_id.mat
-
-
@@ -27,8 +27,6 @@
 
 void loop(){
 boost::shared_ptr<Pacer::Controller> ctrl(ctrl_weak_ptr);
-  Ravelin::Vector3d center_of_mass_x;
-  center_of_mass_x.pose = Pacer::GLOBAL;
   double total_mass=0;
   
   {
@@ -46,15 +44,9 @@ boost::shared_ptr<Pacer::Controller> ctrl(ctrl_weak_ptr);
     OUT_LOG(logERROR)<< "simulated-imu-state-data " << (t-start_time) << " " << state << std::endl;
   }
 
-  const std::map<std::string, boost::shared_ptr<Ravelin::RigidBodyd> >& _id_link_map = ctrl->get_links();
-  std::map<std::string, boost::shared_ptr<Ravelin::RigidBodyd> >::const_iterator it;
-  for(it=_id_link_map.begin();it!=_id_link_map.end();it++){
-    double m = (*it).second->get_mass();
-    total_mass += m;
-    center_of_mass_x += (Ravelin::Pose3d::transform_point(Pacer::GLOBAL,Ravelin::Vector3d(0,0,0,(*it).second->get_pose())) *= m);
-  }
+  // chain link poses come from the Robot's kinematics cache
+  Ravelin::Vector3d center_of_mass_x = ctrl->calc_center_of_mass(total_mass);
   ctrl->set_data<double>("mass",total_mass);
-  center_of_mass_x /= total_mass;
   
   boost::shared_ptr<Ravelin::RigidBodyd>  _root_link = ctrl->get_root_link();
   boost::shared_ptr<Ravelin::Pose3d> base_com_w(new Ravelin::Pose3d);
@@ -1,6 +1,7 @@
 
 bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd& qdd, const Ravelin::MatrixNd& M,const  Ravelin::MatrixNd& NT,
-                         const Ravelin::MatrixNd& D_, const Ravelin::VectorNd& fext, double dt, const Ravelin::MatrixNd& MU, Ravelin::VectorNd& x, Ravelin::VectorNd& cf){
+                         const Ravelin::MatrixNd& D_, const Ravelin::VectorNd& fext, double dt, const Ravelin::MatrixNd& MU, Ravelin::VectorNd& x, Ravelin::VectorNd& cf,
+                         const Pacer::ContactJacobian* J = NULL){
   Ravelin::MatrixNd _workM, _workM2;
   Ravelin::VectorNd _workv, _workv2;
   
@@ -25,14 +26,11 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   OUTLOG(DT,"D'",logDEBUG1);
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
   
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
-  
   // | F E'|  =  inv(M)
   // | E D |
   Ravelin::MatrixNd E(6,nq);
@@ -74,39 +72,79 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   Cn_iM_CdT,   Cn_iM_CnT,   Cn_iM_JxT,
   /*  Jx_iM_CdT,  Jx_iM_CnT,*/ Jx_iM_JxT;
   
-  // S
-  LA_.solve_chol_fast(iM_chol,_workM = DT);
-  D.mult(_workM,Cd_iM_CdT);
+  Ravelin::VectorNd Cd_v, Cn_v, Jx_v;
+  if(J && nk == 4){
+    // products from the per contact blocks of J = [N;S;T], D' = [S' T' -S' -T']:
+    // row a of D is sign(a) times row dj(a) of J
+    std::vector<unsigned> dj(nc*nk);
+    std::vector<double> ds(nc*nk);
+    for(int a=0;a<nc*nk;a++){
+      dj[a] = nc*(1 + (a/nc) % 2) + a % nc;
+      ds[a] = (a < nc*2)? 1.0 : -1.0;
+    }
+    
+    J->mult_inertia_transpose(iM,_workM);
+    Cd_iM_CdT.resize(nc*nk,nc*nk);
+    Cd_iM_CnT.resize(nc*nk,nc);
+    for(int a=0;a<nc*nk;a++){
+      for(int b=0;b<nc*nk;b++)
+        Cd_iM_CdT(a,b) = ds[a]*ds[b]*_workM(dj[a],dj[b]);
+      for(int i=0;i<nc;i++)
+        Cd_iM_CnT(a,i) = ds[a]*_workM(dj[a],i);
+    }
+    _workM.get_sub_mat(0,nc,0,nc,Cn_iM_CnT);
+    Ravelin::MatrixNd::transpose(Cd_iM_CnT,Cn_iM_CdT);
+    
+    // J iM P'
+    J->mult_inertia(iM,nq,_workM);
+    _workM.get_sub_mat(0,nc,0,nq,Cn_iM_JxT);
+    Cd_iM_JxT.resize(nc*nk,nq);
+    for(int a=0;a<nc*nk;a++)
+      for(int j=0;j<nq;j++)
+        Cd_iM_JxT(a,j) = ds[a]*_workM(dj[a],j);
+    
+    // P iM P'
+    Jx_iM_JxT = F;
+    
+    J->mult(v,_workv);
+    _workv.get_sub_vec(0,nc,Cn_v);
+    Cd_v.resize(nc*nk);
+    for(int a=0;a<nc*nk;a++)
+      Cd_v[a] = ds[a]*_workv[dj[a]];
+  } else {
+    // S
+    LA_.solve_chol_fast(iM_chol,_workM = DT);
+    D.mult(_workM,Cd_iM_CdT);
   
-  LA_.solve_chol_fast(iM_chol,_workM =  NT);
-  D.mult(_workM,Cd_iM_CnT);
+    LA_.solve_chol_fast(iM_chol,_workM =  NT);
+    D.mult(_workM,Cd_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  D.mult(_workM,Cd_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    D.mult(_workM,Cd_iM_JxT);
   
-  // N
-  LA_.solve_chol_fast(iM_chol,_workM = DT);
-  N.mult(_workM,Cn_iM_CdT);
+    // N
+    LA_.solve_chol_fast(iM_chol,_workM = DT);
+    N.mult(_workM,Cn_iM_CdT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = NT);
-  N.mult(_workM,Cn_iM_CnT);
+    LA_.solve_chol_fast(iM_chol,_workM = NT);
+    N.mult(_workM,Cn_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  N.mult(_workM,Cn_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    N.mult(_workM,Cn_iM_JxT);
   
-  // P
-  //  LA_.solve_chol_fast(iM_chol,_workM = DT);
-  //  P.mult(_workM,Jx_iM_CdT);
+    // P
+    //  LA_.solve_chol_fast(iM_chol,_workM = DT);
+    //  P.mult(_workM,Jx_iM_CdT);
   
-  //  LA_.solve_chol_fast(iM_chol,_workM = NT);
-  //  P.mult(_workM,Jx_iM_CnT);
+    //  LA_.solve_chol_fast(iM_chol,_workM = NT);
+    //  P.mult(_workM,Jx_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  P.mult(_workM,Jx_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    P.mult(_workM,Jx_iM_JxT);
   
-  Ravelin::VectorNd Cd_v, Cn_v, Jx_v;
-  D.mult(v,Cd_v);
-  N.mult(v,Cn_v);
+    D.mult(v,Cd_v);
+    N.mult(v,Cn_v);
+  }
   P.mult(v,Jx_v);
   
   // Printouts
@@ -234,7 +272,7 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   _Y = Jx_iM_JxT;
   
   // Invert (chol factorize) matrix _Y
-  bool success = _LA.factor_chol(_Y);
+  bool success = LA_.factor_chol(_Y);
   assert(success);
   
   Ravelin::MatrixNd _Q_iM_XT;
@@ -270,11 +308,11 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   
   //  Ravelin::MatrixNd Y;
   //  Y = Ravelin::MatrixNd::identity(_Y.rows());
-  //  _LA.solve_chol_fast(_Y, Y);
+  //  LA_.solve_chol_fast(_Y, Y);
   
   // compute Y*X*inv(M)*Q'
   Ravelin::MatrixNd::transpose(_Q_iM_XT, _workM);
-  _LA.solve_chol_fast(_Y, _workM);
+  LA_.solve_chol_fast(_Y, _workM);
   
   // compute Q*inv(M)*X'*Y*X*inv(M)*Q'
   _Q_iM_XT.mult(_workM, _workM2);
@@ -294,7 +332,7 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   
   // compute Y*X*v
   _YXv = _Xv;
-  _LA.solve_chol_fast(_Y, _YXv);
+  LA_.solve_chol_fast(_Y, _YXv);
   
   // compute Q*inv(M)*X' * Y*X*v
   // & subtract from LCP Vector
@@ -305,24 +343,19 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   Ravelin::VectorNd _Yvqstar;
   _Yvqstar.set_zero(nq);
   _Yvqstar.set_sub_vec(J_IDX, vqstar);
-  _LA.solve_chol_fast(_Y, _Yvqstar);
+  LA_.solve_chol_fast(_Y, _Yvqstar);
   // & add to LCP Vector
   _Q_iM_XT.mult(_Yvqstar, _qq,1.0,1.0);
   
   OUTLOG(_qq,"qq",logDEBUG1);
   // setup remainder of LCP vector
   
-  static Ravelin::VectorNd _v;
-  
-  OUT_LOG(logERROR) << "-- using: Moby::LCP::lcp_fast" << std::endl;
+  Ravelin::VectorNd& _v = IdynContext::current().v_cflcp;
   
-  if (!_lcp.lcp_fast(_MM, _qq, _v))
-  {
-    OUT_LOG(logERROR) << "Principal pivoting method LCP solver failed; falling back to regularized lemke solver" << std::endl;
-    
-    if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v,-20,4,1))
-      throw std::runtime_error("Unable to solve constraint LCP!");
-  }
+  // solve the LCP with the first method of the CFLCP chain that succeeds
+  static const std::vector<unsigned> no_indices;
+  if (!lcp_chain("CFLCP").solve(_MM, _qq, no_indices, _v, false))
+    throw std::runtime_error("Unable to solve constraint LCP!");
   _MM.mult(_v,_workv = _qq,1,1);
 
   OUTLOG(_v,"v",logDEBUG1);
@@ -341,7 +374,7 @@ bool inverse_dynamics_ap(const Ravelin::VectorNd& vel, const Ravelin::VectorNd&
   tau = _YXv;
   tau -= _Yvqstar;
   _Q_iM_XT.transpose_mult(_v, _workv);
-  _LA.solve_chol_fast(_Y, _workv);
+  LA_.solve_chol_fast(_Y, _workv);
   tau += _workv;
   tau.negate();
   
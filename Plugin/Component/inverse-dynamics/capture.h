@@ -0,0 +1,309 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef IDYN_CAPTURE_H
+#define IDYN_CAPTURE_H
+
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/MatrixNd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+/**
+ * @brief Binary capture of inverse dynamics problems (idyn-<pid>.bin).
+ *
+ * Every problem the plugin solves is appended with the results of the
+ * formulations that solved it:
+ *
+ *   file header    : "PACERIDY" | uint32 version | uint32 0
+ *   problem record : uint32 PROBLEM | uint32 ndofs | uint32 nc | uint32 njoints
+ *                    | uint64 tick | double time | double dt | double damping
+ *                    | uint32 active_eefs | uint32 same_indices
+ *                    | double qd[ndofs], qdd_des[njoints], fext[ndofs]
+ *                    | double M[ndofs x ndofs], N[ndofs x nc], D[ndofs x 4nc], MU[nc x 2] (column major)
+ *                    | uint32 indices[nc] (padded to 8 bytes)
+ *   result record  : uint32 RESULT | uint32 name_len | uint32 nx | uint32 ncf | uint32 solved | uint32 0
+ *                    | double latency (s) | double x[nx], cf[ncf] | name (padded to 8 bytes)
+ *
+ * in native byte order.  A record cut short by a crash ends the stream.
+ * The idyn-replay tool (replay.cpp) replays a capture through every formulation.
+ *
+ * write() only serializes into memory; flush() ends the records of a tick.
+ * With USE_THREADS a writer thread takes them from there to the file, so the
+ * control thread never waits on the disk, and the records of a tick are
+ * dropped (flush() returns false) if more than MAX_QUEUED_BYTES are waiting.
+ * Without it the records are written in batches of BATCH_BYTES.
+ */
+struct idyn_problem_t{
+  uint64_t tick;
+  double time, dt, damping;
+  unsigned active_eefs;
+  bool same_indices;
+  Ravelin::VectorNd qd, qdd_des, fext;
+  Ravelin::MatrixNd M, N, D, MU;
+  std::vector<unsigned> indices;
+};
+
+struct idyn_result_t{
+  std::string name;
+  bool solved;
+  double latency;
+  Ravelin::VectorNd x, cf;
+};
+
+class IdynCapture{
+public:
+  enum record_e { PROBLEM = 1, RESULT = 2 };
+  static const uint32_t VERSION = 1;
+  static const size_t MAX_QUEUED_BYTES = 64 << 20, BATCH_BYTES = 1 << 20;
+
+  IdynCapture(const std::string& filename) : _fp(fopen(filename.c_str(),"wb")) {
+    if(!_fp)
+      throw std::runtime_error("Could not open idyn capture file: " + filename);
+    const uint32_t header[2] = {VERSION, 0};
+    append("PACERIDY",8);
+    append(header,sizeof(header));
+#ifdef USE_THREADS
+    _stop = false;
+    pthread_mutex_init(&_mutex,NULL);
+    pthread_cond_init(&_queued_cond,NULL);
+    if(pthread_create(&_writer,NULL,&IdynCapture::writer_thread,this) != 0){
+      fclose(_fp);
+      throw std::runtime_error("Could not start idyn capture thread");
+    }
+#endif
+  }
+
+  ~IdynCapture(){
+#ifdef USE_THREADS
+    pthread_mutex_lock(&_mutex);
+    _stop = true;
+    pthread_cond_signal(&_queued_cond);
+    pthread_mutex_unlock(&_mutex);
+    pthread_join(_writer,NULL);
+    pthread_cond_destroy(&_queued_cond);
+    pthread_mutex_destroy(&_mutex);
+#endif
+    write_out(_pending);
+    fclose(_fp);
+  }
+
+  void write(const idyn_problem_t& p){
+    const uint32_t ndofs = p.M.rows(), nc = p.N.columns(), njoints = p.qdd_des.rows();
+    const uint32_t head[4] = {PROBLEM, ndofs, nc, njoints};
+    append(head,sizeof(head));
+    append(&p.tick,sizeof(uint64_t));
+    const double scalars[3] = {p.time, p.dt, p.damping};
+    append(scalars,sizeof(scalars));
+    const uint32_t flags[2] = {p.active_eefs, p.same_indices};
+    append(flags,sizeof(flags));
+    write(p.qd);
+    write(p.qdd_des);
+    write(p.fext);
+    write(p.M);
+    write(p.N);
+    write(p.D);
+    write(p.MU);
+    std::vector<uint32_t> indices(p.indices.begin(),p.indices.end());
+    indices.resize(nc + nc % 2,0);
+    if(!indices.empty())
+      append(&indices[0],sizeof(uint32_t) * indices.size());
+  }
+
+  void write(const idyn_result_t& r){
+    const uint32_t head[6] = {RESULT, (uint32_t) r.name.size(), r.x.rows(), r.cf.rows(), r.solved, 0};
+    append(head,sizeof(head));
+    append(&r.latency,sizeof(double));
+    write(r.x);
+    write(r.cf);
+    std::string name(r.name);
+    name.resize((name.size() + 7) / 8 * 8,'\0');
+    append(name.data(),name.size());
+  }
+
+  /// @brief End the records of this tick, returns false if they were dropped (writer behind)
+  bool flush(){
+#ifdef USE_THREADS
+    pthread_mutex_lock(&_mutex);
+    const bool queued = _queued.size() + _pending.size() <= MAX_QUEUED_BYTES;
+    if(queued){
+      _queued.insert(_queued.end(),_pending.begin(),_pending.end());
+      pthread_cond_signal(&_queued_cond);
+    }
+    pthread_mutex_unlock(&_mutex);
+    _pending.clear();
+    return queued;
+#else
+    if(_pending.size() >= BATCH_BYTES){
+      write_out(_pending);
+      _pending.clear();
+    }
+    return true;
+#endif
+  }
+
+private:
+  IdynCapture(const IdynCapture&);
+  IdynCapture& operator =(const IdynCapture&);
+
+  void append(const void* data, size_t bytes){
+    const char* p = (const char*) data;
+    _pending.insert(_pending.end(),p,p + bytes);
+  }
+
+  void write(const Ravelin::VectorNd& v){
+    if(v.rows() > 0)
+      append(v.data(),sizeof(double) * v.rows());
+  }
+
+  void write(const Ravelin::MatrixNd& m){
+    if(m.rows() * m.columns() > 0)
+      append(m.data(),sizeof(double) * m.rows() * m.columns());
+  }
+
+  void write_out(const std::vector<char>& buffer){
+    if(!buffer.empty())
+      fwrite(&buffer[0],1,buffer.size(),_fp);
+  }
+
+#ifdef USE_THREADS
+  // writes out the queued records until stopped and drained
+  static void* writer_thread(void* arg){
+    IdynCapture* c = (IdynCapture*) arg;
+    std::vector<char> buffer;
+    pthread_mutex_lock(&c->_mutex);
+    while(true){
+      while(c->_queued.empty() && !c->_stop)
+        pthread_cond_wait(&c->_queued_cond,&c->_mutex);
+      if(c->_queued.empty())
+        break;
+      buffer.swap(c->_queued);
+      pthread_mutex_unlock(&c->_mutex);
+      c->write_out(buffer);
+      fflush(c->_fp);
+      buffer.clear();
+      pthread_mutex_lock(&c->_mutex);
+    }
+    pthread_mutex_unlock(&c->_mutex);
+    return NULL;
+  }
+
+  pthread_t _writer;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _queued_cond;
+  // records handed to the writer thread (guarded by _mutex)
+  std::vector<char> _queued;
+  bool _stop;
+#endif
+
+  FILE* _fp;
+  // records of the current tick (batch without USE_THREADS)
+  std::vector<char> _pending;
+};
+
+/**
+ * @brief Sequential reader of idyn captures.
+ */
+class IdynCaptureReader{
+public:
+  IdynCaptureReader(const std::string& filename) : _fp(fopen(filename.c_str(),"rb")), _tag(0) {
+    if(!_fp)
+      throw std::runtime_error("Could not open idyn capture file: " + filename);
+    char magic[8];
+    uint32_t header[2];
+    if(fread(magic,1,8,_fp) != 8 || memcmp(magic,"PACERIDY",8) != 0
+       || fread(header,sizeof(uint32_t),2,_fp) != 2)
+      throw std::runtime_error("Not an idyn capture file: " + filename);
+    if(header[0] != IdynCapture::VERSION)
+      throw std::runtime_error("Unsupported idyn capture version in: " + filename);
+    read_tag();
+  }
+
+  ~IdynCaptureReader(){ fclose(_fp); }
+
+  /// @brief Reads the next problem and its results, returns false at the end of the stream.
+  bool next(idyn_problem_t& p, std::vector<idyn_result_t>& results){
+    results.clear();
+    if(_tag != IdynCapture::PROBLEM)
+      return false;
+
+    uint32_t head[3], flags[2];
+    double scalars[3];
+    if(!read(head,3) || fread(&p.tick,sizeof(uint64_t),1,_fp) != 1
+       || !read(scalars,3) || !read(flags,2)){
+      _tag = 0;
+      return false;
+    }
+    const unsigned ndofs = head[0], nc = head[1], njoints = head[2];
+    p.time = scalars[0];
+    p.dt = scalars[1];
+    p.damping = scalars[2];
+    p.active_eefs = flags[0];
+    p.same_indices = flags[1];
+    std::vector<uint32_t> indices(nc + nc % 2);
+    if(!read(p.qd,ndofs) || !read(p.qdd_des,njoints) || !read(p.fext,ndofs)
+       || !read(p.M,ndofs,ndofs) || !read(p.N,ndofs,nc) || !read(p.D,ndofs,nc*4) || !read(p.MU,nc,2)
+       || !read(indices.empty()? NULL : &indices[0],indices.size())){
+      _tag = 0;
+      return false;
+    }
+    p.indices.assign(indices.begin(),indices.begin()+nc);
+
+    // results of this problem
+    for(read_tag();_tag == IdynCapture::RESULT;read_tag()){
+      idyn_result_t r;
+      uint32_t rhead[5];
+      if(!read(rhead,5) || fread(&r.latency,sizeof(double),1,_fp) != 1
+         || !read(r.x,rhead[1]) || !read(r.cf,rhead[2]))
+        break;
+      r.solved = rhead[3];
+      r.name.resize((rhead[0] + 7) / 8 * 8);
+      if(!r.name.empty() && fread(&r.name[0],1,r.name.size(),_fp) != r.name.size())
+        break;
+      r.name.resize(rhead[0]);
+      results.push_back(r);
+    }
+    return true;
+  }
+
+private:
+  IdynCaptureReader(const IdynCaptureReader&);
+  IdynCaptureReader& operator =(const IdynCaptureReader&);
+
+  void read_tag(){
+    if(fread(&_tag,sizeof(uint32_t),1,_fp) != 1)
+      _tag = 0;
+  }
+
+  bool read(uint32_t* a, size_t n){
+    return n == 0 || fread(a,sizeof(uint32_t),n,_fp) == n;
+  }
+
+  bool read(double* a, size_t n){
+    return n == 0 || fread(a,sizeof(double),n,_fp) == n;
+  }
+
+  bool read(Ravelin::VectorNd& v, unsigned n){
+    v.set_zero(n);
+    return read(v.data(),n);
+  }
+
+  bool read(Ravelin::MatrixNd& m, unsigned rows, unsigned columns){
+    m.set_zero(rows,columns);
+    return read(m.data(),rows*columns);
+  }
+
+  FILE* _fp;
+  uint32_t _tag;
+};
+
+#endif // IDYN_CAPTURE_H
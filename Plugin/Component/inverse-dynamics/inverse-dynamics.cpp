@@ -14,8 +14,11 @@
  ****************************************************************************/
 #include <Pacer/utilities.h>
 #include <Moby/LCP.h>
-
-int N_SYSTEMS = 0;
+#include <Pacer/solvers.h>
+#include <Pacer/contact_jacobian.h>
+#include <Pacer/robot.h>
+#include <boost/function.hpp>
+#include <map>
 
 using Ravelin::VectorNd;
 using Ravelin::MatrixNd;
@@ -24,12 +27,123 @@ using namespace Ravelin;
 const double NEAR_ZERO = 1e-16;
 
 const double grav = 9.8;
-Ravelin::LinAlgd _LA;
-Moby::LCP _lcp;
 
-Ravelin::Vector3d workv3_;
+typedef Pacer::Robot::inertia_factor_t inertia_factor_t;
 
-Ravelin::VectorNd STAGE1, STAGE2;
+/**
+ * @brief State the formulations below keep between solves.
+ *
+ * Solver engines, warm starts and the factorization hook live here rather
+ * than in globals or function statics.  The formulations use current(): the
+ * context bound to the calling thread by an IdynContext::Scope (the plugin
+ * binds its own around each update, whichever worker runs it), otherwise a
+ * context of the thread's own.  Contexts solving concurrently in separate
+ * threads share nothing; temporaries are locals of the formulations or the
+ * thread_local LA_.
+ */
+struct IdynContext{
+  /// QP workspaces of predict_contact_forces()
+  Pacer::QPSolver qp_solver;
+  
+  /// Fallback chains of the QPs of the contact force formulations, one per QP so that
+  /// each keeps its own active set between ticks; plugin.cpp applies the configured
+  /// method order and reports their stats
+  std::map<std::string,Pacer::QPChainPtr> qp_chain;
+  
+  /// Fallback chains of the LCP formulations (NSLCP, NSLCP-FEW, CFLCP); plugin.cpp
+  /// applies the configured method order and reports their stats
+  std::map<std::string,Pacer::LCPChainPtr> lcp_chain;
+  
+  /// Cholesky factor and (if 'inverse') inverse of M in 'factor', ok is false if M is not
+  /// positive definite.  plugin.cpp points factor_inertia_hook at the controller's memoized
+  /// factorization (copied into 'factor') so that the formulations share a single
+  /// factorization per tick, otherwise M is factored into 'factor'
+  boost::function<bool (const Ravelin::MatrixNd&, inertia_factor_t&, bool)> factor_inertia_hook;
+  inertia_factor_t factor;
+  
+  /// LCP solutions kept as warm starts: predict_contact_forces(), NSLCP, CFLCP
+  Ravelin::VectorNd v_predict, v_nslcp, v_cflcp;
+  
+  /// 'adaptive' of the chains created from now on (plugin.cpp: "<ns>.adaptive-solvers")
+  bool adaptive_solvers;
+  
+  IdynContext() : adaptive_solvers(false) {}
+  
+  /// @brief Drop the solver state (chains with their stats and active sets, warm starts),
+  /// the next solves start cold with the default methods
+  void reset(){
+    qp_chain.clear();
+    lcp_chain.clear();
+    v_predict.resize(0);
+    v_nslcp.resize(0);
+    v_cflcp.resize(0);
+  }
+  
+  /// @brief Context of the calling thread
+  static IdynContext& current(){
+    if(bound())
+      return *bound();
+    static thread_local IdynContext own;
+    return own;
+  }
+  
+  /// Binds a context to the calling thread for the life of the Scope
+  class Scope{
+  public:
+    Scope(IdynContext& context) : _last(bound()) { bound() = &context; }
+    ~Scope(){ bound() = _last; }
+  private:
+    Scope(const Scope&);
+    Scope& operator =(const Scope&);
+    IdynContext* _last;
+  };
+  
+private:
+  static IdynContext*& bound(){
+    static thread_local IdynContext* context = NULL;
+    return context;
+  }
+};
+
+static Pacer::QPChain& qp_chain(const std::string& name){
+  IdynContext& context = IdynContext::current();
+  Pacer::QPChainPtr& chain = context.qp_chain[name];
+  if(!chain){
+    static const char* QP[] = {"active-set","lemke"};
+    chain = Pacer::QPChainPtr(new Pacer::QPChain(std::vector<std::string>(QP,QP+2)));
+    chain->adaptive = context.adaptive_solvers;
+  }
+  return *chain;
+}
+
+static Pacer::LCPChain& lcp_chain(const std::string& name){
+  IdynContext& context = IdynContext::current();
+  Pacer::LCPChainPtr& chain = context.lcp_chain[name];
+  if(!chain){
+    static const char* NSLCP[] = {"lcp-fast","moby-fast","qp","lemke","moby-lemke","pgs"};
+    // no-slip LCP with two feet or fewer in contact
+    static const char* NSLCP_FEW[] = {"moby-fast","moby-lemke","lemke","pgs"};
+    // the Anitescu-Potra matrix is not symmetric and has no contact indices for lcp_fast()
+    static const char* CFLCP[] = {"moby-fast","lemke","moby-lemke","pgs"};
+    if(name.compare("CFLCP") == 0)
+      chain = Pacer::LCPChainPtr(new Pacer::LCPChain(std::vector<std::string>(CFLCP,CFLCP+4)));
+    else if(name.compare("NSLCP-FEW") == 0)
+      chain = Pacer::LCPChainPtr(new Pacer::LCPChain(std::vector<std::string>(NSLCP_FEW,NSLCP_FEW+4)));
+    else
+      chain = Pacer::LCPChainPtr(new Pacer::LCPChain(std::vector<std::string>(NSLCP,NSLCP+6)));
+    chain->adaptive = context.adaptive_solvers;
+  }
+  return *chain;
+}
+
+static const inertia_factor_t& factor_inertia(const Ravelin::MatrixNd& M, bool inverse = true){
+  IdynContext& context = IdynContext::current();
+  if(context.factor_inertia_hook)
+    context.factor_inertia_hook(M,context.factor,inverse);
+  else
+    context.factor.factor(M,inverse,LA_);
+  return context.factor;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////// EXTERNAL DECLEARATIONS //////////////////////////////
@@ -166,14 +280,11 @@ void log_idyn_matrices(const Ravelin::VectorNd& v, const Ravelin::MatrixNd& M,co
   OUTLOG(T,"T",logDEBUG1);
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
   
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
-  
   // | F E'|  =  inv(M)
   // | E D |
   Ravelin::MatrixNd E(6,nq);
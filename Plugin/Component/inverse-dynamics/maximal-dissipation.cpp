@@ -27,15 +27,13 @@ bool predict_contact_forces(const Ravelin::VectorNd& v, const Ravelin::MatrixNd&
   int nq = n - 6;
   int nc = N.columns();
 
-  // Invert M
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  if(!LA_.factor_chol(iM_chol)){
+  // Factor M (iM R is solved for, inv(M) is not needed)
+  const inertia_factor_t& iM_factor = factor_inertia(M,false);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol;
+  if(!iM_factor.ok){
     OUTLOG(M,"M",logDEBUG1);
     throw std::runtime_error("Chol Factorization Failed on M");
   }
-  Ravelin::MatrixNd iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   
   // Compute Jacobians
   int nk = (nc == 0)? 0 : ST.columns()/nc;
@@ -57,7 +55,8 @@ bool predict_contact_forces(const Ravelin::VectorNd& v, const Ravelin::MatrixNd&
     //             --(iM' M iM  == iM)-->
     // G = R' M R
     Ravelin::MatrixNd G,iMR;
-    R.transpose_mult(iM.mult(R,iMR),G);
+    LA_.solve_chol_fast(iM_chol,iMR = R);
+    R.transpose_mult(iMR,G);
     
     // c = v' M iM R [z]
     //    --( M iM R == R)-->
@@ -126,8 +125,7 @@ bool predict_contact_forces(const Ravelin::VectorNd& v, const Ravelin::MatrixNd&
     /// Stage 1 optimization energy minimization
     z.set_zero(nvars);
     
-    static Ravelin::VectorNd _v;
-    if(!Utility::solve_qp_pos(G,c,A,b,z,_v,false)){
+    if(!IdynContext::current().qp_solver.solve_qp_pos(G,c,A,b,z,IdynContext::current().v_predict,false)){
       OUT_LOG(logERROR)  << "%ERROR: Unable to solve stage 1!";
       return false;
     }
@@ -152,7 +150,8 @@ bool predict_contact_forces(const Ravelin::VectorNd& v, const Ravelin::MatrixNd&
     if (LOG(logDEBUG1)) {
       OUTLOG(v,"v- (pre-constraint)",logERROR);
       Ravelin::VectorNd v_plus = v;
-      iM.mult(R.mult(z,workv1),v_plus,1,1);
+      LA_.solve_chol_fast(iM_chol,R.mult(z,workv1));
+      v_plus += workv1;
       OUTLOG(v_plus,"v+ (post-constraint)",logERROR);
       OUTLOG(0.5*M.mult(v_plus,workv1).dot(v_plus),"KE ",logERROR);
       
@@ -195,14 +194,12 @@ bool inverse_dynamics_two_stage_simple(const Ravelin::VectorNd& v, const Ravelin
   ((vqstar = qdd) *= h) += vq;
   
   // Invert M
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  if(!LA_.factor_chol(iM_chol)){
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  if(!iM_factor.ok){
     OUTLOG(M,"M",logDEBUG1);
     throw std::runtime_error("Chol Factorization Failed on M");
   }
-  Ravelin::MatrixNd iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   
   
   // P selection matrix
@@ -397,8 +394,7 @@ bool inverse_dynamics_two_stage_simple(const Ravelin::VectorNd& v, const Ravelin
     /// Stage 1 optimization energy minimization
     Ravelin::VectorNd z(nvars);
     
-    static Ravelin::VectorNd _v;
-    if(!Utility::solve_qp_pos(G,c,A,b,z,_v,false,false)){
+    if(!qp_chain("simple.1").solve_qp_pos(G,c,A,b,z,std::vector<unsigned>(),false)){
       OUT_LOG(logERROR)  << "%ERROR: Unable to solve stage 1!";
       return false;
     }
@@ -567,7 +563,7 @@ bool inverse_dynamics_two_stage_simple(const Ravelin::VectorNd& v, const Ravelin
       
       Ravelin::VectorNd w(size_null_space);
       
-      if(!Utility::solve_qp(G,c,A_OP2,b_OP2,w)){
+      if(!qp_chain("simple.2").solve_qp(G,c,A_OP2,b_OP2,w,std::vector<unsigned>(),false)){
         OUT_LOG(logERROR)  << "ERROR: Unable to solve stage 2!";
       } else {
         OUTLOG(w,"W_OP2",logDEBUG1);
@@ -661,14 +657,12 @@ bool inverse_dynamics_two_stage_simple_no_slip(const Ravelin::VectorNd& v, const
   ((vqstar = qdd) *= h) += vq;
   
   // Invert M
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  if(!LA_.factor_chol(iM_chol)){
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  if(!iM_factor.ok){
     OUTLOG(M,"M",logDEBUG1);
     throw std::runtime_error("Chol Factorization Failed on M");
   }
-  Ravelin::MatrixNd iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   
   
   // P selection matrix
@@ -826,8 +820,7 @@ bool inverse_dynamics_two_stage_simple_no_slip(const Ravelin::VectorNd& v, const
     /// Stage 1 optimization energy minimization
     Ravelin::VectorNd z(nvars);
     
-    static Ravelin::VectorNd _v;
-    if(!Utility::solve_qp_pos(G,c,A,b,z,_v,false,true)){
+    if(!qp_chain("simple-no-slip.1").solve_qp_pos(G,c,A,b,z,std::vector<unsigned>(),false)){
       OUT_LOG(logERROR)  << "%ERROR: Unable to solve stage 1!";
       return false;
     }
@@ -953,7 +946,7 @@ bool inverse_dynamics_two_stage_simple_no_slip(const Ravelin::VectorNd& v, const
       
       Ravelin::VectorNd w(size_null_space);
       
-      if(!Utility::solve_qp(G,c,A_OP2,b_OP2,w)){
+      if(!qp_chain("simple-no-slip.2").solve_qp(G,c,A_OP2,b_OP2,w,std::vector<unsigned>(),false)){
         OUT_LOG(logERROR)  << "ERROR: Unable to solve stage 2!";
       } else {
         OUTLOG(w,"W_OP2",logDEBUG1);
@@ -1058,14 +1051,10 @@ bool inverse_dynamics_sensed_forces(const Ravelin::VectorNd& v, const Ravelin::V
   
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
-  
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   //  LA_.solve_fast(M,iM);
   
   // | F E'|  =  inv(M)
@@ -1210,14 +1199,10 @@ bool inverse_dynamics_two_stage(const Ravelin::VectorNd& v, const Ravelin::Vecto
   
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
-  
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   //  LA_.solve_fast(M,iM);
   
   // | F E'|  =  inv(M)
@@ -1400,12 +1385,9 @@ bool inverse_dynamics_two_stage(const Ravelin::VectorNd& v, const Ravelin::Vecto
   qq.set_sub_vec(0,qq1);
   qq.set_sub_vec(qq1.rows(),qq2);
   
-  static Ravelin::VectorNd _v;
-  bool warm_start = true;
-//  if(_v.rows() != (qq.rows() + z.rows()) || !SAME_AS_LAST_CONTACTS)
-    warm_start = false;
+  const std::string qp_name = (two_stage? "two-stage" : "one-stage");
   
-  if(!Utility::solve_qp_pos(qG,qc,qM,qq,z,_v,warm_start)){
+  if(!qp_chain(qp_name+".1").solve_qp_pos(qG,qc,qM,qq,z,indices,SAME_AS_LAST_CONTACTS)){
     OUT_LOG(logERROR)  << "%ERROR: Unable to solve stage 1!";
     return false;
   }
@@ -1543,7 +1525,7 @@ bool inverse_dynamics_two_stage(const Ravelin::VectorNd& v, const Ravelin::Vecto
     
     // optimize system
     Ravelin::VectorNd w(size_null_space);
-    if(!Utility::solve_qp(qG,qc,qM,qq,w)){
+    if(!qp_chain(qp_name+".2").solve_qp(qG,qc,qM,qq,w,indices,SAME_AS_LAST_CONTACTS)){
       OUT_LOG(logERROR)  << "ERROR: Unable to solve stage 2!";
       return false;
       // then skip to calculating x from stage 1 solution
@@ -1652,14 +1634,10 @@ bool inverse_dynamics_no_slip(const Ravelin::VectorNd& v, const Ravelin::VectorN
   
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol;
-  iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
-  
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
   //  LA_.solve_fast(M,iM);
   
   // | F E'|  =  inv(M)
@@ -1803,12 +1781,9 @@ bool inverse_dynamics_no_slip(const Ravelin::VectorNd& v, const Ravelin::VectorN
   qM.set_sub_mat(0,0,qM1);
   qq.set_sub_vec(0,qq1);
   
-  static Ravelin::VectorNd _v;
-  bool warm_start = true;
-//  if(_v.rows() != (qq.rows() + z.rows()) || !SAME_AS_LAST_CONTACTS)
-    warm_start = false;
+  const std::string qp_name = (two_stage? "no-slip" : "no-slip-one-stage");
   
-  if(!Utility::solve_qp_pos(qG,qc,qM,qq,z,_v,warm_start)){
+  if(!qp_chain(qp_name+".1").solve_qp_pos(qG,qc,qM,qq,z,indices,SAME_AS_LAST_CONTACTS)){
     OUT_LOG(logERROR)  << "%ERROR: Unable to solve stage 1!";
     return false;
   }
@@ -1904,7 +1879,7 @@ bool inverse_dynamics_no_slip(const Ravelin::VectorNd& v, const Ravelin::VectorN
     
     // optimize system
     Ravelin::VectorNd w(size_null_space);
-    if(!Utility::solve_qp(qG,qc,qM,qq,w)){
+    if(!qp_chain(qp_name+".2").solve_qp(qG,qc,qM,qq,w,indices,SAME_AS_LAST_CONTACTS)){
       OUT_LOG(logERROR)  << "ERROR: Unable to solve stage 2!";
       // calculate x from stage 1 solution
       cf_final = cf;
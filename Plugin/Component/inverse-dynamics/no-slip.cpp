@@ -1,5 +1,6 @@
 bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::VectorNd& qdd, const Ravelin::MatrixNd& M,const  Ravelin::MatrixNd& nT,
-                                   const Ravelin::MatrixNd& D, const Ravelin::VectorNd& fext, double dt, Ravelin::VectorNd& x, Ravelin::VectorNd& cf, bool frictionless, std::vector<unsigned>& indices, int active_eefs,bool SAME_AS_LAST_CONTACTS){
+                                   const Ravelin::MatrixNd& D, const Ravelin::VectorNd& fext, double dt, Ravelin::VectorNd& x, Ravelin::VectorNd& cf, bool frictionless, std::vector<unsigned>& indices, int active_eefs,bool SAME_AS_LAST_CONTACTS,
+                                   const Pacer::ContactJacobian* J = NULL){
   Ravelin::MatrixNd _workM, _workM2;
   Ravelin::VectorNd _workv, _workv2;
   
@@ -31,14 +32,11 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   OUTLOG(T,"T",logDEBUG1);
   
   // compute D, E, and F
-  Ravelin::MatrixNd iM_chol = M;
-  bool pass = LA_.factor_chol(iM_chol);
+  const inertia_factor_t& iM_factor = factor_inertia(M);
+  const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol, & iM = iM_factor.iM;
+  bool pass = iM_factor.ok;
   assert(pass);
   
-  Ravelin::MatrixNd iM;
-  iM = Ravelin::MatrixNd::identity(n);
-  LA_.solve_chol_fast(iM_chol,iM);
-  
   // | F E'|  =  inv(M)
   // | E D |
   Ravelin::MatrixNd E(6,nq);
@@ -81,62 +79,89 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   Cn_iM_CsT, Cn_iM_CtT,   Cn_iM_CnT,   Cn_iM_JxT,
   /*  Jx_iM_CsT,  Jx_iM_CtT,    Jx_iM_CnT,*/  Jx_iM_JxT;
   
-  // S
-  LA_.solve_chol_fast(iM_chol,_workM = ST);
-  S.mult(_workM,Cs_iM_CsT);
+  Ravelin::VectorNd Cs_v, Ct_v, Cn_v, Jx_v;
+  if(J){
+    // products from the per contact blocks of J = [N;S;T]: only the entries of
+    // iM over each contact's coordinates are read
+    J->mult_inertia_transpose(iM,_workM);
+    _workM.get_sub_mat(0,nc,0,nc,Cn_iM_CnT);
+    _workM.get_sub_mat(0,nc,nc,nc*2,Cn_iM_CsT);
+    _workM.get_sub_mat(0,nc,nc*2,nc*3,Cn_iM_CtT);
+    _workM.get_sub_mat(nc,nc*2,nc,nc*2,Cs_iM_CsT);
+    _workM.get_sub_mat(nc,nc*2,nc*2,nc*3,Cs_iM_CtT);
+    _workM.get_sub_mat(nc*2,nc*3,nc,nc*2,Ct_iM_CsT);
+    _workM.get_sub_mat(nc*2,nc*3,nc*2,nc*3,Ct_iM_CtT);
+    
+    // J iM P'
+    J->mult_inertia(iM,nq,_workM);
+    _workM.get_sub_mat(0,nc,0,nq,Cn_iM_JxT);
+    _workM.get_sub_mat(nc,nc*2,0,nq,Cs_iM_JxT);
+    _workM.get_sub_mat(nc*2,nc*3,0,nq,Ct_iM_JxT);
+    
+    // P iM P'
+    Jx_iM_JxT = F;
+    
+    J->mult(v,_workv);
+    _workv.get_sub_vec(0,nc,Cn_v);
+    _workv.get_sub_vec(nc,nc*2,Cs_v);
+    _workv.get_sub_vec(nc*2,nc*3,Ct_v);
+  } else {
+    // S
+    LA_.solve_chol_fast(iM_chol,_workM = ST);
+    S.mult(_workM,Cs_iM_CsT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = TT);
-  S.mult(_workM,Cs_iM_CtT);
+    LA_.solve_chol_fast(iM_chol,_workM = TT);
+    S.mult(_workM,Cs_iM_CtT);
   
-  //  LA_.solve_chol_fast(iM_chol,_workM =  NT);
-  //  S.mult(_workM,Cs_iM_CnT);
+    //  LA_.solve_chol_fast(iM_chol,_workM =  NT);
+    //  S.mult(_workM,Cs_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  S.mult(_workM,Cs_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    S.mult(_workM,Cs_iM_JxT);
   
-  // T
-  LA_.solve_chol_fast(iM_chol,_workM = ST);
-  T.mult(_workM,Ct_iM_CsT);
+    // T
+    LA_.solve_chol_fast(iM_chol,_workM = ST);
+    T.mult(_workM,Ct_iM_CsT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = TT);
-  T.mult(_workM,Ct_iM_CtT);
+    LA_.solve_chol_fast(iM_chol,_workM = TT);
+    T.mult(_workM,Ct_iM_CtT);
   
-  //  LA_.solve_chol_fast(iM_chol,_workM = NT);
-  //  T.mult(_workM,Ct_iM_CnT);
+    //  LA_.solve_chol_fast(iM_chol,_workM = NT);
+    //  T.mult(_workM,Ct_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  T.mult(_workM,Ct_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    T.mult(_workM,Ct_iM_JxT);
   
-  // N
-  LA_.solve_chol_fast(iM_chol,_workM = ST);
-  N.mult(_workM,Cn_iM_CsT);
+    // N
+    LA_.solve_chol_fast(iM_chol,_workM = ST);
+    N.mult(_workM,Cn_iM_CsT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = TT);
-  N.mult(_workM,Cn_iM_CtT);
+    LA_.solve_chol_fast(iM_chol,_workM = TT);
+    N.mult(_workM,Cn_iM_CtT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = NT);
-  N.mult(_workM,Cn_iM_CnT);
+    LA_.solve_chol_fast(iM_chol,_workM = NT);
+    N.mult(_workM,Cn_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  N.mult(_workM,Cn_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    N.mult(_workM,Cn_iM_JxT);
   
-  // P
-  //  LA_.solve_chol_fast(iM_chol,_workM = ST);
-  //  P.mult(_workM,Jx_iM_CsT);
+    // P
+    //  LA_.solve_chol_fast(iM_chol,_workM = ST);
+    //  P.mult(_workM,Jx_iM_CsT);
   
-  //  LA_.solve_chol_fast(iM_chol,_workM = TT);
-  //  P.mult(_workM,Jx_iM_CtT);
+    //  LA_.solve_chol_fast(iM_chol,_workM = TT);
+    //  P.mult(_workM,Jx_iM_CtT);
   
-  //  LA_.solve_chol_fast(iM_chol,_workM = NT);
-  //  P.mult(_workM,Jx_iM_CnT);
+    //  LA_.solve_chol_fast(iM_chol,_workM = NT);
+    //  P.mult(_workM,Jx_iM_CnT);
   
-  LA_.solve_chol_fast(iM_chol,_workM = PT);
-  P.mult(_workM,Jx_iM_JxT);
+    LA_.solve_chol_fast(iM_chol,_workM = PT);
+    P.mult(_workM,Jx_iM_JxT);
   
-  Ravelin::VectorNd Cs_v, Ct_v, Cn_v, Jx_v;
-  S.mult(v,Cs_v);
-  T.mult(v,Ct_v);
-  N.mult(v,Cn_v);
+    S.mult(v,Cs_v);
+    T.mult(v,Ct_v);
+    N.mult(v,Cn_v);
+  }
   P.mult(v,Jx_v);
   
   OUTLOG(Cn_v,"Cn_v",logDEBUG1);
@@ -275,7 +300,7 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
       _Y(j,j) -= NEAR_ZERO;
     
     // see whether check matrix can be Cholesky factorized
-    if (!_LA.factor_chol(_Y) || frictionless)
+    if (!LA_.factor_chol(_Y) || frictionless)
       S_indices.pop_back();
     
     // add index for T
@@ -313,7 +338,7 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
       _Y(j,j) -= NEAR_ZERO;
     
     // see whether check matrix can be Cholesky factorized
-    last_success = _LA.factor_chol(_Y);
+    last_success = LA_.factor_chol(_Y);
     if (!last_success && !frictionless)
       T_indices.pop_back();
   }
@@ -383,13 +408,13 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   // check the condition number on Y
   // TODO: remove this code when satisfied Cholesky factorization is not problem
   Ravelin::MatrixNd tmp = _Y;
-  double cond = _LA.cond(tmp);
+  double cond = LA_.cond(tmp);
   if (cond > 1e6){
     OUT_LOG(logERROR) << "Condition number *may* be high (check!): " << cond << std::endl;
-    bool success = _LA.factor_chol(_Y);
+    bool success = LA_.factor_chol(_Y);
     assert(success);
   } else {
-    bool success = _LA.factor_chol(_Y);
+    bool success = LA_.factor_chol(_Y);
     assert(success);
   }
   
@@ -425,11 +450,11 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   
   //  Ravelin::MatrixNd Y;
   //  Y = Ravelin::MatrixNd::identity(_Y.rows());
-  //  _LA.solve_chol_fast(_Y, Y);
+  //  LA_.solve_chol_fast(_Y, Y);
   
   // compute Y*X*inv(M)*Q'
   Ravelin::MatrixNd::transpose(_Q_iM_XT, _workM);
-  _LA.solve_chol_fast(_Y, _workM);
+  LA_.solve_chol_fast(_Y, _workM);
   //  Y.mult_transpose(_Q_iM_XT,_workM);
   
   // compute Q*inv(M)*X'*Y*X*inv(M)*Q'
@@ -452,7 +477,7 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   
   // compute Y*X*v
   _YXv = _Xv;
-  _LA.solve_chol_fast(_Y, _YXv);
+  LA_.solve_chol_fast(_Y, _YXv);
   
   // compute Q*inv(M)*X' * Y*X*v
   _Q_iM_XT.mult(_YXv, _workv);
@@ -466,42 +491,25 @@ bool inverse_dynamics_no_slip_fast(const Ravelin::VectorNd& vel, const Ravelin::
   
   vqstar.select(J_indices.begin(), J_indices.end(), _workv);
   _Yvqstar.set_sub_vec(J_IDX, _workv);
-  _LA.solve_chol_fast(_Y, _Yvqstar);
+  LA_.solve_chol_fast(_Y, _Yvqstar);
   _Q_iM_XT.mult(_Yvqstar,_workv);
   _qq += _workv;
   
   OUTLOG(_qq,"qq",logDEBUG1);
   // setup remainder of LCP vector
   
-  static Ravelin::VectorNd _v;
+  Ravelin::VectorNd& _v = IdynContext::current().v_nslcp;
   if(_v.size() != _qq.size() || !SAME_AS_LAST_CONTACTS)
     _v.resize(0);
   
   if (active_eefs > 0) {
-    // attempt to solve the LCP using the fast method
-    if(active_eefs > 2){
-      OUT_LOG(logERROR) << "-- using: lcp_fast" << std::endl;
-      OUTLOG(_v,"warm_start_v",logDEBUG1);
-      
-      if (!Utility::lcp_fast(_MM, _qq,indices, _v,::NEAR_ZERO))
-      {
-        OUT_LOG(logERROR) << "-- Principal pivoting method LCP solver failed; falling back to regularized lemke solver" << std::endl;
-        
-        if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v,-20,4,1))
-          throw std::runtime_error("Unable to solve constraint LCP!");
-      }
-      
-    } else {
-      OUT_LOG(logERROR) << "-- using: Moby::LCP::lcp_fast" << std::endl;
-      
-      if (!_lcp.lcp_fast(_MM, _qq, _v))
-      {
-        OUT_LOG(logERROR) << "Principal pivoting method LCP solver failed; falling back to regularized lemke solver" << std::endl;
-        
-        if (!_lcp.lcp_lemke_regularized(_MM, _qq, _v,-20,4,1))
-          throw std::runtime_error("Unable to solve constraint LCP!");
-      }
-    }
+    // solve the LCP with the first method of the chain that succeeds: NSLCP (lcp_fast first)
+    // with more than two feet in contact, otherwise NSLCP-FEW (Moby's lcp_fast first)
+    const char* chain = (active_eefs > 2)? "NSLCP" : "NSLCP-FEW";
+    OUT_LOG(logDEBUG) << "-- using: " << chain << std::endl;
+    OUTLOG(_v,"warm_start_v",logDEBUG1);
+    if (!lcp_chain(chain).solve(_MM, _qq, indices, _v, SAME_AS_LAST_CONTACTS))
+      throw std::runtime_error("Unable to solve constraint LCP!");
   }
   OUTLOG(_v,"v",logERROR);
   
@@ -13,8 +13,12 @@
  *  v+ = v + inv(M)([ N, ST+, ST- ] z + h P tau + h fext)
  ****************************************************************************/
 #include "inverse-dynamics.cpp"
+#include "capture.h"
 
 #include <Pacer/controller.h>
+#include <boost/bind.hpp>
+#include <chrono>
+#include <unistd.h>
 #include "../plugin.h"
 
 //#undef OUT_LOG
@@ -28,19 +32,86 @@
 
 using namespace Pacer;
 
+// Parameters read on every tick (resolved in setup())
+static Pacer::variable_handle<double> dt_idyn_handle, alpha_handle, mcpf_handle;
+static Pacer::variable_handle<bool> des_contact_handle, last_cfs_handle;
+static Pacer::variable_handle<std::vector<std::string> > controller_name_handle;
+
+// Capture of every solved problem and its results ("<ns>.capture", see capture.h),
+// written out off the control thread
+static boost::shared_ptr<IdynCapture> capture_;
+
+// Solver state of this plugin, bound to the thread running setup() or loop()
+static IdynContext idyn_context_;
+
+// Solver statistics published every tick, resolved in setup()
+struct chain_handles_t{
+  std::string name;
+  Pacer::variable_handle<std::string> solver;
+  // per method of the chain
+  std::vector<Pacer::variable_handle<int> > calls, successes;
+  std::vector<Pacer::variable_handle<double> > latency, success_rate, error;
+};
+struct qp_chain_handles_t{
+  chain_handles_t chain;
+  Pacer::variable_handle<int> iterations;
+};
+static std::vector<qp_chain_handles_t> qp_chain_handles;
+static std::vector<chain_handles_t> lcp_chain_handles;
+static const unsigned NUM_LCP_FAST_STATS = 5, NUM_LEMKE_STATS = 8;
+static const char* LCP_FAST_STATS[NUM_LCP_FAST_STATS] = {"calls","warm-starts","warm-hits","pivots","total-pivots"};
+static const char* LEMKE_STATS[NUM_LEMKE_STATS] = {"calls","warm-starts","warm-hits","pivots","total-pivots","refactorizations",
+                                                   "moby-checks","moby-mismatches"};
+static Pacer::variable_handle<int> lcp_fast_handles[NUM_LCP_FAST_STATS], lemke_handles[NUM_LEMKE_STATS];
+
+static chain_handles_t get_chain_handles(boost::shared_ptr<Pacer::Controller>& ctrl, const std::string& name, const std::string& prefix, const Pacer::SolverChain& chain){
+  chain_handles_t h;
+  h.name = name;
+  h.solver = ctrl->get_data_handle<std::string>(prefix+"solver");
+  for(unsigned j=0;j<chain.methods().size();j++){
+    const std::string& method = chain.methods()[j];
+    h.calls.push_back(ctrl->get_data_handle<int>(prefix+method+".calls"));
+    h.successes.push_back(ctrl->get_data_handle<int>(prefix+method+".successes"));
+    h.latency.push_back(ctrl->get_data_handle<double>(prefix+method+".latency"));
+    h.success_rate.push_back(ctrl->get_data_handle<double>(prefix+method+".success-rate"));
+    h.error.push_back(ctrl->get_data_handle<double>(prefix+method+".error"));
+  }
+  return h;
+}
+
+// method that solved the last problem of the chain and per method counters
+static void set_chain_handles(chain_handles_t& h, const Pacer::SolverChain& chain){
+  if(chain.last() < 0)
+    h.solver.ref()->assign("none");
+  else
+    h.solver.ref()->assign(chain.methods()[chain.last()]);
+  for(unsigned i=0;i<chain.methods().size();i++){
+    const Pacer::SolverChain::stats_t& stats = chain.stats(i);
+    h.calls[i].set(stats.calls);
+    h.successes[i].set(stats.successes);
+    h.latency[i].set(stats.latency);
+    h.success_rate[i].set(stats.success_rate);
+    h.error[i].set(stats.error);
+  }
+}
+
 void loop(){
   boost::shared_ptr<Pacer::Controller> ctrl(ctrl_weak_ptr);
+  IdynContext::Scope scope(idyn_context_);
   static double last_time = -0.001;
   double dt = t - last_time;
   last_time = t;
   
+  // share the controller's (per-tick memoized) factorization of M
+  IdynContext::current().factor_inertia_hook = boost::bind(static_cast<bool (Pacer::Robot::*)(const Ravelin::MatrixNd&, inertia_factor_t&, bool)>(&Pacer::Robot::factor_generalized_inertia),ctrl.get(),_1,_2,_3);
+
   OUT_LOG(logDEBUG) << "simulator_time = " << t;
   
   
-  double dt_idyn = ctrl->get_data<double>(plugin_namespace+".dt");
-  double alpha = ctrl->get_data<double>(plugin_namespace+".alpha");
-  bool USE_DES_CONTACT = ctrl->get_data<bool>(plugin_namespace+".des-contact");
-  bool USE_LAST_CFS = ctrl->get_data<bool>(plugin_namespace+".last-cfs");
+  double dt_idyn = dt_idyn_handle.get();
+  double alpha = alpha_handle.get();
+  bool USE_DES_CONTACT = des_contact_handle.get();
+  bool USE_LAST_CFS = last_cfs_handle.get();
   
   double DT = dt;//(dt_idyn == 0)? dt : dt_idyn;
 //  if(DT == 0) DT = 0.001;
@@ -64,7 +135,7 @@ void loop(){
   }
   
   double mcpf = 1e2;
-  ctrl->get_data<double>(plugin_namespace+".max-contacts-per-foot",mcpf);
+  mcpf_handle.get(mcpf);
   int MAX_CONTACTS_PER_FOOT = mcpf;
   
   // TODO: REMOVE
@@ -156,7 +227,10 @@ void loop(){
   // Jacobian Calculation
   Ravelin::MatrixNd N,S,T,D;
   
-  ctrl->calc_contact_jacobians(q,contacts,N,S,T);
+  // per contact blocks (used by the LCP formulations) and their dense form
+  static Pacer::ContactJacobian contact_J;
+  ctrl->calc_contact_jacobians(q,contacts,contact_J);
+  contact_J.to_dense(N,S,T);
   
   OUTLOG(N,"N",logDEBUG);
 //  OUTLOG(S,"S",logDEBUG);
@@ -196,6 +270,7 @@ void loop(){
   
   Ravelin::VectorNd cf_init = Ravelin::VectorNd::zero(NC*5);
   {
+    Ravelin::Vector3d workv3;
     for(unsigned i=0;i< contacts.size();i++){
       
       Ravelin::Vector3d tan1,tan2;
@@ -204,7 +279,7 @@ void loop(){
                                tan1[0],                tan1[1],                tan1[2],
                                tan2[0],                tan2[1],                tan2[2]);
       
-      Ravelin::Origin3d contact_impulse = Ravelin::Origin3d(R_foot.mult(contacts[i]->impulse,workv3_));
+      Ravelin::Origin3d contact_impulse = Ravelin::Origin3d(R_foot.mult(contacts[i]->impulse,workv3));
       OUT_LOG(logDEBUG) << "Contact " << i << " mu coulomb: " << contacts[i]->mu_coulomb;
       
       OUT_LOG(logDEBUG) << "compliant: " << contacts[i]->compliant;
@@ -270,14 +345,38 @@ void loop(){
   OUTLOG(MU,"MU",logDEBUG);
   
   // IDYN MAXIMAL DISSIPATION MODEL
-  std::vector<std::string> controller_name = ctrl->get_data<std::vector<std::string> >(plugin_namespace+".type");
+  const std::vector<std::string>& controller_name = controller_name_handle.get();
   
   std::map<std::string,Ravelin::VectorNd> cf_map,uff_map;
   
   OUTLOG(NC,"idyn_NC",logDEBUG);
   
+  // the inputs of the formulations, written before they are solved
+  static uint64_t tick = 0;
+  const bool CAPTURE = capture_ && NC > 0 && !USE_LAST_CFS;
+  if(CAPTURE){
+    idyn_problem_t problem;
+    problem.tick = tick;
+    problem.time = t;
+    problem.dt = DT;
+    problem.damping = 0;
+    ctrl->get_data<double>(plugin_namespace+".damping",problem.damping);
+    problem.active_eefs = active_feet.size();
+    problem.same_indices = SAME_INDICES;
+    problem.qd = generalized_qd;
+    problem.qdd_des = qdd_des;
+    problem.fext = generalized_fext;
+    problem.M = M;
+    problem.N = N;
+    problem.D = D;
+    problem.MU = MU;
+    problem.indices = indices;
+    capture_->write(problem);
+  }
+  tick++;
+  
   ////////////////////////// simulator DT IDYN //////////////////////////////
-  for (std::vector<std::string>::iterator it=controller_name.begin();
+  for (std::vector<std::string>::const_iterator it=controller_name.begin();
        it!=controller_name.end(); it++) {
     
     bool solve_flag = false;
@@ -285,7 +384,7 @@ void loop(){
     Ravelin::VectorNd id = Ravelin::VectorNd::zero(NUM_JOINT_DOFS);
     Ravelin::VectorNd cf = Ravelin::VectorNd::zero(NC*5);
     
-    std::string& name = (*it);
+    const std::string& name = (*it);
     
     OUT_LOG(logDEBUG) << "CONTROLLER: " << name;
     OUT_LOG(logDEBUG) << "USE_LAST_CFS: " << USE_LAST_CFS;
@@ -307,17 +406,18 @@ void loop(){
       struct timeval end_t;
       gettimeofday(&start_t, NULL);
 #endif
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
       try{
         if(name.compare("NSQP") == 0){
           solve_flag = inverse_dynamics_no_slip(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,id,cf,indices,active_feet.size(),SAME_INDICES);
         } else if(name.compare("NSLCP") == 0){
-          solve_flag = inverse_dynamics_no_slip_fast(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,id,cf,false,indices,active_feet.size(),SAME_INDICES);
+          solve_flag = inverse_dynamics_no_slip_fast(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,id,cf,false,indices,active_feet.size(),SAME_INDICES,&contact_J);
         } else if(name.compare("CFQP") == 0){    // IDYN QP
           solve_flag = inverse_dynamics_two_stage(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,MU,id,cf,indices,active_feet.size(),SAME_INDICES);
         } else if(name.compare("CFQP1") == 0){    // IDYN QP
           solve_flag = inverse_dynamics_one_stage(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,MU,id,cf,indices,active_feet.size(),SAME_INDICES);
         } else if(name.compare("CFLCP") == 0){
-          solve_flag = inverse_dynamics_ap(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,MU,id,cf);
+          solve_flag = inverse_dynamics_ap(generalized_qd,qdd_des,M,N,D,generalized_fext,DT,MU,id,cf,&contact_J);
         }  else if(name.compare("SCFQP") == 0){
           double damping = 0;
           ctrl->get_data<double>(plugin_namespace+".damping",damping);
@@ -333,6 +433,16 @@ void loop(){
         solve_flag = false;
       }
       
+      if(CAPTURE){
+        idyn_result_t result;
+        result.name = name;
+        result.solved = solve_flag;
+        result.latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.x = id;
+        result.cf = cf;
+        capture_->write(result);
+      }
+      
       
       if(!std::isfinite(cf.norm()) || !std::isfinite(id.norm())){
         OUTLOG(DT,"DT",logDEBUG);
@@ -373,18 +483,50 @@ void loop(){
     cf_map[name] = cf;
     uff_map[name] = id;
   }
-  
+
+  // hand this tick's records to the capture writer
+  if(CAPTURE && !capture_->flush())
+    OUT_LOG(logERROR) << "idyn capture: writer behind, dropped the problem of tick " << (tick - 1);
+
+  // solver statistics (handles resolved in setup())
+  for(unsigned i=0;i<qp_chain_handles.size();i++){
+    qp_chain_handles_t& h = qp_chain_handles[i];
+    const Pacer::QPChain& chain = qp_chain(h.chain.name);
+    set_chain_handles(h.chain,chain);
+    h.iterations.set(chain.active_set().stats().iterations);
+  }
+  {
+    // lcp_fast() (NSLCP): warm hits are warm starts that needed no pivots
+    const Pacer::LCPSolver::lcp_fast_stats_t& stats = lcp_chain("NSLCP").lcp().lcp_fast_stats();
+    const int values[NUM_LCP_FAST_STATS] = {(int) stats.calls,(int) stats.warm_starts,(int) stats.warm_hits,
+                                            (int) stats.pivots,(int) stats.total_pivots};
+    for(unsigned i=0;i<NUM_LCP_FAST_STATS;i++)
+      lcp_fast_handles[i].set(values[i]);
+  }
+  {
+    // updating Lemke solver (NSLCP fallback): warm hits are reused bases that needed no pivots
+    const Pacer::LCPSolver::lemke_stats_t& stats = lcp_chain("NSLCP").lcp().lemke_stats();
+    const int values[NUM_LEMKE_STATS] = {(int) stats.calls,(int) stats.warm_starts,(int) stats.warm_hits,
+                                         (int) stats.pivots,(int) stats.total_pivots,(int) stats.refactorizations,
+                                         (int) stats.moby_checks,(int) stats.moby_mismatches};
+    for(unsigned i=0;i<NUM_LEMKE_STATS;i++)
+      lemke_handles[i].set(values[i]);
+  }
+  for(unsigned k=0;k<lcp_chain_handles.size();k++)
+    set_chain_handles(lcp_chain_handles[k],lcp_chain(lcp_chain_handles[k].name));
+
   OUTLOG(controller_name,"controller_name",logDEBUG);
   for (int i=0;i<controller_name.size();i++){
-    std::string& name = controller_name[i];//(*it);
+    const std::string& name = controller_name[i];//(*it);
     Ravelin::VectorNd& cf = cf_map[name];
     Ravelin::VectorNd& uff = uff_map[name];
     OUTLOG(uff,"uff_"+name,logNONE);
     OUTLOG(cf,"cf_"+name,logNONE);
     
-    Ravelin::MatrixNd iM_chol = M;
-    bool pass = LA_.factor_chol(iM_chol);
-    assert(pass);
+    // only the Cholesky factor is needed here
+    const inertia_factor_t& iM_factor = factor_inertia(M,false);
+    const Ravelin::MatrixNd& iM_chol = iM_factor.M_chol;
+    assert(iM_factor.ok);
 
     Ravelin::VectorNd qdd_fd = forward_dynamics(iM_chol,N,D,generalized_fext,dt, uff, cf);
     OUTLOG(qdd_fd,"qdd_fd",logNONE);
@@ -426,5 +568,75 @@ void loop(){
 
 
 void setup(){
-  
+  boost::shared_ptr<Pacer::Controller> ctrl(ctrl_weak_ptr);
+  IdynContext::Scope scope(idyn_context_);
+  dt_idyn_handle = ctrl->get_data_handle<double>(plugin_namespace+".dt");
+  alpha_handle = ctrl->get_data_handle<double>(plugin_namespace+".alpha");
+  mcpf_handle = ctrl->get_data_handle<double>(plugin_namespace+".max-contacts-per-foot");
+  des_contact_handle = ctrl->get_data_handle<bool>(plugin_namespace+".des-contact");
+  last_cfs_handle = ctrl->get_data_handle<bool>(plugin_namespace+".last-cfs");
+  controller_name_handle = ctrl->get_data_handle<std::vector<std::string> >(plugin_namespace+".type");
+
+  // "<ns>.capture" (default false): write every problem and its results to idyn-<pid>.bin
+  bool capture = false;
+  ctrl->get_data<bool>(plugin_namespace+".capture",capture);
+  if(capture){
+    char buffer[16];
+    sprintf(buffer,"%06d",getpid());
+    capture_ = boost::shared_ptr<IdynCapture>(new IdynCapture("idyn-"+std::string(buffer)+".bin"));
+  }
+
+  // Solver fallback chains: "<ns>.<formulation>.solvers" replaces the default method order,
+  // "<ns>.adaptive-solvers" (default false) reorders them by observed latency and success rate
+  bool adaptive = false;
+  ctrl->get_data<bool>(plugin_namespace+".adaptive-solvers",adaptive);
+  IdynContext::current().adaptive_solvers = adaptive;
+  // "<ns>.lemke.compare-moby" (default false): check every "lemke" solve against Moby's Lemke
+  bool compare_moby = false;
+  ctrl->get_data<bool>(plugin_namespace+".lemke.compare-moby",compare_moby);
+  // NSLCP-FEW: the no-slip LCP with two feet or fewer in contact
+  static const char* LCP_FORMULATIONS[] = {"NSLCP","NSLCP-FEW","CFLCP"};
+  lcp_chain_handles.clear();
+  for(int i=0;i<3;i++){
+    const std::string formulation(LCP_FORMULATIONS[i]);
+    Pacer::LCPChain& chain = lcp_chain(formulation);
+    std::vector<std::string> methods;
+    if(ctrl->get_data<std::vector<std::string> >(plugin_namespace+"."+formulation+".solvers",methods))
+      chain.set_methods(methods);
+    chain.adaptive = adaptive;
+    chain.lcp().compare_moby = compare_moby;
+    lcp_chain_handles.push_back(get_chain_handles(ctrl,formulation,plugin_namespace+"."+formulation+".",chain));
+  }
+
+  // QP formulations: the chains of both stages of a formulation take its "<ns>.<formulation>.solvers";
+  // stats per QP, with the active set changes of its last solve
+  static const char* QP_FORMULATIONS[][3] = {{"SCFQP","simple.1","simple.2"},
+                                             {"SNSQP","simple-no-slip.1","simple-no-slip.2"},
+                                             {"CFQP","two-stage.1","two-stage.2"},
+                                             {"CFQP1","one-stage.1","one-stage.2"},
+                                             {"NSQP","no-slip.1","no-slip.2"},
+                                             {"NSQP","no-slip-one-stage.1","no-slip-one-stage.2"}};
+  qp_chain_handles.clear();
+  for(unsigned i=0;i<sizeof(QP_FORMULATIONS)/sizeof(QP_FORMULATIONS[0]);i++){
+    const std::string formulation(QP_FORMULATIONS[i][0]);
+    std::vector<std::string> methods;
+    const bool configured = ctrl->get_data<std::vector<std::string> >(plugin_namespace+"."+formulation+".solvers",methods);
+    for(unsigned j=1;j<3;j++){
+      const std::string name(QP_FORMULATIONS[i][j]);
+      Pacer::QPChain& chain = qp_chain(name);
+      if(configured)
+        chain.set_methods(methods);
+      chain.adaptive = adaptive;
+
+      qp_chain_handles_t h;
+      const std::string prefix = plugin_namespace+".qp."+name+".";
+      h.chain = get_chain_handles(ctrl,name,prefix,chain);
+      h.iterations = ctrl->get_data_handle<int>(prefix+"iterations");
+      qp_chain_handles.push_back(h);
+    }
+  }
+  for(unsigned i=0;i<NUM_LCP_FAST_STATS;i++)
+    lcp_fast_handles[i] = ctrl->get_data_handle<int>(plugin_namespace+".lcp-fast."+LCP_FAST_STATS[i]);
+  for(unsigned i=0;i<NUM_LEMKE_STATS;i++)
+    lemke_handles[i] = ctrl->get_data_handle<int>(plugin_namespace+".lemke."+LEMKE_STATS[i]);
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+// Replays an idyn capture (idyn-<pid>.bin, written by the inverse-dynamics
+// plugin with <ns>.capture set, see capture.h) through the inverse dynamics
+// formulations and reports per formulation latencies and the differences of
+// their results from the captured ones
+//
+// usage: idyn-replay [-r REPEAT] FILE [FORMULATION ...]
+//   FORMULATION : NSQP NSLCP CFQP CFQP1 CFLCP SCFQP SNSQP (default: all)
+//   -r REPEAT   : replay the capture REPEAT times (default: 1)
+// Problems are replayed in capture order, every formulation on each problem,
+// so warm starts see the sequence of the run.  The solver chains keep their
+// configured method order (not adaptive), and every pass starts from cold
+// solver state, so the passes time the same work.
+#include "inverse-dynamics.cpp"
+#include "capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+static const char* FORMULATIONS[] = {"NSQP","NSLCP","CFQP","CFQP1","CFLCP","SCFQP","SNSQP"};
+static const unsigned NUM_FORMULATIONS = 7;
+
+struct report_t {
+  report_t() : failures(0), compared(0), flag_mismatches(0), max_dx(0), max_dcf(0) {}
+  std::vector<double> latency, captured_latency;
+  unsigned failures;
+  /// problems with a captured result of this formulation, of those solved differently
+  unsigned compared, flag_mismatches;
+  /// largest differences from the captured joint forces and contact forces
+  double max_dx, max_dcf;
+};
+
+/// contact jacobian blocks of the dense N and D = [S T -S -T] of a captured problem: per contact,
+/// the coordinates with a nonzero entry (the blocks of loop() only add exact zeros to these)
+static void contact_jacobian(const idyn_problem_t& p, Pacer::ContactJacobian& J){
+  const unsigned NDOFS = p.N.rows(), NC = p.N.columns();
+  J.reset(NDOFS);
+  std::vector<unsigned> cols;
+  for(unsigned i=0;i<NC;i++){
+    cols.clear();
+    for(unsigned k=0;k<NDOFS;k++)
+      if(p.N(k,i) != 0 || p.D(k,i) != 0 || p.D(k,NC+i) != 0)
+        cols.push_back(k);
+    Ravelin::MatrixNd& B = J.add_contact(cols);
+    for(unsigned k=0;k<cols.size();k++){
+      B(0,k) = p.N(cols[k],i);
+      B(1,k) = p.D(cols[k],i);
+      B(2,k) = p.D(cols[k],NC+i);
+    }
+  }
+}
+
+/// same dispatch as loop() in plugin.cpp, same_indices replaces that of the capture
+static bool solve(const std::string& name, const idyn_problem_t& p, const Pacer::ContactJacobian& J, bool same_indices, Ravelin::VectorNd& x, Ravelin::VectorNd& cf){
+  std::vector<unsigned> indices = p.indices;
+  x.set_zero(p.qdd_des.rows());
+  cf.set_zero(p.N.columns()*5);
+  if(name.compare("NSQP") == 0)
+    return inverse_dynamics_no_slip(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,x,cf,indices,p.active_eefs,same_indices);
+  if(name.compare("NSLCP") == 0)
+    return inverse_dynamics_no_slip_fast(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,x,cf,false,indices,p.active_eefs,same_indices,&J);
+  if(name.compare("CFQP") == 0)
+    return inverse_dynamics_two_stage(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,p.MU,x,cf,indices,p.active_eefs,same_indices);
+  if(name.compare("CFQP1") == 0)
+    return inverse_dynamics_one_stage(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,p.MU,x,cf,indices,p.active_eefs,same_indices);
+  if(name.compare("CFLCP") == 0)
+    return inverse_dynamics_ap(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,p.MU,x,cf,&J);
+  if(name.compare("SCFQP") == 0)
+    return inverse_dynamics_two_stage_simple(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,p.MU,x,cf,p.damping);
+  if(name.compare("SNSQP") == 0)
+    return inverse_dynamics_two_stage_simple_no_slip(p.qd,p.qdd_des,p.M,p.N,p.D,p.fext,p.dt,x,cf,p.damping);
+  return false;
+}
+
+/// max_i |a_i - b_i|, infinite if the sizes differ
+static double max_diff(const Ravelin::VectorNd& a, const Ravelin::VectorNd& b){
+  if(a.rows() != b.rows())
+    return std::numeric_limits<double>::infinity();
+  double d = 0;
+  for(unsigned i=0;i<a.rows();i++)
+    d = std::max(d,std::fabs(a[i] - b[i]));
+  return d;
+}
+
+/// p-th percentile (0 <= p <= 1) of sorted values, in ms
+static double percentile(const std::vector<double>& sorted, double p){
+  if(sorted.empty())
+    return 0;
+  return sorted[(size_t) (p * (sorted.size() - 1) + 0.5)] * 1000.0;
+}
+
+int main(int argc, char* argv[]){
+  unsigned repeat = 1;
+  int arg = 1;
+  if(arg + 1 < argc && strcmp(argv[arg],"-r") == 0){
+    repeat = std::max(atoi(argv[arg+1]),1);
+    arg += 2;
+  }
+  if(arg >= argc){
+    fprintf(stderr,"usage: %s [-r REPEAT] FILE [FORMULATION ...]\n",argv[0]);
+    return 1;
+  }
+  const std::string filename(argv[arg++]);
+
+  std::vector<std::string> formulations;
+  for(;arg<argc;arg++)
+    formulations.push_back(argv[arg]);
+  if(formulations.empty())
+    formulations.assign(FORMULATIONS,FORMULATIONS+NUM_FORMULATIONS);
+  for(unsigned k=0;k<formulations.size();k++)
+    if(std::find(FORMULATIONS,FORMULATIONS+NUM_FORMULATIONS,formulations[k]) == FORMULATIONS+NUM_FORMULATIONS){
+      fprintf(stderr,"unknown formulation: %s\n",formulations[k].c_str());
+      return 1;
+    }
+
+  try {
+    // the whole corpus, so passes after the first do not include file reads
+    std::vector<idyn_problem_t> problems;
+    std::vector<std::vector<idyn_result_t> > captured;
+    {
+      IdynCaptureReader reader(filename);
+      idyn_problem_t p;
+      std::vector<idyn_result_t> results;
+      while(reader.next(p,results)){
+        problems.push_back(p);
+        captured.push_back(results);
+      }
+    }
+    fprintf(stderr,"%lu problems in %s\n",(unsigned long) problems.size(),filename.c_str());
+    
+    // NSLCP and CFLCP get the blocked jacobian, as in loop()
+    std::vector<Pacer::ContactJacobian> contact_J(problems.size());
+    for(unsigned i=0;i<problems.size();i++)
+      contact_jacobian(problems[i],contact_J[i]);
+
+    std::map<std::string,report_t> reports;
+    for(unsigned i=0;i<problems.size();i++)
+      for(unsigned j=0;j<captured[i].size();j++)
+        reports[captured[i][j].name].captured_latency.push_back(captured[i][j].latency);
+
+    IdynContext context;
+    IdynContext::Scope scope(context);
+    Ravelin::VectorNd x, cf;
+    for(unsigned pass=0;pass<repeat;pass++){
+      // cold solver state, chains in their configured order
+      context.reset();
+      context.adaptive_solvers = false;
+      for(unsigned i=0;i<problems.size();i++){
+        // the captured same_indices of the first problem refers to a tick before the capture
+        // (or, after the first pass, to the last problem of the previous pass)
+        const bool same_indices = problems[i].same_indices && i > 0;
+        for(unsigned k=0;k<formulations.size();k++){
+          const std::string& name = formulations[k];
+          report_t& report = reports[name];
+
+          std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+          bool solve_flag = false;
+          try {
+            solve_flag = solve(name,problems[i],contact_J[i],same_indices,x,cf);
+          } catch(std::exception& e){
+            solve_flag = false;
+          }
+          report.latency.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+          if(!solve_flag)
+            report.failures++;
+
+          // compare with the result of the same formulation in the capture (first pass only)
+          if(pass > 0)
+            continue;
+          for(unsigned j=0;j<captured[i].size();j++){
+            const idyn_result_t& r = captured[i][j];
+            if(r.name.compare(name) != 0)
+              continue;
+            report.compared++;
+            if(r.solved != solve_flag)
+              report.flag_mismatches++;
+            report.max_dx = std::max(report.max_dx,max_diff(x,r.x));
+            report.max_dcf = std::max(report.max_dcf,max_diff(cf,r.cf));
+          }
+        }
+      }
+    }
+
+    printf("%-6s %7s %6s %9s %9s %9s %9s %9s %9s %7s %6s %10s %10s\n",
+           "name","solves","fail","mean(ms)","p50(ms)","p90(ms)","p99(ms)","max(ms)",
+           "cap-p50","cmp","flag","max|dx|","max|dcf|");
+    for(unsigned k=0;k<formulations.size();k++){
+      report_t& report = reports[formulations[k]];
+      std::vector<double>& latency = report.latency;
+      std::sort(latency.begin(),latency.end());
+      std::sort(report.captured_latency.begin(),report.captured_latency.end());
+      double mean = 0;
+      for(unsigned i=0;i<latency.size();i++)
+        mean += latency[i];
+      if(!latency.empty())
+        mean /= latency.size();
+      printf("%-6s %7lu %6u %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %7u %6u %10.3g %10.3g\n",
+             formulations[k].c_str(),(unsigned long) latency.size(),report.failures,mean*1000.0,
+             percentile(latency,0.5),percentile(latency,0.9),percentile(latency,0.99),percentile(latency,1.0),
+             percentile(report.captured_latency,0.5),report.compared,report.flag_mismatches,
+             report.max_dx,report.max_dcf);
+    }
+  } catch(std::exception& e) {
+    fprintf(stderr,"%s\n",e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -107,10 +107,21 @@ boost::shared_ptr<Pacer::Controller> ctrl(ctrl_weak_ptr);
   ctrl->get_joint_generalized_value(Pacer::Controller::velocity_goal,qd_goal);
   ctrl->get_joint_generalized_value(Pacer::Controller::acceleration_goal,qdd_goal);
 
-  double TOL = ctrl->get_data<double>(plugin_namespace+".abs-err-tolerance");
+  Pacer::Robot::ik_options_t options;
+  options.tolerance = ctrl->get_data<double>(plugin_namespace+".abs-err-tolerance");
+  double val;
+  if(ctrl->get_data<double>(plugin_namespace+".max-iterations",val))
+    options.max_iterations = val;
+  if(ctrl->get_data<double>(plugin_namespace+".time-budget",val))
+    options.time_budget = val;
+  if(ctrl->get_data<double>(plugin_namespace+".damping",val))
+    options.damping = val;
+  ctrl->get_data<bool>(plugin_namespace+".warm-start",options.warm_start);
+  
   // This is calculated in global frame always (assume base_link is at origin)
-  ctrl->end_effector_inverse_kinematics(ik_feet,foot_pos,foot_vel,foot_acc,q,
-                                        q_goal,qd_goal,qdd_goal,TOL);
+  if(!ctrl->end_effector_inverse_kinematics(ik_feet,foot_pos,foot_vel,foot_acc,q,
+                                            q_goal,qd_goal,qdd_goal,options,Pacer::Workspace::local()))
+    OUT_LOG(logDEBUG) << "IK did not converge to " << options.tolerance;
 
   ctrl->set_joint_generalized_value(Pacer::Controller::position_goal,q_goal);
   ctrl->set_joint_generalized_value(Pacer::Controller::velocity_goal,qd_goal);
@@ -14,34 +14,80 @@
 #include <Pacer/controller.h>
 
 std::string plugin_namespace;
-boost::weak_ptr<Pacer::Controller> ctrl_weak_ptr;
+
+// Controller the plugin's functions run against: the one passed to init(), except on the
+// thread of a NON_REALTIME update, which sees the snapshot it was handed (the pointer to
+// it is thread_local so the updates of other threads are never pointed at the snapshot)
+class plugin_controller_t {
+public:
+  plugin_controller_t& operator=(const boost::weak_ptr<Pacer::Controller>& ctrl){
+    _ctrl = ctrl;
+    return *this;
+  }
+  
+  boost::shared_ptr<Pacer::Controller> lock() const {
+    return (_snapshot)? *_snapshot : _ctrl.lock();
+  }
+  
+  // throws boost::bad_weak_ptr once the controller is gone
+  operator boost::shared_ptr<Pacer::Controller>() const {
+    return (_snapshot)? *_snapshot : boost::shared_ptr<Pacer::Controller>(_ctrl);
+  }
+  
+  // points this thread at 'snapshot' (if not NULL) for the lifetime of the scope
+  class snapshot_scope {
+  public:
+    snapshot_scope(const boost::shared_ptr<Pacer::Controller>* snapshot) : _previous(_snapshot) {
+      if(snapshot)
+        _snapshot = snapshot;
+    }
+    ~snapshot_scope(){ _snapshot = _previous; }
+  private:
+    const boost::shared_ptr<Pacer::Controller>* _previous;
+  };
+  
+private:
+  boost::weak_ptr<Pacer::Controller> _ctrl;
+  static thread_local const boost::shared_ptr<Pacer::Controller>* _snapshot;
+};
+thread_local const boost::shared_ptr<Pacer::Controller>* plugin_controller_t::_snapshot = NULL;
+
+plugin_controller_t ctrl_weak_ptr;
 double t;
+int plugin_priority;
 
 
 // Implemented by specific plugin
 static void loop();
 
+// Called on the ticks the plugin's schedule fires (decided by the controller)
 void update(const boost::shared_ptr<Pacer::Controller>& ctrl, double t){
   ::t = t;
-  static int ITER = -1;
-  int RTF = ctrl->get_data<int>(plugin_namespace+".real-time-factor");
-  if(++ITER % RTF == 0){
+  // NON_REALTIME updates run against a snapshot of the robot, on a background thread
+  plugin_controller_t::snapshot_scope snapshot((plugin_priority == Pacer::NON_REALTIME)? &ctrl : NULL);
 #ifdef NDEBUG
-    try {
+  try {
 #endif
-      OUT_LOG(logDEBUG4) << plugin_namespace << " is at iteration (" << ITER
-      << ") with RTF (" << RTF << ") at time "<< t << std::endl;
-      loop();
+    OUT_LOG(logDEBUG4) << plugin_namespace << " update at time "<< t << std::endl;
+    loop();
 #ifdef NDEBUG
-    }
-    catch (std::exception& e) {
-      throw std::runtime_error(plugin_namespace+" failed with error: " + e.what());
-    }
-    catch (...){
-      throw std::runtime_error(plugin_namespace+" failed with unkown error.");
-    }
-#endif
   }
+  catch (std::exception& e) {
+    throw std::runtime_error(plugin_namespace+" failed with error: " + e.what());
+  }
+  catch (...){
+    throw std::runtime_error(plugin_namespace+" failed with unkown error.");
+  }
+#endif
+}
+
+// reads an integer option declared as int or double (plugins.xml uses double)
+static int get_int_option(const boost::shared_ptr<Pacer::Controller>& ctrl, const std::string& name, int default_value){
+  int value = default_value;
+  double double_value;
+  if(!ctrl->get_data<int>(name,value) && ctrl->get_data<double>(name,double_value))
+    value = double_value;
+  return value;
 }
 
 static void setup();
@@ -65,9 +111,13 @@ extern "C" {
     plugin_namespace = std::string(std::string(name));
     setup();
     
-    int priority = ctrl->get_data<double>(plugin_namespace+".priority");
+    plugin_priority = ctrl->get_data<double>(plugin_namespace+".priority");
     
-    ctrl->add_plugin_update(priority,name,&update);
+    // update on every real-time-factor'th tick, offset by 'phase' ticks
+    Pacer::plugin_schedule_t schedule(plugin_priority,
+                                      std::max(1,get_int_option(ctrl,plugin_namespace+".real-time-factor",1)),
+                                      std::max(0,get_int_option(ctrl,plugin_namespace+".phase",0)));
+    ctrl->add_plugin_update(name,&update,schedule);
     ctrl->add_plugin_deconstructor(name,&deconstruct);
   }
 }
@@ -0,0 +1,419 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Pacer;
+
+// All matrices in this file are column major: (i,j) -> data[j*ld + i]
+
+// pivots below this fraction of the diagonal make a constraint dependent on the active set
+static const double DEPENDENCE_TOL = 1e-12;
+
+// allowed violation of a constraint, relative to the magnitude of its terms
+static const double FEASIBILITY_TOL = 1e-6;
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+/// In place Cholesky factorization A = R'R of the n x n A, R upper (see fixed::factor_chol())
+/// fails on pivots not above min_pivot
+static bool factor_chol(double* A, unsigned n, double min_pivot){
+  for(unsigned j=0;j<n;j++){
+    double* Aj = A + j*n;
+    for(unsigned i=0;i<j;i++){
+      const double* Ai = A + i*n;
+      double s = Aj[i];
+      for(unsigned k=0;k<i;k++)
+        s -= Ai[k] * Aj[k];
+      Aj[i] = s / Ai[i];
+    }
+    double d = Aj[j];
+    for(unsigned k=0;k<j;k++)
+      d -= Aj[k] * Aj[k];
+    if(!(d > min_pivot))
+      return false;
+    Aj[j] = std::sqrt(d);
+    for(unsigned i=j+1;i<n;i++)
+      Aj[i] = 0;
+  }
+  return true;
+}
+
+/// Solve R'y = b in place, R upper n x n with leading dimension ld
+static void solve_tri_transpose(const double* R, unsigned ld, unsigned n, double* b){
+  for(unsigned i=0;i<n;i++){
+    const double* Ri = R + i*ld;
+    double s = b[i];
+    for(unsigned k=0;k<i;k++)
+      s -= Ri[k] * b[k];
+    b[i] = s / Ri[i];
+  }
+}
+
+/// Solve R x = y in place
+static void solve_tri(const double* R, unsigned ld, unsigned n, double* b){
+  for(unsigned i=n;i-- > 0;){
+    double s = b[i];
+    for(unsigned k=i+1;k<n;k++)
+      s -= R[k*ld+i] * b[k];
+    b[i] = s / R[i*ld+i];
+  }
+}
+
+bool ActiveSetQP::factor_Q(const Ravelin::MatrixNd& Q){
+  const unsigned n = Q.rows();
+
+  // reuse the factorization while Q is unchanged
+  bool same = (_Q.size() == n*n);
+  for(unsigned j=0;j<n && same;j++)
+    for(unsigned i=0;i<n;i++)
+      if(_Q[j*n+i] != Q(i,j)){
+        same = false;
+        break;
+      }
+  if(same)
+    return true;
+
+  _Q.resize(n*n);
+  double max_diag = 0;
+  for(unsigned j=0;j<n;j++){
+    for(unsigned i=0;i<n;i++)
+      _Q[j*n+i] = Q(i,j);
+    max_diag = std::max(max_diag,Q(j,j));
+  }
+
+  // regularize only if Q is not (numerically) positive definite
+  const double eps = regularization * (1.0 + max_diag);
+  _Q_chol = _Q;
+  if(!::factor_chol(&_Q_chol[0],n,eps)){
+    _Q_chol = _Q;
+    for(unsigned i=0;i<n;i++)
+      _Q_chol[i*n+i] += eps;
+    if(!::factor_chol(&_Q_chol[0],n,0)){
+      _Q.clear();
+      return false;
+    }
+  }
+
+  _iQ.assign(n*n,0);
+  for(unsigned j=0;j<n;j++){
+    double* e = &_iQ[j*n];
+    e[j] = 1;
+    solve_tri_transpose(&_Q_chol[0],n,n,e);
+    solve_tri(&_Q_chol[0],n,n,e);
+  }
+  return true;
+}
+
+/// Extend the factor of the active block of H by constraint j, false if j depends on the active set
+bool ActiveSetQP::add_active(unsigned j){
+  const unsigned p = _p, k = _active.size();
+  double* r = &_R[k*p];
+  for(unsigned a=0;a<k;a++)
+    r[a] = _H[j*p+_active[a]];
+  solve_tri_transpose(&_R[0],p,k,r);
+
+  double d = _H[j*p+j];
+  for(unsigned a=0;a<k;a++)
+    d -= r[a] * r[a];
+  if(!(d > DEPENDENCE_TOL * _H[j*p+j]))
+    return false;
+  r[k] = std::sqrt(d);
+
+  _active.push_back(j);
+  _is_active[j] = true;
+  return true;
+}
+
+/// Factor the active block from scratch (after a removal), dropping dependent constraints
+void ActiveSetQP::refactor_active(){
+  std::vector<unsigned> active;
+  active.swap(_active);
+  for(unsigned a=0;a<active.size();a++){
+    _is_active[active[a]] = false;
+    if(!add_active(active[a]))
+      _lambda[active[a]] = 0;
+  }
+}
+
+/// y = inv(H_active) y
+void ActiveSetQP::solve_active(double* y) const {
+  solve_tri_transpose(&_R[0],_p,_active.size(),y);
+  solve_tri(&_R[0],_p,_active.size(),y);
+}
+
+bool ActiveSetQP::iterate(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool warm){
+  const unsigned n = _n, m = _m, p = _p;
+
+  if(!factor_Q(Q))
+    return false;
+
+  // inv(Q) c, inv(Q) A'
+  _iQc.assign(n,0);
+  _iQAT.assign(n*m,0);
+  for(unsigned k=0;k<n;k++){
+    const double* iQk = &_iQ[k*n];
+    for(unsigned i=0;i<n;i++)
+      _iQc[i] += iQk[i] * c[k];
+    for(unsigned a=0;a<m;a++){
+      const double Aak = A(a,k);
+      if(Aak == 0)
+        continue;
+      double* iQATa = &_iQAT[a*n];
+      for(unsigned i=0;i<n;i++)
+        iQATa[i] += iQk[i] * Aak;
+    }
+  }
+
+  // dual problem, for C = [A; I] and d = [b; 0]:
+  // H = C inv(Q) C',  h = -(C inv(Q) c + d),  w = H lambda + h = C x - d
+  _H.resize(p*p);
+  _h.resize(p);
+  for(unsigned a=0;a<m;a++){
+    const double* iQATa = &_iQAT[a*n];
+    for(unsigned e=0;e<m;e++){
+      double s = 0;
+      for(unsigned k=0;k<n;k++)
+        s += A(e,k) * iQATa[k];
+      _H[a*p+e] = s;
+    }
+    double s = b[a];
+    for(unsigned k=0;k<n;k++)
+      s += A(a,k) * _iQc[k];
+    _h[a] = -s;
+  }
+  if(_pos){
+    for(unsigned a=0;a<m;a++)
+      for(unsigned i=0;i<n;i++)
+        _H[(m+i)*p+a] = _H[a*p+m+i] = _iQAT[a*n+i];
+    for(unsigned k=0;k<n;k++)
+      for(unsigned i=0;i<n;i++)
+        _H[(m+k)*p+m+i] = _iQ[k*n+i];
+    for(unsigned i=0;i<n;i++)
+      _h[m+i] = -_iQc[i];
+  }
+
+  _R.resize(p*p);
+  _lambda.assign(p,0);
+  _u.resize(p);
+  _y.resize(std::max(n,p));
+  _is_active.assign(p,false);
+
+  // starting set: the last active set with its negative multipliers removed
+  std::vector<unsigned> start;
+  start.swap(_active);
+  if(warm)
+    for(unsigned a=0;a<start.size();a++)
+      if(start[a] < p && !_is_active[start[a]])
+        add_active(start[a]);
+  while(!_active.empty()){
+    const unsigned k = _active.size();
+    for(unsigned a=0;a<k;a++)
+      _y[a] = -_h[_active[a]];
+    solve_active(&_y[0]);
+
+    unsigned kept = 0;
+    for(unsigned a=0;a<k;a++)
+      if(_y[a] >= 0)
+        kept++;
+      else
+        _is_active[_active[a]] = false;
+    if(kept == k){
+      for(unsigned a=0;a<k;a++)
+        _lambda[_active[a]] = _y[a];
+      break;
+    }
+
+    start.clear();
+    for(unsigned a=0;a<k;a++)
+      if(_is_active[_active[a]])
+        start.push_back(_active[a]);
+    _active.swap(start);
+    refactor_active();
+  }
+
+  double h_max = 0;
+  for(unsigned i=0;i<p;i++)
+    h_max = std::max(h_max,std::fabs(_h[i]));
+  const double tol = tolerance * (1.0 + h_max);
+  const unsigned max_iter = (max_iterations > 0)? max_iterations : 10*p + 10;
+
+  for(;;){
+    // most violated constraint: min_j w_j
+    unsigned j = p;
+    double w_min = -tol;
+    for(unsigned i=0;i<p;i++){
+      if(_is_active[i])
+        continue;
+      const double* Hi = &_H[i*p];
+      double w = _h[i];
+      for(unsigned a=0;a<_active.size();a++)
+        w += Hi[_active[a]] * _lambda[_active[a]];
+      if(w < w_min){
+        w_min = w;
+        j = i;
+      }
+    }
+    if(j == p)
+      break;
+
+    // raise lambda_j keeping w = 0 on the active set until w_j = 0 (add j)
+    // or an active multiplier reaches zero (drop it, then continue with j)
+    for(;;){
+      if(++_stats.iterations > max_iter)
+        return false;
+
+      const unsigned k = _active.size();
+      const double* Hj = &_H[j*p];
+      for(unsigned a=0;a<k;a++)
+        _u[a] = Hj[_active[a]];
+      solve_active(&_u[0]);
+
+      double d = Hj[j], w = _h[j] + Hj[j] * _lambda[j];
+      for(unsigned a=0;a<k;a++){
+        d -= Hj[_active[a]] * _u[a];
+        w += Hj[_active[a]] * _lambda[_active[a]];
+      }
+
+      double t_full = (d > DEPENDENCE_TOL * Hj[j])? std::max(-w / d,0.0) : INF;
+      double t_part = INF;
+      unsigned blocking = k;
+      for(unsigned a=0;a<k;a++)
+        if(_u[a] > 0){
+          double t = _lambda[_active[a]] / _u[a];
+          if(t < t_part){
+            t_part = t;
+            blocking = a;
+          }
+        }
+
+      // no multiplier bounds the step: the primal problem is infeasible
+      if(t_full == INF && t_part == INF)
+        return false;
+
+      const double t = std::min(t_full,t_part);
+      for(unsigned a=0;a<k;a++)
+        _lambda[_active[a]] -= t * _u[a];
+      _lambda[j] += t;
+
+      if(t_full <= t_part){
+        if(!add_active(j))
+          return false;
+        break;
+      }
+
+      _lambda[_active[blocking]] = 0;
+      _is_active[_active[blocking]] = false;
+      _active.erase(_active.begin() + blocking);
+      refactor_active();
+    }
+
+    // recompute the multipliers of the new set to keep round off from accumulating
+    const unsigned k = _active.size();
+    for(unsigned a=0;a<k;a++)
+      _y[a] = -_h[_active[a]];
+    solve_active(&_y[0]);
+    for(unsigned a=0;a<k;a++)
+      _lambda[_active[a]] = std::max(_y[a],0.0);
+  }
+
+  // x = inv(Q)(C' lambda - c)
+  for(unsigned i=0;i<n;i++){
+    double s = -c[i];
+    for(unsigned a=0;a<m;a++)
+      s += A(a,i) * _lambda[a];
+    if(_pos)
+      s += _lambda[m+i];
+    _y[i] = s;
+  }
+  x.resize(n);
+  x.set_zero();
+  for(unsigned k=0;k<n;k++){
+    const double* iQk = &_iQ[k*n];
+    for(unsigned i=0;i<n;i++)
+      x[i] += iQk[i] * _y[k];
+  }
+
+  // feasibility of the solution
+  double x_max = 0;
+  for(unsigned i=0;i<n;i++)
+    x_max = std::max(x_max,std::fabs(x[i]));
+  const double feas_tol = FEASIBILITY_TOL * (1.0 + x_max);
+  for(unsigned a=0;a<m;a++){
+    double s = -b[a], scale = std::fabs(b[a]);
+    for(unsigned k=0;k<n;k++){
+      s += A(a,k) * x[k];
+      scale += std::fabs(A(a,k) * x[k]);
+    }
+    if(s < -FEASIBILITY_TOL * (1.0 + scale))
+      return false;
+  }
+  if(_pos)
+    for(unsigned i=0;i<n;i++){
+      if(x[i] < -feas_tol)
+        return false;
+      x[i] = std::max(x[i],0.0);
+    }
+
+  return Utility::isvalid(x);
+}
+
+bool ActiveSetQP::solve(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool pos, const std::vector<unsigned>& indices, bool same_indices){
+  const unsigned n = Q.rows(), m = A.rows();
+
+  // warm start from the last active set if this is the same problem as last tick
+  bool warm = same_indices && !_active.empty() && pos == _pos
+              && n == _n && m == _m && indices == _indices;
+
+  _n = n;
+  _m = m;
+  _p = m + (pos? n : 0);
+  _pos = pos;
+  _indices = indices;
+
+  _stats.solves++;
+  if(warm)
+    _stats.warm_starts++;
+  _stats.iterations = 0;
+
+  bool SOLVE_FLAG = iterate(Q,c,A,b,x,warm);
+  _stats.total_iterations += _stats.iterations;
+
+#ifndef NDEBUG
+  OUT_LOG(logDEBUG1) << "ActiveSetQP: warm start: " << warm << ", iterations: " << _stats.iterations << ", active constraints: " << _active.size();
+#endif
+
+  if(!SOLVE_FLAG){
+    if(!fallback){
+      _active.clear();
+      return false;
+    }
+    return fall_back(Q,c,A,b,x);
+  }
+  return true;
+}
+
+bool ActiveSetQP::fall_back(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x){
+  _stats.fallbacks++;
+  _active.clear();
+  OUT_LOG(logINFO) << "ActiveSetQP: no solution after " << _stats.iterations << " iterations, falling back to Lemke (" << _stats.fallbacks << " fallbacks)";
+
+  x.set_zero(_n);
+  if(_pos)
+    return _fallback.solve_qp_pos(Q,c,A,b,x,_v,false);
+  return _fallback.solve_qp(Q,c,A,b,x);
+}
+
+bool ActiveSetQP::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices){
+  return solve(Q,c,A,b,x,true,indices,same_indices);
+}
+
+bool ActiveSetQP::solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices){
+  return solve(Q,c,A,b,x,false,indices,same_indices);
+}
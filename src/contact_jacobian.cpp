@@ -0,0 +1,118 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/contact_jacobian.h>
+#include <Pacer/fixed.h>
+
+using namespace Pacer;
+
+Ravelin::MatrixNd& ContactJacobian::add_contact(const std::vector<unsigned>& cols){
+  if(_cols.size() <= _num_contacts){
+    _cols.resize(_num_contacts+1);
+    _blocks.resize(_num_contacts+1);
+  }
+  _cols[_num_contacts] = cols;
+  Ravelin::MatrixNd& block = _blocks[_num_contacts];
+  block.set_zero(3,cols.size());
+  _num_contacts++;
+  return block;
+}
+
+Ravelin::VectorNd& ContactJacobian::mult(const Ravelin::VectorNd& v, Ravelin::VectorNd& y) const {
+  const unsigned NC = _num_contacts;
+  y.set_zero(3*NC);
+  for(unsigned i=0;i<NC;i++){
+    const std::vector<unsigned>& cols = _cols[i];
+    const Ravelin::MatrixNd& B = _blocks[i];
+    for(unsigned r=0;r<3;r++){
+      double sum = 0;
+      for(unsigned k=0;k<cols.size();k++)
+        sum += B(r,k) * v[cols[k]];
+      y[r*NC+i] = sum;
+    }
+  }
+  return y;
+}
+
+Ravelin::MatrixNd& ContactJacobian::mult_inertia_transpose(const Ravelin::MatrixNd& iM, Ravelin::MatrixNd& W) const {
+  const unsigned NC = _num_contacts;
+  W.set_zero(3*NC,3*NC);
+  std::vector<double> P;
+  for(unsigned i=0;i<NC;i++){
+    const std::vector<unsigned>& ci = _cols[i];
+    const Ravelin::MatrixNd& Bi = _blocks[i];
+    for(unsigned j=i;j<NC;j++){
+      const std::vector<unsigned>& cj = _cols[j];
+      const Ravelin::MatrixNd& Bj = _blocks[j];
+
+#ifdef PACER_FIXED_JOINT_DOFS
+      // two foot contacts: fixed size kernel
+      if(ci.size() == fixed_config::CONTACT_COLS && cj.size() == fixed_config::CONTACT_COLS){
+        double Wij[9];
+        fixed::contact_coupling<fixed_config::CONTACT_COLS>(Bi.data(),&ci[0],Bj.data(),&cj[0],iM,Wij);
+        for(unsigned r=0;r<3;r++)
+          for(unsigned s=0;s<3;s++){
+            W(r*NC+i,s*NC+j) = Wij[r*3+s];
+            W(s*NC+j,r*NC+i) = Wij[r*3+s];
+          }
+        continue;
+      }
+#endif
+
+      // P = Bi iM(ci,cj) : 3 x |cj|
+      P.assign(3*cj.size(),0);
+      for(unsigned a=0;a<ci.size();a++)
+        for(unsigned b=0;b<cj.size();b++){
+          const double m = iM(ci[a],cj[b]);
+          for(unsigned r=0;r<3;r++)
+            P[r*cj.size()+b] += Bi(r,a) * m;
+        }
+
+      // W_ij = P Bj'
+      for(unsigned r=0;r<3;r++)
+        for(unsigned s=0;s<3;s++){
+          double sum = 0;
+          for(unsigned b=0;b<cj.size();b++)
+            sum += P[r*cj.size()+b] * Bj(s,b);
+          W(r*NC+i,s*NC+j) = sum;
+          W(s*NC+j,r*NC+i) = sum;
+        }
+    }
+  }
+  return W;
+}
+
+Ravelin::MatrixNd& ContactJacobian::mult_inertia(const Ravelin::MatrixNd& iM, unsigned ncols, Ravelin::MatrixNd& X) const {
+  const unsigned NC = _num_contacts;
+  X.set_zero(3*NC,ncols);
+  for(unsigned i=0;i<NC;i++){
+    const std::vector<unsigned>& cols = _cols[i];
+    const Ravelin::MatrixNd& B = _blocks[i];
+    for(unsigned j=0;j<ncols;j++)
+      for(unsigned r=0;r<3;r++){
+        double sum = 0;
+        for(unsigned k=0;k<cols.size();k++)
+          sum += B(r,k) * iM(cols[k],j);
+        X(r*NC+i,j) = sum;
+      }
+  }
+  return X;
+}
+
+void ContactJacobian::to_dense(Ravelin::MatrixNd& N, Ravelin::MatrixNd& S, Ravelin::MatrixNd& T) const {
+  const unsigned NC = _num_contacts;
+  N.set_zero(_num_dofs,NC);
+  S.set_zero(_num_dofs,NC);
+  T.set_zero(_num_dofs,NC);
+  for(unsigned i=0;i<NC;i++){
+    const std::vector<unsigned>& cols = _cols[i];
+    const Ravelin::MatrixNd& B = _blocks[i];
+    for(unsigned k=0;k<cols.size();k++){
+      N(cols[k],i) = B(0,k);
+      S(cols[k],i) = B(1,k);
+      T(cols[k],i) = B(2,k);
+    }
+  }
+}
@@ -5,8 +5,12 @@
  ****************************************************************************/
 #include <Pacer/controller.h>
 #include <Pacer/utilities.h>
+#ifdef USE_TELEMETRY
+#include <Pacer/telemetry.h>
+#endif
 #include <sys/time.h>
 #include <dlfcn.h>
+#include <fstream>
 #include <errno.h>
 #include <boost/foreach.hpp>
 #include <stdlib.h>     /* getenv */
@@ -19,18 +23,41 @@ using namespace Pacer;
 
 std::map<std::string,void*> Controller::handles;
   
-Controller::Controller(): Robot(){
-  
+Controller::Controller(): Robot(), _update_graph_dirty(true), _update_ctrl(NULL), _update_time(0),
+  _tick_start(0), _tick_budget(0), _degrade_priority(LOWEST_PRIORITY+1), _degrade_max_skips(0),
+  _degrade_window(100), _degrade_max_rtf(64), _degrade_overrun_ratio(0.1), _degrade_skipped(0), _tick(0), _is_snapshot(false){
+#ifdef USE_THREADS
+  pthread_mutex_init(&_phase_mutex,NULL);
+  pthread_mutex_init(&_schedule_mutex,NULL);
+#endif
+  _control_section = Profiler::instance().section("control");
+  _update_section = Profiler::instance().section("control.update");
+  _reset_contact_section = Profiler::instance().section("control.reset_contact");
 }
 
 Controller::~Controller(){
+  // snapshots do not own the plugins
+  if(_is_snapshot)
+    return;
   Utility::visualize.clear();
   close_all_plugins();
+#ifdef USE_PROFILING
+  if(Profiler::enabled()){
+    char buffer[9];
+    sprintf(buffer,"%06d",getpid());
+    std::ofstream out(("profile-"+std::string(buffer)+".txt").c_str());
+    Profiler::instance().dump(out);
+  }
+#endif
 }
 
 
 bool Controller::close_all_plugins(){
   typedef std::pair<std::string,void*> handle_pair;
+  // background updates must return before their libraries are closed
+  while(!_background_jobs.empty())
+    stop_background_job((*_background_jobs.begin()).first);
+  
   // close the loaded plugin libraries
   BOOST_FOREACH( handle_pair handle, handles){
     dlclose(handle.second);
@@ -39,16 +66,103 @@ bool Controller::close_all_plugins(){
 
   handles.clear();
   _update_priority_map.clear();
+  _update_graph_dirty = true;
   return true;
 }
 
 
+void Controller::add_plugin_update(const std::string& name,update_t f,const plugin_schedule_t& schedule){
+  // Fix priority
+  int priority = schedule.priority;
+  if(priority > LOWEST_PRIORITY || priority < NON_REALTIME){
+    OUT_LOG(logERROR) << "Set priorities to range [-1,0.."<<LOWEST_PRIORITY<<"], -1 is for non-realtime processes (will only return data when complete)";
+    if(priority < NON_REALTIME)
+      priority = NON_REALTIME;
+    else if(priority > LOWEST_PRIORITY)
+      priority = LOWEST_PRIORITY;
+  }
+  
+  // Check if this function already has an updater
+  if(_name_priority_map.find(name) != _name_priority_map.end())
+    remove_plugin_update(name);
+  
+  // add plugin back in at new priority
+  _update_priority_map[priority][name] = f;
+  _name_priority_map[name] = priority;
+  _plugin_rate_map[name] = boost::shared_ptr<plugin_rate_t>(new plugin_rate_t(std::max(1u,schedule.rate_divisor),schedule.phase));
+  _update_graph_dirty = true;
+  OUT_LOG(logINFO) << "Plugin " << name << " priority: " << priority << ", rate divisor: " << schedule.rate_divisor << ", phase: " << schedule.phase;
+}
+
+bool Controller::set_plugin_schedule(const std::string& name,const plugin_schedule_t& schedule){
+  std::map<std::string, boost::shared_ptr<plugin_rate_t> >::iterator it = _plugin_rate_map.find(name);
+  if(it == _plugin_rate_map.end())
+    return false;
+  plugin_rate_t& rate = *(*it).second;
+  rate.divisor.store(std::max(1u,schedule.rate_divisor),std::memory_order_relaxed);
+  rate.phase.store(schedule.phase,std::memory_order_relaxed);
+  
+  // the update graphs may be in use, move the plugin between priorities later
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_schedule_mutex);
+#endif
+  _pending_priority_map[name] = std::max(NON_REALTIME,std::min(LOWEST_PRIORITY,schedule.priority));
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_schedule_mutex);
+#endif
+  OUT_LOG(logINFO) << "Plugin " << name << " schedule: priority " << schedule.priority << ", rate divisor: " << schedule.rate_divisor << ", phase: " << schedule.phase;
+  return true;
+}
+
+bool Controller::get_plugin_schedule(const std::string& name,plugin_schedule_t& schedule){
+  std::map<std::string, boost::shared_ptr<plugin_rate_t> >::const_iterator it = _plugin_rate_map.find(name);
+  if(it == _plugin_rate_map.end())
+    return false;
+  schedule.rate_divisor = (*it).second->divisor.load(std::memory_order_relaxed);
+  schedule.phase = (*it).second->phase.load(std::memory_order_relaxed);
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_schedule_mutex);
+#endif
+  std::map<std::string, int>::const_iterator pending = _pending_priority_map.find(name);
+  schedule.priority = (pending != _pending_priority_map.end())? (*pending).second : (*_name_priority_map.find(name)).second;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_schedule_mutex);
+#endif
+  return true;
+}
+
+void Controller::apply_pending_priorities(){
+  std::map<std::string, int> pending;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_schedule_mutex);
+#endif
+  pending.swap(_pending_priority_map);
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_schedule_mutex);
+#endif
+  for(std::map<std::string, int>::const_iterator it=pending.begin();it!=pending.end();it++){
+    const std::string& name = (*it).first;
+    std::map<std::string, int>::iterator current = _name_priority_map.find(name);
+    if(current == _name_priority_map.end() || (*current).second == (*it).second)
+      continue;
+    // leaving the background tier
+    if((*current).second == NON_REALTIME)
+      stop_background_job(name);
+    _update_priority_map[(*it).second][name] = _update_priority_map[(*current).second][name];
+    _update_priority_map[(*current).second].erase(name);
+    OUT_LOG(logINFO) << "Plugin " << name << " priority: " << (*current).second << " --> " << (*it).second;
+    (*current).second = (*it).second;
+    _update_graph_dirty = true;
+  }
+}
+
 bool Controller::remove_plugin(const std::string& plugin_name){
   std::map<std::string, void*>::iterator it = handles.find(plugin_name);
   
   if(it == handles.end())
     return false;
 
+  PROFILE_SCOPE(Profiler::instance().section(plugin_section(plugin_name)+".close"));
   remove_plugin_update(plugin_name);
   void * &handle = (*it).second;
   dlclose(handle);
@@ -60,6 +174,7 @@ bool Controller::remove_plugin(const std::string& plugin_name){
 
 bool Controller::init_plugin(const std::string& plugin_name){
   OUT_LOG(logDEBUG) << ">> init_plugin("<< plugin_name << ")";
+  PROFILE_SCOPE(Profiler::instance().section(plugin_section(plugin_name)+".open"));
   std::string filename;
   bool plugin_filename_found = get_data<std::string>(plugin_name+".file",filename);
   if (!plugin_filename_found)
@@ -100,6 +215,35 @@ bool Controller::init_plugin(const std::string& plugin_name){
     // Init the plugin
     (*INIT)(this->ptr(),plugin_name.c_str());
   }
+  
+  // Data access declared in the configuration (see declare_plugin_access)
+  std::vector<std::string> reads, writes;
+  std::string single;
+  bool declared = false;
+  if(get_data<std::vector<std::string> >(plugin_name+".reads",reads))
+    declared = true;
+  else if(get_data<std::string>(plugin_name+".reads",single)){
+    reads.push_back(single);
+    declared = true;
+  }
+  if(get_data<std::vector<std::string> >(plugin_name+".writes",writes))
+    declared = true;
+  else if(get_data<std::string>(plugin_name+".writes",single)){
+    writes.push_back(single);
+    declared = true;
+  }
+  if(declared){
+    bool uses_model = true;
+    get_data<bool>(plugin_name+".uses-model",uses_model);
+    declare_plugin_access(plugin_name,reads,writes,uses_model);
+  }
+  
+  // Updates longer than this (seconds) are counted as overruns
+  double budget;
+  if(get_data<double>(plugin_name+".budget",budget)){
+    Profiler::instance().set_budget(plugin_section(plugin_name),budget);
+    _degrade_map[plugin_name].budget = budget * 1.0e9;
+  }
   OUT_LOG(logDEBUG) << "<< init_plugin("<< plugin_name << ")";
 
   return true;
@@ -135,6 +279,44 @@ void Controller::init(){
   OUT_LOG(logDEBUG1) << "Log Type : " << LOG_TYPE;
   FILELog::ReportingLevel() =
   FILELog::FromString( (!LOG_TYPE.empty() ) ? LOG_TYPE : "INFO");
+  // ================= SETUP PROFILING ==========================
+  // Time plugin updates and controller phases (build with PROFILING)
+  get_data<bool>("profiling",Profiler::enabled());
+  double tick_budget;
+  if(get_data<double>("tick-budget",tick_budget)){
+    Profiler::instance().set_budget("control",tick_budget);
+    _tick_budget = tick_budget * 1.0e9;
+  }
+  // ================= SETUP TICK BUDGET DEGRADATION ==========================
+  // plugins at this priority or lower may be skipped when the tick is over budget
+  _degrade_priority = std::max(HIGHEST_PRIORITY,get_int_option("degrade-priority",LOWEST_PRIORITY+1));
+  _degrade_max_skips = get_int_option("degrade-max-skips",0);
+  _degrade_window = std::max(1,get_int_option("degrade-window",100));
+  _degrade_max_rtf = get_int_option("degrade-max-rtf",64);
+  get_data<double>("degrade-overrun-ratio",_degrade_overrun_ratio);
+  if(_tick_budget > 0 && _degrade_priority <= LOWEST_PRIORITY)
+    OUT_LOG(logINFO) << "Tick budget: " << tick_budget << " s, plugins at priority >= " << _degrade_priority << " may be skipped";
+#ifndef USE_PROFILING
+  if(Profiler::enabled())
+    OUT_LOG(logERROR) << "\"profiling\" is set but Pacer was built without PROFILING";
+#endif
+  // ================= SETUP PLUGIN WORKERS ==========================
+  // Threads updating independent plugins concurrently (0: serial updates)
+  int plugin_threads = get_int_option("plugin-threads",0);
+  _worker_pool = WorkerPoolPtr(new WorkerPool(plugin_threads));
+  OUT_LOG(logINFO) << "Plugin worker threads: " << _worker_pool->num_workers();
+#ifdef USE_TELEMETRY
+  // Level of OUTLOG series recorded to telemetry (default: all)
+  std::string telemetry_level;
+  if(get_data<std::string>("telemetry",telemetry_level))
+    Telemetry::ReportingLevel() = FILELog::FromString(telemetry_level);
+#endif
+#ifdef LOG_TO_FILE
+  // What to do when the log buffer is full: "DROP" (default) or "BLOCK"
+  std::string log_policy;
+  if(get_data<std::string>("logging-policy",log_policy))
+    LogQueue::instance().set_policy((log_policy.compare("BLOCK") == 0)? LogQueue::BLOCK : LogQueue::DROP);
+#endif
   // ================= IMPORT CONTROLLED ROBOT =================
   std::string robot_model_file = get_data<std::string>("robot-model");
   
@@ -155,17 +337,36 @@ void Controller::control(double t){
   static long long unsigned int iter = 0;
   static double last_time = -0.001;
   const double dt = t - last_time;
+  _tick = iter;
+  _tick_start = Profiler::now();
+  _degrade_skipped = 0;
   
+#ifdef USE_TELEMETRY
+  Telemetry::instance().set_time(iter,t);
+#endif
   OUTLOG(t,"virtual_time",logINFO);
   OUTLOG(dt,"virtual_time_step",logINFO);
-  increment_phase(INITIALIZATION);
-  update();
-  increment_phase(PERCEPTION);
+  {
+    PROFILE_SCOPE(_control_section);
+    increment_phase(INITIALIZATION);
+    // M, its factorization and contact jacobians are computed once per tick
+    invalidate_dynamics();
+    {
+      PROFILE_SCOPE(_update_section);
+      update();
+    }
+    increment_phase(PERCEPTION);
 #ifdef USE_PLUGINS
-  update_plugins(t);
+    update_plugins(t);
 #endif
-  increment_phase(WAITING);
-  reset_contact();
+    increment_phase(WAITING);
+    if(_degrade_skipped > 0)
+      OUTLOG((double) _degrade_skipped,"degrade.skipped",logINFO);
+    {
+      PROFILE_SCOPE(_reset_contact_section);
+      reset_contact();
+    }
+  }
   last_time = t;
 
   iter++;
@@ -181,16 +382,6 @@ bool Controller::update_plugins(double t){
   }
 #endif
   OUT_LOG(logINFO) << ">> update_plugins()";
-  //name_update_t& non_realtime_map = _update_priority_map[NON_REALTIME];
-  //if(!_update_priority_map[i].empty())
-  //BOOST_FOREACH( const name_update_t::value_type& update, non_realtime_map)
-  //{
-  //static std::map<std::string,std::thread> threads = std::map<std::string,std::thread>();
-  //if(threads.find(update.first) != threads.end());
-  //OUT_LOG(logDEBUG1) << ">> " << update.first;
-  //threads[update.first] = (*(update.second)),this->ptr(),t);
-  //OUT_LOG(logDEBUG1) << "<< " << update.first;
-  //}
   
   // remove the plugins that have been marked for closure
   if(!plugins_to_close.empty()){
@@ -210,6 +401,13 @@ bool Controller::update_plugins(double t){
     plugins_to_open.clear();
   }
   
+  apply_pending_priorities();
+  
+#ifdef USE_THREADS
+  // publish finished NON_REALTIME updates and relaunch them on this tick's state
+  update_background_plugins(t);
+#endif
+  
 #ifdef LOG_TO_FILE
   for(int i = HIGHEST_PRIORITY;i<=LOWEST_PRIORITY;i++){
     if(!_update_priority_map[i].empty()){
@@ -219,20 +417,430 @@ bool Controller::update_plugins(double t){
   }
 #endif
   
+  if(_update_graph_dirty)
+    build_update_graph();
+  if(!_worker_pool)
+    _worker_pool = WorkerPoolPtr(new WorkerPool(0));
+  
   // Update plugins in priority queue
-  for(int i = HIGHEST_PRIORITY;i<=LOWEST_PRIORITY;i++){
-    if(!_update_priority_map[i].empty()){ // SRZ: do I need this line?
-      BOOST_FOREACH( const name_update_t::value_type& update, _update_priority_map[i]){
-        OUT_LOG(logINFO) << ">> " << update.first;
-        (*(update.second))(this->ptr(),t);
-        OUT_LOG(logINFO) << "<< " << update.first;
-      }
+  const boost::shared_ptr<Controller> ctrl = this->ptr();
+  _update_ctrl = &ctrl;
+  _update_time = t;
+  try {
+    for(int i = HIGHEST_PRIORITY;i<=LOWEST_PRIORITY;i++){
+      std::map<int , std::vector<dag_task_t> >::iterator it = _update_graph.find(i);
+      if(it != _update_graph.end())
+        _worker_pool->run_graph((*it).second);
     }
+#ifndef USE_THREADS
+    // no background threads: NON_REALTIME plugins are updated last
+    BOOST_FOREACH( const name_update_t::value_type& update, _update_priority_map[NON_REALTIME])
+      run_plugin_update(update.first,update.second,NULL,Profiler::instance().section(plugin_section(update.first)),NULL);
+#endif
+  } catch(...) {
+    _update_ctrl = NULL;
+    throw;
   }
+  _update_ctrl = NULL;
   
   OUT_LOG(logINFO) << "<< update_plugins()";
   return true;
 }
 
+void Controller::run_plugin_update(const std::string& name,update_t f,plugin_rate_t* rate,Profiler::section_t* section,degrade_t* degrade){
+  if(rate && !rate->fires(_tick)){
+    // a tick without an update counts as within budget
+    if(degrade)
+      account_plugin_update(name,*degrade,rate,0);
+    return;
+  }
+  if(degrade && skip_plugin_update(name,*degrade))
+    return;
+  OUT_LOG(logINFO) << ">> " << name;
+  const int64_t start = (degrade)? Profiler::now() : 0;
+  {
+    PROFILE_SCOPE(section);
+    (*f)(*_update_ctrl,_update_time);
+  }
+  if(degrade)
+    account_plugin_update(name,*degrade,rate,Profiler::now() - start);
+  OUT_LOG(logINFO) << "<< " << name;
+}
+
+int Controller::get_int_option(const std::string& name,int default_value){
+  int value = default_value;
+  double double_value;
+  if(!get_data<int>(name,value) && get_data<double>(name,double_value))
+    value = double_value;
+  return value;
+}
+
+// Called by the thread updating plugin 'name' (degrade is not shared with other plugins)
+bool Controller::skip_plugin_update(const std::string& name,degrade_t& degrade){
+  const int64_t elapsed = Profiler::now() - _tick_start;
+  if(elapsed <= _tick_budget){
+    degrade.consecutive_skips = 0;
+    return false;
+  }
+  
+  if(_degrade_max_skips > 0 && degrade.consecutive_skips >= _degrade_max_skips){
+    OUT_LOG(logINFO) << "-- SCHEDULER -- " << name << " runs over budget (" << elapsed*1.0e-9 << " s) after " << degrade.consecutive_skips << " skipped ticks";
+    OUTLOG(elapsed*1.0e-9,name+".degrade.forced",logINFO);
+    degrade.consecutive_skips = 0;
+    return false;
+  }
+  
+  OUT_LOG(logINFO) << "-- SCHEDULER -- " << name << " skipped, tick over budget (" << elapsed*1.0e-9 << " s)";
+  OUTLOG(elapsed*1.0e-9,name+".degrade.skip",logINFO);
+  degrade.consecutive_skips++;
+  _degrade_skipped++;
+  return true;
+}
+
+void Controller::account_plugin_update(const std::string& name,degrade_t& degrade,plugin_rate_t* rate,int64_t duration){
+  if(degrade.budget <= 0 || !rate)
+    return;
+  degrade.window_updates++;
+  if(duration > degrade.budget)
+    degrade.window_overruns++;
+  if(degrade.window_updates < _degrade_window)
+    return;
+  
+  const bool chronic = (degrade.window_overruns > _degrade_overrun_ratio * degrade.window_updates);
+  degrade.window_updates = 0;
+  degrade.window_overruns = 0;
+  if(!chronic)
+    return;
+  
+  // halve the update rate
+  const unsigned rtf = rate->divisor.load(std::memory_order_relaxed);
+  if(rtf >= _degrade_max_rtf)
+    return;
+  const unsigned new_rtf = std::min<unsigned>(rtf*2,_degrade_max_rtf);
+  rate->divisor.store(new_rtf,std::memory_order_relaxed);
+  OUT_LOG(logINFO) << "-- SCHEDULER -- " << name << " chronically over its budget, real-time-factor: " << rtf << " --> " << new_rtf;
+  OUTLOG((double) new_rtf,name+".degrade.real-time-factor",logINFO);
+}
+
+void Controller::declare_plugin_access(const std::string& name,const std::vector<std::string>& reads,const std::vector<std::string>& writes,bool uses_model){
+  plugin_access_t& access = _plugin_access_map[name];
+  access.reads = std::set<std::string>(reads.begin(),reads.end());
+  access.writes = std::set<std::string>(writes.begin(),writes.end());
+  // kinematic queries write the shared model (poses, forward kinematics caches)
+  if(uses_model)
+    access.writes.insert("model");
+  
+  // setting state units may advance the controller phase
+  access.phase_mask = 0;
+  for(int u = misc_sensor;u <= load_goal;u++){
+    if(access.writes.find(state_resource(static_cast<unit_e>(u))) == access.writes.end())
+      continue;
+    if(u <= load)
+      access.phase_mask |= (1 << PERCEPTION);
+    else if(u <= acceleration_goal)
+      access.phase_mask |= (1 << PLANNING);
+    else
+      access.phase_mask |= (1 << CONTROL);
+  }
+  OUT_LOG(logINFO) << "Plugin " << name << " reads: " << reads << ", writes: " << writes << ", uses model: " << uses_model;
+  _update_graph_dirty = true;
+}
+
+// true if resources 'a' and 'b' (possibly ending in wildcard '*') can name the same data
+static bool resources_overlap(const std::string& a,const std::string& b){
+  const bool a_wild = (!a.empty() && a[a.size()-1] == '*'),
+             b_wild = (!b.empty() && b[b.size()-1] == '*');
+  if(!a_wild && !b_wild)
+    return a.compare(b) == 0;
+  const size_t n = std::min((a_wild)? a.size()-1 : a.size(),(b_wild)? b.size()-1 : b.size());
+  return a.compare(0,n,b,0,n) == 0;
+}
+
+static bool resources_overlap(const std::set<std::string>& A,const std::set<std::string>& B){
+  std::set<std::string>::const_iterator it,jt;
+  for(it=A.begin();it!=A.end();it++)
+    for(jt=B.begin();jt!=B.end();jt++)
+      if(resources_overlap(*it,*jt))
+        return true;
+  return false;
+}
+
+bool Controller::plugins_conflict(const std::string& a,const std::string& b){
+  std::map<std::string, plugin_access_t>::const_iterator ia = _plugin_access_map.find(a),
+                                                         ib = _plugin_access_map.find(b);
+  // undeclared plugins may touch anything
+  if(ia == _plugin_access_map.end() || ib == _plugin_access_map.end())
+    return true;
+  const plugin_access_t &A = (*ia).second, &B = (*ib).second;
+  
+  if(resources_overlap(A.writes,B.writes) || resources_overlap(A.writes,B.reads) || resources_overlap(A.reads,B.writes))
+    return true;
+  
+  // plugins moving the controller to different phases keep their order
+  const unsigned phases = A.phase_mask | B.phase_mask;
+  if(A.phase_mask && B.phase_mask && (phases & (phases - 1)))
+    return true;
+  return false;
+}
+
+void Controller::build_update_graph(){
+  _update_graph.clear();
+  for(int i = HIGHEST_PRIORITY;i<=LOWEST_PRIORITY;i++){
+    const name_update_t& updates = _update_priority_map[i];
+    if(updates.empty())
+      continue;
+    
+    std::vector<std::string> names = get_map_keys(updates);
+    std::vector<dag_task_t>& graph = _update_graph[i];
+    graph.resize(names.size());
+    for(int j=0;j<names.size();j++){
+      degrade_t* degrade = (_tick_budget > 0 && i >= _degrade_priority)? &_degrade_map[names[j]] : NULL;
+      graph[j].run = boost::bind(&Controller::run_plugin_update,this,names[j],(*updates.find(names[j])).second,
+                                 _plugin_rate_map[names[j]].get(),Profiler::instance().section(plugin_section(names[j])),degrade);
+      for(int k=0;k<j;k++){
+        if(plugins_conflict(names[k],names[j])){
+          graph[k].successors.push_back(j);
+          graph[j].num_predecessors++;
+        }
+      }
+    }
+    
+#ifdef LOG_TO_FILE
+    for(int j=0;j<names.size();j++){
+      std::vector<std::string> after;
+      for(int k=0;k<j;k++)
+        if(std::find(graph[k].successors.begin(),graph[k].successors.end(),j) != graph[k].successors.end())
+          after.push_back(names[k]);
+      OUT_LOG(logINFO) << "PRIORITY " << i << ": " << names[j] << " runs after " << after;
+    }
+#endif
+  }
+  _update_graph_dirty = false;
+}
+
+// ============================================================================
+// ====================== Background (NON_REALTIME) updates ===================
+
+static bool resource_declared(const std::set<std::string>& resources,const std::string& name){
+  std::set<std::string>::const_iterator it;
+  for(it=resources.begin();it!=resources.end();it++)
+    if(resources_overlap(*it,name))
+      return true;
+  return false;
+}
+
+void Controller::stop_background_job(const std::string& name){
+#ifdef USE_THREADS
+  std::map<std::string, boost::shared_ptr<background_job_t> >::iterator it = _background_jobs.find(name);
+  if(it == _background_jobs.end())
+    return;
+  boost::shared_ptr<background_job_t> job = (*it).second;
+  _background_jobs.erase(it);
+  
+  pthread_mutex_lock(&job->mutex);
+  job->stop = true;
+  pthread_cond_signal(&job->cond);
+  pthread_mutex_unlock(&job->mutex);
+  // waits for an update in progress to return
+  pthread_join(job->thread,NULL);
+  pthread_cond_destroy(&job->cond);
+  pthread_mutex_destroy(&job->mutex);
+  OUT_LOG(logINFO) << "Background plugin " << name << " stopped: " << job->launched << " updates launched, " << job->published << " published";
+#endif
+}
+
+// Copies the variables of 'from' in 'resources' (all if NULL) to 'data', re-pointed at the frames of the other model
+void Controller::clone_rebased(Controller& from,const std::set<std::string>* resources,const frame_map_t& frames,std::vector<data_slot_ptr>& data){
+  if(!resources)
+    from.clone_data(data);
+  else
+    from.clone_data(data,boost::bind(&resource_declared,boost::cref(*resources),_1));
+  // frames outside the models are copied once per call
+  frame_map_t f(frames);
+  for(int i=0;i<data.size();i++)
+    data[i]->rebase(f);
+}
+
+#ifdef USE_THREADS
+// Maps the link frames of model 'from' to those of 'to' (read from the same file)
+static void map_model_frames(const boost::shared_ptr<Ravelin::ArticulatedBodyd>& from,const boost::shared_ptr<Ravelin::ArticulatedBodyd>& to,frame_map_t& frames){
+  const std::vector<boost::shared_ptr<Ravelin::RigidBodyd> >& from_links = from->get_links(), &to_links = to->get_links();
+  if(from_links.size() != to_links.size())
+    throw std::runtime_error("map_model_frames: models have different numbers of links");
+  frames.clear();
+  for(int i=0;i<from_links.size();i++){
+    frames[from_links[i]->get_pose().get()] = to_links[i]->get_pose();
+    frames[from_links[i]->get_inertial_pose().get()] = to_links[i]->get_inertial_pose();
+  }
+  frames[from->get_gc_pose().get()] = to->get_gc_pose();
+}
+
+boost::shared_ptr<Controller> Controller::create_snapshot(){
+  boost::shared_ptr<Controller> snapshot(new Controller());
+  snapshot->_is_snapshot = true;
+  
+  std::vector<data_slot_ptr> data;
+  clone_data(data);
+  snapshot->publish_data(data);
+  
+  // the snapshot has its own kinematic model
+  read_robot_from_file(get_data<std::string>("robot-model"),snapshot->get_abrobot());
+  snapshot->controller_phase = INITIALIZATION;
+  snapshot->init_robot();
+  // any unit may be set in a background update
+  snapshot->controller_phase = WAITING;
+  return snapshot;
+}
+
+void Controller::update_background_plugins(double t){
+  const name_update_t& updates = _update_priority_map[NON_REALTIME];
+  for(name_update_t::const_iterator it=updates.begin();it!=updates.end();it++){
+    const std::string& name = (*it).first;
+    boost::shared_ptr<background_job_t> job = _background_jobs[name];
+    if(!job){
+      // the snapshot is built by the background thread, the plugin is first launched once it is ready
+      job = boost::shared_ptr<background_job_t>(new background_job_t(name,(*it).second,this));
+      job->section = Profiler::instance().section(plugin_section(name));
+      pthread_mutex_init(&job->mutex,NULL);
+      pthread_cond_init(&job->cond,NULL);
+      if(pthread_create(&job->thread,NULL,&Controller::background_thread,job.get()) != 0){
+        _background_jobs.erase(name);
+        pthread_cond_destroy(&job->cond);
+        pthread_mutex_destroy(&job->mutex);
+        throw std::runtime_error("Could not create background thread for plugin: " + name);
+      }
+      _background_jobs[name] = job;
+      OUT_LOG(logINFO) << "Background plugin " << name << " started";
+    }
+    
+    pthread_mutex_lock(&job->mutex);
+    if(job->done){
+      job->done = false;
+      if(!job->error.empty()){
+        const std::string error = job->error;
+        job->error.clear();
+        pthread_mutex_unlock(&job->mutex);
+        throw std::runtime_error(name + " (NON_REALTIME) failed with error: " + error);
+      }
+      publish_background_results(*job);
+    }
+    
+    if(job->ready && !job->running){
+      // the worker is idle: refresh its snapshot (the declared reads) and relaunch the update
+      // variables outside the declared reads keep the values they had when the snapshot was created
+      std::map<std::string, plugin_access_t>::const_iterator access = _plugin_access_map.find(name);
+      job->writes.clear();
+      if(access != _plugin_access_map.end())
+        job->writes = (*access).second.writes;
+      else
+        job->writes.insert(name+".*");
+      
+      std::vector<data_slot_ptr> data;
+      clone_rebased(*this,(access != _plugin_access_map.end())? &(*access).second.reads : NULL,job->to_snapshot,data);
+      job->snapshot->publish_data(data);
+      job->snapshot->copy_state(*this);
+      job->time = t;
+      
+      job->running = true;
+      job->launched++;
+      pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->mutex);
+  }
+}
+
+// Builds the snapshot 'job' runs against, on the background thread (reading a model
+// file is too slow for a control tick)
+void Controller::build_background_snapshot(background_job_t& job){
+  job.snapshot = create_snapshot();
+  map_model_frames(get_abrobot(),job.snapshot->get_abrobot(),job.to_snapshot);
+  map_model_frames(job.snapshot->get_abrobot(),get_abrobot(),job.from_snapshot);
+  // the variables cloned before the snapshot had a model refer to frames of this one
+  std::vector<data_slot_ptr> data;
+  clone_rebased(*this,NULL,job.to_snapshot,data);
+  job.snapshot->publish_data(data);
+}
+
+void* Controller::background_thread(void* arg){
+  background_job_t* job = static_cast<background_job_t*>(arg);
+  std::string error;
+  try {
+    job->owner->build_background_snapshot(*job);
+  } catch(std::exception& e) {
+    error = e.what();
+  } catch(...) {
+    error = "unknown error";
+  }
+  
+  pthread_mutex_lock(&job->mutex);
+  if(!error.empty()){
+    // reported by the control thread, the plugin is never launched
+    job->error = "building snapshot: " + error;
+    job->done = true;
+  } else {
+    job->ready = true;
+  }
+  for(;;){
+    while(!job->running && !job->stop)
+      pthread_cond_wait(&job->cond,&job->mutex);
+    if(job->stop)
+      break;
+    pthread_mutex_unlock(&job->mutex);
+    
+    std::string error;
+    try {
+      job->owner->run_background_job(*job);
+    } catch(std::exception& e) {
+      error = e.what();
+    } catch(...) {
+      error = "unknown error";
+    }
+    
+    pthread_mutex_lock(&job->mutex);
+    job->error = error;
+    job->running = false;
+    job->done = true;
+  }
+  pthread_mutex_unlock(&job->mutex);
+  return NULL;
+}
+
+// Runs on the background thread, the control thread does not touch the job until it is done
+void Controller::run_background_job(background_job_t& job){
+  Controller& snapshot = *job.snapshot;
+  // bring the snapshot's model to the copied state
+  snapshot.update();
+  
+  OUT_LOG(logINFO) << ">> " << job.name << " (NON_REALTIME, t = " << job.time << ")";
+  {
+    PROFILE_SCOPE(job.section);
+    (*job.update)(job.snapshot,job.time);
+  }
+  OUT_LOG(logINFO) << "<< " << job.name;
+  
+  job.data.clear();
+  clone_rebased(snapshot,&job.writes,job.from_snapshot,job.data);
+  job.state.clear();
+  for(int u = misc_sensor;u <= load_goal;u++){
+    const unit_e unit = static_cast<unit_e>(u);
+    if(resource_declared(job.writes,state_resource(unit)))
+      job.state.push_back(std::make_pair(unit,snapshot.get_generalized_value_ref(unit)));
+  }
+}
+
+// Called from the control thread with the job mutex held
+void Controller::publish_background_results(background_job_t& job){
+  publish_data(job.data);
+  for(int i=0;i<job.state.size();i++)
+    assign_state(job.state[i].first,job.state[i].second);
+  set_data<double>(job.name+".result-time",job.time);
+  job.published++;
+  OUT_LOG(logINFO) << "Published " << job.name << " (NON_REALTIME, t = " << job.time << "): "
+                   << job.data.size() << " variables, " << job.state.size() << " state units";
+  job.data.clear();
+  job.state.clear();
+}
+#endif
+
 // ===========================  END CONTROLLER  ===============================
 // ============================================================================
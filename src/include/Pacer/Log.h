@@ -61,35 +61,227 @@ inline std::ostringstream& Logger::Get(TLogLevel level)
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
-inline Logger::~Logger()
+
+#ifdef LOG_TO_FILE
+#include <atomic>
+#include <time.h>
+#include <pthread.h>
+
+// Number of message slots in the log ring buffer (must be a power of 2)
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 8192
+#endif
+// Longest message stored without truncation (bytes, incl. terminator)
+#ifndef LOG_MESSAGE_SIZE
+#define LOG_MESSAGE_SIZE 512
+#endif
+
+/**
+ * @brief Bounded multi-producer ring buffer drained by a background writer thread.
+ *
+ * Producers (Logger::~Logger) copy their message into a preallocated slot and
+ * return, the writer thread batches slots into one fwrite on a log file that
+ * stays open.  When the buffer is full the message is dropped (default) or,
+ * with the BLOCK policy, the producer yields until a slot frees up.
+ * All storage is allocated once, producers never allocate or touch the file.
+ */
+class LogQueue
 {
-  static std::string name;
+public:
+  enum policy_e { DROP, BLOCK };
+
+  static LogQueue& instance(){
+    // never destroyed: Loggers may still run during static destruction
+    static LogQueue* queue = new LogQueue();
+    return *queue;
+  }
+
+  /// @brief Enqueue one message (truncated to LOG_MESSAGE_SIZE-1 bytes, keeping
+  /// its trailing newline).  Returns false if the message was dropped.
+  bool push(const char* msg, size_t len){
+    if(stopped.load(std::memory_order_acquire)){
+      write_direct(msg,len);
+      return true;
+    }
+    slot_t* s;
+    bool waited = false;
+    size_t pos = head.load(std::memory_order_relaxed);
+    for(;;){
+      s = &slots[pos & (LOG_QUEUE_SIZE-1)];
+      size_t seq = s->seq.load(std::memory_order_acquire);
+      long diff = (long) seq - (long) pos;
+      if(diff == 0){
+        if(head.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed))
+          break;
+      } else if(diff < 0){
+        // full
+        if(policy == DROP){
+          dropped.fetch_add(1,std::memory_order_relaxed);
+          return false;
+        }
+        // count messages that had to wait, not spins
+        if(!waited){
+          blocked.fetch_add(1,std::memory_order_relaxed);
+          waited = true;
+        }
+        sched_yield();
+        pos = head.load(std::memory_order_relaxed);
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    if(len >= LOG_MESSAGE_SIZE){
+      // keep the record on its own line (OUTLOG matrices are parsed line by line)
+      memcpy(s->msg,msg,LOG_MESSAGE_SIZE-2);
+      s->msg[LOG_MESSAGE_SIZE-2] = '\n';
+      len = LOG_MESSAGE_SIZE-1;
+      truncated.fetch_add(1,std::memory_order_relaxed);
+    } else {
+      memcpy(s->msg,msg,len);
+    }
+    s->len = len;
+    s->seq.store(pos+1,std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Block until all messages pushed before this call are on disk.
+  void flush(){
+    size_t target = head.load(std::memory_order_acquire);
+    while(!stopped.load(std::memory_order_acquire) && written_pos.load(std::memory_order_acquire) < target)
+      sched_yield();
+  }
+
+  /// @brief Stop the writer thread after draining the buffer, later messages are written synchronously.
+  void stop(){
+    if(stopped.exchange(true))
+      return;
+    pthread_join(writer,NULL);
+    drain();
+    write_counters();
+    fflush(file);
+  }
+
+  void set_policy(policy_e p){ policy = p; }
+  policy_e get_policy() const { return policy; }
+
+  // counters
+  unsigned long num_written() const { return written.load(std::memory_order_relaxed); }
+  unsigned long num_dropped() const { return dropped.load(std::memory_order_relaxed); }
+  unsigned long num_blocked() const { return blocked.load(std::memory_order_relaxed); }
+  unsigned long num_truncated() const { return truncated.load(std::memory_order_relaxed); }
+
+  const std::string& filename() const { return name; }
+
+private:
+  struct slot_t {
+    std::atomic<size_t> seq;
+    size_t len;
+    char msg[LOG_MESSAGE_SIZE];
+  };
+
+  // bytes gathered per fwrite
+  static const size_t BATCH_SIZE = 64*1024;
+
+  LogQueue() : policy(DROP), head(0), tail(0), written_pos(0),
+               written(0), dropped(0), blocked(0), truncated(0), reported_dropped(0), stopped(false)
+  {
+    slots = new slot_t[LOG_QUEUE_SIZE];
+    for(size_t i=0;i<LOG_QUEUE_SIZE;i++)
+      slots[i].seq.store(i,std::memory_order_relaxed);
+    batch = new char[BATCH_SIZE];
 
-  if (name.empty()) {
-    FILE * pFile;
-    static int pid = getpid();
     char buffer[9];
-    sprintf(buffer,"%06d",pid);
+    sprintf(buffer,"%06d",getpid());
     name = std::string("out-"+std::string(buffer)+".log");
-    pFile = fopen (name.c_str(),"w");
-    fprintf(pFile, "INITED LOGGER\n");
-    fflush(pFile);
-    fclose (pFile);
+    file = fopen(name.c_str(),"w");
+    fprintf(file, "INITED LOGGER\n");
+    fflush(file);
+
+    pthread_create(&writer,NULL,&LogQueue::writer_thread,this);
+    atexit(&LogQueue::at_exit);
+  }
+
+  static void at_exit(){ instance().stop(); }
+
+  static void* writer_thread(void* arg){
+    LogQueue* q = static_cast<LogQueue*>(arg);
+    const struct timespec idle = {0, 1000000}; // 1ms
+    while(!q->stopped.load(std::memory_order_acquire)){
+      if(q->drain() == 0)
+        nanosleep(&idle,NULL);
+    }
+    return NULL;
+  }
+
+  // Moves all ready messages to the file, returns the number of messages written
+  size_t drain(){
+    size_t n = 0, fill = 0;
+    for(;;){
+      slot_t* s = &slots[tail & (LOG_QUEUE_SIZE-1)];
+      if(s->seq.load(std::memory_order_acquire) != tail+1)
+        break;
+      if(fill + s->len > BATCH_SIZE){
+        fwrite(batch,1,fill,file);
+        fill = 0;
+      }
+      memcpy(batch+fill,s->msg,s->len);
+      fill += s->len;
+      s->seq.store(tail+LOG_QUEUE_SIZE,std::memory_order_release);
+      tail++;
+      n++;
+    }
+    if(n > 0){
+      fwrite(batch,1,fill,file);
+      write_counters();
+      fflush(file);
+      written.fetch_add(n,std::memory_order_relaxed);
+      written_pos.store(tail,std::memory_order_release);
+    }
+    return n;
+  }
+
+  // Notes lost messages in the log itself
+  void write_counters(){
+    unsigned long d = dropped.load(std::memory_order_relaxed);
+    if(d != reported_dropped){
+      fprintf(file, " WARNING: LOGGER dropped %lu messages (buffer full), %lu total\n", d - reported_dropped, d);
+      reported_dropped = d;
+    }
+  }
+
+  void write_direct(const char* msg, size_t len){
+    static pthread_mutex_t direct_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&direct_mutex);
+    fwrite(msg,1,len,file);
+    fflush(file);
+    pthread_mutex_unlock(&direct_mutex);
+    written.fetch_add(1,std::memory_order_relaxed);
   }
+
+  LogQueue(const LogQueue&);
+  LogQueue& operator =(const LogQueue&);
+
+  policy_e policy;
+  slot_t* slots;
+  char* batch;
+  std::atomic<size_t> head;         // next slot claimed by a producer
+  size_t tail;                      // next slot read by the writer (writer only)
+  std::atomic<size_t> written_pos;  // tail after the last fflush
+  std::atomic<unsigned long> written, dropped, blocked, truncated;
+  unsigned long reported_dropped;   // writer only
+  std::atomic<bool> stopped;
+  pthread_t writer;
+  FILE* file;
+  std::string name;
+};
+#endif
+
+inline Logger::~Logger()
+{
 #ifdef LOG_TO_FILE
-    os << std::endl;
-    FILE * pFile;
-//    static int pid = getpid();
-//    char buffer[9];
-//    sprintf(buffer,"%06d",pid);
-//    static std::string name("out-"+std::string(buffer)+".log");
-    pFile = fopen(name.c_str(),"a");
-    fprintf(pFile, "%s", os.str().c_str());
-    fflush(pFile);
-    fclose (pFile);
-//#else
-//    fprintf(stdout, "%s", os.str().c_str());
-//    fflush(stdout);
+  os << std::endl;
+  const std::string& msg = os.str();
+  LogQueue::instance().push(msg.c_str(),msg.size());
 #endif
 }
 
@@ -0,0 +1,64 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef CONTACT_JACOBIAN_H
+#define CONTACT_JACOBIAN_H
+
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/MatrixNd.h>
+#include <vector>
+
+namespace Pacer{
+
+  /**
+   * @brief Contact Jacobian stored as one dense block per contact.
+   *
+   * A contact on a leg only moves that leg's chain coordinates and the
+   * base, so contact i keeps a 3 x columns(i).size() block over just those
+   * generalized coordinates (rows: normal, first tangent, second tangent).
+   *
+   * The equivalent dense matrix is J = [N';S';T'] (3NC x NDOFS, see
+   * Robot::calc_contact_jacobians()): row r of contact i's block is row
+   * r*NC + i of J.  All products below use that ordering.
+   */
+  class ContactJacobian{
+  public:
+    ContactJacobian() : _num_dofs(0), _num_contacts(0) {}
+
+    /// @brief Remove all contacts (keeps allocated blocks for reuse)
+    void reset(unsigned num_dofs){
+      _num_dofs = num_dofs;
+      _num_contacts = 0;
+    }
+
+    /// @brief Append a contact moving generalized coordinates 'cols', returns its 3 x cols.size() block to fill
+    Ravelin::MatrixNd& add_contact(const std::vector<unsigned>& cols);
+
+    unsigned num_contacts() const { return _num_contacts; }
+    unsigned num_dofs() const { return _num_dofs; }
+    const std::vector<unsigned>& columns(unsigned i) const { return _cols[i]; }
+    const Ravelin::MatrixNd& block(unsigned i) const { return _blocks[i]; }
+
+    /// @brief y = J v (3NC)
+    Ravelin::VectorNd& mult(const Ravelin::VectorNd& v, Ravelin::VectorNd& y) const;
+
+    /// @brief W = J iM J' (3NC x 3NC) for the (dense, symmetric) inverse generalized inertia iM
+    /// only the entries of iM coupling two contacts' coordinates are read
+    Ravelin::MatrixNd& mult_inertia_transpose(const Ravelin::MatrixNd& iM, Ravelin::MatrixNd& W) const;
+
+    /// @brief X = J iM(:,0:ncols) (3NC x ncols), e.g. the contact rows times the joint columns of iM
+    Ravelin::MatrixNd& mult_inertia(const Ravelin::MatrixNd& iM, unsigned ncols, Ravelin::MatrixNd& X) const;
+
+    /// @brief Dense NDOFS x NC normal (N) and tangent (S,T) Jacobians
+    void to_dense(Ravelin::MatrixNd& N, Ravelin::MatrixNd& S, Ravelin::MatrixNd& T) const;
+
+  private:
+    unsigned _num_dofs, _num_contacts;
+    std::vector<std::vector<unsigned> > _cols;
+    std::vector<Ravelin::MatrixNd> _blocks;
+  };
+}
+
+#endif // CONTACT_JACOBIAN_H
@@ -7,12 +7,15 @@
 #define CONTROL_H
 
 #include <Pacer/robot.h>
+#include <Pacer/workers.h>
+#include <Pacer/profiler.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <set>
 
 namespace Pacer{
   
@@ -25,6 +28,20 @@ namespace Pacer{
   HIGHEST_PRIORITY = 0,
   LOWEST_PRIORITY = 10;
   
+  /**
+   * @brief When and in which order a plugin is updated.
+   */
+  struct plugin_schedule_t{
+    // update order within a tick [HIGHEST_PRIORITY..LOWEST_PRIORITY] or NON_REALTIME
+    int priority;
+    // update on every 'rate_divisor'-th tick (the plugin's real-time-factor) ...
+    unsigned rate_divisor;
+    // ... namely on ticks where (tick % rate_divisor) == (phase % rate_divisor)
+    unsigned phase;
+    
+    plugin_schedule_t(int p = LOWEST_PRIORITY, unsigned r = 1, unsigned ph = 0) : priority(p), rate_divisor(r), phase(ph) {}
+  };
+  
   class Controller : public Robot, public boost::enable_shared_from_this<Controller>
   {
   public:
@@ -49,23 +66,69 @@ namespace Pacer{
   public:
     void control(double t);
     
+    /**
+     * @brief Register update 'f' of plugin 'name' with 'schedule'.
+     *
+     * Plugins at priorities [HIGHEST_PRIORITY..LOWEST_PRIORITY] are updated on
+     * the ticks their schedule fires (see plugin_schedule_t), the controller
+     * decides this without calling into the plugin.  NON_REALTIME plugins are
+     * updated on a background thread (USE_THREADS) against a snapshot of the
+     * robot (state, contacts, variables and its own kinematic model) taken at
+     * the start of the tick the update was launched.  When an update
+     * finishes, its results are published at the start of the next tick, all
+     * at once, and the update is relaunched on a new snapshot; the control
+     * tick never waits for it (rate divisor and phase do not apply).
+     * Published results are the plugin's declared writes (variables and
+     * "state.<unit>", see declare_plugin_access()) or, without a declaration,
+     * the variables "<name>.*".  "<name>.result-time" holds the time of the
+     * snapshot the last published results were computed from.  A relaunch
+     * copies only the declared reads into the snapshot (all variables without a
+     * declaration), other variables keep their values from the first snapshot.
+     * Frames of copied Vector3d/Pose3d values are re-pointed at the receiving
+     * model's link frames, other frames are copied.
+     * NOTE: NON_REALTIME updates must access the robot through the controller
+     *       passed to 'f' (handles resolved in setup() refer to the live robot).
+     *       Without USE_THREADS they are updated last in every tick.
+     */
+    void add_plugin_update(const std::string& name,update_t f,const plugin_schedule_t& schedule);
+    
+    /// @brief Register update 'f' of plugin 'name' at 'priority', updated on every tick
     void add_plugin_update(int priority,const std::string& name,update_t f){
-      // Fix priority
-      if(priority > LOWEST_PRIORITY || priority < NON_REALTIME){
-        OUT_LOG(logERROR) << "Set priorities to range [-1,0.."<<LOWEST_PRIORITY<<"], -1 is for non-realtime processes (will only return data when complete)";
-        if(priority < NON_REALTIME)
-          priority = NON_REALTIME;
-        else if(priority > LOWEST_PRIORITY)
-          priority = LOWEST_PRIORITY;
-      }
-      
-      // Check if this function already has an updater
-      if(_name_priority_map.find(name) != _name_priority_map.end())
-        remove_plugin_update(name);
-      
-      // add plugin back in at new priority
-      _update_priority_map[priority][name] = f;
-      _name_priority_map[name] = priority;
+      add_plugin_update(name,f,plugin_schedule_t(priority));
+    }
+    
+    /**
+     * @brief Change the schedule of plugin 'name', returns false if it is not registered.
+     * Rate divisor and phase apply from the next tick, a new priority from the
+     * next call to update_plugins(); may be called from a plugin update.
+     */
+    bool set_plugin_schedule(const std::string& name,const plugin_schedule_t& schedule);
+    
+    /// @brief Current schedule of plugin 'name', returns false if it is not registered.
+    bool get_plugin_schedule(const std::string& name,plugin_schedule_t& schedule);
+    
+    /**
+     * @brief Declare the data plugin 'name' reads and writes during its update.
+     *
+     * Entries are variable names (as used with get_data/set_data), robot
+     * state units as "state.<unit>" (e.g., "state.position_goal", see
+     * state_resource()) or "model" for the kinematic model (set_model_state(),
+     * jacobians, link poses, center of mass).  Every kinematic query poses the
+     * shared model or fills its forward kinematics caches, so "model" is added
+     * to the writes unless 'uses_model' is false (the update never touches the
+     * model).  A trailing '*' matches any suffix (e.g., "LF_FOOT.*").  Plugins
+     * at the same priority whose declarations do not conflict may be updated
+     * concurrently (see "plugin-threads"), conflicting plugins keep their
+     * (name) order.  Plugins without a declaration are never run concurrently
+     * with any other plugin.
+     * Can also be declared in the configuration: <name>.reads / <name>.writes
+     * and <name>.uses-model (default true)
+     */
+    void declare_plugin_access(const std::string& name,const std::vector<std::string>& reads,const std::vector<std::string>& writes,bool uses_model = true);
+    
+    /// @brief Name of robot state unit 'u' in plugin access declarations
+    std::string state_resource(unit_e u){
+      return std::string("state.")+unit_enum_string(u);
     }
     
     void add_plugin_deconstructor(const std::string& name,update_t f){
@@ -92,6 +155,127 @@ namespace Pacer{
     std::map< std::string , int > _name_priority_map;
     std::vector<std::string> plugins_to_open, plugins_to_close;
     
+    // --------------- Concurrent plugin updates --------------- //
+    struct plugin_access_t{
+      std::set<std::string> reads, writes;
+      // controller phases entered by written state units (bit per ControllerPhase)
+      unsigned phase_mask;
+    };
+    std::map<std::string, plugin_access_t> _plugin_access_map;
+    
+    // priority --> dependency graph of plugin updates (in name order)
+    std::map<int , std::vector<dag_task_t> > _update_graph;
+    bool _update_graph_dirty;
+    WorkerPoolPtr _worker_pool;
+    
+    // arguments of the plugin updates in progress
+    const boost::shared_ptr<Controller>* _update_ctrl;
+    double _update_time;
+    
+    bool plugins_conflict(const std::string& a,const std::string& b);
+    void build_update_graph();
+    // --------------- Plugin schedules --------------- //
+    // rate of a plugin, read by the thread updating it and changed from any thread
+    struct plugin_rate_t{
+      std::atomic<unsigned> divisor, phase;
+      plugin_rate_t(unsigned d,unsigned p) : divisor(d), phase(p) {}
+      bool fires(uint64_t tick) const {
+        const unsigned d = divisor.load(std::memory_order_relaxed);
+        return d <= 1 || (tick % d) == (phase.load(std::memory_order_relaxed) % d);
+      }
+    };
+    std::map<std::string, boost::shared_ptr<plugin_rate_t> > _plugin_rate_map;
+    // priority changes requested by set_plugin_schedule(), applied in update_plugins()
+    std::map<std::string, int> _pending_priority_map;
+#ifdef USE_THREADS
+    pthread_mutex_t _schedule_mutex;
+#endif
+    // control ticks since init()
+    uint64_t _tick;
+    
+    void apply_pending_priorities();
+    
+    // --------------- Tick budget degradation --------------- //
+    /**
+     * Once "tick-budget" seconds have elapsed in a tick, plugins at priority
+     * "degrade-priority" or lower (higher number) are skipped for the rest of
+     * the tick.  A plugin skipped "degrade-max-skips" ticks in a row (0: no
+     * limit) is run regardless on the next tick.  A degradable plugin whose
+     * updates exceed "<name>.budget" in more than "degrade-overrun-ratio" of
+     * the last "degrade-window" ticks has its rate divisor (real-time-factor)
+     * doubled (up to "degrade-max-rtf").  Decisions are logged as telemetry series
+     * "<name>.degrade.{skip,forced,real-time-factor}" and "degrade.skipped".
+     */
+    struct degrade_t{
+      // update budget (ns), 0: not monitored for chronic overruns
+      int64_t budget;
+      unsigned consecutive_skips, window_updates, window_overruns;
+      degrade_t() : budget(0), consecutive_skips(0), window_updates(0), window_overruns(0) {}
+    };
+    // plugin --> degradation state (entries are only added on the control thread)
+    std::map<std::string, degrade_t> _degrade_map;
+    int64_t _tick_start, _tick_budget;
+    int _degrade_priority, _degrade_max_skips, _degrade_window, _degrade_max_rtf;
+    double _degrade_overrun_ratio;
+    // plugins skipped in the current tick
+    std::atomic<int> _degrade_skipped;
+    
+    bool skip_plugin_update(const std::string& name,degrade_t& degrade);
+    void account_plugin_update(const std::string& name,degrade_t& degrade,plugin_rate_t* rate,int64_t duration);
+    
+    // reads an integer option that may be declared as int or double
+    int get_int_option(const std::string& name,int default_value);
+    
+    void run_plugin_update(const std::string& name,update_t f,plugin_rate_t* rate,Profiler::section_t* section,degrade_t* degrade);
+    
+    // Profiler sections of the control tick (see Profiler, "profiling")
+    Profiler::section_t *_control_section, *_update_section, *_reset_contact_section;
+    static std::string plugin_section(const std::string& name){ return "plugin."+name; }
+    
+    // --------------- Background (NON_REALTIME) plugin updates --------------- //
+    struct background_job_t{
+      std::string name;
+      update_t update;
+      Controller* owner;
+      // robot the update runs against, built by the background thread (see 'ready') and
+      // only touched by the control thread while the job is idle
+      boost::shared_ptr<Controller> snapshot;
+      // time of the snapshot being processed
+      double time;
+      // resources published when an update finishes
+      std::set<std::string> writes;
+      // frames of the controller's model --> those of the snapshot's model, and back
+      frame_map_t to_snapshot, from_snapshot;
+      // results of the last finished update
+      std::vector<data_slot_ptr> data;
+      std::vector<std::pair<unit_e,Ravelin::VectorNd> > state;
+      std::string error;
+      Profiler::section_t* section;
+      bool ready, running, done, stop;
+      unsigned long launched, published;
+#ifdef USE_THREADS
+      pthread_t thread;
+      pthread_mutex_t mutex;
+      pthread_cond_t cond;
+#endif
+      background_job_t(const std::string& n,update_t f,Controller* c) : name(n), update(f), owner(c),
+        time(0), section(NULL), ready(false), running(false), done(false), stop(false), launched(0), published(0) {}
+    };
+    std::map<std::string, boost::shared_ptr<background_job_t> > _background_jobs;
+    // true for the snapshots background plugins run against
+    bool _is_snapshot;
+    
+    boost::shared_ptr<Controller> create_snapshot();
+    void build_background_snapshot(background_job_t& job);
+    static void clone_rebased(Controller& from,const std::set<std::string>* resources,const frame_map_t& frames,std::vector<data_slot_ptr>& data);
+    void update_background_plugins(double t);
+    void stop_background_job(const std::string& name);
+    void run_background_job(background_job_t& job);
+    void publish_background_results(background_job_t& job);
+#ifdef USE_THREADS
+    static void* background_thread(void* arg);
+#endif
+    
     bool reload_plugin(const std::string& name){
       remove_plugin(name);
       return init_plugin(name);
@@ -100,12 +284,17 @@ namespace Pacer{
     bool init_plugin(const std::string& name);
     bool remove_plugin(const std::string& plugin_name);
     void remove_plugin_update(const std::string& name){
+      stop_background_job(name);
       (*_plugin_deconstruct_map[name])(this->ptr(),0);
       
       //delete _update_priority_map.at(_name_priority_map.at(name)).at(name)->second;
       _update_priority_map[_name_priority_map[name]].erase(name);
       _name_priority_map.erase(name);
       _plugin_deconstruct_map.erase(name);
+      _plugin_access_map.erase(name);
+      _degrade_map.erase(name);
+      _plugin_rate_map.erase(name);
+      _update_graph_dirty = true;
       
     }
     
@@ -132,6 +321,10 @@ namespace Pacer{
     
   private:
     ControllerPhase controller_phase;
+#ifdef USE_THREADS
+    // serializes phase checks/changes of concurrently updated plugins
+    pthread_mutex_t _phase_mutex;
+#endif
     const char * enum_string(const ControllerPhase& e){
       int i = static_cast<int>(e);
       return (const char *[]) {
@@ -230,6 +423,7 @@ namespace Pacer{
     }
     
     void reset_phase(){
+      invalidate_dynamics();
       controller_phase = PERCEPTION;
       OUT_LOG(logINFO) << "-- SCHEDULER -- " << "Controller Phase reset: ==> PLANNING";
     }
@@ -266,7 +460,21 @@ namespace Pacer{
       }
     }
     
-    bool check_phase_internal(const unit_e& u){return check_phase( u, true);}
+    bool check_phase_internal(const unit_e& u){
+#ifdef USE_THREADS
+      pthread_mutex_lock(&_phase_mutex);
+      try {
+        bool result = check_phase( u, true);
+        pthread_mutex_unlock(&_phase_mutex);
+        return result;
+      } catch(...) {
+        pthread_mutex_unlock(&_phase_mutex);
+        throw;
+      }
+#else
+      return check_phase( u, true);
+#endif
+    }
 
   public:
     bool check_phase(const unit_e& u){ return check_phase( u, false); }
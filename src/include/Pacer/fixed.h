@@ -0,0 +1,214 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/MatrixNd.h>
+#include <cmath>
+
+namespace Pacer{
+namespace fixed{
+
+  /**
+   * @brief Compile time description of a robot topology.
+   *
+   * The kernels in this file take their sizes from a config_t, so for a
+   * fixed robot (e.g. the 12 dof quadruped, config_t<12,4>) every loop bound
+   * is a constant and the compiler is free to unroll and vectorize.
+   * Legs are assumed to have the same number of joints and the base to be
+   * floating.
+   */
+  template <unsigned JOINT_DOFS, unsigned LEGS>
+  struct config_t{
+    static_assert(LEGS > 0 && JOINT_DOFS % LEGS == 0, "joints must divide evenly between the legs");
+
+    static constexpr unsigned NUM_JOINT_DOFS = JOINT_DOFS;
+    static constexpr unsigned NUM_LEGS = LEGS;
+    static constexpr unsigned LEG_DOFS = JOINT_DOFS / LEGS;
+    /// generalized coordinates: [joints | base (6)]
+    static constexpr unsigned NDOFS = JOINT_DOFS + 6;
+    static constexpr unsigned NEULER = JOINT_DOFS + 7;
+    /// columns of a foot contact's Jacobian block (leg joints + base, see ContactJacobian)
+    static constexpr unsigned CONTACT_COLS = LEG_DOFS + 6;
+    /// rows of the stacked end effector IK system (3 per foot)
+    static constexpr unsigned IK_ROWS = 3 * LEGS;
+  };
+
+  /// Stack storage for N values
+  template <unsigned N>
+  struct vector_t{
+    alignas(32) double data[N];
+
+    double& operator[](unsigned i){ return data[i]; }
+    const double& operator[](unsigned i) const { return data[i]; }
+
+    void set_zero(){
+      for(unsigned i=0;i<N;i++)
+        data[i] = 0;
+    }
+    void get(Ravelin::VectorNd& v) const {
+      v.resize(N);
+      std::copy(data,data+N,v.data());
+    }
+  };
+
+  /// Stack storage for an R x C matrix, column major like Ravelin::MatrixNd
+  template <unsigned R, unsigned C>
+  struct matrix_t{
+    alignas(32) double data[R*C];
+
+    double& operator()(unsigned i, unsigned j){ return data[j*R+i]; }
+    const double& operator()(unsigned i, unsigned j) const { return data[j*R+i]; }
+
+    void set(const Ravelin::MatrixNd& M){
+      for(unsigned j=0;j<C;j++)
+        for(unsigned i=0;i<R;i++)
+          data[j*R+i] = M(i,j);
+    }
+    void get(Ravelin::MatrixNd& M) const {
+      M.resize(R,C);
+      for(unsigned j=0;j<C;j++)
+        for(unsigned i=0;i<R;i++)
+          M(i,j) = data[j*R+i];
+    }
+  };
+
+  /// @brief In place Cholesky factorization A = R'R of the N x N column major A
+  /// leaves R in the upper triangle and zeros below it (the layout of Ravelin::LinAlgd::factor_chol())
+  /// returns false if A is not positive definite
+  template <unsigned N>
+  bool factor_chol(double* A){
+    for(unsigned j=0;j<N;j++){
+      double* Aj = A + j*N;
+      for(unsigned i=0;i<j;i++){
+        const double* Ai = A + i*N;
+        double s = Aj[i];
+        for(unsigned k=0;k<i;k++)
+          s -= Ai[k] * Aj[k];
+        Aj[i] = s / Ai[i];
+      }
+      double d = Aj[j];
+      for(unsigned k=0;k<j;k++)
+        d -= Aj[k] * Aj[k];
+      if(!(d > 0))
+        return false;
+      Aj[j] = std::sqrt(d);
+      for(unsigned i=j+1;i<N;i++)
+        Aj[i] = 0;
+    }
+    return true;
+  }
+
+  /// @brief Solve R'R X = B in place for the K columns of the N x K column major B
+  template <unsigned N, unsigned K>
+  void solve_chol(const double* R, double* B){
+    for(unsigned c=0;c<K;c++){
+      double* b = B + c*N;
+      // R' z = b
+      for(unsigned i=0;i<N;i++){
+        const double* Ri = R + i*N;
+        double s = b[i];
+        for(unsigned k=0;k<i;k++)
+          s -= Ri[k] * b[k];
+        b[i] = s / Ri[i];
+      }
+      // R x = z
+      for(unsigned i=N;i-- > 0;){
+        double s = b[i];
+        for(unsigned k=i+1;k<N;k++)
+          s -= R[k*N+i] * b[k];
+        b[i] = s / R[i*N+i];
+      }
+    }
+  }
+
+  /// @brief Cholesky factor (M_chol) and inverse (iM) of the N x N generalized inertia
+  template <unsigned N>
+  bool factor_inertia(const Ravelin::MatrixNd& M, Ravelin::MatrixNd& M_chol, Ravelin::MatrixNd& iM){
+    matrix_t<N,N> R, X;
+    R.set(M);
+    if(!factor_chol<N>(R.data))
+      return false;
+    for(unsigned i=0;i<N*N;i++)
+      X.data[i] = 0;
+    for(unsigned i=0;i<N;i++)
+      X(i,i) = 1;
+    solve_chol<N,N>(R.data,X.data);
+    R.get(M_chol);
+    X.get(iM);
+    return true;
+  }
+
+  /// @brief Damped least squares step dx = J' (J J' + lambda I)^-1 e for the R x C column major J
+  /// returns false if the damped system could not be factored
+  template <unsigned R, unsigned C>
+  bool dls_step(const double* J, const double* e, double lambda, double* dx){
+    matrix_t<R,R> A;
+    for(unsigned k=0;k<R;k++)
+      for(unsigned i=k;i<R;i++){
+        double s = 0;
+        for(unsigned c=0;c<C;c++)
+          s += J[c*R+i] * J[c*R+k];
+        A(i,k) = A(k,i) = s;
+      }
+    for(unsigned i=0;i<R;i++)
+      A(i,i) += lambda;
+    if(!factor_chol<R>(A.data))
+      return false;
+
+    vector_t<R> y;
+    for(unsigned i=0;i<R;i++)
+      y[i] = e[i];
+    solve_chol<R,1>(A.data,y.data);
+
+    for(unsigned c=0;c<C;c++){
+      double s = 0;
+      for(unsigned i=0;i<R;i++)
+        s += J[c*R+i] * y[i];
+      dx[c] = s;
+    }
+    return true;
+  }
+
+  /// @brief 3 x 3 coupling W = Bi iM(ci,cj) Bj' of two K column contact Jacobian blocks
+  /// (Bi, Bj column major 3 x K, see ContactJacobian::mult_inertia_transpose())
+  template <unsigned K>
+  void contact_coupling(const double* Bi, const unsigned* ci, const double* Bj, const unsigned* cj,
+                        const Ravelin::MatrixNd& iM, double W[9]){
+    matrix_t<K,K> S;
+    for(unsigned b=0;b<K;b++)
+      for(unsigned a=0;a<K;a++)
+        S(a,b) = iM(ci[a],cj[b]);
+
+    // P = Bi S : 3 x K
+    matrix_t<3,K> P;
+    for(unsigned b=0;b<K;b++)
+      for(unsigned r=0;r<3;r++){
+        double s = 0;
+        for(unsigned a=0;a<K;a++)
+          s += Bi[a*3+r] * S(a,b);
+        P(r,b) = s;
+      }
+
+    // W = P Bj' : 3 x 3 (row major)
+    for(unsigned r=0;r<3;r++)
+      for(unsigned t=0;t<3;t++){
+        double s = 0;
+        for(unsigned b=0;b<K;b++)
+          s += P(r,b) * Bj[b*3+t];
+        W[r*3+t] = s;
+      }
+  }
+}
+
+#ifdef PACER_FIXED_JOINT_DOFS
+  /// Topology the fixed size kernels are compiled for (cmake FIXED_JOINT_DOFS, FIXED_LEGS)
+  typedef fixed::config_t<PACER_FIXED_JOINT_DOFS,PACER_FIXED_LEGS> fixed_config;
+#endif
+}
+
+#endif // FIXED_H
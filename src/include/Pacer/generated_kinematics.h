@@ -0,0 +1,41 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef GENERATED_KINEMATICS_H
+#define GENERATED_KINEMATICS_H
+
+/// Symbol a generated kinematics library exports (see pacer_generated_kinematics_fn)
+#define PACER_GENERATED_KINEMATICS_SYMBOL "pacer_generated_kinematics"
+
+namespace Pacer{
+
+  /**
+   * @brief Forward kinematics of one end effector chain as straight-line code.
+   *
+   * Emitted by pacer-kinematics-codegen (src/main/kinematics_codegen.cpp) and
+   * loaded by Robot::load_generated_kinematics().  'q' holds the chain
+   * coordinates in end_effector_t::chain order (coords[k] is the generalized
+   * coordinate of q[k]).
+   */
+  struct generated_chain_t{
+    const char* end_effector;
+    unsigned num_coords;
+    const unsigned* coords;
+    /// p: end effector origin in the base link frame
+    /// J (if not NULL): 6 x num_coords column major Jacobian at p in base link orientation, rows [linear; angular]
+    void (*kinematics)(const double* q, double* p, double* J);
+  };
+
+  struct generated_kinematics_t{
+    // robot model the code was generated from
+    const char* model;
+    unsigned num_chains;
+    const generated_chain_t* chains;
+  };
+
+  typedef const generated_kinematics_t* (*pacer_generated_kinematics_fn)();
+}
+
+#endif // GENERATED_KINEMATICS_H
@@ -0,0 +1,139 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+
+namespace Pacer{
+
+  /**
+   * @brief Running histogram of durations (nanoseconds).
+   *
+   * 'num_buckets' linear buckets of 'resolution' ns, the last bucket also
+   * counts every larger sample.  add() is O(1) and never allocates, so it can
+   * be called from a real-time loop; min, max and mean are exact, percentiles
+   * are accurate to one bucket.
+   */
+  class Histogram{
+  public:
+    Histogram(int64_t resolution = 1000, unsigned num_buckets = 2000)
+    : _resolution(resolution), _buckets(num_buckets,0) { reset(); }
+
+    void add(int64_t ns){
+      if(ns < 0)
+        ns = 0;
+      const uint64_t i = ns / _resolution;
+      _buckets[(i < _buckets.size())? i : _buckets.size()-1]++;
+      _count++;
+      _sum += ns;
+      if(ns < _min) _min = ns;
+      if(ns > _max) _max = ns;
+    }
+
+    void reset(){
+      std::fill(_buckets.begin(),_buckets.end(),0);
+      _count = 0;
+      _sum = 0;
+      _min = std::numeric_limits<int64_t>::max();
+      _max = 0;
+    }
+
+    uint64_t count() const { return _count; }
+    int64_t min() const { return (_count)? _min : 0; }
+    int64_t max() const { return _max; }
+    double mean() const { return (_count)? (double) _sum / (double) _count : 0; }
+
+    /// @brief Upper edge (ns) of the bucket holding the p-th fraction (0..1) of samples (clamped to max())
+    int64_t percentile(double p) const {
+      if(_count == 0)
+        return 0;
+      const double rank = p * (double) _count;
+      uint64_t seen = 0;
+      for(unsigned i=0;i<_buckets.size();i++){
+        seen += _buckets[i];
+        if(seen > 0 && (double) seen >= rank){
+          const int64_t upper = (int64_t) (i+1) * _resolution;
+          return (upper < _max)? upper : _max;
+        }
+      }
+      return _max;
+    }
+
+    int64_t resolution() const { return _resolution; }
+    const std::vector<uint64_t>& buckets() const { return _buckets; }
+
+  private:
+    friend class AtomicHistogram;
+
+    int64_t _resolution;
+    std::vector<uint64_t> _buckets;
+    uint64_t _count;
+    int64_t _sum, _min, _max;
+  };
+
+  /**
+   * @brief Histogram that may be added to and read from several threads without locks.
+   *
+   * Counters are updated with relaxed atomics: a concurrent snapshot() can be
+   * off by the samples being added while it is taken, never corrupted.
+   */
+  class AtomicHistogram{
+  public:
+    AtomicHistogram(int64_t resolution = 1000, unsigned num_buckets = 2000)
+    : _resolution(resolution), _num_buckets(num_buckets), _buckets(new std::atomic<uint64_t>[num_buckets]) { reset(); }
+    ~AtomicHistogram(){ delete [] _buckets; }
+
+    void add(int64_t ns){
+      if(ns < 0)
+        ns = 0;
+      const uint64_t i = ns / _resolution;
+      _buckets[(i < _num_buckets)? i : _num_buckets-1].fetch_add(1,std::memory_order_relaxed);
+      _sum.fetch_add(ns,std::memory_order_relaxed);
+      int64_t m = _min.load(std::memory_order_relaxed);
+      while(ns < m && !_min.compare_exchange_weak(m,ns,std::memory_order_relaxed));
+      m = _max.load(std::memory_order_relaxed);
+      while(ns > m && !_max.compare_exchange_weak(m,ns,std::memory_order_relaxed));
+    }
+
+    void reset(){
+      for(unsigned i=0;i<_num_buckets;i++)
+        _buckets[i].store(0,std::memory_order_relaxed);
+      _sum.store(0,std::memory_order_relaxed);
+      _min.store(std::numeric_limits<int64_t>::max(),std::memory_order_relaxed);
+      _max.store(0,std::memory_order_relaxed);
+    }
+
+    /// @brief Copy the current counts into 'h' (for percentiles etc.)
+    void snapshot(Histogram& h) const {
+      h._resolution = _resolution;
+      h._buckets.resize(_num_buckets);
+      h._count = 0;
+      for(unsigned i=0;i<_num_buckets;i++){
+        h._buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        h._count += h._buckets[i];
+      }
+      h._sum = _sum.load(std::memory_order_relaxed);
+      h._min = _min.load(std::memory_order_relaxed);
+      h._max = _max.load(std::memory_order_relaxed);
+    }
+
+  private:
+    AtomicHistogram(const AtomicHistogram&);
+    AtomicHistogram& operator =(const AtomicHistogram&);
+
+    int64_t _resolution;
+    unsigned _num_buckets;
+    std::atomic<uint64_t>* _buckets;
+    std::atomic<int64_t> _sum, _min, _max;
+  };
+}
+
+#endif // HISTOGRAM_H
@@ -43,29 +43,41 @@ std::ostream& operator << (std::ostream& os, const std::map<std::string, T >& v)
   return os;
 }
 
-#ifdef LOG_TO_FILE
+#if defined(LOG_TO_FILE) || defined(USE_TELEMETRY)
 
-void OUTLOG(const std::map<std::string,Ravelin::VectorNd>& z, std::string name,TLogLevel LL);
-void OUTLOG(const std::map<std::string,double>& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::MatrixNd& M, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::SharedConstMatrixNd& M, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Matrix3d& M, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Pose3d& P, std::string name,TLogLevel LL);
-void OUTLOG(const boost::shared_ptr<Ravelin::Pose3d>& P, std::string name,TLogLevel LL);
-void OUTLOG(const boost::shared_ptr<const Ravelin::Pose3d>& P, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::VectorNd& z, std::string name,TLogLevel LL);
-void OUTLOG(const std::vector<double>& z, std::string name,TLogLevel LL);
-void OUTLOG(const std::vector<int>& z, std::string name,TLogLevel LL);
-void OUTLOG(const std::vector<std::string>& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::SVector6d& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Origin3d& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Vector3d& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Vector2d& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::SharedVectorNd& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::AAngled& z, std::string name,TLogLevel LL);
-void OUTLOG(const Ravelin::Quatd& z, std::string name,TLogLevel LL);
-void OUTLOG(const std::string& z, std::string name,TLogLevel LL);
-void OUTLOG(double x, std::string name,TLogLevel LL);
+#ifdef USE_TELEMETRY
+#include <Pacer/telemetry.h>
+typedef Pacer::Telemetry::site_t outlog_site_t;
+// Each call site keeps (per thread) the telemetry id of the series it records,
+// so a sample costs no series lookup while its name and width do not change
+#define OUTLOG(value,name,LL) \
+  do { static thread_local outlog_site_t outlog_site_; outlog(value,name,LL,&outlog_site_); } while(0)
+#else
+struct outlog_site_t;
+#define OUTLOG(value,name,LL) outlog(value,name,LL,(outlog_site_t*) NULL)
+#endif
+
+void outlog(const std::map<std::string,Ravelin::VectorNd>& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const std::map<std::string,double>& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::MatrixNd& M, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::SharedConstMatrixNd& M, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Matrix3d& M, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Pose3d& P, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const boost::shared_ptr<Ravelin::Pose3d>& P, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const boost::shared_ptr<const Ravelin::Pose3d>& P, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::VectorNd& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const std::vector<double>& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const std::vector<int>& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const std::vector<std::string>& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::SVector6d& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Origin3d& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Vector3d& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Vector2d& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::SharedVectorNd& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::AAngled& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const Ravelin::Quatd& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(const std::string& z, std::string name,TLogLevel LL, outlog_site_t* site);
+void outlog(double x, std::string name,TLogLevel LL, outlog_site_t* site);
 #else
 #define OUTLOG(value,name,stream)
 #endif
@@ -0,0 +1,76 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <Pacer/histogram.h>
+#include <boost/function.hpp>
+#include <stdint.h>
+
+namespace Pacer{
+
+  /**
+   * @brief Runs a function at a fixed rate on absolute (CLOCK_MONOTONIC) deadlines.
+   *
+   * Deadline k is start + k*period, so compute time does not accumulate as
+   * drift.  A tick finishing after the next deadline is an overrun; deadlines
+   * that have already passed are skipped (counted as missed periods) instead
+   * of being run back to back.
+   *
+   * The calling thread can optionally be moved to SCHED_FIFO, have its memory
+   * locked (mlockall) and be pinned to a CPU.  Each of these is best effort:
+   * when not permitted (e.g., no CAP_SYS_NICE) a warning is logged and the
+   * loop runs without it.
+   */
+  class PeriodicExecutor{
+  public:
+    struct options_t{
+      // seconds between deadlines
+      double period;
+      // SCHED_FIFO priority [1..99], 0: keep the default scheduler
+      int priority;
+      // lock current and future pages in memory
+      bool lock_memory;
+      // CPU to pin the loop to, -1: no pinning
+      int cpu;
+
+      options_t() : period(0.001), priority(0), lock_memory(false), cpu(-1) {}
+    };
+
+    PeriodicExecutor(const options_t& options);
+
+    /**
+     * @brief Calls tick(t) on every deadline until it returns false.
+     * t is the time (s) of the deadline since the first one, the first call
+     * has t = 0.
+     */
+    void run(const boost::function<bool (double)>& tick);
+
+    /// @brief Time from a deadline to the start of its tick
+    const Histogram& wakeup_latency() const { return _wakeup_latency; }
+    /// @brief Time spent in tick()
+    const Histogram& compute_time() const { return _compute_time; }
+
+    uint64_t ticks() const { return _ticks; }
+    /// @brief Ticks that finished after the next deadline
+    uint64_t overruns() const { return _overruns; }
+    /// @brief Deadlines skipped after overruns
+    uint64_t missed_periods() const { return _missed_periods; }
+
+    const options_t& options() const { return _options; }
+
+  private:
+    // applies scheduling, memory locking and affinity to the calling thread
+    void setup_thread();
+
+    options_t _options;
+    int64_t _period;
+    Histogram _wakeup_latency, _compute_time;
+    uint64_t _ticks, _overruns, _missed_periods;
+  };
+}
+
+#endif // PERIODIC_H
@@ -0,0 +1,132 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Pacer/histogram.h>
+
+#include <map>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <time.h>
+#include <boost/shared_ptr.hpp>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+namespace Pacer{
+
+  /**
+   * @brief Timing of named code sections (plugin updates, Controller phases).
+   *
+   * Every section keeps a call count, an overrun count (calls longer than the
+   * section's budget, if set) and a histogram of call durations.  Sections are
+   * registered once and never removed, so a section_t* stays valid and can be
+   * cached; recording into a section is lock free and may happen concurrently
+   * with queries from other threads.
+   *
+   * Timing is compiled in with USE_PROFILING (cmake PROFILING) and switched on
+   * at runtime with enabled() ("profiling" in vars.xml).
+   */
+  class Profiler{
+  public:
+    struct section_t{
+      section_t(const std::string& n) : name(n), budget(0), time(1000,5000), calls(0), overruns(0) {}
+
+      const std::string name;
+      // calls taking longer than this (ns) are overruns, 0: no budget
+      std::atomic<int64_t> budget;
+      AtomicHistogram time;
+      std::atomic<uint64_t> calls, overruns;
+
+      void record(int64_t ns){
+        time.add(ns);
+        calls.fetch_add(1,std::memory_order_relaxed);
+        const int64_t b = budget.load(std::memory_order_relaxed);
+        if(b > 0 && ns > b)
+          overruns.fetch_add(1,std::memory_order_relaxed);
+      }
+    };
+
+    struct summary_t{
+      std::string name;
+      uint64_t calls, overruns;
+      // seconds
+      double budget, mean, p50, p99, max, total;
+    };
+
+    static Profiler& instance();
+
+    /// @brief Runtime switch, sections are not timed while false.
+    static bool& enabled();
+
+    /// @brief Section 'name' (registered on first use)
+    section_t* section(const std::string& name);
+
+    /// @brief Calls to section 'name' longer than 'seconds' count as overruns (0: no budget)
+    void set_budget(const std::string& name, double seconds);
+
+    /// @brief Statistics of section 'name', returns false if it was never registered
+    bool get_summary(const std::string& name, summary_t& summary);
+
+    /// @brief Statistics of all sections (in name order)
+    void get_summaries(std::vector<summary_t>& summaries);
+
+    /// @brief Table of all sections
+    void dump(std::ostream& out);
+
+    /// @brief Clear the statistics of all sections (budgets are kept)
+    void reset();
+
+    static int64_t now(){
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC,&ts);
+      return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+  private:
+    Profiler();
+    Profiler(const Profiler&);
+    Profiler& operator =(const Profiler&);
+
+    static void summarize(const section_t& section, summary_t& summary);
+
+    std::map<std::string, boost::shared_ptr<section_t> > _sections;
+#ifdef USE_THREADS
+    pthread_mutex_t _mutex;
+#endif
+  };
+
+  /**
+   * @brief Times its own lifetime into a Profiler section (if profiling is enabled).
+   */
+  class ProfileScope{
+  public:
+    ProfileScope(Profiler::section_t* section) : _section(Profiler::enabled()? section : NULL) {
+      if(_section)
+        _start = Profiler::now();
+    }
+    ~ProfileScope(){
+      if(_section)
+        _section->record(Profiler::now() - _start);
+    }
+  private:
+    Profiler::section_t* _section;
+    int64_t _start;
+  };
+}
+
+#ifdef USE_PROFILING
+# define PROFILE_CONCAT_(a,b) a##b
+# define PROFILE_CONCAT(a,b) PROFILE_CONCAT_(a,b)
+/// Time the rest of the enclosing scope into section 'section' (a Profiler::section_t*)
+# define PROFILE_SCOPE(section) Pacer::ProfileScope PROFILE_CONCAT(profile_scope_,__LINE__)(section)
+#else
+# define PROFILE_SCOPE(section)
+#endif
+
+#endif // PROFILER_H
@@ -11,16 +11,22 @@
 #include <Ravelin/RCArticulatedBodyd.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 #include <boost/icl/type_traits/to_string.hpp>
 
 #include <Pacer/output.h>
+#include <Pacer/variables.h>
+#include <Pacer/workspace.h>
+#include <Pacer/contact_jacobian.h>
+#include <Pacer/fixed.h>
+#include <Pacer/generated_kinematics.h>
 
 #include <numeric>
+#include <algorithm>
 #include <math.h>
 #include <cmath>
 #include <sys/types.h>
 #include <sys/times.h>
-#include <boost/any.hpp>
 #ifdef USE_THREADS
 #include <pthread.h>
 #endif
@@ -39,6 +45,12 @@ namespace Pacer{
   public:
     
     Robot(){
+#ifdef USE_THREADS
+      pthread_mutex_init(&_data_map_mutex,NULL);
+      pthread_mutex_init(&_state_mutex,NULL);
+      pthread_mutex_init(&_end_effector_state_mutex,NULL);
+      pthread_mutex_init(&_dynamics_mutex,NULL);
+#endif
     }
     
   protected:
@@ -51,15 +63,26 @@ namespace Pacer{
     struct is_pointer<T*> { static const bool value = true; };
     
     // Map for storing arbitrary data
-    std::map< std::string , boost::any > _data_map;
+    std::map< std::string , data_slot_ptr > _data_map;
 #ifdef USE_THREADS
     pthread_mutex_t _data_map_mutex;
 #endif
     
-    // Returns 'true' if new key was created in map
-    bool set_data_internal(const std::string& n, boost::any to_append);
-    // Returns 'true' if new key was created in map
-    bool get_data_internal(const std::string& n, boost::any& operand);
+    // Returns the slot for variable 'n' or a null pointer if it was never declared
+    data_slot_ptr find_data_slot(const std::string& n);
+    // Returns the slot stored for variable 'n', inserting 'slot' if 'n' is
+    // undeclared or declared with another type (old slot is marked unset)
+    data_slot_ptr insert_data_slot(const std::string& n, const data_slot_ptr& slot);
+    
+    template<class T>
+    boost::shared_ptr<data_slot<T> > resolve_data_slot(const std::string& n){
+      data_slot_ptr slot = find_data_slot(n);
+      if(!slot || slot->type() != typeid(T)){
+        // declare (or re-declare with a new type)
+        slot = insert_data_slot(n,data_slot_ptr(new data_slot<T>(n)));
+      }
+      return boost::static_pointer_cast<data_slot<T> >(slot);
+    }
     
   public:
     
@@ -70,29 +93,30 @@ namespace Pacer{
       if(is_pointer<T>::value){
         throw std::runtime_error("Can't save pointers! : " + n);
       }
-      return set_data_internal(n,v);
+      variable_handle<T> h(resolve_data_slot<T>(n));
+      return h.set(v);
     }
     
     void remove_data(std::string n);
 
     template<class T>
     T get_data(std::string n){
-      T v;
+      data_slot_ptr slot = find_data_slot(n);
       
-      using boost::any_cast;
-      boost::any operand;
-      
-      if(get_data_internal(n,operand)){
-        try
-        {
-          v = any_cast<T>(operand);
+      if(slot){
+        slot->lock();
+        const bool exists = slot->exists;
+        if(exists && slot->type() == typeid(T)){
+          T v = static_cast<data_slot<T>*>(slot.get())->value;
+          slot->unlock();
+          OUT_LOG(logINFO) << "Get: " << n << " ("<< slot->type().name() <<") --> " << v;
+          return v;
         }
-        catch(const boost::bad_any_cast &)
+        slot->unlock();
+        if(exists)
         {
-          throw std::runtime_error("Variable: \"" + n + "\" was requested as '" + typeid(T).name() + "' but is actually '" + operand.type().name() + "'");
+          throw std::runtime_error("Variable: \"" + n + "\" was requested as '" + typeid(T).name() + "' but is actually '" + slot->type().name() + "'");
         }
-        OUT_LOG(logINFO) << "Get: " << n << " ("<< operand.type().name() <<") --> " << v;
-        return v;
       }
       
       // else
@@ -113,6 +137,27 @@ namespace Pacer{
       }
     }
     
+    /// @brief Resolve a typed handle to variable 'n' (see variable_handle).
+    /// The variable does not need to exist yet, the handle sees it once set.
+    template<class T>
+    variable_handle<T> get_data_handle(const std::string& n){
+      if(is_pointer<T>::value){
+        throw std::runtime_error("Can't save pointers! : " + n);
+      }
+      data_slot_ptr slot = find_data_slot(n);
+      if(slot && slot->type() != typeid(T) && slot->is_set()){
+        throw std::runtime_error("Variable: \"" + n + "\" was requested as '" + typeid(T).name() + "' but is actually '" + slot->type().name() + "'");
+      }
+      return variable_handle<T>(resolve_data_slot<T>(n));
+    }
+    
+  protected:
+    /// @brief Appends copies of the variables whose names pass 'select' (default: all) to 'slots'
+    void clone_data(std::vector<data_slot_ptr>& slots, const boost::function<bool (const std::string&)>& select = boost::function<bool (const std::string&)>());
+    
+    /// @brief Stores (copies of) 'slots' in the data map in one critical section,
+    /// readers using the string API see either none or all of them.
+    void publish_data(const std::vector<data_slot_ptr>& slots);
     
     /// ---------------------------  Getters  ---------------------------
   public:
@@ -147,6 +192,48 @@ namespace Pacer{
       // For locomotion, this informs us if this link should be used to calculate a jocobian
       bool                   active;
       bool                   stance;
+      
+      // chain coordinates of the last inverse kinematics solution (warm start)
+      Ravelin::VectorNd      ik_solution;
+      
+      // end effectors whose chains share joints with this one
+      std::vector<end_effector_t*> shared_chains;
+      
+      /// Forward kinematics of the chain, maintained by Robot::set_chain_state()
+      struct fk_cache_t{
+        // Robot model version the cache refers to (see Robot::set_model_coordinates())
+        unsigned long version;
+        // chain coordinates the joints are posed at (empty: as set by the model)
+        Ravelin::VectorNd q;
+        // chain_links[i] -> GLOBAL, entries [0,stale) are out of date
+        std::vector<Ravelin::Transform3d> link_transform;
+        unsigned stale;
+        
+        fk_cache_t() : version(0), stale(0) {}
+      };
+      mutable fk_cache_t fk;
+      
+      // straight-line kinematics of the chain (see load_generated_kinematics()), NULL: use the model
+      const generated_chain_t* generated;
+      
+      end_effector_t() : generated(NULL) {}
+    };
+    
+    /**
+     * @brief Settings of the whole body inverse kinematics solver
+     */
+    struct ik_options_t{
+      // every end effector within 'tolerance' (m) of its goal
+      double tolerance;
+      // initial Levenberg-Marquardt damping
+      double damping;
+      unsigned max_iterations;
+      // wall time (s) allowed per solve, 0: no limit
+      double time_budget;
+      // start each chain from its previous solution when that is closer to the goal
+      bool warm_start;
+      
+      ik_options_t() : tolerance(1e-4), damping(1e-3), max_iterations(100), time_budget(0), warm_start(true) {}
     };
     
   private:
@@ -248,29 +335,57 @@ namespace Pacer{
     }
     
   private:
-    std::map<unit_e , std::map<std::string, Ravelin::VectorNd > > _state;
-    std::map<unit_e , Ravelin::VectorNd> _base_state;
+    /**
+     * @brief Contiguous range of generalized coordinates belonging to one joint.
+     */
+    struct joint_span_t{
+      unsigned offset;  // generalized coordinate of the joint's first dof
+      unsigned dofs;    // number of dofs
+    };
+    
+    // unit --> dense generalized vector: [joints (NUM_JOINT_DOFS) | base]
+    // base is NEULER (position, position_goal) or NSPATIAL (others) wide
+    std::vector<Ravelin::VectorNd> _state;
     std::map<unit_e , std::map<std::string, Ravelin::Origin3d > > _end_effector_state;
     std::map<std::string, bool > _end_effector_is_set;
     
 #ifdef USE_THREADS
     pthread_mutex_t _state_mutex;
-    pthread_mutex_t _base_state_mutex;
     pthread_mutex_t _end_effector_state_mutex;
 #endif
-    // TODO: Populate these value in Robot::compile()
     
     // JOINT_NAME --> {gcoord_dof1,...}
     std::map<std::string,std::vector<int> > _id_dof_coord_map;
     
     // gcoord --> (JOINT_NAME,dof)
     std::map<int,std::pair<std::string, int> > _coord_id_map;
-
+    
+    // JOINT_NAME --> span in generalized coordinates (populated in compile())
+    std::map<std::string,joint_span_t> _id_span_map;
+    // spans ordered as _joint_ids
+    std::vector<joint_span_t> _joint_spans;
+    
+    const joint_span_t& get_joint_span(const std::string& id) const {
+      std::map<std::string,joint_span_t>::const_iterator it = _id_span_map.find(id);
+      if(it == _id_span_map.end())
+        throw std::runtime_error("Joint: \"" + id + "\" is not a known (actuated) joint!");
+      return (*it).second;
+    }
+    
+    Ravelin::VectorNd& state_vector(unit_e u){ return _state[u]; }
+    
+    unsigned num_base_dof(unit_e u) const {
+      return (u == position || u == position_goal)? NEULER : NSPATIAL;
+    }
+    
   protected:
     virtual bool check_phase_internal(const unit_e& u) = 0;
 
   public:
-    int get_joint_dofs(const std::string& id){ return _id_dof_coord_map[id].size(); }
+    int get_joint_dofs(const std::string& id){
+      std::map<std::string,joint_span_t>::const_iterator it = _id_span_map.find(id);
+      return (it == _id_span_map.end())? 0 : (*it).second.dofs;
+    }
     
     //////////////////////////////////////////////////////
     /// ------------ GET/SET JOINT value  ------------ ///
@@ -296,6 +411,14 @@ namespace Pacer{
     void set_joint_value(unit_e u,const std::map<std::string,std::vector<double> >& id_dof_val_map);
     
     void set_joint_value(unit_e u,const std::map<std::string,Ravelin::VectorNd >& id_dof_val_map);
+    
+    /// @brief Read-only view of joint 'id' in the state store (no copy).
+    /// NOTE: View is not guarded by the state mutex and is invalidated by init_state().
+    Ravelin::SharedConstVectorNd get_joint_value_view(const std::string& id, unit_e u){
+      const joint_span_t& span = get_joint_span(id);
+      const Ravelin::VectorNd& x = state_vector(u);
+      return x.segment(span.offset,span.offset+span.dofs);
+    }
     /// ------------- GENERALIZED VECTOR CONVERSIONS  ------------- ///
     
     
@@ -303,13 +426,11 @@ namespace Pacer{
       generalized_vec.set_zero(NUM_JOINT_DOFS);
       std::map<std::string,std::vector<double> >::const_iterator it;
       for(it=id_dof_val_map.begin();it!=id_dof_val_map.end();it++){
-        const std::vector<int>& dof = _id_dof_coord_map[(*it).first];
+        const joint_span_t& span = get_joint_span((*it).first);
         const std::vector<double>& dof_val = (*it).second;
-        if(dof.size() != dof_val.size())
-          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof.size())+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
-        for(int j=0;j<(*it).second.size();j++){
-          generalized_vec[dof[j]] = dof_val[j];
-        }
+        if(span.dofs != dof_val.size())
+          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
+        std::copy(dof_val.begin(),dof_val.end(),generalized_vec.data()+span.offset);
       }
     }
     
@@ -317,15 +438,12 @@ namespace Pacer{
     void convert_to_generalized(const std::map<std::string,std::vector<T> >& id_dof_val_map, std::vector<T>& generalized_vec){
       typename std::map<std::string,std::vector<T> >::const_iterator it;
       generalized_vec.resize(NUM_JOINT_DOFS);
-      it = id_dof_val_map.begin();
       for(it=id_dof_val_map.begin();it!=id_dof_val_map.end();it++){
-        const std::vector<int>& dof = _id_dof_coord_map[(*it).first];
+        const joint_span_t& span = get_joint_span((*it).first);
         const std::vector<T>& dof_val = (*it).second;
-        if(dof.size() != dof_val.size())
-          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof.size())+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
-        for(int j=0;j<(*it).second.size();j++){
-          generalized_vec[dof[j]] = dof_val[j];
-        }
+        if(span.dofs != dof_val.size())
+          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
+        std::copy(dof_val.begin(),dof_val.end(),generalized_vec.begin()+span.offset);
       }
     }
     
@@ -334,13 +452,11 @@ namespace Pacer{
       generalized_vec.set_zero(NUM_JOINT_DOFS);
       std::map<std::string,Ravelin::VectorNd >::const_iterator it;
       for(it=id_dof_val_map.begin();it!=id_dof_val_map.end();it++){
-        const std::vector<int>& dof = _id_dof_coord_map[(*it).first];
+        const joint_span_t& span = get_joint_span((*it).first);
         const Ravelin::VectorNd& dof_val = (*it).second;
-        if(dof.size() != dof_val.rows())
-          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof.size())+" , provided="+boost::icl::to_string<double>::apply(dof_val.rows()));
-        for(int j=0;j<(*it).second.rows();j++){
-          generalized_vec[dof[j]] = dof_val[j];
-        }
+        if(span.dofs != dof_val.rows())
+          throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.rows()));
+        generalized_vec.set_sub_vec(span.offset,dof_val);
       }
     }
     
@@ -357,11 +473,8 @@ namespace Pacer{
     template <typename T>
     std::map<std::string,std::vector<T> > make_id_value_map(){
       std::map<std::string,std::vector<T> > id_dof_val_map;
-      std::map<std::string,std::vector<int> >::iterator it;
-      for(it=_id_dof_coord_map.begin();it!=_id_dof_coord_map.end();it++){
-        const std::vector<int>& dof = (*it).second;
-        std::vector<T>& dof_val = id_dof_val_map[(*it).first];
-        dof_val.resize(dof.size());
+      for(int i=0;i<_joint_ids.size();i++){
+        id_dof_val_map[_joint_ids[i]].resize(_joint_spans[i].dofs);
       }
       return id_dof_val_map;
     }
@@ -371,16 +484,10 @@ namespace Pacer{
       if(generalized_vec.size() != NUM_JOINT_DOFS)
         throw std::runtime_error("Missized generalized vector: internal="+boost::icl::to_string<double>::apply(NUM_JOINT_DOFS)+" , provided="+boost::icl::to_string<double>::apply(generalized_vec.size()));
       
-      //      std::map<std::string,std::vector<int> >::iterator it;
-      std::vector<std::string> keys = get_map_keys(_id_dof_coord_map);
-      
-      for(int i=0;i<keys.size();i++){
-        const std::vector<int>& dof = _id_dof_coord_map[keys[i]];
-        std::vector<T>& dof_val = id_dof_val_map[keys[i]];
-        dof_val.resize(dof.size());
-        for(int j=0;j<dof.size();j++){
-          dof_val[j] = generalized_vec[dof[j]];
-        }
+      for(int i=0;i<_joint_ids.size();i++){
+        const joint_span_t& span = _joint_spans[i];
+        typename std::vector<T>::const_iterator start = generalized_vec.begin()+span.offset;
+        id_dof_val_map[_joint_ids[i]].assign(start,start+span.dofs);
       }
     }
     
@@ -389,16 +496,10 @@ namespace Pacer{
       if(generalized_vec.rows() != NUM_JOINT_DOFS)
         throw std::runtime_error("Missized generalized vector: internal="+boost::icl::to_string<double>::apply(NUM_JOINT_DOFS)+" , provided="+boost::icl::to_string<double>::apply(generalized_vec.rows()));
       
-      //      std::map<std::string,std::vector<int> >::iterator it;
-      std::vector<std::string> keys = get_map_keys(_id_dof_coord_map);
-      
-      for(int i=0;i<keys.size();i++){
-        const std::vector<int>& dof = _id_dof_coord_map[keys[i]];
-        std::vector<double>& dof_val = id_dof_val_map[keys[i]];
-        dof_val.resize(dof.size());
-        for(int j=0;j<dof.size();j++){
-          dof_val[j] = generalized_vec[dof[j]];
-        }
+      for(int i=0;i<_joint_ids.size();i++){
+        const joint_span_t& span = _joint_spans[i];
+        const double* start = generalized_vec.data()+span.offset;
+        id_dof_val_map[_joint_ids[i]].assign(start,start+span.dofs);
       }
     }
     
@@ -406,16 +507,9 @@ namespace Pacer{
       if(generalized_vec.rows() != NUM_JOINT_DOFS)
         throw std::runtime_error("Missized generalized vector: internal="+boost::icl::to_string<double>::apply(NUM_JOINT_DOFS)+" , provided="+boost::icl::to_string<double>::apply(generalized_vec.rows()));
       
-      //      std::map<std::string,std::vector<int> >::iterator it;
-      std::vector<std::string> keys = get_map_keys(_id_dof_coord_map);
-      
-      for(int i=0;i<keys.size();i++){
-        const std::vector<int>& dof = _id_dof_coord_map[keys[i]];
-        Ravelin::VectorNd& dof_val = id_dof_val_map[keys[i]];
-        dof_val.resize(dof.size());
-        for(int j=0;j<dof.size();j++){
-          dof_val[j] = generalized_vec[dof[j]];
-        }
+      for(int i=0;i<_joint_ids.size();i++){
+        const joint_span_t& span = _joint_spans[i];
+        generalized_vec.get_sub_vec(span.offset,span.offset+span.dofs,id_dof_val_map[_joint_ids[i]]);
       }
     }
     
@@ -433,6 +527,12 @@ namespace Pacer{
     /// With Base
     Ravelin::VectorNd get_generalized_value(unit_e u);
     
+    /// @brief Read-only reference to the dense state vector (joints | base) for unit 'u', no copy.
+    /// NOTE: Not guarded by the state mutex and invalidated by init_state().
+    const Ravelin::VectorNd& get_generalized_value_ref(unit_e u){
+      return state_vector(u);
+    }
+    
     void set_base_value(unit_e u,const Ravelin::VectorNd& vec);
     
     void get_base_value(unit_e u, Ravelin::VectorNd& vec);
@@ -456,6 +556,12 @@ namespace Pacer{
     void init_state();
     
     void reset_state();
+    
+    /// @brief Copy the state, end effector state and contacts of 'robot' (same model) into this robot
+    void copy_state(Robot& robot);
+    
+    /// @brief Overwrite state unit 'u' without a phase check (publishes background results)
+    void assign_state(unit_e u, const Ravelin::VectorNd& v);
   protected:
     
     /// @brief Sets up robot after construction and parameter import
@@ -476,30 +582,84 @@ namespace Pacer{
     void calc_com();
     
     /// @brief Set Plugin internal model to input state
+    /// (the link poses are only recomputed if the model is not already at q)
     void set_model_state(const Ravelin::VectorNd& q,const Ravelin::VectorNd& qd = Ravelin::VectorNd::zero(0));
     
+    /**
+     * @brief Poses the chain of 'foot' at chain coordinates x (in foot.chain order).
+     *
+     * Only joints whose coordinates differ from the cached ones are re-posed,
+     * and only the links outboard of them are marked for recomputation.  The
+     * rest of the articulated body is not updated.
+     */
+    void set_chain_state(const end_effector_t& foot, const Ravelin::VectorNd& x);
+    
+    /// @brief Transform from chain_links[i] of 'foot' to GLOBAL (cached, computed outboard from the base)
+    const Ravelin::Transform3d& get_chain_link_transform(const end_effector_t& foot, unsigned i);
+    
+    /// @brief GLOBAL position of the origin of the end effector link of 'foot' (cached)
+    Ravelin::Vector3d get_end_effector_position(const end_effector_t& foot);
+    
+    /// @brief Center of mass (GLOBAL) of the model, chain links are taken from the cache
+    Ravelin::Vector3d calc_center_of_mass(double& total_mass);
+    
+    /// @brief Drop cached kinematics, call after changing the model through get_abrobot()
+    void invalidate_kinematics();
+    
+    /**
+     * @brief Use the end effector kinematics of a library written by pacer-kinematics-codegen.
+     *
+     * Each generated chain is checked against calc_jacobian() at a few
+     * configurations around the current state, chains that disagree with the
+     * model are not used.  link_jacobian() and dist_to_goal() of the end
+     * effectors with generated kinematics no longer traverse the model.
+     * Returns the number of end effectors using generated kinematics.
+     */
+    unsigned load_generated_kinematics(const std::string& library);
+    
+    /**
+     * Kinematics routines
+     *
+     * Each routine has an overload taking a Workspace that holds all of its
+     * temporaries, the other overload uses Workspace::local().  They still
+     * pose the kinematic model of this Robot, concurrent calls need a Robot
+     * (e.g., a Controller snapshot) per thread.
+     */
+    
     /// @brief Calculate N (normal), S (1st tangent), T (2nd tangent) contact jacobians
     void calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c ,Ravelin::MatrixNd& N,Ravelin::MatrixNd& S,Ravelin::MatrixNd& T);
+    void calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c ,Ravelin::MatrixNd& N,Ravelin::MatrixNd& S,Ravelin::MatrixNd& T, Workspace& ws);
+    
+    /// @brief Blocked contact jacobian: per contact, only the coordinates of the contact link's chain and the base
+    /// (copied from the memoized one, J keeps its blocks' storage across calls)
+    void calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c, ContactJacobian& J);
+    void calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c, ContactJacobian& J, Workspace& ws);
         
     /// @brief Calculate 6x(N+6) jacobian for point(in frame) on link at state q
+    /// (memoized per (link, point) for the last q until invalidate_dynamics())
     Ravelin::MatrixNd calc_jacobian(const Ravelin::VectorNd& q, const std::string& link, Ravelin::Origin3d point);
     
     /// @brief Resolved Motion Rate control (iterative inverse kinematics)
     /// iterative inverse kinematics for a 3d (linear) goal
     void RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::Origin3d& goal,Ravelin::VectorNd& q_des, double TOL = 1e-4);
+    void RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::Origin3d& goal,Ravelin::VectorNd& q_des, double TOL, Workspace& ws);
     
     /// @brief Resolved Motion Rate control (iterative inverse kinematics)
     /// iterative inverse kinematics for a 6d (linear and angular) goal
     void RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::VectorNd& goal,Ravelin::VectorNd& q_des, double TOL = 1e-4);
+    void RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::VectorNd& goal,Ravelin::VectorNd& q_des, double TOL, Workspace& ws);
     
     /// @brief N x 3d kinematics
     Ravelin::VectorNd& link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk);
+    Ravelin::VectorNd& link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk, Workspace& ws);
     
     /// @brief N x 6d Jacobian
     Ravelin::MatrixNd& link_jacobian(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, Ravelin::MatrixNd& gk);
+    Ravelin::MatrixNd& link_jacobian(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, Ravelin::MatrixNd& gk, Workspace& ws);
     
     /// @brief N x 6d kinematics
     Ravelin::VectorNd& link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::VectorNd& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk);
+    Ravelin::VectorNd& link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::VectorNd& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk, Workspace& ws);
     
     Ravelin::VectorNd& dist_to_goal(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& dist);
     
@@ -513,9 +673,102 @@ namespace Pacer{
                                          Ravelin::VectorNd& q_des,
                                          Ravelin::VectorNd& qd_des,
                                          Ravelin::VectorNd& qdd_des, double TOL = 1e-4);
+    void end_effector_inverse_kinematics(
+                                         const std::vector<std::string>& foot_id,
+                                         const std::vector<Ravelin::Origin3d>& foot_pos,
+                                         const std::vector<Ravelin::Origin3d>& foot_vel,
+                                         const std::vector<Ravelin::Origin3d>& foot_acc,
+                                         const Ravelin::VectorNd& q,
+                                         Ravelin::VectorNd& q_des,
+                                         Ravelin::VectorNd& qd_des,
+                                         Ravelin::VectorNd& qdd_des, double TOL, Workspace& ws);
     
+    /**
+     * @brief Solves for joint positions placing every listed end effector at
+     * its goal (GLOBAL frame), and for the joint velocities and accelerations
+     * producing the goal end effector velocities and accelerations.
+     *
+     * All end effectors are solved together with damped least squares
+     * (Levenberg-Marquardt).  Trial steps only pose the joints of the chains
+     * involved.  Returns false when the tolerance was not met within the
+     * iteration or time budget, q_des then holds the best solution found.
+     */
+    bool end_effector_inverse_kinematics(
+                                         const std::vector<std::string>& foot_id,
+                                         const std::vector<Ravelin::Origin3d>& foot_pos,
+                                         const std::vector<Ravelin::Origin3d>& foot_vel,
+                                         const std::vector<Ravelin::Origin3d>& foot_acc,
+                                         const Ravelin::VectorNd& q,
+                                         Ravelin::VectorNd& q_des,
+                                         Ravelin::VectorNd& qd_des,
+                                         Ravelin::VectorNd& qdd_des, const ik_options_t& options, Workspace& ws);
+    
+    /**
+     * Per-tick dynamics
+     *
+     * The generalized inertia, its factorization and the contact jacobians
+     * are memoized: repeated requests for the same q (and contact set) return
+     * the stored results until invalidate_dynamics() (called by the
+     * Controller at the start of every tick and by reset_phase()).
+     */
+    
+    /// @brief Generalized inertia at q
     void calc_generalized_inertia(const Ravelin::VectorNd& q, Ravelin::MatrixNd& M);
     
+    /// Cholesky factor (LinAlgd::factor_chol) and inverse of a generalized inertia
+    struct inertia_factor_t{
+      /// M is positive definite (M_chol is set)
+      bool ok;
+      /// iM is set
+      bool inverse;
+      Ravelin::MatrixNd M_chol, iM;
+      
+      inertia_factor_t() : ok(false), inverse(false) {}
+      
+      /// @brief Factor M, and invert it if 'with_inverse', returns ok
+      bool factor(const Ravelin::MatrixNd& M, bool with_inverse, Ravelin::LinAlgd& LA){
+        inverse = false;
+#ifdef PACER_FIXED_JOINT_DOFS
+        if(M.rows() == fixed_config::NDOFS && M.columns() == fixed_config::NDOFS){
+          if(with_inverse)
+            return (inverse = ok = fixed::factor_inertia<fixed_config::NDOFS>(M,M_chol,iM));
+          fixed::matrix_t<fixed_config::NDOFS,fixed_config::NDOFS> R;
+          R.set(M);
+          if((ok = fixed::factor_chol<fixed_config::NDOFS>(R.data)))
+            R.get(M_chol);
+          return ok;
+        }
+#endif
+        M_chol = M;
+        ok = LA.factor_chol(M_chol);
+        if(with_inverse)
+          invert(LA);
+        return ok;
+      }
+      
+      /// @brief Compute iM from M_chol if not done yet
+      void invert(Ravelin::LinAlgd& LA){
+        if(!ok || inverse)
+          return;
+        iM.set_identity(M_chol.rows());
+        LA.solve_chol_fast(M_chol,iM);
+        inverse = true;
+      }
+    };
+    
+    /// @brief Factorization of generalized inertia M into 'f', with its inverse if
+    /// 'inverse', returns f.ok (false if M is not positive definite).  Memoized for
+    /// the M last returned by calc_generalized_inertia() (copied out under the lock),
+    /// the inverse is only computed once requested.  Any other M is factored on
+    /// every call.
+    bool factor_generalized_inertia(const Ravelin::MatrixNd& M, inertia_factor_t& f, bool inverse = true);
+    
+    /// @brief Factor and inverse of M (see above), returns ok
+    bool factor_generalized_inertia(const Ravelin::MatrixNd& M, Ravelin::MatrixNd& M_chol, Ravelin::MatrixNd& iM);
+    
+    /// @brief Drop memoized dynamics
+    void invalidate_dynamics();
+    
     const boost::shared_ptr<Ravelin::RigidBodyd> get_root_link(){return _root_link;}
     
     int joint_dofs(){return NUM_JOINT_DOFS;}
@@ -542,6 +795,8 @@ namespace Pacer{
 //    std::map<std::string,boost::shared_ptr<Ravelin::RigidBodyd> > _id_end_effector_map;
     boost::shared_ptr<Ravelin::RigidBodyd> _root_link;
     std::map<std::string,boost::shared_ptr<Ravelin::Jointd> > _id_joint_map;
+    // generalized coordinates moving each link (inner joints up to the base, then the base), ascending
+    std::map<std::string,std::vector<unsigned> > _id_link_coords_map;
     std::vector<std::string> _link_ids;
     std::vector<std::string> _joint_ids;
     std::vector<std::string> _end_effector_ids;
@@ -553,6 +808,71 @@ namespace Pacer{
 
     std::vector<bool> _disabled_dofs;
     
+    // Kinematic model state: generalized coordinates last set by
+    // set_model_coordinates() (valid unless joints were posed since) and a
+    // version bumped on every full pose update
+    Ravelin::VectorNd _model_q;
+    bool _model_q_valid = false;
+    unsigned long _model_version = 1;
+    
+    // poses the model at the (full, Euler) generalized coordinates q
+    void set_model_coordinates(const Ravelin::VectorNd& q);
+    
+    // brings the cache of 'foot' to the current model version
+    void sync_fk_cache(const end_effector_t& foot);
+    
+    // generated kinematics of 'foot' at x: end effector origin (GLOBAL), J (6 x chain, base link orientation) if not NULL
+    Ravelin::Vector3d generated_kinematics(const end_effector_t& foot, const Ravelin::VectorNd& x, double* J);
+    
+    // compares 'chain' with the model kinematics of 'foot'
+    bool check_generated_kinematics(const end_effector_t& foot, const generated_chain_t& chain);
+    
+    // compares the fixed size kernels (Pacer/fixed.h) with the Ravelin routines they replace,
+    // on the inertia of the current model state
+    bool check_fixed_kernels();
+    
+    // memoized contact jacobians of 'c' at q (_dynamics_mutex held)
+    const ContactJacobian& memoized_contact_jacobians(const Ravelin::VectorNd& q, const std::vector<boost::shared_ptr<contact_t> >& c, Workspace& ws);
+    
+    // projects the jacobians of contacts 'c' at the current model state
+    void calc_contact_jacobian_blocks(const std::vector<boost::shared_ptr<contact_t> >& c, ContactJacobian& J, Workspace& ws);
+    
+    // Memoized dynamics (see invalidate_dynamics())
+    struct dynamics_cache_t{
+      // M at q
+      bool inertia_valid;
+      Ravelin::VectorNd q;
+      Ravelin::MatrixNd M;
+      // factorization of M (attempted)
+      bool factor_valid;
+      inertia_factor_t factor;
+      // contact jacobians at contact_q for 'contacts'
+      bool jacobians_valid;
+      Ravelin::VectorNd contact_q;
+      std::vector<contact_t> contacts;
+      ContactJacobian J;
+      // calc_jacobian() results at jacobian_q, the first num_jacobians are valid
+      struct jacobian_t{
+        std::string link;
+        Ravelin::Origin3d point;
+        Ravelin::MatrixNd J;
+      };
+      Ravelin::VectorNd jacobian_q;
+      std::vector<jacobian_t> jacobians;
+      unsigned num_jacobians;
+      
+      dynamics_cache_t() : inertia_valid(false), factor_valid(false), jacobians_valid(false), num_jacobians(0) {}
+    } _dynamics;
+#ifdef USE_THREADS
+    pthread_mutex_t _dynamics_mutex;
+#endif
+    
+    // Variables published on every tick by update() (resolved in init_robot())
+    variable_handle<Ravelin::VectorNd>
+      _generalized_q_handle, _generalized_qd_handle,
+      _generalized_qdd_handle, _generalized_fext_handle,
+      _q_handle, _qd_handle, _qdd_handle;
+    
     /// set up internal models after kineamtic model is set (called from init)
     void compile();
   };
@@ -0,0 +1,484 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef SOLVERS_H
+#define SOLVERS_H
+
+#include <Ravelin/LinAlgd.h>
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/MatrixNd.h>
+#include <Moby/LCP.h>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <string>
+#include <random>
+
+namespace Pacer{
+
+  /**
+   * @brief LCP solvers (w = Mz + q, w >= 0, z >= 0, z'w = 0) with their own state.
+   *
+   * All temporaries, and the random number generator breaking pivoting
+   * ties in lcp_fast(), are members, so separate LCPSolvers can be used
+   * from separate threads and give repeatable results for a given seed.
+   * Utility::lcp_fast() and Utility::lcp_symm_iter() use local(), the
+   * instance of the calling thread.
+   */
+  class LCPSolver{
+  public:
+    LCPSolver(unsigned seed = 0) : compare_moby(false), _rng(seed), _ld(0), _n(0), _updates(0) {}
+
+    /// @brief Restart the pivoting tie breaks from 'seed'
+    void seed(unsigned seed) { _rng.seed(seed); }
+
+    /// Pivoting counters of lcp_fast()
+    struct lcp_fast_stats_t{
+      lcp_fast_stats_t() : calls(0), warm_starts(0), warm_hits(0), pivots(0), total_pivots(0) {}
+      unsigned calls;
+      /// calls warm started from z, of those solved without pivoting
+      unsigned warm_starts, warm_hits;
+      /// pivots of the last call and of all calls
+      unsigned pivots, total_pivots;
+    };
+
+    /// @brief Fast pivoting for degenerate, monotone LCPs with few nonzero, nonbasic variables
+    /// indices: foot of each variable, z: if of size q.rows(), used as a warm start
+    bool lcp_fast(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const std::vector<unsigned>& indices, Ravelin::VectorNd& z, double zero_tol);
+
+    const lcp_fast_stats_t& lcp_fast_stats() const { return _fast_stats; }
+
+    /// @brief Projected symmetric SOR for symmetric M [Murty 1988]
+    bool lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER);
+
+    /// Result of the last lcp_pgs()
+    struct pgs_stats_t{
+      pgs_stats_t() : iterations(0), error(0), omega(0) {}
+      unsigned iterations;
+      /// complementarity error max_i |min(z_i, w_i)|
+      double error;
+      /// relaxation factor reached
+      double omega;
+    };
+
+    /**
+     * @brief Projected Gauss-Seidel / SOR with early exit
+     *
+     * M is copied to padded row major storage so each update is a 4 wide
+     * dot product (AVX if the build targets it).  The complementarity error
+     * is checked every few sweeps; the solver stops once it is below
+     * tol * (1 + max|q|) and shrinks the relaxation factor when the error
+     * grows (grows it again, up to 1.9, while the error keeps falling).
+     * z: if of size q.rows(), used as the starting point
+     * returns true if the error tolerance was reached within max_iter sweeps
+     */
+    bool lcp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double tol = 1e-8, unsigned max_iter = 1000, double omega = 1.0);
+
+    const pgs_stats_t& pgs_stats() const { return _pgs_stats; }
+
+    /// Pivoting counters of lcp_lemke()
+    struct lemke_stats_t{
+      lemke_stats_t() : calls(0), warm_starts(0), warm_hits(0), pivots(0), total_pivots(0), refactorizations(0), moby_checks(0), moby_mismatches(0) {}
+      unsigned calls;
+      /// calls starting from the last basis, of those solved by it without pivoting
+      unsigned warm_starts, warm_hits;
+      /// pivots of the last call and of all calls
+      unsigned pivots, total_pivots;
+      unsigned refactorizations;
+      /// calls checked against Moby (compare_moby), of those solved by only one of the two
+      unsigned moby_checks, moby_mismatches;
+    };
+
+    /**
+     * @brief Lemke's method keeping the basis inverse between pivots and calls
+     *
+     * The explicit inverse of the basis is updated in O(n^2) per pivot (a
+     * rank-1, product form update) and recomputed from scratch (Gauss-Jordan
+     * elimination with partial pivoting) every few updates to bound round
+     * off.  The complementary basis of the solution is kept: the next call
+     * of the same size starts by refactoring it, which solves the LCP
+     * outright if the active set has not changed (e.g. a tick with the same
+     * contacts), and otherwise runs Lemke from that basis with the covering
+     * vector B*1.  A warm start that fails is retried cold.  A solution is
+     * accepted if w >= 0 and w_i = 0 for every basic z_i (within tolerance).
+     * piv_tol, zero_tol < 0: computed from the size and norm of M
+     */
+    bool lcp_lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double piv_tol = -1.0, double zero_tol = -1.0);
+
+    /// @brief lcp_lemke(), retried on M + 10^k I for k = min_exp, min_exp + step_exp, ..., max_exp
+    /// (the semantics of Moby::LCP::lcp_lemke_regularized()); every attempt starts from the
+    /// basis kept before the first one
+    bool lcp_lemke_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp = -20, unsigned step_exp = 4, int max_exp = 20, double piv_tol = -1.0, double zero_tol = -1.0);
+
+    /// @brief Forget the basis kept for warm starts
+    void reset_lemke() { _lemke_basis.clear(); }
+
+    const lemke_stats_t& lemke_stats() const { return _lemke_stats; }
+
+    /// if set, lcp_lemke() also solves every problem with Moby::LCP::lcp_lemke()
+    /// and counts (and logs) the problems only one of the two solves (debugging)
+    bool compare_moby;
+
+    /// @brief Solver of the calling thread
+    static LCPSolver& local();
+
+  private:
+    unsigned rand_min(const Ravelin::VectorNd& v, double zero_tol);
+    unsigned select_pivot(const Ravelin::VectorNd& znbas, const std::vector<unsigned>& nonbas, const std::vector<unsigned>& indices, double zero_tol);
+    bool pivot(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const std::vector<unsigned>& indices, Ravelin::VectorNd& z, double zero_tol);
+
+    std::mt19937 _rng;
+
+    // lcp_fast
+    std::vector<unsigned> _minima, _neg, _repeated;
+    std::vector<unsigned> _nonbas, _bas;
+    std::vector<bool> _represented;
+    Ravelin::MatrixNd _Msub, _Mmix;
+    Ravelin::VectorNd _z, _qbas, _w;
+    Ravelin::LinAlgd _LA;
+    lcp_fast_stats_t _fast_stats;
+
+    // lcp_symm_iter
+    std::vector<Ravelin::VectorNd> _rows;
+    Ravelin::MatrixNd _L, _G, _U;
+    Ravelin::VectorNd _row, _znew;
+
+    // lcp_pgs: M row major with rows padded to _ld, z padded likewise
+    double pgs_error(const Ravelin::VectorNd& q) const;
+    unsigned _ld;
+    std::vector<double> _Mrow, _zpad, _idiag;
+    pgs_stats_t _pgs_stats;
+
+    // lcp_lemke: basic variable labels (w_i: i, z_i: n+i, z0: 2n), basis inverse (column major)
+    bool lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, bool warm, double piv_tol, double zero_tol);
+    void lemke_column(const Ravelin::MatrixNd& M, unsigned label, double* a) const;
+    bool lemke_refactor(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q);
+    void lemke_pivot(unsigned r, unsigned label);
+    unsigned _n;
+    std::vector<unsigned> _basis, _lemke_basis, _lemke_start;
+    std::vector<double> _Binv, _B, _xB, _col, _u, _d;
+    unsigned _updates;
+    Ravelin::MatrixNd _MR;
+    // compare_moby
+    Moby::LCP _moby;
+    Ravelin::VectorNd _z_moby;
+    lemke_stats_t _lemke_stats;
+  };
+
+  /**
+   * @brief Convex QP solver (through LCPs) keeping its workspace between calls.
+   *
+   * The LCP matrices and vectors are members that only grow, so repeated
+   * solves of problems of similar size do not allocate.  A QPSolver is not
+   * thread safe; keep one per caller (see QPSolverPtr) or use local(), the
+   * instance of the calling thread behind Utility::solve_qp().
+   */
+  class QPSolver{
+  public:
+    QPSolver() {}
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. Ax >= b, x >= 0
+    /// v: LCP solution [x;lambda], used as the starting point if warm_start and updated on success
+    bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, Ravelin::VectorNd& v, bool warm_start = false, bool regularize = true);
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. x >= 0
+    bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, Ravelin::VectorNd& x, bool warm_start = false);
+
+    /**
+     * @brief min 1/2 x'Qx + c'x  s.t. Ax >= b (x free)
+     *
+     * With Q positive definite the LCP is posed in the multipliers only,
+     *   x = inv(Q)(A'lambda - c),  w = A inv(Q) A' lambda - (A inv(Q) c + b),
+     * (m variables), otherwise x is split into positive and negative parts
+     * (2n + m variables).
+     */
+    bool solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x);
+
+    /// @brief Solver of the calling thread
+    static QPSolver& local();
+
+  private:
+    bool solve_lcp(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z);
+    bool lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, bool regularize, double zero_tol);
+    bool solve_qp_split(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x);
+
+    Moby::LCP _lcp;
+    LCPSolver _lcp_solver;
+    Ravelin::LinAlgd _LA;
+    // LCP
+    Ravelin::MatrixNd _MMM;
+    Ravelin::VectorNd _zzz, _qqq;
+    // problem data
+    Ravelin::MatrixNd _AT, _Q_chol, _iQAT;
+    Ravelin::VectorNd _iQc;
+  };
+
+  typedef boost::shared_ptr<QPSolver> QPSolverPtr;
+
+  /**
+   * @brief Dense dual active set solver for the small convex QPs of inverse dynamics.
+   *
+   * Solves the problems of QPSolver without going through Lemke.  The
+   * constraints C = [A; I] (the identity rows only for solve_qp_pos()) are
+   * handled in their multipliers lambda >= 0,
+   *   x = inv(Q)(C'lambda - c),
+   * adding the most violated constraint and dropping multipliers that reach
+   * zero (Goldfarb-Idnani), with the Cholesky factor of the active block of
+   * C inv(Q) C' extended in place as constraints are added.
+   *
+   * The active set of the last solution is kept and becomes the starting
+   * set of the next solve when the problem has the same dimensions and
+   * contact indices (the contacts are the same feet as on the last tick),
+   * so a tick usually costs a factorization and a couple of iterations.
+   * The factorization of Q is reused while Q does not change.
+   *
+   * A Q that is only PSD is regularized by 'regularization' * (1 + max(diag(Q))).  If the
+   * iteration stalls or the solution fails its feasibility check the problem
+   * is handed to a QPSolver (Lemke), counted in stats().fallbacks, unless
+   * 'fallback' is cleared (QPChain tries Lemke as a method of its own).  Not
+   * thread safe; keep one instance per problem so warm starts are not shared.
+   */
+  class ActiveSetQP{
+  public:
+    struct stats_t{
+      stats_t() : solves(0), warm_starts(0), iterations(0), total_iterations(0), fallbacks(0) {}
+      unsigned solves, warm_starts;
+      /// active set changes of the last solve and of all solves
+      unsigned iterations, total_iterations;
+      unsigned fallbacks;
+    };
+
+    ActiveSetQP() : max_iterations(0), regularization(1e-8), tolerance(1e-10), fallback(true), _n(0), _m(0), _p(0), _pos(false) {}
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. Ax >= b, x >= 0
+    /// indices: contact indices of the problem, same_indices: contacts are unchanged since the last tick
+    bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices);
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. Ax >= b (x free)
+    bool solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices);
+
+    /// @brief Forget the active set, the next solve starts cold
+    void reset() { _active.clear(); _indices.clear(); }
+
+    const stats_t& stats() const { return _stats; }
+
+    /// active set changes before falling back (0: 10 * number of constraints)
+    unsigned max_iterations;
+    double regularization, tolerance;
+    /// hand failed problems to Lemke (otherwise solve fails)
+    bool fallback;
+
+  private:
+    bool solve(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool pos, const std::vector<unsigned>& indices, bool same_indices);
+    bool iterate(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool warm);
+    bool factor_Q(const Ravelin::MatrixNd& Q);
+    bool add_active(unsigned j);
+    void refactor_active();
+    void solve_active(double* y) const;
+    bool fall_back(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x);
+
+    QPSolver _fallback;
+    Ravelin::VectorNd _v;
+
+    // problem: n variables, m general constraints, p = m (+ n) constraints in C
+    unsigned _n, _m, _p;
+    bool _pos;
+    std::vector<unsigned> _indices;
+
+    // Q (as given), Cholesky factor of regularized Q and inv(Q), column major n x n
+    std::vector<double> _Q, _Q_chol, _iQ;
+    // dual problem: H = C inv(Q) C' (p x p), h = -(C inv(Q) c + d)
+    std::vector<double> _H, _h, _iQc, _iQAT;
+    // active set, its Cholesky factor (upper, leading dimension p) and multipliers
+    std::vector<unsigned> _active;
+    std::vector<bool> _is_active;
+    std::vector<double> _R, _lambda, _u, _w, _y;
+
+    stats_t _stats;
+  };
+
+  typedef boost::shared_ptr<ActiveSetQP> ActiveSetQPPtr;
+
+  /**
+   * @brief Ordered list of solver methods, tried until one solves the problem.
+   *
+   * Base of LCPChain and QPChain.  A method succeeds if it returns a finite
+   * solution with an error (defined by the chain) below tolerance times the
+   * scale of the problem data.
+   *
+   * Each method keeps exponentially weighted averages of its latency and
+   * success rate (starting from a success rate of 1, so a single failure
+   * does not rule a method out).  If 'adaptive' is set (default false: the
+   * configured order), the methods are tried in increasing order of expected
+   * cost, latency / success rate (which minimizes the expected time to a
+   * solution for independent attempts), once every method has been called at
+   * least once; until then, and on ties, the configured order is kept.
+   *
+   * Adaptive chains also explore: every 'explore_interval' solves, the method
+   * not leading the order that was attempted longest ago is tried first, so
+   * every method is eventually called and a method whose record is stale
+   * (e.g. it failed on a few hard problems) is measured again.  Not thread
+   * safe.
+   */
+  class SolverChain{
+  public:
+    struct stats_t{
+      stats_t() : calls(0), successes(0), time(0), latency(0), success_rate(1), error(0) {}
+      unsigned calls, successes;
+      /// total time (s), averaged time per call (s) and success rate
+      double time, latency, success_rate;
+      /// error of the solution of the last call
+      double error;
+    };
+
+    virtual ~SolverChain() {}
+
+    const std::vector<std::string>& methods() const { return _names; }
+    const stats_t& stats(unsigned i) const { return _stats[i]; }
+    /// method that solved the last problem, -1 if none did
+    int last() const { return _last; }
+
+    bool adaptive;
+    double tolerance;
+    /// weight of the latest call in the averages of stats_t
+    double smoothing;
+    /// solves between two explorations of an adaptive chain (0: never explore)
+    unsigned explore_interval;
+
+  protected:
+    SolverChain(const std::string& label) : adaptive(false), tolerance(1e-6), smoothing(0.05), explore_interval(50), _label(label), _last(-1), _solves(0) {}
+
+    /// @brief Start over with these methods (names already checked) and fresh stats
+    void set_names(const std::vector<std::string>& names);
+
+    /// @brief Try the methods in order, a method succeeds if attempt() returns an error <= tol
+    bool run(double tol);
+
+    /// @brief Solve the current problem with method i, returns the error of the solution
+    /// (infinity if the method failed)
+    virtual double attempt(unsigned i) = 0;
+
+  private:
+    std::string _label;
+    std::vector<std::string> _names;
+    std::vector<stats_t> _stats;
+    std::vector<unsigned> _order;
+    int _last;
+    // solves so far, and the solve each method was last attempted in (0: never)
+    unsigned long _solves;
+    std::vector<unsigned long> _last_attempt;
+  };
+
+  /**
+   * @brief Ordered list of LCP methods, tried until one solves the problem.
+   *
+   * Methods (by name):
+   *   "lcp-fast"   LCPSolver::lcp_fast(), warm started (needs the indices of all variables)
+   *   "moby-fast"  Moby::LCP::lcp_fast()
+   *   "qp"         ActiveSetQP on min 1/2 z'Mz + q'z s.t. z >= 0 (symmetric M only), warm started
+   *   "lemke"      LCPSolver::lcp_lemke_regularized()
+   *   "moby-lemke" Moby::LCP::lcp_lemke_regularized()
+   *   "pgs"        LCPSolver::lcp_pgs() (projected SOR)
+   * A method succeeds if it returns a finite z with complementarity error
+   * max_i |min(z_i, w_i)| below tolerance * (1 + max|q|).
+   */
+  class LCPChain : public SolverChain{
+  public:
+    typedef SolverChain::stats_t stats_t;
+
+    /// throws std::runtime_error on an unknown method name
+    LCPChain(const std::vector<std::string>& methods);
+
+    /// @brief Replace the methods, throws std::runtime_error on an unknown method name
+    void set_methods(const std::vector<std::string>& methods);
+
+    /**
+     * @brief Solve w = Mz + q, w >= 0, z >= 0, z'w = 0
+     * indices: foot of each variable, same_indices: contacts are unchanged since the last solve
+     * z: if of size q.rows(), used as a warm start by the methods that take one
+     */
+    bool solve(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const std::vector<unsigned>& indices, Ravelin::VectorNd& z, bool same_indices);
+
+    /// solver behind "lcp-fast", "lemke" and "pgs" (for its pivoting counters)
+    const LCPSolver& lcp() const { return _lcp; }
+    LCPSolver& lcp() { return _lcp; }
+
+  private:
+    enum method_t { LCP_FAST, MOBY_FAST, QP, LEMKE, MOBY_LEMKE, PGS };
+    double attempt(unsigned i);
+    double error(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const Ravelin::VectorNd& z);
+
+    std::vector<method_t> _methods;
+
+    // problem of the current solve()
+    const Ravelin::MatrixNd* _M;
+    const Ravelin::VectorNd* _q;
+    const std::vector<unsigned>* _indices;
+    Ravelin::VectorNd* _z;
+    bool _same_indices;
+
+    LCPSolver _lcp;
+    Moby::LCP _moby;
+    ActiveSetQP _qp;
+    Ravelin::MatrixNd _A;
+    Ravelin::VectorNd _b, _z0, _w;
+  };
+
+  typedef boost::shared_ptr<LCPChain> LCPChainPtr;
+
+  /**
+   * @brief Ordered list of QP methods, tried until one solves the problem.
+   *
+   * Methods (by name):
+   *   "active-set" ActiveSetQP (without its own Lemke fallback), warm started from
+   *                the last active set while the contacts are unchanged
+   *   "lemke"      QPSolver, the LCP of the optimality conditions by Lemke
+   * A method succeeds if it returns a finite x violating Ax >= b (and x >= 0
+   * for solve_qp_pos()) by at most tolerance * (1 + max|b|).  Both methods
+   * are exact, so optimality is not checked again.
+   */
+  class QPChain : public SolverChain{
+  public:
+    typedef SolverChain::stats_t stats_t;
+
+    /// throws std::runtime_error on an unknown method name
+    QPChain(const std::vector<std::string>& methods);
+
+    /// @brief Replace the methods, throws std::runtime_error on an unknown method name
+    void set_methods(const std::vector<std::string>& methods);
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. Ax >= b, x >= 0
+    /// indices: contact indices of the problem, same_indices: contacts are unchanged since the last solve
+    bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices);
+
+    /// @brief min 1/2 x'Qx + c'x  s.t. Ax >= b (x free)
+    bool solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices);
+
+    /// engine behind "active-set" (for its iteration counters)
+    const ActiveSetQP& active_set() const { return _active_set; }
+
+  private:
+    enum method_t { ACTIVE_SET, LEMKE };
+    bool solve(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool pos, const std::vector<unsigned>& indices, bool same_indices);
+    double attempt(unsigned i);
+    double error(const Ravelin::VectorNd& x);
+
+    std::vector<method_t> _methods;
+
+    // problem of the current solve()
+    const Ravelin::MatrixNd* _Q, * _A;
+    const Ravelin::VectorNd* _c, * _b;
+    const std::vector<unsigned>* _indices;
+    Ravelin::VectorNd* _x;
+    bool _pos, _same_indices;
+
+    ActiveSetQP _active_set;
+    QPSolver _lemke;
+    Ravelin::VectorNd _v, _x0, _w;
+  };
+
+  typedef boost::shared_ptr<QPChain> QPChainPtr;
+}
+
+#endif // SOLVERS_H
@@ -0,0 +1,173 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include <Pacer/Log.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+namespace Pacer{
+
+  /**
+   * @brief Binary telemetry stream (telemetry-<pid>.bin).
+   *
+   * Each named series is registered once with a fixed width, after which every
+   * sample is appended as a fixed-size record to a memory-mapped file:
+   *
+   *   file header   : "PACERTLM" | uint32 version | uint32 0
+   *   schema record : uint32 SCHEMA | uint32 id | uint32 width | uint32 name_len | name (padded to 8 bytes)
+   *   data record   : uint32 DATA   | uint32 id | uint64 tick  | double time     | double[width]
+   *
+   * A name logged with a new width (e.g., a contact force vector when the number
+   * of contacts changes) is registered as another series with the same name.
+   * The file is written through the page cache, so samples survive a crash;
+   * trailing unused (zero) space is ignored by the reader.
+   *
+   * The address space of the whole stream is mapped once and the (sparse) file
+   * is preallocated in 1 GB chunks; with USE_THREADS a grower thread extends it
+   * by a chunk when half a chunk is left, so record() never calls ftruncate or
+   * mmap on the control thread and drops samples if the grower falls behind.
+   *
+   * Use the 'pacer-telemetry' tool (src/main/telemetry.cpp) to export series.
+   */
+  class Telemetry{
+  public:
+    enum record_e { END = 0, SCHEMA = 1, DATA = 2 };
+    static const uint32_t VERSION = 1;
+
+    /// @brief Process wide telemetry stream, file is created on first use.
+    static Telemetry& instance();
+
+    /// @brief Returns the id of series 'name' with 'width' doubles per sample (registers it if new),
+    /// -1 if the series is new and its schema could not be written (file full), in which
+    /// case it is not registered and the next call tries again
+    int register_series(const std::string& name, unsigned width);
+
+    /// @brief Append one sample of series 'id' (width doubles) stamped with the current tick and time.
+    /// Samples of id -1 are dropped.
+    void record(int id, const double* data);
+
+    /// @brief Register (if needed) and record series 'name' in one call.
+    void record(const std::string& name, const double* data, unsigned width){
+      record(register_series(name,width),data);
+    }
+
+    /// @brief Series id of one recording site (e.g., an OUTLOG call site)
+    struct site_t{
+      site_t() : width(0), id(-1) {}
+      std::string name;
+      unsigned width;
+      int id;
+    };
+
+    /// @brief Record series 'name' through 'site', which registers it only when the
+    /// name or width differs from the site's last sample (or registration failed).
+    void record(site_t& site, const std::string& name, const double* data, unsigned width){
+      if(site.id < 0 || site.width != width || site.name != name){
+        site.id = register_series(name,width);
+        site.name = name;
+        site.width = width;
+      }
+      record(site.id,data);
+    }
+
+    /// @brief Stamp subsequent records (called once per control tick).
+    void set_time(uint64_t tick, double time){ _tick = tick; _time = time; }
+
+    /// @brief Series whose level is above this are not recorded.
+    static TLogLevel& ReportingLevel();
+
+    /// @brief Trim the file to its used size and unmap it.
+    void close();
+
+    ~Telemetry(){ close(); }
+
+  private:
+    Telemetry();
+    Telemetry(const Telemetry&);
+    Telemetry& operator =(const Telemetry&);
+
+    // returns a pointer to 'bytes' of writable space at the end of the stream, NULL if full
+    char* reserve(size_t bytes);
+    // extends the file to 'capacity' bytes
+    bool grow(size_t capacity);
+
+    int _fd;
+    char* _data;
+    // bytes written, file length (mapped part usable by reserve())
+    size_t _size, _capacity;
+    uint64_t _tick;
+    double _time;
+    // set once a sample was dropped
+    bool _full;
+
+    // (name,width) --> series id
+    std::map<std::pair<std::string,unsigned>,int> _series_id;
+    std::vector<unsigned> _series_width;
+
+#ifdef USE_THREADS
+    static void* grower_thread(void* arg);
+
+    pthread_mutex_t _mutex;
+    // signals the grower thread
+    pthread_cond_t _grow;
+    pthread_t _grower;
+    bool _growing, _stop;
+#endif
+  };
+
+  /**
+   * @brief Sequential reader for telemetry files (used by the extraction tool).
+   */
+  class TelemetryReader{
+  public:
+    struct series_t{
+      int id;
+      std::string name;
+      unsigned width;
+      unsigned long samples;
+    };
+
+    struct sample_t{
+      int id;
+      uint64_t tick;
+      double time;
+      const double* data;
+    };
+
+    TelemetryReader(const std::string& filename);
+    ~TelemetryReader();
+
+    /// @brief Reads the next data sample, returns false at the end of the stream.
+    bool next(sample_t& s);
+
+    /// @brief Rewind to the first record.
+    void rewind(){ _pos = _start; }
+
+    /// @brief All series in the file (scans the whole file once).
+    const std::vector<series_t>& get_series();
+
+    /// @brief Series 'id' (declared before the last sample returned by next()).
+    const series_t& get_series(int id) const { return _series[id]; }
+
+  private:
+    int _fd;
+    const char* _data;
+    size_t _size, _pos, _start;
+    std::vector<series_t> _series;
+    // true once get_series() has counted the samples of every series
+    bool _scanned;
+  };
+}
+
+#endif // TELEMETRY_H
@@ -32,8 +32,10 @@ static const double _TWO_PI= M_PI*2.0;
 #include <Pacer/controller.h>
 
 #include <Ravelin/LinAlgd.h>
+#include <Pacer/workspace.h>
 
-static Ravelin::LinAlgd LA_;
+// one instance per thread (and translation unit), see Pacer::Workspace
+static thread_local Ravelin::LinAlgd LA_;
 
 class Utility{
 
@@ -145,6 +147,7 @@ public:
   /// Calculates The null pace for matrix M and places it in Vk
   /// returns the number of columns in Vk
   static unsigned kernal( Ravelin::MatrixNd& M,Ravelin::MatrixNd& null_M);
+  static unsigned kernal( Ravelin::MatrixNd& M,Ravelin::MatrixNd& null_M, Pacer::Workspace& ws);
   static void check_finite(Ravelin::VectorNd& v);
 
   static double distance_from_plane(const Ravelin::Vector3d& normal,const Ravelin::Vector3d& point, const Ravelin::Vector3d& x);
@@ -162,7 +165,7 @@ public:
                    std::vector<Ravelin::Vector3d> & ddtrajectory);
 
   static double get_z_plane(double x, double y,const Ravelin::Vector3d& N, const Ravelin::Vector3d& P){
-    static std::vector<double> gp(4);
+    double gp[4];
     // N(X - P) = a(x - px) + b(y - py) + c(z - pz) = 0
     // ax + by + cz + N.-P = 0
     // ax + by + cz = d
@@ -230,11 +233,19 @@ public:
 
 	// Solvers
   static void solve(Ravelin::MatrixNd& M,Ravelin::VectorNd& bx);
+  /// Solves (or least squares solves) M x = b in place of bx, M is overwritten.
+  /// M must not be ws.solve_M and bx must not be ws.solve_v
+  static void solve(Ravelin::MatrixNd& M,Ravelin::VectorNd& bx, Pacer::Workspace& ws);
+  /// QPs are solved by the calling thread's Pacer::QPSolver (Pacer/solvers.h), callers solving often should keep their own
   static bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, Ravelin::VectorNd& v, bool warm_start = false,bool regularize = true);
   static bool solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, Ravelin::VectorNd& x, bool warm_start = false);
   static bool solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x);
+  /// LCPs are solved by the calling thread's Pacer::LCPSolver (Pacer/solvers.h)
 	static bool lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER);
   static bool lcp_fast(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const std::vector<unsigned>& indices, Ravelin::VectorNd& z, double zero_tol);
+  static bool lcp_lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double piv_tol = -1.0, double zero_tol = -1.0);
+  static bool lcp_lemke_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp = -20, unsigned step_exp = 4, int max_exp = 20, double piv_tol = -1.0, double zero_tol = -1.0);
+  static bool lcp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double tol = 1e-8, unsigned max_iter = 1000);
 };
 
 static double sigmoid(double x){
@@ -0,0 +1,261 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+#include <Ravelin/Vector3d.h>
+#include <Ravelin/Pose3d.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+namespace Pacer{
+
+  /// Frames of one robot model --> the corresponding frames of another (see data_slot_base::rebase)
+  typedef std::map<const Ravelin::Pose3d*, boost::shared_ptr<const Ravelin::Pose3d> > frame_map_t;
+
+  /**
+   * @brief Points 'frame' at its counterpart in 'frames'.  A frame outside the
+   * map (e.g., a plugin's own frame) is copied, with its relative frames
+   * rebased, and the copy is added to 'frames' so frames shared by several
+   * values stay shared.
+   */
+  inline void rebase_frame(boost::shared_ptr<const Ravelin::Pose3d>& frame, frame_map_t& frames){
+    if(!frame)
+      return;
+    frame_map_t::const_iterator it = frames.find(frame.get());
+    if(it != frames.end()){
+      frame = (*it).second;
+      return;
+    }
+    boost::shared_ptr<Ravelin::Pose3d> copy(new Ravelin::Pose3d(*frame));
+    frames[frame.get()] = copy;
+    rebase_frame(copy->rpose,frames);
+    frame = copy;
+  }
+
+  /**
+   * @brief Type-erased storage slot for one named variable in the Robot data map.
+   *
+   * Slots are never destroyed while the Robot is alive: remove_data() only
+   * marks a slot as unset, so handles resolved against it stay valid and pick
+   * the value back up when the variable is set again.
+   *
+   * With USE_THREADS, 'exists' and the value are guarded by the slot's own
+   * mutex (lock()/unlock()); the data map mutex only guards the map.  Where
+   * both are taken, the map mutex is taken first.
+   */
+  class data_slot_base{
+  public:
+    data_slot_base(const std::string& n) : name(n), exists(false) {
+#ifdef USE_THREADS
+      pthread_mutex_init(&_mutex,NULL);
+#endif
+    }
+    virtual ~data_slot_base(){
+#ifdef USE_THREADS
+      pthread_mutex_destroy(&_mutex);
+#endif
+    }
+    virtual const std::type_info& type() const = 0;
+    /// @brief New slot holding a copy of this variable (locks this slot)
+    virtual data_slot_base* clone() const = 0;
+    /// @brief Copy the value (and exists flag) of 'slot', which must have the same type
+    /// and be private to the caller (locks this slot only)
+    virtual void assign(const data_slot_base& slot) = 0;
+    /// @brief Re-point the frames the value refers to (see rebase_frame()), for
+    /// values copied between robots with their own models
+    virtual void rebase(frame_map_t& frames){}
+
+    void lock() const {
+#ifdef USE_THREADS
+      pthread_mutex_lock(&_mutex);
+#endif
+    }
+    void unlock() const {
+#ifdef USE_THREADS
+      pthread_mutex_unlock(&_mutex);
+#endif
+    }
+
+    /// @brief exists, read under the lock
+    bool is_set() const {
+      lock();
+      bool e = exists;
+      unlock();
+      return e;
+    }
+
+    /// @brief Marks the variable as unset
+    void clear(){
+      lock();
+      exists = false;
+      unlock();
+    }
+
+    const std::string name;
+    // false until the variable is first assigned (and after remove_data())
+    bool exists;
+
+  private:
+    data_slot_base(const data_slot_base&);
+    data_slot_base& operator =(const data_slot_base&);
+#ifdef USE_THREADS
+    mutable pthread_mutex_t _mutex;
+#endif
+  };
+
+  typedef boost::shared_ptr<data_slot_base> data_slot_ptr;
+
+  template<class T>
+  class data_slot : public data_slot_base{
+  public:
+    data_slot(const std::string& n) : data_slot_base(n), value() {}
+    const std::type_info& type() const { return typeid(T); }
+
+    data_slot_base* clone() const {
+      data_slot<T>* slot = new data_slot<T>(name);
+      lock();
+      slot->value = value;
+      slot->exists = exists;
+      unlock();
+      return slot;
+    }
+
+    void assign(const data_slot_base& slot){
+      lock();
+      value = static_cast<const data_slot<T>&>(slot).value;
+      exists = slot.exists;
+      unlock();
+    }
+
+    void rebase(frame_map_t& frames){}
+
+    T value;
+  };
+
+  template<>
+  inline void data_slot<Ravelin::Vector3d>::rebase(frame_map_t& frames){
+    rebase_frame(value.pose,frames);
+  }
+
+  template<>
+  inline void data_slot<Ravelin::Pose3d>::rebase(frame_map_t& frames){
+    rebase_frame(value.rpose,frames);
+  }
+
+  /**
+   * @brief Writable reference to a variable that holds the variable's lock
+   * (USE_THREADS) until it goes out of scope, see variable_handle::ref().
+   */
+  template<class T>
+  class locked_ref{
+  public:
+    locked_ref(data_slot<T>* slot) : _slot(slot) { _slot->lock(); }
+    locked_ref(locked_ref&& r) : _slot(r._slot) { r._slot = NULL; }
+    ~locked_ref(){
+      if(_slot)
+        _slot->unlock();
+    }
+
+    T& operator *() const { return _slot->value; }
+    T* operator ->() const { return &_slot->value; }
+
+  private:
+    locked_ref(const locked_ref&);
+    locked_ref& operator =(const locked_ref&);
+    data_slot<T>* _slot;
+  };
+
+  /**
+   * @brief Pre-resolved, typed reference to a variable in the Robot data map.
+   *
+   * Resolve once (e.g., in a plugin's setup()) with Robot::get_data_handle<T>(name)
+   * and read/write the slot directly on every tick: no string building, map
+   * lookup or boost::any copy.
+   *
+   * Every access takes the slot's mutex (USE_THREADS), so handles and the
+   * string API may be used from several threads (worker pool, background
+   * plugins).  Values are read by copy; ref() holds the lock for the life of
+   * the returned reference, so do not access other variables through it.
+   */
+  template<class T>
+  class variable_handle{
+  public:
+    variable_handle() {}
+    variable_handle(const boost::shared_ptr<data_slot<T> >& slot) : _slot(slot) {}
+
+    /// @brief true if this handle has been resolved against a Robot
+    bool valid() const { return _slot.get() != NULL; }
+
+    /// @brief true if the variable currently holds a value
+    bool exists() const { return valid() && _slot->is_set(); }
+
+    const std::string& name() const { return slot()->name; }
+
+    /// @brief Read the variable (throws if it has not been set).
+    T get() const {
+      data_slot<T>* s = slot();
+      s->lock();
+      if(!s->exists){
+        s->unlock();
+        throw std::runtime_error("Variable: \"" + s->name + "\" not found in data!");
+      }
+      T v = s->value;
+      s->unlock();
+      return v;
+    }
+
+    /// @brief Get data we're not sure exists.
+    /// Return false and do nothing to data if it doesnt exist
+    bool get(T& val) const {
+      if(!valid())
+        return false;
+      _slot->lock();
+      bool e = _slot->exists;
+      if(e)
+        val = _slot->value;
+      _slot->unlock();
+      return e;
+    }
+
+    /// @brief Writable reference to the stored value (in place, no copy), marks the
+    /// variable as set.  The variable stays locked while the reference lives.
+    locked_ref<T> ref() {
+      data_slot<T>* s = slot();
+      locked_ref<T> r(s);
+      s->exists = true;
+      return r;
+    }
+
+    /// Returns 'true' if the variable did not hold a value before this call
+    bool set(const T& v){
+      data_slot<T>* s = slot();
+      s->lock();
+      bool new_var = !s->exists;
+      s->value = v;
+      s->exists = true;
+      s->unlock();
+      return new_var;
+    }
+
+  private:
+    data_slot<T>* slot() const {
+      if(!_slot)
+        throw std::runtime_error("Variable handle used before it was resolved!");
+      return _slot.get();
+    }
+
+    boost::shared_ptr<data_slot<T> > _slot;
+  };
+}
+
+#endif // VARIABLES_H
@@ -0,0 +1,85 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <vector>
+#include <deque>
+#include <exception>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+namespace Pacer{
+
+  /**
+   * @brief Task in a dependency graph: runs once all of its predecessors are done.
+   */
+  struct dag_task_t{
+    boost::function<void ()> run;
+    // indices of tasks that must wait for this one
+    std::vector<int> successors;
+    // number of tasks this one waits for
+    int num_predecessors;
+
+    dag_task_t() : num_predecessors(0) {}
+  };
+
+  /**
+   * @brief Fixed pool of worker threads executing task graphs.
+   *
+   * run_graph() blocks until every task has finished, the calling thread
+   * executes tasks too. Ready tasks are started lowest index first.  If a task
+   * throws, no new tasks are started and the exception of the lowest indexed
+   * failed task is rethrown once the running tasks have returned.
+   *
+   * Without USE_THREADS (or with 0 workers) graphs are run serially in index
+   * order, which is a valid topological order when successors have higher
+   * indices than their predecessors.
+   */
+  class WorkerPool{
+  public:
+    WorkerPool(int num_workers);
+    ~WorkerPool();
+
+    int num_workers() const { return _num_workers; }
+
+    void run_graph(std::vector<dag_task_t>& tasks);
+
+  private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator =(const WorkerPool&);
+
+    void run_serial(std::vector<dag_task_t>& tasks);
+
+    int _num_workers;
+
+#ifdef USE_THREADS
+    static void* worker_thread(void* arg);
+    // executes ready tasks until the current graph is finished, returns false on shutdown
+    bool work(bool caller);
+    void run_task(int i);
+
+    std::vector<pthread_t> _threads;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _work_cond, _done_cond;
+
+    // current graph
+    std::vector<dag_task_t>* _tasks;
+    std::vector<int> _waiting_on;
+    std::vector<int> _ready;          // min-heap of ready task indices
+    std::vector<std::exception_ptr> _errors;
+    int _remaining, _running;
+    bool _abort, _shutdown;
+#endif
+  };
+
+  typedef boost::shared_ptr<WorkerPool> WorkerPoolPtr;
+}
+
+#endif // WORKERS_H
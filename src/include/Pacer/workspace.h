@@ -0,0 +1,54 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <Ravelin/LinAlgd.h>
+#include <Ravelin/VectorNd.h>
+#include <Ravelin/MatrixNd.h>
+
+namespace Pacer{
+
+  /**
+   * @brief Scratch storage for the kinematics and linear algebra routines.
+   *
+   * Routines that take a Workspace keep all of their temporaries in it, so
+   * calls given different workspaces never share buffers and may run
+   * concurrently.  The overloads without a Workspace argument use local(),
+   * a separate instance per thread.
+   *
+   * Members are grouped by the routine that owns them so that a caller can
+   * use the general temporaries around calls to Utility::solve() and the
+   * Jacobian routines without them clobbering each other.
+   *
+   * NOTE: a Workspace only covers temporaries, the kinematic model of a
+   * Robot (link poses) is still shared by everything using that Robot.
+   */
+  struct Workspace{
+    /// factorizations, SVD
+    Ravelin::LinAlgd LA;
+
+    /// Utility::solve()
+    Ravelin::MatrixNd solve_M;
+    Ravelin::VectorNd solve_v;
+
+    /// full body Jacobian (Robot::link_jacobian(), Robot::calc_contact_jacobians())
+    Ravelin::MatrixNd J;
+
+    /// Robot::end_effector_inverse_kinematics()
+    Ravelin::MatrixNd ik_J, ik_A, ik_gk;
+    Ravelin::VectorNd ik_x, ik_x_trial, ik_e, ik_e_trial, ik_y;
+
+    /// general temporaries of the calling routine
+    Ravelin::MatrixNd M;
+    Ravelin::VectorNd v, v1, v2;
+
+    /// @brief Workspace of the calling thread
+    static Workspace& local();
+  };
+}
+
+#endif // WORKSPACE_H
@@ -5,14 +5,14 @@
  ****************************************************************************/
 #include <Pacer/robot.h>
 #include <Pacer/utilities.h>
+#include <Pacer/profiler.h>
+
+#include <set>
+#include <dlfcn.h>
 
 using namespace Ravelin;
 using namespace Pacer;
 
-static Ravelin::VectorNd workv_;
-static Ravelin::Vector3d workv3_;
-static Ravelin::MatrixNd workM_;
-
 
 Ravelin::MatrixNd Pacer::Robot::calc_link_jacobian(const Ravelin::VectorNd& q, const std::string& link){
   return calc_jacobian(q,link,Ravelin::Origin3d(0,0,0));
@@ -39,9 +39,126 @@ std::vector< boost::shared_ptr<Ravelin::Jointd> >& vec_to_joint_state(const Rave
   return joints;
 }
 
+void Robot::invalidate_kinematics(){
+  _model_q_valid = false;
+  _model_version++;
+}
+
+void Robot::sync_fk_cache(const end_effector_t& foot){
+  end_effector_t::fk_cache_t& fk = foot.fk;
+  if(fk.version == _model_version)
+    return;
+  fk.version = _model_version;
+  fk.q.resize(0);
+  fk.link_transform.resize(foot.chain_links.size());
+  fk.stale = foot.chain_links.size();
+}
+
+void Robot::set_chain_state(const end_effector_t& foot, const Ravelin::VectorNd& x){
+  sync_fk_cache(foot);
+  end_effector_t::fk_cache_t& fk = foot.fk;
+  const bool known = (fk.q.size() == x.size());
+  bool changed_any = false;
+  for (int i=0, ii=0; i<foot.chain_joints.size(); i++) {
+    const boost::shared_ptr<Ravelin::Jointd>& joint = foot.chain_joints[i];
+    bool changed = false;
+    for (int j=0; j<joint->num_dof(); j++,ii++) {
+      if(known && fk.q[ii] == x[ii])
+        continue;
+      joint->q[j] = x[ii];
+      changed = true;
+    }
+    if(!changed)
+      continue;
+    joint->get_induced_pose();
+    // chain_links[0..i] are outboard of joint i
+    fk.stale = std::max<unsigned>(fk.stale,i+1);
+    changed_any = true;
+  }
+  if(!changed_any)
+    return;
+  fk.q = x;
+  
+  // the model is no longer at the coordinates of the last set_model_coordinates()
+  _model_q_valid = false;
+  for(int k=0;k<foot.shared_chains.size();k++){
+    end_effector_t::fk_cache_t& other = foot.shared_chains[k]->fk;
+    other.q.resize(0);
+    other.stale = other.link_transform.size();
+  }
+}
+
+const Ravelin::Transform3d& Robot::get_chain_link_transform(const end_effector_t& foot, unsigned i){
+  sync_fk_cache(foot);
+  end_effector_t::fk_cache_t& fk = foot.fk;
+  const unsigned n = foot.chain_links.size();
+  // outboard from the innermost stale link: T_k = T_{k+1} * (link k -> link k+1)
+  for(;fk.stale > i;fk.stale--){
+    const unsigned k = fk.stale-1;
+    if(k+1 == n)
+      fk.link_transform[k] = Ravelin::Pose3d::calc_relative_pose(foot.chain_links[k]->get_pose(),GLOBAL);
+    else
+      fk.link_transform[k] = fk.link_transform[k+1] * Ravelin::Pose3d::calc_relative_pose(foot.chain_links[k]->get_pose(),foot.chain_links[k+1]->get_pose());
+  }
+  return fk.link_transform[i];
+}
+
+Ravelin::Vector3d Robot::get_end_effector_position(const end_effector_t& foot){
+  return Ravelin::Vector3d(get_chain_link_transform(foot,0).x,GLOBAL);
+}
+
+Ravelin::Vector3d Robot::calc_center_of_mass(double& total_mass){
+  Ravelin::Vector3d com(0,0,0,GLOBAL);
+  total_mass = 0;
+  
+  std::set<const Ravelin::RigidBodyd*> done;
+  std::map<std::string,boost::shared_ptr<end_effector_t> >::const_iterator it;
+  for(it=_id_end_effector_map.begin();it!=_id_end_effector_map.end();it++){
+    const end_effector_t& foot = *((*it).second.get());
+    for(int k=0;k<foot.chain_links.size();k++){
+      if(!done.insert(foot.chain_links[k].get()).second)
+        continue;
+      const double m = foot.chain_links[k]->get_mass();
+      total_mass += m;
+      com += (Ravelin::Vector3d(get_chain_link_transform(foot,k).x,GLOBAL) *= m);
+    }
+  }
+  
+  std::map<std::string,boost::shared_ptr<Ravelin::RigidBodyd> >::const_iterator lt;
+  for(lt=_id_link_map.begin();lt!=_id_link_map.end();lt++){
+    if(done.count((*lt).second.get()))
+      continue;
+    const double m = (*lt).second->get_mass();
+    total_mass += m;
+    com += (Ravelin::Pose3d::transform_point(GLOBAL,Ravelin::Vector3d(0,0,0,(*lt).second->get_pose())) *= m);
+  }
+  
+  if(total_mass > 0)
+    com /= total_mass;
+  return com;
+}
+
 Ravelin::MatrixNd& Robot::link_jacobian(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, Ravelin::MatrixNd& gk){
+  return link_jacobian(x,foot,frame,gk,Workspace::local());
+}
+
+Ravelin::MatrixNd& Robot::link_jacobian(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, Ravelin::MatrixNd& gk, Workspace& ws){
+  if(foot.generated){
+    const unsigned n = foot.chain.size();
+    ws.J.resize(6,n);
+    generated_kinematics(foot,x,ws.J.data());
+    // base link orientation -> 'frame' orientation
+    const Ravelin::Matrix3d R(Ravelin::Pose3d::calc_relative_pose(foot.chain_joints.back()->get_inboard_link()->get_pose(),frame).q);
+    gk.resize(6,n);
+    for(int k=0;k<n;k++)
+      for(int h=0;h<6;h+=3)
+        for(int r=0;r<3;r++)
+          gk(h+r,k) = R(r,0)*ws.J(h,k) + R(r,1)*ws.J(h+1,k) + R(r,2)*ws.J(h+2,k);
+    return gk;
+  }
+  
   gk.resize(6,foot.chain.size());
-  Ravelin::Vector3d foot_origin_vec = Ravelin::Pose3d::transform_point(frame,Ravelin::Vector3d(0,0,0,foot.link->get_pose()));
+  Ravelin::Vector3d foot_origin_vec = Ravelin::Pose3d::transform_point(frame,get_end_effector_position(foot));
   double * foot_origin = foot_origin_vec.data();
 //  std::cerr << foot.id << " origin: " << foot_origin_vec << std::endl;
   boost::shared_ptr<Ravelin::Pose3d> jacobian_frame
@@ -52,11 +169,11 @@ Ravelin::MatrixNd& Robot::link_jacobian(const Ravelin::VectorNd& x,const end_eff
    )
   );
   
-  _abrobot->calc_jacobian(_abrobot->get_gc_pose(),jacobian_frame,foot.link,workM_);
+  _abrobot->calc_jacobian(_abrobot->get_gc_pose(),jacobian_frame,foot.link,ws.J);
   
   for(int j=0;j<6;j++) {                                     // x,y,z
     for(int k=0;k<foot.chain.size();k++){
-      gk(j,k) = workM_(j,foot.chain[k]);
+      gk(j,k) = ws.J(j,foot.chain[k]);
     }
   }
   
@@ -64,9 +181,35 @@ Ravelin::MatrixNd& Robot::link_jacobian(const Ravelin::VectorNd& x,const end_eff
 }
 
 Ravelin::MatrixNd Robot::calc_jacobian(const Ravelin::VectorNd& q,const std::string& link, Ravelin::Origin3d point){
-  Ravelin::MatrixNd J;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  set_model_coordinates(q);
   
-  _abrobot->set_generalized_coordinates_euler(q);
+  // memoized for the last q only (entries are reused to keep their storage)
+  bool same_q = (_dynamics.jacobian_q.size() == q.size());
+  for(int i=0;same_q && i<q.size();i++)
+    same_q = (_dynamics.jacobian_q[i] == q[i]);
+  if(!same_q){
+    _dynamics.jacobian_q = q;
+    _dynamics.num_jacobians = 0;
+  }
+  for(unsigned i=0;i<_dynamics.num_jacobians;i++){
+    const dynamics_cache_t::jacobian_t& e = _dynamics.jacobians[i];
+    if(e.link.compare(link) == 0 && e.point[0] == point[0] && e.point[1] == point[1] && e.point[2] == point[2]){
+      Ravelin::MatrixNd J = e.J;
+#ifdef USE_THREADS
+      pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+      return J;
+    }
+  }
+  
+  if(_dynamics.num_jacobians == _dynamics.jacobians.size())
+    _dynamics.jacobians.push_back(dynamics_cache_t::jacobian_t());
+  dynamics_cache_t::jacobian_t& e = _dynamics.jacobians[_dynamics.num_jacobians++];
+  e.link = link;
+  e.point = point;
   
   boost::shared_ptr<Ravelin::Pose3d>
   jacobian_frame(
@@ -74,19 +217,103 @@ Ravelin::MatrixNd Robot::calc_jacobian(const Ravelin::VectorNd& q,const std::str
                                      Ravelin::Origin3d(Ravelin::Pose3d::transform_point(GLOBAL,Ravelin::Vector3d(point.data(),_id_link_map[link]->get_pose())).data())
                                      ,GLOBAL));
   
-  _abrobot->calc_jacobian(_abrobot->get_gc_pose(),jacobian_frame,_id_link_map[link],J);
+  _abrobot->calc_jacobian(_abrobot->get_gc_pose(),jacobian_frame,_id_link_map[link],e.J);
   
 //  OUTLOG(_root_link->get_mixed_pose(),"base_frame",logERROR);
 //  OUTLOG(jacobian_frame,"jacobian_frame",logERROR);
   
+  Ravelin::MatrixNd J = e.J;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
   return J;
 }
 
+Ravelin::Vector3d Robot::generated_kinematics(const end_effector_t& foot, const Ravelin::VectorNd& x, double* J){
+  double p[3];
+  (*foot.generated->kinematics)(x.data(),p,J);
+  return Ravelin::Pose3d::transform_point(GLOBAL,Ravelin::Vector3d(p,foot.chain_joints.back()->get_inboard_link()->get_pose()));
+}
+
+bool Robot::check_generated_kinematics(const end_effector_t& foot, const generated_chain_t& chain){
+  const unsigned n = foot.chain.size();
+  if(chain.num_coords != n || !std::equal(foot.chain.begin(),foot.chain.end(),chain.coords))
+    return false;
+  
+  const double TOL = 1e-6;
+  const boost::shared_ptr<const Ravelin::Pose3d> base = foot.chain_joints.back()->get_inboard_link()->get_pose();
+  const Ravelin::VectorNd q0 = get_generalized_value(position);
+  Ravelin::VectorNd q = q0, x(n);
+  Ravelin::MatrixNd J(6,n), J_model;
+  double err = 0;
+  // the current state and a few configurations around it
+  for(unsigned check=0;check<5;check++){
+    for(unsigned k=0;k<n;k++)
+      q[foot.chain[k]] = x[k] = q0[foot.chain[k]] + 0.25*check*sin(1.0+k+check);
+    J_model = calc_jacobian(q,foot.id,Ravelin::Origin3d(0,0,0));
+    const Ravelin::Vector3d p_model = get_end_effector_position(foot);
+    const Ravelin::Vector3d p = generated_kinematics(foot,x,J.data());
+    const Ravelin::Matrix3d R(Ravelin::Pose3d::calc_relative_pose(base,GLOBAL).q);
+    for(int r=0;r<3;r++)
+      err = std::max(err,fabs(p[r] - p_model[r]));
+    for(int k=0;k<n;k++)
+      for(int h=0;h<6;h+=3)
+        for(int r=0;r<3;r++)
+          err = std::max(err,fabs(R(r,0)*J(h,k) + R(r,1)*J(h+1,k) + R(r,2)*J(h+2,k) - J_model(h+r,foot.chain[k])));
+  }
+  set_model_coordinates(q0);
+  OUT_LOG(logDEBUG1) << foot.id << " generated kinematics error: " << err;
+  return err < TOL;
+}
+
+unsigned Robot::load_generated_kinematics(const std::string& library){
+  // the library stays loaded for the life of the process
+  void* handle = dlopen(library.c_str(),RTLD_NOW);
+  if(!handle){
+    OUT_LOG(logERROR) << "Robot: failed to read generated kinematics from " << library << ": " << dlerror();
+    return 0;
+  }
+  dlerror();
+  pacer_generated_kinematics_fn get_kinematics = (pacer_generated_kinematics_fn) dlsym(handle,PACER_GENERATED_KINEMATICS_SYMBOL);
+  const char* dlsym_error = dlerror();
+  if(dlsym_error){
+    OUT_LOG(logERROR) << "Robot: cannot load symbol '" << PACER_GENERATED_KINEMATICS_SYMBOL << "' from " << library << ": " << dlsym_error;
+    return 0;
+  }
+  
+  const generated_kinematics_t* kinematics = (*get_kinematics)();
+  OUT_LOG(logINFO) << "Generated kinematics of " << kinematics->model << " from " << library;
+  unsigned used = 0;
+  for(unsigned i=0;i<kinematics->num_chains;i++){
+    const generated_chain_t& chain = kinematics->chains[i];
+    std::map<std::string,boost::shared_ptr<end_effector_t> >::iterator it = _id_end_effector_map.find(chain.end_effector);
+    if(it == _id_end_effector_map.end()){
+      OUT_LOG(logERROR) << "Generated kinematics for unknown end effector " << chain.end_effector;
+      continue;
+    }
+    end_effector_t& foot = *(*it).second;
+    foot.generated = NULL;
+    if(check_generated_kinematics(foot,chain)){
+      foot.generated = &chain;
+      used++;
+    } else {
+      OUT_LOG(logERROR) << "Generated kinematics of " << chain.end_effector << " do not match the model, not used";
+    }
+  }
+  return used;
+}
+
 /// Working kinematics function [y] = f(x,foot,pt,y,J)
 /// evaluated in foot link frame
 Ravelin::VectorNd& Robot::dist_to_goal(const Ravelin::VectorNd& x,const end_effector_t& foot_const,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& dist){
+  if(foot_const.generated){
+    const Ravelin::Vector3d p = generated_kinematics(foot_const,x,NULL);
+    dist = Ravelin::Pose3d::transform_vector(frame,Ravelin::Vector3d(goal[0]-p[0],goal[1]-p[1],goal[2]-p[2],Pacer::GLOBAL));
+    return dist;
+  }
+  
   end_effector_t& foot = const_cast<end_effector_t&>(foot_const);
-  vec_to_joint_state(x,foot.chain_joints);
+  set_chain_state(foot,x);
 
   dist = Ravelin::Pose3d::transform_vector(frame,Ravelin::Pose3d::transform_point(
                                                                                   foot.link->get_pose(),Vector3d(goal,Pacer::GLOBAL)));
@@ -94,14 +321,22 @@ Ravelin::VectorNd& Robot::dist_to_goal(const Ravelin::VectorNd& x,const end_effe
 }
 
 Ravelin::VectorNd& Robot::link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot_const,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& dist, Ravelin::MatrixNd& jacobian){
+  return link_kinematics(x,foot_const,frame,goal,dist,jacobian,Workspace::local());
+}
+
+Ravelin::VectorNd& Robot::link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot_const,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::Origin3d& goal, Ravelin::VectorNd& dist, Ravelin::MatrixNd& jacobian, Workspace& ws){
   dist_to_goal(x,foot_const,frame,goal,dist);
-  link_jacobian(x,foot_const,frame,jacobian);
-  jacobian = jacobian.get_sub_mat(0,3,0,jacobian.columns(),workM_);
+  link_jacobian(x,foot_const,frame,jacobian,ws);
+  jacobian = jacobian.get_sub_mat(0,3,0,jacobian.columns(),ws.M);
   return dist;
 }
 
 /// Resolved Motion Rate Control
 void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::Origin3d& input_goal,Ravelin::VectorNd& q_des, double TOL){
+  RMRC(foot,q,input_goal,q_des,TOL,Workspace::local());
+}
+
+void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::Origin3d& input_goal,Ravelin::VectorNd& q_des, double TOL, Workspace& ws){
   // NOTE: Current robot configuration must be set
   
   OUT_LOG(logDEBUG1) << "Robot::RMRC() -- 3D";
@@ -124,7 +359,7 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
 
   double alpha = 1, err = 1, last_err = 2;
   
-  link_kinematics(x,foot,base_frame,goal,step,J);
+  link_kinematics(x,foot,base_frame,goal,step,J,ws);
   
   err = step.norm();
   OUT_LOG(logDEBUG1) << "err: " << err;
@@ -137,14 +372,14 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
     //    OUTLOG(x,"q",logDEBUG1);
 //    OUTLOG(step,"xstep",logDEBUG1);
 //    OUTLOG(J,"J",logDEBUG1);
-    Utility::solve(workM_ = J,step);
+    Utility::solve(ws.M = J,step,ws);
     
     Ravelin::VectorNd qstep = step;
 //    OUTLOG(qstep,"qstep",logDEBUG1);
     
     // Line Search
     {
-      Ravelin::VectorNd workv1_,workv2_;
+      Ravelin::VectorNd& workv1_ = ws.v1, & workv2_ = ws.v2;
 
       double alpha = 1, beta = 0.75;
       Ravelin::VectorNd dist1, dist2;
@@ -173,18 +408,18 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
     }
     
     
-    x += ( (workv_ = qstep)*= alpha );
+    x += ( (ws.v = qstep)*= alpha );
     OUT_LOG(logDEBUG1) << "q: " << x;
     
     // get foot pos
-    link_kinematics(x,foot,base_frame,goal,step,J);
+    link_kinematics(x,foot,base_frame,goal,step,J,ws);
     
     err = step.norm();
     OUT_LOG(logDEBUG1) << "err: " << err;
     
     // if error increases, backstep then return
     if(err > last_err){
-      x -= ( (workv_ = qstep)*= alpha );
+      x -= ( (ws.v = qstep)*= alpha );
       break;
     }
   }
@@ -198,10 +433,14 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
 /// Working kinematics function [y] = f(x,foot,pt,y,J)
 /// evaluated in foot link frame
 Ravelin::VectorNd& Robot::link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::VectorNd& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk){
+  return link_kinematics(x,foot,frame,goal,fk,gk,Workspace::local());
+}
+
+Ravelin::VectorNd& Robot::link_kinematics(const Ravelin::VectorNd& x,const end_effector_t& foot,const boost::shared_ptr<const Ravelin::Pose3d> frame, const Ravelin::VectorNd& goal, Ravelin::VectorNd& fk, Ravelin::MatrixNd& gk, Workspace& ws){
   // This is bad code, you should not be here
   assert(false);
   
-  link_jacobian(x,foot,frame,gk);
+  link_jacobian(x,foot,frame,gk,ws);
    const Ravelin::Vector3d upper(goal[0],goal[1],goal[2],frame);
    const Ravelin::Vector3d lower(goal[3],goal[4],goal[5],frame);
    fk = Ravelin::VectorNd(6,Ravelin::Pose3d::transform(
@@ -227,6 +466,10 @@ Ravelin::VectorNd& Robot::link_kinematics(const Ravelin::VectorNd& x,const end_e
 
 /// 6d IK
 void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::VectorNd& goal,Ravelin::VectorNd& q_des, double TOL){
+  RMRC(foot,q,goal,q_des,TOL,Workspace::local());
+}
+
+void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Ravelin::VectorNd& goal,Ravelin::VectorNd& q_des, double TOL, Workspace& ws){
   OUT_LOG(logDEBUG1) << "Robot::RMRC() -- 6D";
 
   
@@ -241,7 +484,7 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
   for(int k=0;k<foot.chain.size();k++)                // actuated joints
     x[k] = q[foot.chain[k]];
   
-  link_kinematics(x,foot,base_frame,goal,step,J);
+  link_kinematics(x,foot,base_frame,goal,step,J,ws);
   
   err = step.norm();
   OUTLOG(goal,"goal",logDEBUG1);
@@ -250,7 +493,7 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
     // update error
     last_err = err;
     OUTLOG(step,"xstep",logDEBUG1);
-    Utility::solve(workM_ = J,step);
+    Utility::solve(ws.M = J,step,ws);
     
     Ravelin::VectorNd qstep = step;
     OUTLOG(qstep,"qstep",logDEBUG1);
@@ -264,8 +507,8 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
       Ravelin::VectorNd xx = x;
       // distance to goal is greater alpha*step than beta*alpha*step?
       // reduce alpha to alpha*beta
-      while (link_kinematics((x = xx) += ((workv_ = qstep)*= alpha)      ,foot,base_frame,goal,fk1,workM_).norm() >
-             link_kinematics((x = xx) += ((workv_ = qstep)*= alpha*beta) ,foot,base_frame,goal,fk1,workM_).norm()){
+      while (link_kinematics((x = xx) += ((ws.v = qstep)*= alpha)      ,foot,base_frame,goal,fk1,ws.M,ws).norm() >
+             link_kinematics((x = xx) += ((ws.v = qstep)*= alpha*beta) ,foot,base_frame,goal,fk1,ws.M,ws).norm()){
         alpha = alpha*beta;
       }
       x = xx;
@@ -273,17 +516,17 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
     
     OUT_LOG(logDEBUG1) << "alpha: " << alpha;
     
-    x += ( (workv_ = qstep)*= alpha );
+    x += ( (ws.v = qstep)*= alpha );
     
     // get foot pos
-    link_kinematics(x,foot,base_frame,goal,step,J);
+    link_kinematics(x,foot,base_frame,goal,step,J,ws);
     
     err = step.norm();
     OUTLOG(err,"err",logDEBUG1);
     
     // if error increases, backstep then return
     if(err > last_err){
-      x -= ( (workv_ = qstep)*= alpha );
+      x -= ( (ws.v = qstep)*= alpha );
       break;
     }
   }
@@ -295,25 +538,76 @@ void Robot::RMRC(const end_effector_t& foot,const Ravelin::VectorNd& q,const Rav
 }
 
 void Robot::calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c ,Ravelin::MatrixNd& N,Ravelin::MatrixNd& S,Ravelin::MatrixNd& T){
-  static Ravelin::VectorNd workv_;
-  static Ravelin::MatrixNd workM_;
-  
-  set_model_state(q);
+  calc_contact_jacobians(q,c,N,S,T,Workspace::local());
+}
+
+void Robot::calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c ,Ravelin::MatrixNd& N,Ravelin::MatrixNd& S,Ravelin::MatrixNd& T, Workspace& ws){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  memoized_contact_jacobians(q,c,ws).to_dense(N,S,T);
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+}
+
+void Robot::calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c, ContactJacobian& J){
+  calc_contact_jacobians(q,c,J,Workspace::local());
+}
+
+/// True if the memoized contacts are the same set as 'c' (same links, points and directions)
+static bool same_contacts(const std::vector<Robot::contact_t>& cached, const std::vector<boost::shared_ptr<Robot::contact_t> >& c){
+  if(cached.size() != c.size())
+    return false;
+  for(int i=0;i<c.size();i++){
+    const Robot::contact_t& a = cached[i], & b = *(c[i].get());
+    if(a.id != b.id)
+      return false;
+    for(int d=0;d<3;d++)
+      if(a.point[d] != b.point[d] || a.normal[d] != b.normal[d] || a.tangent[d] != b.tangent[d])
+        return false;
+  }
+  return true;
+}
+
+void Robot::calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost::shared_ptr<contact_t> > c, ContactJacobian& J, Workspace& ws){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  J = memoized_contact_jacobians(q,c,ws);
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+}
+
+// Called with _dynamics_mutex held, the result is only valid until it is released
+const ContactJacobian& Robot::memoized_contact_jacobians(const Ravelin::VectorNd& q, const std::vector<boost::shared_ptr<contact_t> >& c, Workspace& ws){
+  set_model_coordinates(q);
   
+  bool cached = _dynamics.jacobians_valid && _dynamics.contact_q.size() == q.size() && same_contacts(_dynamics.contacts,c);
+  for(int i=0;cached && i<q.size();i++)
+    cached = (_dynamics.contact_q[i] == q[i]);
+  if(!cached){
+    calc_contact_jacobian_blocks(c,_dynamics.J,ws);
+    _dynamics.contact_q = q;
+    _dynamics.contacts.resize(c.size());
+    for(int i=0;i<c.size();i++)
+      _dynamics.contacts[i] = *(c[i].get());
+    _dynamics.jacobians_valid = true;
+  }
+  return _dynamics.J;
+}
+
+void Robot::calc_contact_jacobian_blocks(const std::vector<boost::shared_ptr<contact_t> >& c, ContactJacobian& J, Workspace& ws){
   int NC = c.size();
-  N.set_zero(NDOFS,NC);
-  S.set_zero(NDOFS,NC);
-  T.set_zero(NDOFS,NC);
-  if(NC==0) return;
+  J.reset(NDOFS);
   
   // Contact Jacobian [GLOBAL frame]
-  Ravelin::MatrixNd J(3,NDOFS);
   for(int i=0;i<NC;i++){
     boost::shared_ptr<const Ravelin::Pose3d>
     impulse_frame(new Ravelin::Pose3d(Ravelin::Quatd::identity(),c[i]->point.data(),GLOBAL));
     
-    _abrobot->calc_jacobian(_abrobot->get_gc_pose(),impulse_frame,_id_link_map[c[i]->id],workM_);
-    workM_.get_sub_mat(0,3,0,NDOFS,J);
+    _abrobot->calc_jacobian(_abrobot->get_gc_pose(),impulse_frame,_id_link_map[c[i]->id],ws.J);
     
     Vector3d
     normal  = c[i]->normal,
@@ -322,17 +616,18 @@ void Robot::calc_contact_jacobians(const Ravelin::VectorNd& q, std::vector<boost
     tan2.normalize();
     //      Ravelin::Vector3d::determine_orthonormal_basis(normal,tan1,tan2);
     
-    // Normal direction
-    J.transpose_mult(normal,workv_);
-    N.set_column(i,workv_);
-    
-    // 1st tangent
-    J.transpose_mult(tan1,workv_);
-    S.set_column(i,workv_);
-    
-    // 2nd tangent
-    J.transpose_mult(tan2,workv_);
-    T.set_column(i,workv_);
+    // Project the linear rows onto normal & tangents, only over the
+    // coordinates that move the contact link (its chain and the base)
+    const std::vector<unsigned>& cols = _id_link_coords_map[c[i]->id];
+    Ravelin::MatrixNd& B = J.add_contact(cols);
+    for(int k=0;k<cols.size();k++){
+      const unsigned col = cols[k];
+      for(int d=0;d<3;d++){
+        B(0,k) += normal[d] * ws.J(d,col);
+        B(1,k) += tan1[d]   * ws.J(d,col);
+        B(2,k) += tan2[d]   * ws.J(d,col);
+      }
+    }
   }
 }
 
@@ -345,53 +640,214 @@ void Robot::end_effector_inverse_kinematics(
                                             Ravelin::VectorNd& q_des,
                                             Ravelin::VectorNd& qd_des,
                                             Ravelin::VectorNd& qdd_des, double TOL){
-  
+  end_effector_inverse_kinematics(foot_id,foot_pos,foot_vel,foot_acc,q,q_des,qd_des,qdd_des,TOL,Workspace::local());
+}
+
+void Robot::end_effector_inverse_kinematics(
+                                            const std::vector<std::string>& foot_id,
+                                            const std::vector<Ravelin::Origin3d>& foot_pos,
+                                            const std::vector<Ravelin::Origin3d>& foot_vel,
+                                            const std::vector<Ravelin::Origin3d>& foot_acc,
+                                            const Ravelin::VectorNd& q,
+                                            Ravelin::VectorNd& q_des,
+                                            Ravelin::VectorNd& qd_des,
+                                            Ravelin::VectorNd& qdd_des, double TOL, Workspace& ws){
+  ik_options_t options;
+  options.tolerance = TOL;
+  end_effector_inverse_kinematics(foot_id,foot_pos,foot_vel,foot_acc,q,q_des,qd_des,qdd_des,options,ws);
+}
+
+/// Gathers the chain coordinates (columns 'cols') of x
+static const Ravelin::VectorNd& chain_coords(const std::vector<unsigned>& cols,const Ravelin::VectorNd& x,Ravelin::VectorNd& xc){
+  xc.resize(cols.size());
+  for(int k=0;k<cols.size();k++)
+    xc[k] = x[cols[k]];
+  return xc;
+}
+
+/// Stacked 3d errors (goal - position) of the end effectors, returns the largest error
+static double end_effector_error(Robot& robot,const std::vector<Robot::end_effector_t*>& feet,const std::vector<Ravelin::Origin3d>& foot_pos,Ravelin::VectorNd& e){
+  double max_err = 0;
+  e.resize(3*feet.size());
+  for(int i=0;i<feet.size();i++){
+    Ravelin::Vector3d x = robot.get_end_effector_position(*feet[i]);
+    double err = 0;
+    for(int d=0;d<3;d++){
+      e[3*i+d] = foot_pos[i][d] - x[d];
+      err += e[3*i+d]*e[3*i+d];
+    }
+    max_err = std::max(max_err,sqrt(err));
+  }
+  return max_err;
+}
+
+bool Robot::end_effector_inverse_kinematics(
+                                            const std::vector<std::string>& foot_id,
+                                            const std::vector<Ravelin::Origin3d>& foot_pos,
+                                            const std::vector<Ravelin::Origin3d>& foot_vel,
+                                            const std::vector<Ravelin::Origin3d>& foot_acc,
+                                            const Ravelin::VectorNd& q,
+                                            Ravelin::VectorNd& q_des,
+                                            Ravelin::VectorNd& qd_des,
+                                            Ravelin::VectorNd& qdd_des, const ik_options_t& options, Workspace& ws){
+  const int64_t start = Profiler::now();
+
   q_des = q.segment(0,NUM_JOINT_DOFS);
   qd_des.set_zero(NUM_JOINT_DOFS);
   qdd_des.set_zero(NUM_JOINT_DOFS);
   
   int NUM_EEFS = foot_id.size();
   
-  set_model_state(q);
+  set_model_coordinates(q);
+  
+  // Columns of the stacked system are the union of the chain coordinates
+  std::vector<end_effector_t*> feet(NUM_EEFS);
+  std::vector<std::vector<unsigned> > foot_cols(NUM_EEFS);
+  std::vector<unsigned> coords;
+  std::vector<int> coord_col(NUM_JOINT_DOFS,-1);
   for(int i=0;i<NUM_EEFS;i++){
-
-    end_effector_t& foot = *(_id_end_effector_map[foot_id[i]].get());
+    feet[i] = _id_end_effector_map[foot_id[i]].get();
+    const std::vector<unsigned>& chain = feet[i]->chain;
+    for(int k=0;k<chain.size();k++){
+      if(coord_col[chain[k]] < 0){
+        coord_col[chain[k]] = coords.size();
+        coords.push_back(chain[k]);
+      }
+      foot_cols[i].push_back(coord_col[chain[k]]);
+    }
+  }
+  const int M = 3*NUM_EEFS, N = coords.size();
+  
+  Ravelin::VectorNd& x = ws.ik_x;
+  x.resize(N);
+  for(int j=0;j<N;j++)
+    x[j] = q[coords[j]];
+  
+  // Warm start: keep the previous solution of a chain if it starts closer to the goal
+  if(options.warm_start){
+    for(int i=0;i<NUM_EEFS;i++){
+      end_effector_t& foot = *feet[i];
+      if(foot.ik_solution.size() != foot.chain.size())
+        continue;
+      std::vector<end_effector_t*> one(1,&foot);
+      std::vector<Ravelin::Origin3d> goal(1,foot_pos[i]);
+      const double cold_err = end_effector_error(*this,one,goal,ws.ik_e);
+      Ravelin::VectorNd& x_warm = (ws.ik_x_trial = x);
+      for(int k=0;k<foot.chain.size();k++)
+        x_warm[foot_cols[i][k]] = foot.ik_solution[k];
+      set_chain_state(foot,chain_coords(foot_cols[i],x_warm,ws.v));
+      if(end_effector_error(*this,one,goal,ws.ik_e) < cold_err)
+        x = x_warm;
+      else
+        set_chain_state(foot,chain_coords(foot_cols[i],x,ws.v));
+    }
+  }
+  
+  Ravelin::VectorNd& e = ws.ik_e, & e_trial = ws.ik_e_trial, & y = ws.ik_y;
+  Ravelin::MatrixNd& J = ws.ik_J, & A = ws.ik_A, & gk = ws.ik_gk;
+  
+  double err = end_effector_error(*this,feet,foot_pos,e);
+  double lambda = options.damping;
+  bool update_jacobian = true;
+  unsigned iter = 0;
+  for(;err > options.tolerance && iter < options.max_iterations;iter++){
+    if(options.time_budget > 0 && (Profiler::now() - start) * 1e-9 > options.time_budget)
+      break;
+    
+    // J: (3 x NUM_EEFS) x N, linear rows of each end effector jacobian
+    if(update_jacobian){
+      J.set_zero(M,N);
+      for(int i=0;i<NUM_EEFS;i++){
+        link_jacobian(chain_coords(foot_cols[i],x,ws.v),*feet[i],GLOBAL,gk,ws);
+        for(int d=0;d<3;d++)
+          for(int k=0;k<foot_cols[i].size();k++)
+            J(3*i+d,foot_cols[i][k]) = gk(d,k);
+      }
+      update_jacobian = false;
+    }
+    
+    // step = J' (J J' + lambda I)^-1 e
+#ifdef PACER_FIXED_JOINT_DOFS
+    if(M == fixed_config::IK_ROWS && N == fixed_config::NUM_JOINT_DOFS){
+      ws.ik_x_trial.resize(N);
+      if(!fixed::dls_step<fixed_config::IK_ROWS,fixed_config::NUM_JOINT_DOFS>(J.data(),e.data(),lambda,ws.ik_x_trial.data())){
+        lambda *= 10;
+        continue;
+      }
+    } else
+#endif
+    {
+      J.mult_transpose(J,A);
+      for(int i=0;i<M;i++)
+        A(i,i) += lambda;
+      if(!ws.LA.factor_chol(A)){
+        lambda *= 10;
+        continue;
+      }
+      ws.LA.solve_chol_fast(A,y = e);
+      J.transpose_mult(y,ws.ik_x_trial);
+    }
+    ws.ik_x_trial += x;
     
-    // POSITION
-    OUTLOG(Ravelin::Pose3d::transform_point(GLOBAL,Ravelin::Vector3d(foot.link->get_pose())),foot.id + "_x",logDEBUG1);
-    OUTLOG(foot_pos[i],foot.id + "_x_des",logDEBUG1);
-    RMRC(foot,q,foot_pos[i],q_des,TOL);
+    for(int i=0;i<NUM_EEFS;i++)
+      set_chain_state(*feet[i],chain_coords(foot_cols[i],ws.ik_x_trial,ws.v));
+    const double err_trial = end_effector_error(*this,feet,foot_pos,e_trial);
+    OUT_LOG(logDEBUG2) << "IK iter " << iter << " lambda: " << lambda << " err: " << err << " -> " << err_trial;
     
-    //    RMRC(foot,q,Ravelin::VectorNd(6,Ravelin::SVector6d(foot_pos[i],Ravelin::Vector3d::zero()).data()),q_des,TOL);
-    OUTLOG(q_des.select(foot.chain_bool,workv_),foot.id + "_q",logDEBUG1);
+    if(err_trial < err){
+      // accept, trust the linearization more
+      x = ws.ik_x_trial;
+      e = e_trial;
+      err = err_trial;
+      lambda = std::max(lambda*0.5,Pacer::NEAR_ZERO);
+      update_jacobian = true;
+    } else {
+      // reject, damp harder from the same point
+      for(int i=0;i<NUM_EEFS;i++)
+        set_chain_state(*feet[i],chain_coords(foot_cols[i],x,ws.v));
+      lambda *= 4;
+    }
+  }
+  
+  OUT_LOG(logDEBUG1) << "Robot::end_effector_inverse_kinematics() -- iterations: " << iter << ", err: " << err
+                     << ", time: " << (Profiler::now() - start) * 1e-9;
+  
+  for(int j=0;j<N;j++)
+    q_des[coords[j]] = x[j];
+  for(int i=0;i<NUM_EEFS;i++){
+    end_effector_t& foot = *feet[i];
+    foot.ik_solution.resize(foot.chain.size());
+    for(int k=0;k<foot.chain.size();k++)
+      foot.ik_solution[k] = x[foot_cols[i][k]];
+    OUTLOG(q_des.select(foot.chain_bool,ws.v),foot.id + "_q",logDEBUG1);
   }
   
-  set_model_state(q);
+  set_model_coordinates(q);
   for(int i=0;i<NUM_EEFS;i++){
-    end_effector_t& foot = *(_id_end_effector_map[foot_id[i]].get());
+    end_effector_t& foot = *feet[i];
 
     // Calc jacobian for AB at this EEF
-    Ravelin::MatrixNd J;
-    Ravelin::VectorNd x(foot.chain.size());
+    Ravelin::MatrixNd J_foot;
+    Ravelin::VectorNd x_foot(foot.chain.size());
     for(int k=0;k<foot.chain.size();k++)                // actuated joints
-      x[k] = q[foot.chain[k]];
+      x_foot[k] = q[foot.chain[k]];
 
-    link_jacobian(x,foot,GLOBAL,J);
+    link_jacobian(x_foot,foot,GLOBAL,J_foot,ws);
 
     Ravelin::VectorNd qd_foot,qdd_foot;
     // VELOCITY & ACCELERATION
-    OUTLOG(J,foot.id + "__J", logDEBUG1);
+    OUTLOG(J_foot,foot.id + "__J", logDEBUG1);
     OUTLOG(foot_vel[i],foot.id + "_xd", logDEBUG1);
     qd_foot = Ravelin::VectorNd::zero(6);
     qd_foot.segment(0,3) = foot_vel[i];
-    Utility::solve((workM_ = J),qd_foot);
+    Utility::solve((ws.M = J_foot),qd_foot,ws);
     OUTLOG(qd_foot,foot.id + "_qd", logDEBUG1);
     
     OUTLOG(foot_acc[i],foot.id + "_xdd", logDEBUG1);
     qdd_foot = Ravelin::VectorNd::zero(6);
     qdd_foot.segment(0,3) = foot_acc[i];
 
-    Utility::solve((workM_ = J),qdd_foot);
+    Utility::solve((ws.M = J_foot),qdd_foot,ws);
     OUTLOG(qdd_foot,foot.id + "_qdd", logDEBUG1);
     
     for(int j=0;j<foot.chain.size();j++){
@@ -399,6 +855,8 @@ void Robot::end_effector_inverse_kinematics(
       qdd_des[foot.chain[j]] = qdd_foot[j];
     }
   }
+  
+  return err <= options.tolerance;
 }
 
 
@@ -410,19 +868,23 @@ void Robot::end_effector_inverse_kinematics(
 
 double Pacer::Robot::get_joint_value(const std::string& id, unit_e u, int dof)
 {
-  OUT_LOG(logDEBUG) << "Get: "<< id << "_" << unit_enum_string(u) << "["<< dof << "] --> " << _state[u][id][dof];
-  return _state[u][id][dof];
+  const joint_span_t& span = get_joint_span(id);
+  double val = state_vector(u)[span.offset+dof];
+  OUT_LOG(logDEBUG) << "Get: "<< id << "_" << unit_enum_string(u) << "["<< dof << "] --> " << val;
+  return val;
 }
 
 Ravelin::VectorNd Pacer::Robot::get_joint_value(const std::string& id, unit_e u)
 {
-  OUT_LOG(logDEBUG) << "Get: "<< id << "_" << unit_enum_string(u) << " --> " << _state[u][id];
-  return _state[u][id];
+  Ravelin::VectorNd dof_val;
+  get_joint_value(id,u,dof_val);
+  return dof_val;
 }
 
 void Pacer::Robot::get_joint_value(const std::string& id, unit_e u, Ravelin::VectorNd& dof_val)
 {
-  dof_val = _state[u][id];
+  const joint_span_t& span = get_joint_span(id);
+  state_vector(u).get_sub_vec(span.offset,span.offset+span.dofs,dof_val);
 #ifdef LOG_TO_FILE
   OUT_LOG(logDEBUG) << "Get: "<< id << "_" << unit_enum_string(u) << " --> " << dof_val;
 #endif
@@ -430,10 +892,9 @@ void Pacer::Robot::get_joint_value(const std::string& id, unit_e u, Ravelin::Vec
 
 void Pacer::Robot::get_joint_value(const std::string& id, unit_e u,std::vector<double>& dof_val)
 {
-  Ravelin::VectorNd& dof = _state[u][id];
-  dof_val.resize(dof.rows());
-  for(int i=0;i<dof.rows();i++)
-    dof_val[i] = dof[i];
+  const joint_span_t& span = get_joint_span(id);
+  const double* start = state_vector(u).data()+span.offset;
+  dof_val.assign(start,start+span.dofs);
 #ifdef LOG_TO_FILE
   OUT_LOG(logDEBUG) << "Get: "<< id << "_" << unit_enum_string(u) << " --> " << dof_val;
 #endif
@@ -444,10 +905,11 @@ void Pacer::Robot::set_joint_value(const std::string& id, unit_e u, int dof, dou
   OUT_LOG(logDEBUG) << "Set: "<< id << "_" << unit_enum_string(u) << "["<< dof <<"] <-- " << val;
   
   check_phase_internal(u);
+  const joint_span_t& span = get_joint_span(id);
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
-  _state[u][id][dof] = val;
+  state_vector(u)[span.offset+dof] = val;
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
 #endif
@@ -459,13 +921,13 @@ void Pacer::Robot::set_joint_value(const std::string& id, unit_e u, const Raveli
   OUT_LOG(logDEBUG) << "Set: "<< id << "_" << unit_enum_string(u) << " <-- " << dof_val;
 #endif
   check_phase_internal(u);
+  const joint_span_t& span = get_joint_span(id);
+  if(span.dofs != dof_val.rows())
+    throw std::runtime_error("Missized dofs in joint "+id+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.rows()));
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
-  Ravelin::VectorNd& dof = _state[u][id];
-  if(dof.rows() != dof_val.rows())
-    throw std::runtime_error("Missized dofs in joint "+id+": internal="+boost::icl::to_string<double>::apply(dof.rows())+" , provided="+boost::icl::to_string<double>::apply(dof_val.rows()));
-  dof = dof_val;
+  state_vector(u).set_sub_vec(span.offset,dof_val);
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
 #endif
@@ -478,41 +940,38 @@ void Pacer::Robot::set_joint_value(const std::string& id, unit_e u, const std::v
 #endif
   
   check_phase_internal(u);
+  const joint_span_t& span = get_joint_span(id);
+  if(span.dofs != dof_val.size())
+    throw std::runtime_error("Missized dofs in joint "+id+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
-  Ravelin::VectorNd& dof = _state[u][id];
-  if(dof.rows() != dof_val.size())
-    throw std::runtime_error("Missized dofs in joint "+id+": internal="+boost::icl::to_string<double>::apply(dof.rows())+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
-  for(int i=0;i<dof.rows();i++)
-    dof[i] = dof_val[i];
+  std::copy(dof_val.begin(),dof_val.end(),state_vector(u).data()+span.offset);
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
 #endif
 }
 
 void Pacer::Robot::get_joint_value(Pacer::Robot::unit_e u, std::map<std::string,std::vector<double> >& id_dof_val_map){
-  std::map<std::string,Ravelin::VectorNd>::iterator it;
-  for(it=_state[u].begin();it!=_state[u].end();it++){
-    const Ravelin::VectorNd& dof_val_internal = (*it).second;
-    std::vector<double>& dof_val = id_dof_val_map[(*it).first];
-    dof_val.resize(dof_val_internal.size());
-    for(int j=0;j<(*it).second.rows();j++){
-      dof_val[j] = dof_val_internal[j];
-    }
+  const Ravelin::VectorNd& x = state_vector(u);
+  for(int i=0;i<_joint_ids.size();i++){
+    const joint_span_t& span = _joint_spans[i];
+    std::vector<double>& dof_val = id_dof_val_map[_joint_ids[i]];
+    dof_val.assign(x.data()+span.offset,x.data()+span.offset+span.dofs);
 #ifdef LOG_TO_FILE
-    OUT_LOG(logDEBUG) << "Get: "<< (*it).first << "_" << unit_enum_string(u) << " --> " << dof_val;
+    OUT_LOG(logDEBUG) << "Get: "<< _joint_ids[i] << "_" << unit_enum_string(u) << " --> " << dof_val;
 #endif
   }
 }
 
 void Pacer::Robot::get_joint_value(Pacer::Robot::unit_e u, std::map<std::string,Ravelin::VectorNd >& id_dof_val_map){
-  const std::vector<std::string>& keys = _joint_ids;
-  for(int i=0;i<keys.size();i++){
-    const Ravelin::VectorNd& dof_val_internal = _state[u][keys[i]];
-    id_dof_val_map[keys[i]] = dof_val_internal;
+  const Ravelin::VectorNd& x = state_vector(u);
+  for(int i=0;i<_joint_ids.size();i++){
+    const joint_span_t& span = _joint_spans[i];
+    Ravelin::VectorNd& dof_val = id_dof_val_map[_joint_ids[i]];
+    x.get_sub_vec(span.offset,span.offset+span.dofs,dof_val);
 #ifdef LOG_TO_FILE
-    OUT_LOG(logDEBUG) << "Get: "<< keys[i] << "_" << unit_enum_string(u) << " --> " << dof_val_internal;
+    OUT_LOG(logDEBUG) << "Get: "<< _joint_ids[i] << "_" << unit_enum_string(u) << " --> " << dof_val;
 #endif
   }
 }
@@ -521,21 +980,23 @@ void Pacer::Robot::set_joint_value(Pacer::Robot::unit_e u,const std::map<std::st
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
+  Ravelin::VectorNd& x = state_vector(u);
   std::map<std::string,std::vector<double> >::const_iterator it;
   
   for(it=id_dof_val_map.begin();it!=id_dof_val_map.end();it++){
-    Ravelin::VectorNd& dof_val_internal = _state[u][(*it).first];
+    const joint_span_t& span = get_joint_span((*it).first);
     const std::vector<double>& dof_val = (*it).second;
 #ifdef LOG_TO_FILE
     OUT_LOG(logDEBUG) << "Set: "<< (*it).first << "_" << unit_enum_string(u) << " <-- " << dof_val;
 #endif
-    if(dof_val_internal.rows() != dof_val.size()){
-      std::cerr << "Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof_val_internal.rows())+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()) << std::endl;
-      throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof_val_internal.rows())+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
-    }
-    for(int j=0;j<(*it).second.size();j++){
-      dof_val_internal[j] = dof_val[j];
+    if(span.dofs != dof_val.size()){
+      std::cerr << "Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()) << std::endl;
+#ifdef USE_THREADS
+      pthread_mutex_unlock(&_state_mutex);
+#endif
+      throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply(dof_val.size()));
     }
+    std::copy(dof_val.begin(),dof_val.end(),x.data()+span.offset);
   }
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
@@ -546,13 +1007,18 @@ void Pacer::Robot::set_joint_value(Pacer::Robot::unit_e u,const std::map<std::st
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
+  Ravelin::VectorNd& x = state_vector(u);
   std::map<std::string,Ravelin::VectorNd >::const_iterator it;
   for(it=id_dof_val_map.begin();it!=id_dof_val_map.end();it++){
-    Ravelin::VectorNd& dof_val_internal = _state[u][(*it).first];
+    const joint_span_t& span = get_joint_span((*it).first);
     OUT_LOG(logDEBUG) << "Set: "<< (*it).first << "_" << unit_enum_string(u) << " <-- " << (*it).second;
-    if(dof_val_internal.rows() != (*it).second.rows())
-      throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(dof_val_internal.rows())+" , provided="+boost::icl::to_string<double>::apply((*it).second.rows()));
-    dof_val_internal = (*it).second;
+    if(span.dofs != (*it).second.rows()){
+#ifdef USE_THREADS
+      pthread_mutex_unlock(&_state_mutex);
+#endif
+      throw std::runtime_error("Missized dofs in joint "+(*it).first+": internal="+boost::icl::to_string<double>::apply(span.dofs)+" , provided="+boost::icl::to_string<double>::apply((*it).second.rows()));
+    }
+    x.set_sub_vec(span.offset,(*it).second);
   }
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
@@ -570,20 +1036,7 @@ void Pacer::Robot::set_joint_generalized_value(Pacer::Robot::unit_e u, const Rav
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
-  
-  // TODO: make this more efficient ITERATORS dont work
-  //      std::map<std::string,Ravelin::VectorNd>::iterator it;
-  const std::vector<std::string>& keys = _joint_ids;
-  
-  for(int i=0;i<keys.size();i++){
-    const std::vector<int>& dof = _id_dof_coord_map[keys[i]];
-    Ravelin::VectorNd& dof_val = _state[u][keys[i]];
-    if(dof.size() != dof_val.rows())
-      throw std::runtime_error("Missized dofs in joint "+keys[i]+": internal="+boost::icl::to_string<double>::apply(dof.size())+" , provided="+boost::icl::to_string<double>::apply(dof_val.rows()));
-    for(int j=0;j<dof.size();j++){
-      dof_val[j] = generalized_vec[dof[j]];
-    }
-  }
+  state_vector(u).set_sub_vec(0,generalized_vec);
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
 #endif
@@ -591,15 +1044,7 @@ void Pacer::Robot::set_joint_generalized_value(Pacer::Robot::unit_e u, const Rav
 }
 
 void Pacer::Robot::get_joint_generalized_value(Pacer::Robot::unit_e u, Ravelin::VectorNd& generalized_vec){
-  generalized_vec.set_zero(NUM_JOINT_DOFS);
-  std::map<std::string,Ravelin::VectorNd>::iterator it;
-  for(it=_state[u].begin();it!=_state[u].end();it++){
-    const std::vector<int>& dof = _id_dof_coord_map[(*it).first];
-    const Ravelin::VectorNd& dof_val = (*it).second;
-    for(int j=0;j<(*it).second.size();j++){
-      generalized_vec[dof[j]] = dof_val[j];
-    }
-  }
+  state_vector(u).get_sub_vec(0,NUM_JOINT_DOFS,generalized_vec);
   OUT_LOG(logDEBUG) << "Get: joint_generalized_" << unit_enum_string(u) << " --> " << generalized_vec;
 }
 
@@ -612,33 +1057,27 @@ Ravelin::VectorNd Pacer::Robot::get_joint_generalized_value(Pacer::Robot::unit_e
 /// With Base
 void Pacer::Robot::set_generalized_value(Pacer::Robot::unit_e u,const Ravelin::VectorNd& generalized_vec){
   check_phase_internal(u);
-  if (floating_base())
-  switch(u){
-    case(position_goal):
-    case(position):
-      set_base_value(u,generalized_vec.segment(NUM_JOINT_DOFS,NUM_JOINT_DOFS+NEULER));
-      break;
-    default:
-      set_base_value(u,generalized_vec.segment(NUM_JOINT_DOFS,NUM_JOINT_DOFS+NSPATIAL));
-      break;
+  if (floating_base()){
+    const unsigned N = NUM_JOINT_DOFS+num_base_dof(u);
+    if(generalized_vec.rows() != N)
+      throw std::runtime_error("Missized generalized vector: internal="+boost::icl::to_string<double>::apply(N)+" , provided="+boost::icl::to_string<double>::apply(generalized_vec.rows()));
+#ifdef USE_THREADS
+    pthread_mutex_lock(&_state_mutex);
+#endif
+    // joints and base are contiguous: one copy
+    state_vector(u) = generalized_vec;
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&_state_mutex);
+#endif
+  } else {
+    set_joint_generalized_value(u,generalized_vec.segment(0,NUM_JOINT_DOFS));
   }
-  set_joint_generalized_value(u,generalized_vec.segment(0,NUM_JOINT_DOFS));
   OUT_LOG(logDEBUG) << "Set: generalized_" << unit_enum_string(u) << " <-- " << generalized_vec;
 }
 
 /// With Base
 void Pacer::Robot::get_generalized_value(Pacer::Robot::unit_e u, Ravelin::VectorNd& generalized_vec){
-  switch(u){
-    case(position_goal):
-    case(position):
-      generalized_vec.set_zero(NUM_JOINT_DOFS+NEULER);
-      break;
-    default:
-      generalized_vec.set_zero(NUM_JOINT_DOFS+NSPATIAL);
-      break;
-  }
-  generalized_vec.set_sub_vec(0,get_joint_generalized_value(u));
-  generalized_vec.set_sub_vec(NUM_JOINT_DOFS,get_base_value(u));
+  generalized_vec = state_vector(u);
   OUT_LOG(logDEBUG) << "Get: generalized_" << unit_enum_string(u) << " --> " << generalized_vec;
 }
 
@@ -671,7 +1110,7 @@ void Pacer::Robot::set_base_value(Pacer::Robot::unit_e u,const Ravelin::VectorNd
 #ifdef USE_THREADS
   pthread_mutex_lock(&_state_mutex);
 #endif
-  _base_state[u] = vec;
+  state_vector(u).set_sub_vec(NUM_JOINT_DOFS,vec);
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_state_mutex);
 #endif
@@ -684,7 +1123,7 @@ void Pacer::Robot::get_base_value(Pacer::Robot::unit_e u, Ravelin::VectorNd& vec
     return;
   }
 
-  vec = _base_state[u];
+  state_vector(u).get_sub_vec(NUM_JOINT_DOFS,NUM_JOINT_DOFS+num_base_dof(u),vec);
   OUT_LOG(logDEBUG) << "Get: base_" << unit_enum_string(u) << " --> " << vec;
 }
 
@@ -776,8 +1215,6 @@ std::map<std::string,Ravelin::Origin3d> Pacer::Robot::get_end_effector_value(Pac
 void Pacer::Robot::init_state(){
   check_phase_internal(initialization);
   reset_contact();
-  // TODO: make this more efficient ITERATORS dont work
-  //      std::map<std::string,Ravelin::VectorNd>::iterator it;
   
   const int num_state_units = 8;
   unit_e state_units[num_state_units] = {position,position_goal,velocity,velocity_goal,acceleration,acceleration_goal,load, load_goal};
@@ -789,21 +1226,18 @@ void Pacer::Robot::init_state(){
       _end_effector_state[u][foot_keys[i]].set_zero();
       _end_effector_is_set[foot_keys[i]] = false;
     }
-    
-    _state[u] = std::map<std::string, Ravelin::VectorNd >();
-    const std::vector<std::string>& keys = _joint_ids;
-    for(int i=0;i<keys.size();i++){
-      const int N = get_joint_dofs(keys[i]);
-      _state[u][keys[i]].set_zero(N);
-    }
+  }
+  
+  // Every unit gets a dense [joints | base] vector so lookups never allocate
+  _state.resize(clean_up+1);
+  for(int u=0;u<_state.size();u++){
+    _state[u].set_zero(NUM_JOINT_DOFS+num_base_dof(static_cast<unit_e>(u)));
   }
 }
 
 void Pacer::Robot::reset_state(){
   check_phase_internal(clean_up);
   reset_contact();
-  // TODO: make this more efficient ITERATORS dont work
-  //      std::map<std::string,Ravelin::VectorNd>::iterator it;
   
   const int num_state_units = 8;
   unit_e state_units[num_state_units] = {position,position_goal,velocity,velocity_goal,acceleration,acceleration_goal,load, load_goal};
@@ -815,10 +1249,48 @@ void Pacer::Robot::reset_state(){
       _end_effector_is_set[foot_keys[i]] = false;
     }
     
-    const std::vector<std::string>& keys = _joint_ids;
-    for(int i=0;i<keys.size();i++){
-      const int N = get_joint_dofs(keys[i]);
-      _state[u][keys[i]].set_zero(N);
-    }
+    // only the joint entries are cleared, base state persists across ticks
+    std::fill(_state[u].data(),_state[u].data()+NUM_JOINT_DOFS,0.0);
   }
 }
+
+void Pacer::Robot::copy_state(Pacer::Robot& robot){
+  if(robot.NUM_JOINT_DOFS != NUM_JOINT_DOFS)
+    throw std::runtime_error("copy_state: robots have different numbers of joint dofs");
+#ifdef USE_THREADS
+  pthread_mutex_lock(&robot._state_mutex);
+  pthread_mutex_lock(&_state_mutex);
+#endif
+  _state = robot._state;
+  _end_effector_state = robot._end_effector_state;
+  _end_effector_is_set = robot._end_effector_is_set;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_state_mutex);
+  pthread_mutex_unlock(&robot._state_mutex);
+#endif
+  
+  // contacts are shared pointers, copy the contact data
+  _id_contacts_map.clear();
+  std::map<std::string,std::vector< boost::shared_ptr<contact_t> > >::const_iterator it;
+  for(it=robot._id_contacts_map.begin();it!=robot._id_contacts_map.end();it++){
+    std::vector< boost::shared_ptr<contact_t> >& c = _id_contacts_map[(*it).first];
+    for(int i=0;i<(*it).second.size();i++)
+      c.push_back(boost::shared_ptr<contact_t>(new contact_t(*(*it).second[i])));
+  }
+}
+
+void Pacer::Robot::assign_state(Pacer::Robot::unit_e u, const Ravelin::VectorNd& v){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_state_mutex);
+#endif
+  if(v.rows() != _state[u].rows()){
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&_state_mutex);
+#endif
+    throw std::runtime_error("assign_state: state vector has the wrong size for unit " + std::string(unit_enum_string(u)));
+  }
+  _state[u] = v;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_state_mutex);
+#endif
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using Pacer::LCPChain;
+
+// zero tolerance of lcp_fast() (that of the inverse dynamics plugin)
+static const double FAST_ZERO_TOL = 1e-16;
+
+LCPChain::LCPChain(const std::vector<std::string>& methods) : SolverChain("LCPChain"), _M(NULL), _q(NULL), _indices(NULL), _z(NULL), _same_indices(false) {
+  // "lemke" is a method of its own
+  _qp.fallback = false;
+  set_methods(methods);
+}
+
+void LCPChain::set_methods(const std::vector<std::string>& methods){
+  std::vector<method_t> m;
+  for(unsigned i=0;i<methods.size();i++){
+    const std::string& name = methods[i];
+    if(name.compare("lcp-fast") == 0)
+      m.push_back(LCP_FAST);
+    else if(name.compare("moby-fast") == 0)
+      m.push_back(MOBY_FAST);
+    else if(name.compare("qp") == 0)
+      m.push_back(QP);
+    else if(name.compare("lemke") == 0)
+      m.push_back(LEMKE);
+    else if(name.compare("moby-lemke") == 0)
+      m.push_back(MOBY_LEMKE);
+    else if(name.compare("pgs") == 0)
+      m.push_back(PGS);
+    else
+      throw std::runtime_error("Unknown LCP method: " + name);
+  }
+
+  _methods = m;
+  set_names(methods);
+}
+
+double LCPChain::error(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const Ravelin::VectorNd& z){
+  const unsigned n = q.rows();
+  if(z.rows() != n || !Utility::isvalid(z))
+    return std::numeric_limits<double>::infinity();
+  M.mult(z,_w);
+  _w += q;
+  double err = 0;
+  for(unsigned i=0;i<n;i++)
+    err = std::max(err,std::fabs(std::min(z[i],_w[i])));
+  return err;
+}
+
+double LCPChain::attempt(unsigned i){
+  const Ravelin::MatrixNd& M = *_M;
+  const Ravelin::VectorNd& q = *_q;
+  const std::vector<unsigned>& indices = *_indices;
+  Ravelin::VectorNd& z = *_z;
+  const unsigned n = q.rows();
+
+  z = _z0;
+  bool SOLVE_FLAG = false;
+  switch(_methods[i]){
+    case LCP_FAST:
+      // lcp_fast() needs the foot of each variable
+      if(indices.size() != n)
+        break;
+      SOLVE_FLAG = _lcp.lcp_fast(M,q,indices,z,FAST_ZERO_TOL);
+      break;
+    case MOBY_FAST:
+      SOLVE_FLAG = _moby.lcp_fast(M,q,z);
+      break;
+    case QP: {
+      // the LCP is the optimality condition of the QP only for symmetric M
+      double asym = 0, M_max = 0;
+      for(unsigned r=0;r<n;r++)
+        for(unsigned c=0;c<n;c++){
+          asym = std::max(asym,std::fabs(M(r,c) - M(c,r)));
+          M_max = std::max(M_max,std::fabs(M(r,c)));
+        }
+      if(asym > std::sqrt(std::numeric_limits<double>::epsilon()) * (1.0 + M_max))
+        break;
+      _A.resize(0,n);
+      _b.resize(0);
+      z.set_zero(n);
+      SOLVE_FLAG = _qp.solve_qp_pos(M,q,_A,_b,z,indices,_same_indices);
+      break;
+    }
+    case LEMKE:
+      SOLVE_FLAG = _lcp.lcp_lemke_regularized(M,q,z,-20,4,1);
+      break;
+    case MOBY_LEMKE:
+      SOLVE_FLAG = _moby.lcp_lemke_regularized(M,q,z,-20,4,1);
+      break;
+    case PGS:
+      SOLVE_FLAG = _lcp.lcp_pgs(M,q,z,tolerance);
+      break;
+  }
+  return SOLVE_FLAG? error(M,q,z) : std::numeric_limits<double>::infinity();
+}
+
+bool LCPChain::solve(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, const std::vector<unsigned>& indices, Ravelin::VectorNd& z, bool same_indices){
+  const unsigned n = q.rows();
+  double q_max = 0;
+  for(unsigned i=0;i<n;i++)
+    q_max = std::max(q_max,std::fabs(q[i]));
+
+  _M = &M;
+  _q = &q;
+  _indices = &indices;
+  _z = &z;
+  _same_indices = same_indices;
+  _z0 = z;
+  return run(tolerance * (1.0 + q_max));
+}
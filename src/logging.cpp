@@ -10,9 +10,28 @@
 #include <iostream>     // std::cout, std::fixed
 #include <iomanip>      // std::setprecision
 
+#if defined(LOG_TO_FILE) || defined(USE_TELEMETRY)
+
+#ifdef USE_TELEMETRY
+#include <Pacer/telemetry.h>
+// Numeric series are also appended to the binary telemetry stream, through the
+// series id kept by the OUTLOG call site
+#define TELEMETRY_RECORD(name,data,n,LL) \
+  if (site && LL <= Pacer::Telemetry::ReportingLevel()) \
+    Pacer::Telemetry::instance().record(*site,name,data,n)
+#else
+#define TELEMETRY_RECORD(name,data,n,LL)
+#endif
+
+// Don't format text that would not be written
 #ifdef LOG_TO_FILE
+#define TEXT_LOGGED(LL) (LL <= FILELog::ReportingLevel())
+#else
+#define TEXT_LOGGED(LL) (false)
+#endif
 
-void OUTLOG(const std::map<std::string,Ravelin::VectorNd>& z, std::string name,TLogLevel LL){
+void outlog(const std::map<std::string,Ravelin::VectorNd>& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   OUT_LOG(LL) << name << " = [\n";
   for (std::map<std::string,Ravelin::VectorNd>::const_iterator it = z.begin(); it != z.end(); it++) {
     std::ostringstream str;
@@ -24,7 +43,8 @@ void OUTLOG(const std::map<std::string,Ravelin::VectorNd>& z, std::string name,T
   OUT_LOG(LL) << "]";
 }
 
-void OUTLOG(const std::map<std::string,double>& z, std::string name,TLogLevel LL){
+void outlog(const std::map<std::string,double>& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   std::ostringstream str;
   for (std::map<std::string,double>::const_iterator it = z.begin(); it != z.end(); it++) {
     str << (*it).first << " = [" << (*it).second << "]';\n";
@@ -32,7 +52,8 @@ void OUTLOG(const std::map<std::string,double>& z, std::string name,TLogLevel LL
   OUT_LOG(LL) << name << " = [\n" << str.str() << "]';";
 }
 
-void OUTLOG(const Ravelin::MatrixNd& M, std::string name,TLogLevel LL){
+void outlog(const Ravelin::MatrixNd& M, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<M.rows();i++){
@@ -44,7 +65,8 @@ void OUTLOG(const Ravelin::MatrixNd& M, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::SharedConstMatrixNd& M, std::string name,TLogLevel LL){
+void outlog(const Ravelin::SharedConstMatrixNd& M, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<M.rows();i++){
@@ -56,7 +78,8 @@ void OUTLOG(const Ravelin::SharedConstMatrixNd& M, std::string name,TLogLevel LL
   
 }
 
-void OUTLOG(const Ravelin::Matrix3d& M, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Matrix3d& M, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<M.rows();i++){
@@ -68,7 +91,8 @@ void OUTLOG(const Ravelin::Matrix3d& M, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::Pose3d& P, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Pose3d& P, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   Ravelin::Matrix3d R;
   R = Ravelin::Matrix3d(P.q);
@@ -84,7 +108,8 @@ void OUTLOG(const Ravelin::Pose3d& P, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const boost::shared_ptr<Ravelin::Pose3d>& P, std::string name,TLogLevel LL){
+void outlog(const boost::shared_ptr<Ravelin::Pose3d>& P, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   Ravelin::Matrix3d R;
   R = Ravelin::Matrix3d(P->q);
@@ -100,7 +125,8 @@ void OUTLOG(const boost::shared_ptr<Ravelin::Pose3d>& P, std::string name,TLogLe
   
 }
 
-void OUTLOG(const boost::shared_ptr<const Ravelin::Pose3d>& P, std::string name,TLogLevel LL){
+void outlog(const boost::shared_ptr<const Ravelin::Pose3d>& P, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   Ravelin::Matrix3d R;
   R = Ravelin::Matrix3d(P->q);
@@ -116,7 +142,9 @@ void OUTLOG(const boost::shared_ptr<const Ravelin::Pose3d>& P, std::string name,
   
 }
 
-void OUTLOG(const Ravelin::VectorNd& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::VectorNd& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,z.data(),z.rows(),LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.rows();i++)
@@ -126,7 +154,9 @@ void OUTLOG(const Ravelin::VectorNd& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const std::vector<double>& z, std::string name,TLogLevel LL){
+void outlog(const std::vector<double>& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,(z.empty())? NULL : &z[0],z.size(),LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.size();i++)
@@ -136,7 +166,14 @@ void OUTLOG(const std::vector<double>& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const std::vector<int>& z, std::string name,TLogLevel LL){
+void outlog(const std::vector<int>& z, std::string name,TLogLevel LL, outlog_site_t* site){
+#ifdef USE_TELEMETRY
+  if (LL <= Pacer::Telemetry::ReportingLevel()){
+    std::vector<double> zd(z.begin(),z.end());
+    TELEMETRY_RECORD(name,(zd.empty())? NULL : &zd[0],zd.size(),LL);
+  }
+#endif
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.size();i++)
@@ -146,7 +183,8 @@ void OUTLOG(const std::vector<int>& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const std::vector<std::string>& z, std::string name,TLogLevel LL){
+void outlog(const std::vector<std::string>& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.size();i++)
@@ -155,7 +193,8 @@ void OUTLOG(const std::vector<std::string>& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const std::string& z, std::string name,TLogLevel LL){
+void outlog(const std::string& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   
@@ -163,7 +202,12 @@ void OUTLOG(const std::string& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::SVector6d& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::SVector6d& z, std::string name,TLogLevel LL, outlog_site_t* site){
+#ifdef USE_TELEMETRY
+  const double zd[6] = {z[0],z[1],z[2],z[3],z[4],z[5]};
+  TELEMETRY_RECORD(name,zd,6,LL);
+#endif
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.rows();i++)
@@ -173,7 +217,9 @@ void OUTLOG(const Ravelin::SVector6d& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::Origin3d& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Origin3d& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,z.data(),3,LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<3;i++)
@@ -182,7 +228,9 @@ void OUTLOG(const Ravelin::Origin3d& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::Vector3d& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Vector3d& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,z.data(),3,LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<3;i++)
@@ -191,7 +239,12 @@ void OUTLOG(const Ravelin::Vector3d& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::Vector2d& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Vector2d& z, std::string name,TLogLevel LL, outlog_site_t* site){
+#ifdef USE_TELEMETRY
+  const double zd[2] = {z[0],z[1]};
+  TELEMETRY_RECORD(name,zd,2,LL);
+#endif
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<2;i++)
@@ -200,7 +253,9 @@ void OUTLOG(const Ravelin::Vector2d& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::SharedVectorNd& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::SharedVectorNd& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,z.data(),z.rows(),LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   std::ostringstream str;
   for(int i=0;i<z.rows();i++)
@@ -209,7 +264,8 @@ void OUTLOG(const Ravelin::SharedVectorNd& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::AAngled& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::AAngled& z, std::string name,TLogLevel LL, outlog_site_t* site){
+  if(!TEXT_LOGGED(LL)) return;
   
   OUT_LOG(LL) << std::setprecision(9)
   << name << " = <"
@@ -217,13 +273,20 @@ void OUTLOG(const Ravelin::AAngled& z, std::string name,TLogLevel LL){
   
 }
 
-void OUTLOG(const Ravelin::Quatd& z, std::string name,TLogLevel LL){
+void outlog(const Ravelin::Quatd& z, std::string name,TLogLevel LL, outlog_site_t* site){
+#ifdef USE_TELEMETRY
+  const double zd[4] = {z.x,z.y,z.z,z.w};
+  TELEMETRY_RECORD(name,zd,4,LL);
+#endif
+  if(!TEXT_LOGGED(LL)) return;
   
   OUT_LOG(LL) << std::setprecision(9)
   << name << " = " << z ;
 }
 
-void OUTLOG(double x, std::string name,TLogLevel LL){
+void outlog(double x, std::string name,TLogLevel LL, outlog_site_t* site){
+  TELEMETRY_RECORD(name,&x,1,LL);
+  if(!TEXT_LOGGED(LL)) return;
   
   OUT_LOG(LL) << name << " = " << x << ";" << std::endl;
   
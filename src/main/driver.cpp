@@ -4,7 +4,9 @@
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
 #include <Pacer/controller.h>
+#include <Pacer/periodic.h>
 #include <time.h>
+#include <boost/bind.hpp>
 
 using Pacer::Controller;
 
@@ -58,17 +60,106 @@ double step(double step_size = 0){
   
     if(REAL_TIME){
       TIME = get_current_time();
-      std::cerr << "Realtime : " <<  std::endl;
+      OUT_LOG(logDEBUG) << "Realtime : ";
 
     } else {
       TIME += step;
     }
     static double FIRST_TIME = TIME-step;
 
-    std::cerr << "time = " << (TIME-FIRST_TIME) << std::endl;
+    OUT_LOG(logDEBUG) << "time = " << (TIME-FIRST_TIME);
   robot_ptr->control( TIME-FIRST_TIME );
   return TIME;
 }
+
+// {min, mean, 50%, 99%, 99.9%, max} (seconds), 's' is resized in place
+static void summarize(const Histogram& h, std::vector<double>& s){
+  const double SEC_PER_NSEC = 1.0e-9;
+  s.resize(6);
+  s[0] = h.min() * SEC_PER_NSEC;
+  s[1] = h.mean() * SEC_PER_NSEC;
+  s[2] = h.percentile(0.5) * SEC_PER_NSEC;
+  s[3] = h.percentile(0.99) * SEC_PER_NSEC;
+  s[4] = h.percentile(0.999) * SEC_PER_NSEC;
+  s[5] = h.max() * SEC_PER_NSEC;
+}
+
+// Timing variables, resolved before the periodic loop starts: publishing
+// from the real-time thread only copies into the stored values
+static struct timing_handles_t{
+  variable_handle<std::vector<double> > latency, compute, latency_histogram, compute_histogram;
+  variable_handle<double> resolution, ticks, overruns, missed_periods;
+} timing;
+
+static void resolve_timing(const PeriodicExecutor& executor){
+  timing.latency = robot_ptr->get_data_handle<std::vector<double> >("main.timing.wakeup-latency");
+  timing.compute = robot_ptr->get_data_handle<std::vector<double> >("main.timing.compute-time");
+  timing.latency_histogram = robot_ptr->get_data_handle<std::vector<double> >("main.timing.wakeup-latency-histogram");
+  timing.compute_histogram = robot_ptr->get_data_handle<std::vector<double> >("main.timing.compute-time-histogram");
+  // counts are published as doubles (exact to 2^53), an int would wrap
+  timing.resolution = robot_ptr->get_data_handle<double>("main.timing.histogram-resolution");
+  timing.ticks = robot_ptr->get_data_handle<double>("main.timing.ticks");
+  timing.overruns = robot_ptr->get_data_handle<double>("main.timing.overruns");
+  timing.missed_periods = robot_ptr->get_data_handle<double>("main.timing.missed-periods");
+  
+  // allocate the stored vectors once
+  timing.latency.ref()->reserve(6);
+  timing.compute.ref()->reserve(6);
+  timing.latency_histogram.ref()->reserve(executor.wakeup_latency().buckets().size());
+  timing.compute_histogram.ref()->reserve(executor.compute_time().buckets().size());
+}
+
+static void publish_timing(const PeriodicExecutor& executor){
+  const Histogram &latency = executor.wakeup_latency(),
+                  &compute = executor.compute_time();
+  summarize(latency,*timing.latency.ref());
+  summarize(compute,*timing.compute.ref());
+  timing.latency_histogram.ref()->assign(latency.buckets().begin(),latency.buckets().end());
+  timing.compute_histogram.ref()->assign(compute.buckets().begin(),compute.buckets().end());
+  timing.resolution.set(latency.resolution() * 1.0e-9);
+  timing.ticks.set(executor.ticks());
+  timing.overruns.set(executor.overruns());
+  timing.missed_periods.set(executor.missed_periods());
+}
+
+static bool realtime_tick(const PeriodicExecutor* executor, double period, double max_time, unsigned publish_every, double t){
+  // the first deadline follows the initial control(0) call
+  TIME = t + period;
+  robot_ptr->control( TIME );
+  if((executor->ticks()+1) % publish_every == 0)
+    publish_timing(*executor);
+  return TIME < max_time;
+}
+
+// reads an integer option that may have been declared as an int or a double
+static void get_int_option(const std::string& name, int& val){
+  double double_val;
+  if(!robot_ptr->get_data<int>(name,val) && robot_ptr->get_data<double>(name,double_val))
+    val = double_val;
+}
+
+void run(double max_time, double period){
+  PeriodicExecutor::options_t options;
+  options.period = period;
+  get_int_option("main.realtime-priority",options.priority);
+  get_int_option("main.cpu",options.cpu);
+  robot_ptr->get_data<bool>("main.lock-memory",options.lock_memory);
+  
+  // timing statistics are published once per second
+  const unsigned publish_every = std::max(1.0,1.0/period);
+  PeriodicExecutor executor(options);
+  resolve_timing(executor);
+  executor.run(boost::bind(&realtime_tick,&executor,period,max_time,publish_every,_1));
+  publish_timing(executor);
+  
+  std::vector<double> latency, compute;
+  summarize(executor.wakeup_latency(),latency);
+  summarize(executor.compute_time(),compute);
+  std::cerr << "ticks: " << executor.ticks() << ", overruns: " << executor.overruns()
+            << ", missed periods: " << executor.missed_periods() << std::endl
+            << "wake-up latency (us) mean: " << latency[1]*1e6 << ", 99%: " << latency[3]*1e6 << ", max: " << latency[5]*1e6 << std::endl
+            << "compute time (us) mean: " << compute[1]*1e6 << ", 99%: " << compute[3]*1e6 << ", max: " << compute[5]*1e6 << std::endl;
+}
 }
 
 
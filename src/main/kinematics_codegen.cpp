@@ -0,0 +1,403 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+// Emits the forward kinematics of every end effector chain of a robot as
+// straight-line C++ (see Pacer/generated_kinematics.h)
+//
+// usage: pacer-kinematics-codegen OUT.cpp
+//   run in a directory with a vars.xml (as pacer-main), OUT.cpp is compiled
+//   into a library that vars.xml names as "kinematics-library"
+//   (see Robot::load_generated_kinematics(), cmake KINEMATICS_MODELS)
+//
+// Every chain is checked against the Ravelin model at random configurations
+// before it is written, chains with multi-dof joints are skipped.
+#include <Pacer/controller.h>
+#include <Pacer/generated_kinematics.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdexcept>
+
+typedef Pacer::Robot::end_effector_t end_effector_t;
+
+/// One link of a chain: its pose in the parent link at q = 0 and the motion of its inner joint
+struct link_t {
+  enum joint_e { FIXED, REVOLUTE, PRISMATIC };
+  std::string joint;
+  // parent <- link, row major
+  double R[9], t[3];
+  joint_e type;
+  // index of the joint's coordinate in q
+  int coord;
+  // joint axis and a point on it (link frame)
+  double axis[3], pivot[3];
+};
+
+/// Chain from the base to the end effector
+struct chain_t {
+  std::string id;
+  std::vector<unsigned> coords;
+  std::vector<link_t> links;
+};
+
+static const double SNAP_TOL = 1e-14, CHECK_TOL = 1e-6;
+static const unsigned NUM_CHECKS = 20;
+
+// exact zeros and ones let the compiler drop terms of the generated code
+static double snap(double x){
+  if(fabs(x) < SNAP_TOL) return 0;
+  if(fabs(x-1) < SNAP_TOL) return 1;
+  if(fabs(x+1) < SNAP_TOL) return -1;
+  return x;
+}
+
+static void copy3(const Ravelin::Vector3d& v, double* x){
+  for(int i=0;i<3;i++)
+    x[i] = snap(v[i]);
+}
+
+/// Reads the chain of 'foot' from the model (posed at q = 0)
+static bool extract_chain(Pacer::Robot& robot, const end_effector_t& foot, chain_t& chain){
+  chain.id = foot.id;
+  chain.coords = foot.chain;
+  chain.links.clear();
+
+  Ravelin::VectorNd q = robot.get_generalized_value(Pacer::Robot::position);
+  for(unsigned k=0;k<foot.chain.size();k++)
+    q[foot.chain[k]] = 0;
+  robot.set_model_state(q);
+
+  // chain_links, chain_joints and chain are ordered end effector -> base
+  std::vector<int> coord(foot.chain_joints.size());
+  for(unsigned i=0,k=0;i<foot.chain_joints.size();i++){
+    coord[i] = k;
+    k += foot.chain_joints[i]->num_dof();
+  }
+
+  for(int i=foot.chain_links.size()-1;i>=0;i--){
+    const boost::shared_ptr<Ravelin::RigidBodyd>& link = foot.chain_links[i];
+    const boost::shared_ptr<Ravelin::Jointd>& joint = foot.chain_joints[i];
+    link_t l;
+    l.joint = joint->joint_id;
+    l.coord = coord[i];
+
+    Ravelin::Transform3d T = Ravelin::Pose3d::calc_relative_pose(link->get_pose(),joint->get_inboard_link()->get_pose());
+    Ravelin::Matrix3d R(T.q);
+    for(int r=0;r<3;r++){
+      for(int c=0;c<3;c++)
+        l.R[r*3+c] = snap(R(r,c));
+      l.t[r] = snap(T.x[r]);
+    }
+
+    if(joint->num_dof() == 0){
+      l.type = link_t::FIXED;
+    } else if(joint->num_dof() == 1){
+      const Ravelin::SVelocityd& s = joint->get_spatial_axes()[0];
+      Ravelin::Vector3d w = s.get_angular(), v = s.get_linear();
+      if(w.norm() > 0.5){
+        l.type = link_t::REVOLUTE;
+        copy3(Ravelin::Pose3d::transform_vector(link->get_pose(),Ravelin::Vector3d(w.data(),s.pose)),l.axis);
+      } else {
+        l.type = link_t::PRISMATIC;
+        copy3(Ravelin::Pose3d::transform_vector(link->get_pose(),Ravelin::Vector3d(v.data(),s.pose)),l.axis);
+      }
+      copy3(Ravelin::Pose3d::transform_point(link->get_pose(),Ravelin::Vector3d(0,0,0,s.pose)),l.pivot);
+    } else {
+      fprintf(stderr,"%s: joint %s has %u dofs, only fixed and single dof joints are supported\n",
+              foot.id.c_str(),joint->joint_id.c_str(),joint->num_dof());
+      return false;
+    }
+    chain.links.push_back(l);
+  }
+  return true;
+}
+
+// a = a * b (3x3 row major)
+static void mult3(double* a, const double* b){
+  double c[9];
+  for(int r=0;r<3;r++)
+    for(int k=0;k<3;k++)
+      c[r*3+k] = a[r*3]*b[k] + a[r*3+1]*b[3+k] + a[r*3+2]*b[6+k];
+  std::copy(c,c+9,a);
+}
+
+// y += s * R x
+static void add_rotated(const double* R, const double* x, double s, double* y){
+  for(int r=0;r<3;r++)
+    y[r] += s * (R[r*3]*x[0] + R[r*3+1]*x[1] + R[r*3+2]*x[2]);
+}
+
+static void rotation(const double* a, double angle, double* M){
+  const double c = cos(angle), s = sin(angle), v = 1 - c;
+  M[0] = c + a[0]*a[0]*v;      M[1] = a[0]*a[1]*v - a[2]*s; M[2] = a[0]*a[2]*v + a[1]*s;
+  M[3] = a[1]*a[0]*v + a[2]*s; M[4] = c + a[1]*a[1]*v;      M[5] = a[1]*a[2]*v - a[0]*s;
+  M[6] = a[2]*a[0]*v - a[1]*s; M[7] = a[2]*a[1]*v + a[0]*s; M[8] = c + a[2]*a[2]*v;
+}
+
+/// Reference evaluation of the chain, the generated code performs the same operations
+static void evaluate(const chain_t& chain, const double* q, double* p, double* J){
+  const unsigned n = chain.coords.size();
+  double R[9] = {1,0,0,0,1,0,0,0,1}, t[3] = {0,0,0}, M[9];
+  std::vector<double> w(3*n), o(3*n);
+  for(unsigned i=0;i<chain.links.size();i++){
+    const link_t& l = chain.links[i];
+    add_rotated(R,l.t,1,t);
+    mult3(R,l.R);
+    if(l.type == link_t::REVOLUTE){
+      add_rotated(R,l.pivot,1,t);
+      std::copy(t,t+3,&o[3*l.coord]);
+      rotation(l.axis,q[l.coord],M);
+      mult3(R,M);
+      std::fill(&w[3*l.coord],&w[3*l.coord]+3,0.0);
+      add_rotated(R,l.axis,1,&w[3*l.coord]);
+      add_rotated(R,l.pivot,-1,t);
+    } else if(l.type == link_t::PRISMATIC){
+      std::fill(&w[3*l.coord],&w[3*l.coord]+3,0.0);
+      add_rotated(R,l.axis,1,&w[3*l.coord]);
+      for(int r=0;r<3;r++)
+        t[r] += w[3*l.coord+r] * q[l.coord];
+    }
+  }
+  std::copy(t,t+3,p);
+  for(unsigned i=0;i<chain.links.size();i++){
+    const link_t& l = chain.links[i];
+    if(l.type == link_t::FIXED)
+      continue;
+    double* col = J + 6*l.coord;
+    const double* wk = &w[3*l.coord];
+    if(l.type == link_t::REVOLUTE){
+      double d[3];
+      for(int r=0;r<3;r++)
+        d[r] = t[r] - o[3*l.coord+r];
+      col[0] = wk[1]*d[2] - wk[2]*d[1];
+      col[1] = wk[2]*d[0] - wk[0]*d[2];
+      col[2] = wk[0]*d[1] - wk[1]*d[0];
+      std::copy(wk,wk+3,col+3);
+    } else {
+      std::copy(wk,wk+3,col);
+      std::fill(col+3,col+6,0.0);
+    }
+  }
+}
+
+/// Compares the chain against the model at q = 0 and random configurations
+static bool check_chain(Pacer::Robot& robot, const end_effector_t& foot, const chain_t& chain){
+  const unsigned n = chain.coords.size();
+  boost::shared_ptr<const Ravelin::Pose3d> base = foot.chain_joints.back()->get_inboard_link()->get_pose();
+  Ravelin::VectorNd q = robot.get_generalized_value(Pacer::Robot::position), x(n);
+  Ravelin::MatrixNd gk;
+  std::vector<double> J(6*n);
+  double p[3], err = 0;
+  for(unsigned check=0;check<NUM_CHECKS;check++){
+    for(unsigned k=0;k<n;k++){
+      x[k] = (check == 0)? 0 : M_PI * (2.0*rand()/RAND_MAX - 1);
+      q[chain.coords[k]] = x[k];
+    }
+    robot.set_model_state(q);
+    Ravelin::Vector3d pos = Ravelin::Pose3d::transform_point(base,robot.get_end_effector_position(foot));
+    robot.link_jacobian(x,foot,base,gk);
+
+    evaluate(chain,x.data(),p,&J[0]);
+    for(int r=0;r<3;r++)
+      err = std::max(err,fabs(p[r] - pos[r]));
+    for(unsigned k=0;k<n;k++)
+      for(int r=0;r<6;r++)
+        err = std::max(err,fabs(J[6*k+r] - gk(r,k)));
+  }
+  if(err > CHECK_TOL)
+    fprintf(stderr,"%s: generated kinematics differ from the model by %g\n",chain.id.c_str(),err);
+  return err <= CHECK_TOL;
+}
+
+static void out(FILE* f, const char* format, ...){
+  va_list args;
+  va_start(args,format);
+  vfprintf(f,format,args);
+  va_end(args);
+}
+
+/// "v[0]*c[0] + v[1]*c[1] + v[2]*c[2]" without zero terms, "0" if all are
+static std::string dot(const std::string v[3], const double c[3]){
+  std::string s;
+  char term[128];
+  for(int i=0;i<3;i++){
+    if(c[i] == 0)
+      continue;
+    if(c[i] == 1)
+      snprintf(term,sizeof(term),"%s%s",s.empty()? "" : " + ",v[i].c_str());
+    else if(c[i] == -1)
+      snprintf(term,sizeof(term),"%s%s",s.empty()? "-" : " - ",v[i].c_str());
+    else
+      snprintf(term,sizeof(term),"%s%s*%.17g",s.empty()? "" : " + ",v[i].c_str(),c[i]);
+    s += term;
+  }
+  return s.empty()? "0" : s;
+}
+
+static std::string var(const char* name, int i){
+  char s[32];
+  snprintf(s,sizeof(s),"%s%d",name,i);
+  return s;
+}
+
+// names of the entries in row r of R
+static void row(int r, std::string v[3]){
+  for(int c=0;c<3;c++)
+    v[c] = var("R",r*3+c);
+}
+
+/// t (sign)= R x for constant x
+static void emit_add_rotated(FILE* f, const double* x, const char* sign){
+  std::string v[3];
+  for(int r=0;r<3;r++){
+    row(r,v);
+    std::string e = dot(v,x);
+    if(e != "0")
+      out(f,"  t%d %s= %s;\n",r,sign,e.c_str());
+  }
+}
+
+static void emit_chain(FILE* f, const chain_t& chain, unsigned index){
+  const unsigned n = chain.coords.size();
+  out(f,"\n// %s: q = [",chain.id.c_str());
+  for(int i=chain.links.size()-1;i>=0;i--)
+    if(chain.links[i].type != link_t::FIXED)
+      out(f," %s",chain.links[i].joint.c_str());
+  out(f," ]\n");
+  out(f,"static const unsigned coords_%u[] = {",index);
+  for(unsigned k=0;k<n;k++)
+    out(f,"%s%u",k? "," : "",chain.coords[k]);
+  out(f,"};\n\n");
+
+  out(f,"static void kinematics_%u(const double* q, double* p, double* J){\n",index);
+  out(f,"  double R0 = 1, R1 = 0, R2 = 0, R3 = 0, R4 = 1, R5 = 0, R6 = 0, R7 = 0, R8 = 1;\n");
+  out(f,"  double t0 = 0, t1 = 0, t2 = 0;\n");
+  for(unsigned i=0;i<chain.links.size();i++){
+    const link_t& l = chain.links[i];
+    out(f,"\n  // %s\n",l.joint.c_str());
+    emit_add_rotated(f,l.t,"+");
+
+    // R = R l.R
+    std::string v[3];
+    out(f,"  {\n");
+    for(int r=0;r<3;r++){
+      row(r,v);
+      for(int c=0;c<3;c++){
+        const double col[3] = {l.R[c],l.R[3+c],l.R[6+c]};
+        out(f,"    const double a%d = %s;\n",r*3+c,dot(v,col).c_str());
+      }
+    }
+    out(f,"    R0 = a0; R1 = a1; R2 = a2; R3 = a3; R4 = a4; R5 = a5; R6 = a6; R7 = a7; R8 = a8;\n");
+    out(f,"  }\n");
+
+    const int k = l.coord;
+    if(l.type == link_t::REVOLUTE){
+      const double* a = l.axis;
+      emit_add_rotated(f,l.pivot,"+");
+      out(f,"  const double o%d_0 = t0, o%d_1 = t1, o%d_2 = t2;\n",k,k,k);
+      out(f,"  {\n");
+      out(f,"    const double c = cos(q[%d]), s = sin(q[%d]), v = 1 - c;\n",k,k);
+      // rotation about the axis (same terms as rotation())
+      const std::string csv[3] = {"c","v","s"};
+      const double m[9][3] = {
+        {1,a[0]*a[0],0},     {0,a[0]*a[1],-a[2]}, {0,a[0]*a[2],a[1]},
+        {0,a[1]*a[0],a[2]},  {1,a[1]*a[1],0},     {0,a[1]*a[2],-a[0]},
+        {0,a[2]*a[0],-a[1]}, {0,a[2]*a[1],a[0]},  {1,a[2]*a[2],0}};
+      for(int j=0;j<9;j++)
+        out(f,"    const double m%d = %s;\n",j,dot(csv,m[j]).c_str());
+      for(int r=0;r<3;r++)
+        for(int c=0;c<3;c++)
+          out(f,"    const double a%d = R%d*m%d + R%d*m%d + R%d*m%d;\n",r*3+c,r*3,c,r*3+1,3+c,r*3+2,6+c);
+      out(f,"    R0 = a0; R1 = a1; R2 = a2; R3 = a3; R4 = a4; R5 = a5; R6 = a6; R7 = a7; R8 = a8;\n");
+      out(f,"  }\n");
+      for(int r=0;r<3;r++){
+        row(r,v);
+        out(f,"  const double w%d_%d = %s;\n",k,r,dot(v,a).c_str());
+      }
+      emit_add_rotated(f,l.pivot,"-");
+    } else if(l.type == link_t::PRISMATIC){
+      for(int r=0;r<3;r++){
+        row(r,v);
+        out(f,"  const double w%d_%d = %s;\n",k,r,dot(v,l.axis).c_str());
+      }
+      out(f,"  t0 += w%d_0*q[%d]; t1 += w%d_1*q[%d]; t2 += w%d_2*q[%d];\n",k,k,k,k,k,k);
+    }
+  }
+
+  out(f,"\n  p[0] = t0; p[1] = t1; p[2] = t2;\n");
+  out(f,"  if(!J)\n    return;\n");
+  for(unsigned i=0;i<chain.links.size();i++){
+    const link_t& l = chain.links[i];
+    const int k = l.coord;
+    if(l.type == link_t::REVOLUTE){
+      out(f,"  {\n");
+      out(f,"    const double d0 = t0 - o%d_0, d1 = t1 - o%d_1, d2 = t2 - o%d_2;\n",k,k,k);
+      out(f,"    J[%d] = w%d_1*d2 - w%d_2*d1; J[%d] = w%d_2*d0 - w%d_0*d2; J[%d] = w%d_0*d1 - w%d_1*d0;\n",
+          6*k,k,k,6*k+1,k,k,6*k+2,k,k);
+      out(f,"    J[%d] = w%d_0; J[%d] = w%d_1; J[%d] = w%d_2;\n",6*k+3,k,6*k+4,k,6*k+5,k);
+      out(f,"  }\n");
+    } else if(l.type == link_t::PRISMATIC){
+      out(f,"  J[%d] = w%d_0; J[%d] = w%d_1; J[%d] = w%d_2;\n",6*k,k,6*k+1,k,6*k+2,k);
+      out(f,"  J[%d] = 0; J[%d] = 0; J[%d] = 0;\n",6*k+3,6*k+4,6*k+5);
+    }
+  }
+  out(f,"}\n");
+}
+
+int main(int argc, char* argv[]){
+  if(argc != 2){
+    fprintf(stderr,"usage: %s OUT.cpp  (run in a directory with vars.xml)\n",argv[0]);
+    return 1;
+  }
+
+  try {
+    boost::shared_ptr<Pacer::Controller> ctrl(new Pacer::Controller());
+    ctrl->init();
+    const std::string model = ctrl->get_data<std::string>("robot-model");
+
+    std::vector<chain_t> chains;
+    std::map<std::string,boost::shared_ptr<end_effector_t> >& feet = ctrl->get_end_effectors();
+    std::map<std::string,boost::shared_ptr<end_effector_t> >::iterator it;
+    srand(0);
+    for(it=feet.begin();it!=feet.end();it++){
+      const end_effector_t& foot = *(*it).second;
+      chain_t chain;
+      if(!extract_chain(*ctrl,foot,chain))
+        continue;
+      if(!check_chain(*ctrl,foot,chain))
+        return 1;
+      chains.push_back(chain);
+    }
+
+    FILE* f = fopen(argv[1],"w");
+    if(!f){
+      fprintf(stderr,"cannot write %s\n",argv[1]);
+      return 1;
+    }
+    out(f,"// Generated by pacer-kinematics-codegen from %s, do not edit\n",model.c_str());
+    out(f,"#include <Pacer/generated_kinematics.h>\n#include <math.h>\n");
+    for(unsigned i=0;i<chains.size();i++)
+      emit_chain(f,chains[i],i);
+
+    if(!chains.empty()){
+      out(f,"\nstatic const Pacer::generated_chain_t chains[] = {\n");
+      for(unsigned i=0;i<chains.size();i++)
+        out(f,"  {\"%s\", %u, coords_%u, kinematics_%u},\n",chains[i].id.c_str(),(unsigned) chains[i].coords.size(),i,i);
+      out(f,"};\n");
+    }
+    out(f,"\n");
+    out(f,"static const Pacer::generated_kinematics_t kinematics = {\"%s\", %u, %s};\n\n",
+        model.c_str(),(unsigned) chains.size(),chains.empty()? "0" : "chains");
+    out(f,"extern \"C\" const Pacer::generated_kinematics_t* pacer_generated_kinematics(){\n  return &kinematics;\n}\n");
+    fclose(f);
+    printf("%s: %u chains\n",argv[1],(unsigned) chains.size());
+  } catch(std::exception& e){
+    fprintf(stderr,"%s\n",e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -3,40 +3,41 @@
  * This library is distributed under the terms of the Apache V2.0
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
-#include <time.h>
-static double sleep_duration(double duration){
-    timespec req,rem;
-    int seconds = duration;
-    req.tv_nsec = (duration - (double)seconds) * 1.0e+9;
-    req.tv_sec = seconds;
-    nanosleep(&req,&rem);
-    return 0;//( ( (double) rem.tv_nsec / 1.0e+9 ) + (double) rem.tv_sec);
-}
-
+// usage: pacer-main MAX_TIME FREQUENCY
+//  runs the controller at FREQUENCY (Hz) on absolute deadlines until MAX_TIME
+//  (seconds, negative: forever).  Scheduling options are read from vars.xml:
+//  main.realtime-priority (SCHED_FIFO), main.lock-memory, main.cpu
 namespace Pacer{
 extern void init( );
-extern double step(double dt = 0);
+extern void run(double max_time, double period);
 }
 
 #include <cstdlib>
+#include <cstdio>
+#include <limits>
 
 
 int main(int argc, char* argv[])
 {
+  if(argc < 3){
+    fprintf(stderr,"usage: %s MAX_TIME FREQUENCY\n",argv[0]);
+    return 1;
+  }
+  
   Pacer::init();
 
     // Hz Frequency
     int freq = atoi(argv[2]);
+    if(freq <= 0){
+      fprintf(stderr,"FREQUENCY must be positive\n");
+      return 1;
+    }
     const double seconds_per_message = 1.0 / (double) freq;
   
-  float max_time = atof(argv[1]);
+  double max_time = atof(argv[1]);
   if(max_time < 0)
-    max_time = INFINTY;
-  float time = 0;
-  while (time < max_time) {
-    time = Pacer::step(seconds_per_message);
-    double remaining = sleep_duration(seconds_per_message);
-  }
+    max_time = std::numeric_limits<double>::infinity();
+  Pacer::run(max_time,seconds_per_message);
 
   return 0;
 }
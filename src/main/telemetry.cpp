@@ -0,0 +1,106 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+// Exports series from a Pacer telemetry file (telemetry-<pid>.bin) as columns
+//
+// usage: pacer-telemetry [-t] FILE                      list series
+//        pacer-telemetry [-t] FILE PATTERN[=OUT] ...    export series matching
+//                                                       PATTERN (shell glob) to
+//                                                       OUT (default: stdout)
+//  -t : prefix each row with the tick and time columns
+#include <Pacer/telemetry.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <map>
+#include <stdexcept>
+
+struct export_t {
+  std::string pattern;
+  FILE* out;
+};
+
+int main(int argc, char* argv[]){
+  bool print_time = false;
+  int arg = 1;
+  if(arg < argc && strcmp(argv[arg],"-t") == 0){
+    print_time = true;
+    arg++;
+  }
+  if(arg >= argc){
+    fprintf(stderr,"usage: %s [-t] FILE [PATTERN[=OUT] ...]\n",argv[0]);
+    return 1;
+  }
+
+  try {
+    Pacer::TelemetryReader reader(argv[arg++]);
+
+    // No patterns: list series
+    if(arg == argc){
+      const std::vector<Pacer::TelemetryReader::series_t>& series = reader.get_series();
+      printf("%-6s %-40s %-6s %s\n","id","name","width","samples");
+      for(unsigned i=0;i<series.size();i++)
+        printf("%-6d %-40s %-6u %lu\n",series[i].id,series[i].name.c_str(),series[i].width,series[i].samples);
+      return 0;
+    }
+
+    std::vector<export_t> exports;
+    std::map<std::string,FILE*> files;
+    for(;arg<argc;arg++){
+      export_t e;
+      e.pattern = argv[arg];
+      e.out = stdout;
+      size_t eq = e.pattern.find('=');
+      if(eq != std::string::npos){
+        std::string filename = e.pattern.substr(eq+1);
+        e.pattern = e.pattern.substr(0,eq);
+        if(files.find(filename) == files.end()){
+          files[filename] = fopen(filename.c_str(),"w");
+          if(!files[filename])
+            throw std::runtime_error("Could not open output file: " + filename);
+        }
+        e.out = files[filename];
+      }
+      exports.push_back(e);
+    }
+
+    // series id --> outputs, resolved when the series is first seen
+    std::vector<std::vector<FILE*> > outputs;
+    std::vector<bool> resolved;
+
+    Pacer::TelemetryReader::sample_t s;
+    while(reader.next(s)){
+      if(s.id >= (int) resolved.size()){
+        resolved.resize(s.id+1,false);
+        outputs.resize(s.id+1);
+      }
+      if(!resolved[s.id]){
+        const std::string& name = reader.get_series(s.id).name;
+        for(unsigned i=0;i<exports.size();i++)
+          if(fnmatch(exports[i].pattern.c_str(),name.c_str(),0) == 0)
+            outputs[s.id].push_back(exports[i].out);
+        resolved[s.id] = true;
+      }
+
+      const std::vector<FILE*>& out = outputs[s.id];
+      const unsigned width = reader.get_series(s.id).width;
+      for(unsigned i=0;i<out.size();i++){
+        if(print_time)
+          fprintf(out[i],"%llu %.9g ",(unsigned long long) s.tick,s.time);
+        for(unsigned j=0;j<width;j++)
+          fprintf(out[i],"%.9g ",s.data[j]);
+        fprintf(out[i],"\n");
+      }
+    }
+
+    for(std::map<std::string,FILE*>::iterator it=files.begin();it!=files.end();it++)
+      fclose((*it).second);
+  } catch(std::exception& e) {
+    fprintf(stderr,"%s\n",e.what());
+    return 1;
+  }
+  return 0;
+}
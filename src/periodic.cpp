@@ -0,0 +1,108 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/periodic.h>
+#include <Pacer/Log.h>
+
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <stdexcept>
+
+using namespace Pacer;
+
+static const int64_t NSEC_PER_SEC = 1000000000LL;
+
+static inline int64_t now_ns(){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (int64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline timespec to_timespec(int64_t ns){
+  timespec ts;
+  ts.tv_sec = ns / NSEC_PER_SEC;
+  ts.tv_nsec = ns % NSEC_PER_SEC;
+  return ts;
+}
+
+static void warn(const std::string& what){
+  std::cerr << "PeriodicExecutor: " << what << " (" << strerror(errno) << "), continuing without it" << std::endl;
+  OUT_LOG(logERROR) << "PeriodicExecutor: " << what << " (" << strerror(errno) << ")";
+}
+
+PeriodicExecutor::PeriodicExecutor(const options_t& options)
+: _options(options), _ticks(0), _overruns(0), _missed_periods(0)
+{
+  if(!(options.period > 0))
+    throw std::runtime_error("PeriodicExecutor: period must be positive");
+  _period = options.period * NSEC_PER_SEC;
+  // latency & compute time buckets of 1us up to 2 periods (at least 2 ms)
+  const unsigned num_buckets = std::max<int64_t>(2000,2*_period/1000);
+  _wakeup_latency = Histogram(1000,num_buckets);
+  _compute_time = Histogram(1000,num_buckets);
+}
+
+void PeriodicExecutor::setup_thread(){
+  if(_options.cpu >= 0){
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(_options.cpu,&cpus);
+    if(sched_setaffinity(0,sizeof(cpus),&cpus) != 0)
+      warn("could not pin to cpu");
+  }
+
+  if(_options.lock_memory){
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+      warn("could not lock memory");
+    } else {
+      // fault in the stack now rather than on the first deep call in the loop
+      volatile char stack[512*1024];
+      for(size_t i=0;i<sizeof(stack);i+=4096)
+        stack[i] = 0;
+    }
+  }
+
+  if(_options.priority > 0){
+    sched_param param;
+    param.sched_priority = _options.priority;
+    if(sched_setscheduler(0,SCHED_FIFO,&param) != 0)
+      warn("could not set SCHED_FIFO priority");
+  }
+}
+
+void PeriodicExecutor::run(const boost::function<bool (double)>& tick){
+  setup_thread();
+
+  const int64_t start = now_ns();
+  int64_t deadline = start;
+  for(;;){
+    timespec ts = to_timespec(deadline);
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL) == EINTR);
+
+    const int64_t wake = now_ns();
+    _wakeup_latency.add(wake - deadline);
+    const bool keep_running = tick((double) (deadline - start) / (double) NSEC_PER_SEC);
+    const int64_t done = now_ns();
+    _compute_time.add(done - wake);
+    _ticks++;
+    if(!keep_running)
+      break;
+
+    deadline += _period;
+    if(done > deadline){
+      _overruns++;
+      // skip deadlines that have already passed, the next tick is on the first one ahead
+      const int64_t overrun = done - deadline;
+      const int64_t missed = overrun / _period + 1;
+      _missed_periods += missed;
+      deadline += missed * _period;
+      OUT_LOG(logDEBUG) << "PeriodicExecutor: overrun of " << overrun << " ns, skipped " << missed << " periods";
+    }
+  }
+}
@@ -0,0 +1,125 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/profiler.h>
+
+#include <stdio.h>
+
+using namespace Pacer;
+
+static const double SEC_PER_NSEC = 1.0e-9;
+
+Profiler& Profiler::instance(){
+  static Profiler profiler;
+  return profiler;
+}
+
+bool& Profiler::enabled(){
+  static bool enabled = false;
+  return enabled;
+}
+
+Profiler::Profiler(){
+#ifdef USE_THREADS
+  pthread_mutex_init(&_mutex,NULL);
+#endif
+}
+
+Profiler::section_t* Profiler::section(const std::string& name){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  boost::shared_ptr<section_t>& s = _sections[name];
+  if(!s)
+    s = boost::shared_ptr<section_t>(new section_t(name));
+  section_t* result = s.get();
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+  return result;
+}
+
+void Profiler::set_budget(const std::string& name, double seconds){
+  section(name)->budget.store(seconds / SEC_PER_NSEC,std::memory_order_relaxed);
+}
+
+void Profiler::summarize(const section_t& section, summary_t& summary){
+  Histogram h;
+  section.time.snapshot(h);
+  summary.name = section.name;
+  summary.calls = section.calls.load(std::memory_order_relaxed);
+  summary.overruns = section.overruns.load(std::memory_order_relaxed);
+  summary.budget = section.budget.load(std::memory_order_relaxed) * SEC_PER_NSEC;
+  summary.mean = h.mean() * SEC_PER_NSEC;
+  summary.p50 = h.percentile(0.5) * SEC_PER_NSEC;
+  summary.p99 = h.percentile(0.99) * SEC_PER_NSEC;
+  summary.max = h.max() * SEC_PER_NSEC;
+  summary.total = h.mean() * h.count() * SEC_PER_NSEC;
+}
+
+bool Profiler::get_summary(const std::string& name, summary_t& summary){
+  boost::shared_ptr<section_t> s;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  std::map<std::string, boost::shared_ptr<section_t> >::const_iterator it = _sections.find(name);
+  if(it != _sections.end())
+    s = (*it).second;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+  if(!s)
+    return false;
+  summarize(*s,summary);
+  return true;
+}
+
+void Profiler::get_summaries(std::vector<summary_t>& summaries){
+  std::vector<boost::shared_ptr<section_t> > sections;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  std::map<std::string, boost::shared_ptr<section_t> >::const_iterator it;
+  for(it=_sections.begin();it!=_sections.end();it++)
+    sections.push_back((*it).second);
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+  summaries.resize(sections.size());
+  for(unsigned i=0;i<sections.size();i++)
+    summarize(*sections[i],summaries[i]);
+}
+
+void Profiler::dump(std::ostream& out){
+  std::vector<summary_t> summaries;
+  get_summaries(summaries);
+  char line[256];
+  snprintf(line,sizeof(line),"%-40s %10s %10s %10s %10s %10s %10s %10s\n",
+           "section","calls","overruns","budget(us)","mean(us)","p50(us)","p99(us)","max(us)");
+  out << line;
+  for(unsigned i=0;i<summaries.size();i++){
+    const summary_t& s = summaries[i];
+    snprintf(line,sizeof(line),"%-40s %10llu %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+             s.name.c_str(),(unsigned long long) s.calls,(unsigned long long) s.overruns,
+             s.budget*1e6,s.mean*1e6,s.p50*1e6,s.p99*1e6,s.max*1e6);
+    out << line;
+  }
+}
+
+void Profiler::reset(){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  std::map<std::string, boost::shared_ptr<section_t> >::iterator it;
+  for(it=_sections.begin();it!=_sections.end();it++){
+    section_t& s = *(*it).second;
+    s.time.reset();
+    s.calls.store(0,std::memory_order_relaxed);
+    s.overruns.store(0,std::memory_order_relaxed);
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+}
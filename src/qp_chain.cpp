@@ -0,0 +1,99 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using Pacer::QPChain;
+
+QPChain::QPChain(const std::vector<std::string>& methods) : SolverChain("QPChain"), _Q(NULL), _A(NULL), _c(NULL), _b(NULL), _indices(NULL), _x(NULL), _pos(false), _same_indices(false) {
+  // "lemke" is a method of its own
+  _active_set.fallback = false;
+  set_methods(methods);
+}
+
+void QPChain::set_methods(const std::vector<std::string>& methods){
+  std::vector<method_t> m;
+  for(unsigned i=0;i<methods.size();i++){
+    const std::string& name = methods[i];
+    if(name.compare("active-set") == 0)
+      m.push_back(ACTIVE_SET);
+    else if(name.compare("lemke") == 0)
+      m.push_back(LEMKE);
+    else
+      throw std::runtime_error("Unknown QP method: " + name);
+  }
+
+  _methods = m;
+  set_names(methods);
+}
+
+double QPChain::error(const Ravelin::VectorNd& x){
+  const Ravelin::MatrixNd& A = *_A;
+  const Ravelin::VectorNd& b = *_b;
+  if(x.rows() != _Q->rows() || !Utility::isvalid(x))
+    return std::numeric_limits<double>::infinity();
+  double err = 0;
+  if(A.rows() > 0){
+    A.mult(x,_w);
+    for(unsigned i=0;i<b.rows();i++)
+      err = std::max(err,b[i] - _w[i]);
+  }
+  if(_pos)
+    for(unsigned i=0;i<x.rows();i++)
+      err = std::max(err,-x[i]);
+  return err;
+}
+
+double QPChain::attempt(unsigned i){
+  const Ravelin::MatrixNd& Q = *_Q, & A = *_A;
+  const Ravelin::VectorNd& c = *_c, & b = *_b;
+  Ravelin::VectorNd& x = *_x;
+
+  x = _x0;
+  bool SOLVE_FLAG = false;
+  switch(_methods[i]){
+    case ACTIVE_SET:
+      SOLVE_FLAG = _pos? _active_set.solve_qp_pos(Q,c,A,b,x,*_indices,_same_indices)
+                       : _active_set.solve_qp(Q,c,A,b,x,*_indices,_same_indices);
+      break;
+    case LEMKE:
+      // cold start, as ActiveSetQP's own fallback
+      x.set_zero(Q.rows());
+      SOLVE_FLAG = _pos? _lemke.solve_qp_pos(Q,c,A,b,x,_v,false)
+                       : _lemke.solve_qp(Q,c,A,b,x);
+      break;
+  }
+  return SOLVE_FLAG? error(x) : std::numeric_limits<double>::infinity();
+}
+
+bool QPChain::solve(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, bool pos, const std::vector<unsigned>& indices, bool same_indices){
+  double b_max = 0;
+  for(unsigned i=0;i<b.rows();i++)
+    b_max = std::max(b_max,std::fabs(b[i]));
+
+  _Q = &Q;
+  _A = &A;
+  _c = &c;
+  _b = &b;
+  _x = &x;
+  _indices = &indices;
+  _pos = pos;
+  _same_indices = same_indices;
+  _x0 = x;
+  return run(tolerance * (1.0 + b_max));
+}
+
+bool QPChain::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices){
+  return solve(Q,c,A,b,x,true,indices,same_indices);
+}
+
+bool QPChain::solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, const std::vector<unsigned>& indices, bool same_indices){
+  return solve(Q,c,A,b,x,false,indices,same_indices);
+}
@@ -9,24 +9,198 @@
 
 using namespace Pacer;
 
+void Robot::set_model_coordinates(const Ravelin::VectorNd& q){
+  // skip the full pose update if the model is already there
+  bool unchanged = _model_q_valid && _model_q.size() == q.size();
+  for(int i=0;unchanged && i<q.size();i++)
+    unchanged = (_model_q[i] == q[i]);
+  if(unchanged)
+    return;
+  _abrobot->set_generalized_coordinates_euler(q);
+  _model_q = q;
+  _model_q_valid = true;
+  _model_version++;
+}
+
 void Robot::set_model_state(const Ravelin::VectorNd& q,const Ravelin::VectorNd& qd){
   Ravelin::VectorNd set_q,set_qd;
-  if(get_data<Ravelin::VectorNd>("generalized_q", set_q)){
+  if(_generalized_q_handle.get(set_q)){
     set_q.set_sub_vec(0,q);
-    _abrobot->set_generalized_coordinates_euler(set_q);
+    set_model_coordinates(set_q);
   }
 
   if(qd.rows() > 0)
-  if(get_data<Ravelin::VectorNd>("generalized_qd", set_qd)){
+  if(_generalized_qd_handle.get(set_qd)){
     set_qd.set_sub_vec(0,qd);
     _abrobot->set_generalized_velocity(Ravelin::DynamicBodyd::eSpatial,set_qd);
   }
 }
 
+static bool same_vector(const Ravelin::VectorNd& a, const Ravelin::VectorNd& b){
+  if(a.size() != b.size())
+    return false;
+  for(int i=0;i<a.size();i++)
+    if(a[i] != b[i])
+      return false;
+  return true;
+}
+
+static bool same_matrix(const Ravelin::MatrixNd& a, const Ravelin::MatrixNd& b){
+  if(a.rows() != b.rows() || a.columns() != b.columns())
+    return false;
+  return std::equal(a.data(),a.data()+a.rows()*a.columns(),b.data());
+}
+
+void Robot::invalidate_dynamics(){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  _dynamics.inertia_valid = false;
+  _dynamics.factor_valid = false;
+  _dynamics.jacobians_valid = false;
+  _dynamics.num_jacobians = 0;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+}
+
 void Robot::calc_generalized_inertia(const Ravelin::VectorNd& q, Ravelin::MatrixNd& M){
-  set_model_state(q);
-  M.resize(NDOFS,NDOFS);
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  set_model_coordinates(q);
+  if(!_dynamics.inertia_valid || !same_vector(_dynamics.q,q)){
+    _dynamics.M.resize(NDOFS,NDOFS);
+    _abrobot->get_generalized_inertia(_dynamics.M);
+    _dynamics.q = q;
+    _dynamics.inertia_valid = true;
+    _dynamics.factor_valid = false;
+  }
+  M = _dynamics.M;
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+}
+
+bool Robot::factor_generalized_inertia(const Ravelin::MatrixNd& M, inertia_factor_t& f, bool inverse){
+  Workspace& ws = Workspace::local();
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_dynamics_mutex);
+#endif
+  // only the inertia of the current tick is memoized, others are factored every call
+  const bool memoized = _dynamics.inertia_valid && same_matrix(_dynamics.M,M);
+  if(memoized){
+    if(!_dynamics.factor_valid){
+      _dynamics.factor.factor(M,inverse,ws.LA);
+      _dynamics.factor_valid = true;
+    } else if(inverse)
+      _dynamics.factor.invert(ws.LA);
+    f = _dynamics.factor;
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_dynamics_mutex);
+#endif
+  if(!memoized)
+    f.factor(M,inverse,ws.LA);
+  return f.ok;
+}
+
+bool Robot::factor_generalized_inertia(const Ravelin::MatrixNd& M, Ravelin::MatrixNd& M_chol, Ravelin::MatrixNd& iM){
+  inertia_factor_t f;
+  if(factor_generalized_inertia(M,f,true)){
+    M_chol = f.M_chol;
+    iM = f.iM;
+  }
+  return f.ok;
+}
+
+#ifdef PACER_FIXED_JOINT_DOFS
+// |a - b| relative to the magnitude of the reference b
+static double rel_diff(double a, double b){
+  return fabs(a - b) / (1.0 + fabs(b));
+}
+#endif
+
+bool Robot::check_fixed_kernels(){
+#ifdef PACER_FIXED_JOINT_DOFS
+  if(NDOFS != fixed_config::NDOFS || NUM_JOINT_DOFS != fixed_config::NUM_JOINT_DOFS){
+    OUT_LOG(logINFO) << "Robot: fixed size kernels are built for " << fixed_config::NUM_JOINT_DOFS
+                     << " joint dofs, this robot has " << NUM_JOINT_DOFS << " (using the Ravelin routines)";
+    return true;
+  }
+  
+  const double TOL = 1e-8;
+  Ravelin::LinAlgd LA;
+  double err = 0;
+  
+  // factor_inertia(): inertia of the current model state
+  Ravelin::MatrixNd M(NDOFS,NDOFS), M_chol, iM, R, iR;
   _abrobot->get_generalized_inertia(M);
+  if(!fixed::factor_inertia<fixed_config::NDOFS>(M,M_chol,iM)){
+    OUT_LOG(logERROR) << "Robot: fixed size factor_inertia() failed on the generalized inertia";
+    return false;
+  }
+  R = M;
+  if(!LA.factor_chol(R))
+    return false;
+  iR = Ravelin::MatrixNd::identity(NDOFS);
+  LA.solve_chol_fast(R,iR);
+  for(unsigned i=0;i<NDOFS;i++)
+    for(unsigned j=0;j<NDOFS;j++)
+      err = std::max(err,std::max(rel_diff(M_chol(i,j),R(i,j)),rel_diff(iM(i,j),iR(i,j))));
+  
+  // contact_coupling(): blocks of the contacts of two feet against their dense rows
+  const unsigned K = fixed_config::CONTACT_COLS;
+  std::vector<std::vector<unsigned> > cols;
+  for(unsigned i=0;i<_end_effector_ids.size() && cols.size() < 2;i++)
+    if(_id_link_coords_map[_end_effector_ids[i]].size() == K)
+      cols.push_back(_id_link_coords_map[_end_effector_ids[i]]);
+  if(cols.size() == 1)
+    cols.push_back(cols[0]);
+  if(!cols.empty()){
+    Ravelin::MatrixNd Bi(3,K), Bj(3,K), Ji, Jj, iMJjT, W;
+    Ji.set_zero(3,NDOFS);
+    Jj.set_zero(3,NDOFS);
+    for(unsigned k=0;k<K;k++)
+      for(unsigned r=0;r<3;r++){
+        Ji(r,cols[0][k]) = Bi(r,k) = sin(1.0 + r + 3*k);
+        Jj(r,cols[1][k]) = Bj(r,k) = cos(2.0 + r + 3*k);
+      }
+    double Wij[9];
+    fixed::contact_coupling<K>(Bi.data(),&cols[0][0],Bj.data(),&cols[1][0],iR,Wij);
+    Ji.mult(iR.mult_transpose(Jj,iMJjT),W);
+    for(unsigned r=0;r<3;r++)
+      for(unsigned t=0;t<3;t++)
+        err = std::max(err,rel_diff(Wij[r*3+t],W(r,t)));
+  }
+  
+  // dls_step(): an IK sized system
+  const unsigned IK_ROWS = fixed_config::IK_ROWS, N = fixed_config::NUM_JOINT_DOFS;
+  const double lambda = 1e-2;
+  Ravelin::MatrixNd J(IK_ROWS,N), A;
+  Ravelin::VectorNd e(IK_ROWS), y, dx(N), dx_fixed(N);
+  for(unsigned j=0;j<N;j++)
+    for(unsigned i=0;i<IK_ROWS;i++)
+      J(i,j) = sin(0.5 + i + IK_ROWS*j);
+  for(unsigned i=0;i<IK_ROWS;i++)
+    e[i] = cos(0.5 + i);
+  if(!fixed::dls_step<IK_ROWS,N>(J.data(),e.data(),lambda,dx_fixed.data()))
+    return false;
+  J.mult_transpose(J,A);
+  for(unsigned i=0;i<IK_ROWS;i++)
+    A(i,i) += lambda;
+  if(!LA.factor_chol(A))
+    return false;
+  LA.solve_chol_fast(A,y = e);
+  J.transpose_mult(y,dx);
+  for(unsigned i=0;i<N;i++)
+    err = std::max(err,rel_diff(dx_fixed[i],dx[i]));
+  
+  OUT_LOG(logDEBUG1) << "Robot: fixed size kernels error: " << err;
+  return err < TOL;
+#else
+  return true;
+#endif
 }
 
 void Robot::compile(){
@@ -90,36 +264,33 @@ void Robot::compile(){
   _link_ids = get_map_keys(_id_link_map);
   
   
-  // initialize state data with name data
-  init_state();
-  
   // set up other joint data
   _disabled_dofs.resize(NDOFS);
   std::fill(_disabled_dofs.begin(),_disabled_dofs.end(),true);
   
-  std::map<std::string, boost::shared_ptr<Ravelin::Jointd> >::iterator it;
-  for(it=_id_joint_map.begin();it!=_id_joint_map.end();it++){
-    const std::pair<std::string, boost::shared_ptr<Ravelin::Jointd> >& id_joint = (*it);
-    _id_dof_coord_map[id_joint.first] = std::vector<int>(id_joint.second->num_dof());
-    for(int j=0;j<id_joint.second->num_dof();j++){
-      if(id_joint.second->num_dof() == 0)
-        _disabled_dofs[id_joint.second->get_coord_index() + j] = false;
-      _id_dof_coord_map[id_joint.first][j]
-      = id_joint.second->get_coord_index() + j;
-      
-      _coord_id_map[id_joint.second->get_coord_index() + j]
-      = std::pair<std::string,int>(id_joint.first,j);
-    }
+  _joint_spans.clear();
+  for(unsigned i=0;i<_joint_ids.size();i++){
+    const boost::shared_ptr<Ravelin::Jointd>& joint = _id_joint_map[_joint_ids[i]];
+    const std::string& id = _joint_ids[i];
     
-    OUTLOG(_id_dof_coord_map[id_joint.first],id_joint.first+"_dofs",logDEBUG1);
+    joint_span_t span;
+    span.offset = joint->get_coord_index();
+    span.dofs = joint->num_dof();
+    _id_span_map[id] = span;
+    _joint_spans.push_back(span);
     
-    std::map<unit_e , std::map<std::string, Ravelin::VectorNd > >::iterator it;
-    for(it=_state.begin();it!=_state.end();it++){
-      std::map<std::string, Ravelin::VectorNd >& dof = (*it).second;
-      dof[id_joint.first] = Ravelin::VectorNd(_id_dof_coord_map[id_joint.first].size());
+    _id_dof_coord_map[id] = std::vector<int>(span.dofs);
+    for(int j=0;j<span.dofs;j++){
+      _id_dof_coord_map[id][j] = span.offset + j;
+      _coord_id_map[span.offset + j] = std::pair<std::string,int>(id,j);
     }
+    
+    OUTLOG(_id_dof_coord_map[id],id+"_dofs",logDEBUG1);
   }
   
+  // initialize state data with name data
+  init_state();
+  
   // set up enbd effectors
   // TODO: (Depricated?)
   // Initialize end effectors
@@ -161,6 +332,41 @@ void Robot::compile(){
     _id_end_effector_map[_end_effector_ids[i]] = eef;
   }
   
+  // coordinates moving each link: inner joints up to the base, then the base
+  _id_link_coords_map.clear();
+  for(unsigned i=0;i<links.size();i++){
+    std::vector<unsigned>& coords = _id_link_coords_map[links[i]->body_id];
+    boost::shared_ptr<Ravelin::RigidBodyd> rb_ptr = links[i];
+    while (rb_ptr != _abrobot->get_base_link()) {
+      boost::shared_ptr<Ravelin::Jointd> joint_ptr = rb_ptr->get_inner_joint_explicit();
+      std::map<std::string,std::vector<int> >::const_iterator dof = _id_dof_coord_map.find(joint_ptr->joint_id);
+      if(dof != _id_dof_coord_map.end())
+        coords.insert(coords.end(),(*dof).second.begin(),(*dof).second.end());
+      rb_ptr = joint_ptr->get_inboard_link();
+    }
+    std::sort(coords.begin(),coords.end());
+    for(unsigned j=NUM_JOINT_DOFS;j<NDOFS;j++)
+      coords.push_back(j);
+  }
+  
+  // chains sharing joints invalidate each other's kinematics cache
+  std::map<std::string,boost::shared_ptr<end_effector_t> >::iterator it, jt;
+  for(it=_id_end_effector_map.begin();it!=_id_end_effector_map.end();it++)
+    for(jt=_id_end_effector_map.begin();jt!=_id_end_effector_map.end();jt++){
+      if(it == jt)
+        continue;
+      const std::vector<bool>& a = (*it).second->chain_bool, & b = (*jt).second->chain_bool;
+      for(int j=0;j<a.size() && j<b.size();j++)
+        if(a[j] && b[j]){
+          (*it).second->shared_chains.push_back((*jt).second.get());
+          break;
+        }
+    }
+  invalidate_kinematics();
+  
+  if(!check_fixed_kernels())
+    throw std::runtime_error("Robot: fixed size kernels (PACER_FIXED_JOINT_DOFS) disagree with the Ravelin routines");
+  
   OUT_LOG(logDEBUG2) << "end COMPILE";
 }
 
@@ -168,18 +374,18 @@ void Robot::update(){
   check_phase_internal(misc_sensor);
 
   // Propagate data set in _state into robot model
-  Ravelin::VectorNd generalized_q = get_generalized_value(position);
-  Ravelin::VectorNd generalized_qd = get_generalized_value(velocity);
-  Ravelin::VectorNd generalized_qdd = get_generalized_value(acceleration);
-  Ravelin::VectorNd generalized_fext = get_generalized_value(load);
+  const Ravelin::VectorNd& generalized_q = get_generalized_value_ref(position);
+  const Ravelin::VectorNd& generalized_qd = get_generalized_value_ref(velocity);
+  const Ravelin::VectorNd& generalized_qdd = get_generalized_value_ref(acceleration);
+  const Ravelin::VectorNd& generalized_fext = get_generalized_value_ref(load);
   set_joint_generalized_value(position_goal,generalized_q.segment(0,NUM_JOINT_DOFS));
   set_joint_generalized_value(velocity_goal,generalized_qd.segment(0,NUM_JOINT_DOFS));
   set_joint_generalized_value(acceleration_goal,Ravelin::VectorNd::zero(NUM_JOINT_DOFS));
 
-  set_data<Ravelin::VectorNd>("generalized_q", generalized_q);
-  set_data<Ravelin::VectorNd>("generalized_qd", generalized_qd);
-  set_data<Ravelin::VectorNd>("generalized_qdd", generalized_qdd);
-  set_data<Ravelin::VectorNd>("generalized_fext", generalized_fext);
+  _generalized_q_handle.set(generalized_q);
+  _generalized_qd_handle.set(generalized_qd);
+  _generalized_qdd_handle.set(generalized_qdd);
+  _generalized_fext_handle.set(generalized_fext);
   set_generalized_value(load_goal,Ravelin::VectorNd::zero(generalized_fext.rows()));
 
   Ravelin::Vector3d workv;
@@ -201,10 +407,10 @@ void Robot::update(){
   Ravelin::VectorNd qdd = generalized_qdd.segment(0,NUM_JOINT_DOFS);
   Ravelin::VectorNd fext = generalized_fext.segment(0,NUM_JOINT_DOFS);
   
-  if(set_data<Ravelin::VectorNd>("q",q))
+  if(_q_handle.set(q))
     set_data<Ravelin::VectorNd>("init.q",q);
-  set_data<Ravelin::VectorNd>("qd",qd);
-  set_data<Ravelin::VectorNd>("qdd",qdd);
+  _qd_handle.set(qd);
+  _qdd_handle.set(qdd);
   
   set_model_state(generalized_q);
   
@@ -258,6 +464,14 @@ void Robot::init_robot(){
   check_phase_internal(initialization);
   OUT_LOG(logDEBUG) << "> > Robot::init_robot(.)";
   
+  _generalized_q_handle    = get_data_handle<Ravelin::VectorNd>("generalized_q");
+  _generalized_qd_handle   = get_data_handle<Ravelin::VectorNd>("generalized_qd");
+  _generalized_qdd_handle  = get_data_handle<Ravelin::VectorNd>("generalized_qdd");
+  _generalized_fext_handle = get_data_handle<Ravelin::VectorNd>("generalized_fext");
+  _q_handle   = get_data_handle<Ravelin::VectorNd>("q");
+  _qd_handle  = get_data_handle<Ravelin::VectorNd>("qd");
+  _qdd_handle = get_data_handle<Ravelin::VectorNd>("qdd");
+  
   compile();
   
   // Initialized Joints
@@ -311,6 +525,13 @@ void Robot::init_robot(){
     
     set_base_value(velocity,init_basev);
   }
+  
+  // straight-line end effector kinematics (pacer-kinematics-codegen)
+  std::string kinematics_library;
+  if(get_data<std::string>("kinematics-library",kinematics_library)){
+    _generalized_q_handle.set(get_generalized_value(position));
+    OUT_LOG(logINFO) << load_generated_kinematics(kinematics_library) << " end effectors use generated kinematics";
+  }
 
   OUT_LOG(logDEBUG) << "<< Robot::init_robot(.)";
 }
@@ -7,31 +7,38 @@
 #include <algorithm>
 #include <Moby/insertion_sort>
 #include <Pacer/utilities.h>
+#include <Pacer/solvers.h>
 
 using namespace Ravelin;
+using Pacer::LCPSolver;
+
+LCPSolver& LCPSolver::local(){
+  static thread_local LCPSolver solver;
+  return solver;
+}
 
 /// Get the minimum index of vector v; if there are multiple minima (within zero_tol), returns one randomly
-unsigned rand_min(const VectorNd& v, double zero_tol)
+unsigned LCPSolver::rand_min(const VectorNd& v, double zero_tol)
 {
-  static std::vector<unsigned> minima;
+  std::vector<unsigned>& minima = _minima;
   minima.clear();
   unsigned minv = std::min_element(v.begin(), v.end()) - v.begin();
   minima.push_back(minv);
   for (unsigned i=0; i< v.rows(); i++)
     if (i != minv && v[i] < v[minv] + zero_tol)
       minima.push_back(i);
-  return minima[rand() % minima.size()];
+  return minima[_rng() % minima.size()];
 }
 
 /// Pivoting rule
-unsigned select_pivot(const VectorNd& znbas, const std::vector<unsigned>& nonbas, const std::vector<unsigned>& indices, double zero_tol)
+unsigned LCPSolver::select_pivot(const VectorNd& znbas, const std::vector<unsigned>& nonbas, const std::vector<unsigned>& indices, double zero_tol)
 {
   // if nonbas is empty, return INF
   if (nonbas.empty())
     return std::numeric_limits<unsigned>::max();
 
   // find all indices i of znbas for which znbas[i] < 0
-  static std::vector<unsigned> neg;
+  std::vector<unsigned>& neg = _neg;
   neg.clear();
   for (unsigned i=0; i< znbas.size(); i++)
     if (znbas[i] < -zero_tol)
@@ -39,7 +46,7 @@ unsigned select_pivot(const VectorNd& znbas, const std::vector<unsigned>& nonbas
 
   // of all negative indices, find those which have a contact point with the
   // same link in nonbas
-  static std::vector<unsigned> repeated;
+  std::vector<unsigned>& repeated = _repeated;
   repeated.clear();
   for (unsigned i=0; i< neg.size(); i++)
   {
@@ -94,17 +101,12 @@ unsigned select_pivot(const VectorNd& znbas, const std::vector<unsigned>& nonbas
  * \param zero_tol the tolerance for solving to zero
  * \return true if the solver is successful
  */
-bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<unsigned>& indices, VectorNd& z, double zero_tol)
+bool LCPSolver::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<unsigned>& indices, VectorNd& z, double zero_tol)
 {
   const unsigned N = q.rows();
-  const unsigned UINF = std::numeric_limits<unsigned>::max();
 
-  // setup static variables
-  static std::vector<unsigned> _nonbas, _bas;
-  static std::vector<bool> _represented;
-  static MatrixNd _Msub, _Mmix;
-  static VectorNd _z, _qbas, _w;
-  static LinAlgd _LA;
+  _fast_stats.calls++;
+  _fast_stats.pivots = 0;
 
   // verify that indices are the right size
   assert(indices.size() == N);
@@ -138,8 +140,10 @@ bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<u
   }
 
   // look for warm-start
-  if (z.size() == N)
+  const bool warm = (z.size() == N);
+  if (warm)
   {
+    _fast_stats.warm_starts++;
     _nonbas.clear();
     for (unsigned i=0; i< N; i++)
       if (z[i] > zero_tol)
@@ -167,6 +171,20 @@ bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<u
       }
   }
 
+  if (!pivot(M, q, indices, z, zero_tol))
+    return false;
+  if (warm && _fast_stats.pivots == 0)
+    _fast_stats.warm_hits++;
+  return true;
+}
+
+/// Principal pivoting of lcp_fast() from the nonbasic set in _nonbas (sorted)
+bool LCPSolver::pivot(const MatrixNd& M, const VectorNd& q, const std::vector<unsigned>& indices, VectorNd& z, double zero_tol)
+{
+  const unsigned N = q.rows();
+  const unsigned UINF = std::numeric_limits<unsigned>::max();
+  unsigned minw;
+
   // setup basic indices
   _bas.clear();
   for (unsigned i=0; i< N; i++)
@@ -191,6 +209,8 @@ bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<u
     }
     catch (SingularException e)
     {
+      _fast_stats.pivots += piv;
+      _fast_stats.total_pivots += piv;
       return false;
     }
 
@@ -222,6 +242,8 @@ bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<u
         for (unsigned i=0, j=0; j < _nonbas.size(); i++, j++)
           z[_nonbas[j]] = _z[i];
 
+        _fast_stats.pivots += piv;
+        _fast_stats.total_pivots += piv;
         return true;
       }
     }
@@ -248,6 +270,12 @@ bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<u
   }
 
   // if we're here, then the maximum number of pivots has been exceeded
+  _fast_stats.pivots += MAX_PIV;
+  _fast_stats.total_pivots += MAX_PIV;
   return false;
 }
 
+bool Utility::lcp_fast(const MatrixNd& M, const VectorNd& q, const std::vector<unsigned>& indices, VectorNd& z, double zero_tol)
+{
+  return LCPSolver::local().lcp_fast(M,q,indices,z,zero_tol);
+}
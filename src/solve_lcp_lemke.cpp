@@ -0,0 +1,320 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using Pacer::LCPSolver;
+
+// basis inverse updates between refactorizations
+static const unsigned REFACTOR_EVERY = 32;
+
+// Lemke's method on w - Mz - d z0 = q:  the basis B holds the columns of the
+// n basic variables (w_i: e_i, z_j: -M_j, z0: -d) and B xB = q.
+
+/// column of the variable 'label' in [I, -M, -d]
+void LCPSolver::lemke_column(const Ravelin::MatrixNd& M, unsigned label, double* a) const {
+  const unsigned n = _n;
+  if(label < n){
+    std::fill(a,a+n,0.0);
+    a[label] = 1;
+  } else if(label < 2*n){
+    for(unsigned i=0;i<n;i++)
+      a[i] = -M(i,label-n);
+  } else {
+    for(unsigned i=0;i<n;i++)
+      a[i] = -_d[i];
+  }
+}
+
+/// Invert the basis from scratch (Gauss-Jordan with partial pivoting) and recompute xB
+bool LCPSolver::lemke_refactor(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q){
+  const unsigned n = _n;
+  _lemke_stats.refactorizations++;
+  _updates = 0;
+
+  _B.resize(n*n);
+  for(unsigned j=0;j<n;j++)
+    lemke_column(M,_basis[j],&_B[j*n]);
+  _Binv.assign(n*n,0);
+  for(unsigned i=0;i<n;i++)
+    _Binv[i*n+i] = 1;
+
+  double* B = &_B[0];
+  double* X = &_Binv[0];
+  for(unsigned k=0;k<n;k++){
+    unsigned p = k;
+    for(unsigned i=k+1;i<n;i++)
+      if(std::fabs(B[k*n+i]) > std::fabs(B[k*n+p]))
+        p = i;
+    if(!(std::fabs(B[k*n+p]) > std::numeric_limits<double>::epsilon()))
+      return false;
+    if(p != k)
+      for(unsigned j=0;j<n;j++){
+        std::swap(B[j*n+k],B[j*n+p]);
+        std::swap(X[j*n+k],X[j*n+p]);
+      }
+    const double ipiv = 1.0 / B[k*n+k];
+    for(unsigned j=0;j<n;j++){
+      B[j*n+k] *= ipiv;
+      X[j*n+k] *= ipiv;
+    }
+    for(unsigned i=0;i<n;i++){
+      const double f = B[k*n+i];
+      if(i == k || f == 0)
+        continue;
+      for(unsigned j=0;j<n;j++){
+        B[j*n+i] -= f * B[j*n+k];
+        X[j*n+i] -= f * X[j*n+k];
+      }
+    }
+  }
+
+  _xB.assign(n,0);
+  for(unsigned k=0;k<n;k++)
+    for(unsigned i=0;i<n;i++)
+      _xB[i] += X[k*n+i] * q[k];
+  return true;
+}
+
+/// Replace basic variable r by 'label', whose column in the current basis is _u = inv(B) a
+void LCPSolver::lemke_pivot(unsigned r, unsigned label){
+  const unsigned n = _n;
+  const double* u = &_u[0];
+  const double ipiv = 1.0 / u[r];
+
+  // rank-1 update of inv(B): row r /= u_r, row i -= u_i * row r
+  for(unsigned k=0;k<n;k++){
+    double* Xk = &_Binv[k*n];
+    const double xr = Xk[r] * ipiv;
+    for(unsigned i=0;i<n;i++)
+      Xk[i] -= u[i] * xr;
+    Xk[r] = xr;
+  }
+
+  const double theta = _xB[r] * ipiv;
+  for(unsigned i=0;i<n;i++)
+    _xB[i] -= u[i] * theta;
+  _xB[r] = theta;
+
+  _basis[r] = label;
+  _updates++;
+}
+
+bool LCPSolver::lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, bool warm, double piv_tol, double zero_tol){
+  const unsigned n = _n;
+  const unsigned Z0 = 2*n;
+  const unsigned MAX_PIV = std::max(50*n,(unsigned) 1000);
+
+  _col.resize(n);
+  _u.resize(n);
+
+  unsigned r = 0;
+  if(warm){
+    // refactor the last complementary basis
+    _basis = _lemke_basis;
+    _d.assign(n,0);
+    if(!lemke_refactor(M,q))
+      return false;
+    r = std::min_element(_xB.begin(),_xB.end()) - _xB.begin();
+    if(_xB[r] < -zero_tol){
+      // covering vector d = B 1, so that inv(B)(q + d z0) = xB + z0
+      for(unsigned j=0;j<n;j++){
+        lemke_column(M,_basis[j],&_col[0]);
+        for(unsigned i=0;i<n;i++)
+          _d[i] += _col[i];
+      }
+    }
+  } else {
+    // all w basic, covering vector d = 1
+    _basis.resize(n);
+    for(unsigned i=0;i<n;i++)
+      _basis[i] = i;
+    _d.assign(n,1);
+    _Binv.assign(n*n,0);
+    for(unsigned i=0;i<n;i++)
+      _Binv[i*n+i] = 1;
+    _xB.resize(n);
+    for(unsigned i=0;i<n;i++)
+      _xB[i] = q[i];
+    _updates = 0;
+    r = std::min_element(_xB.begin(),_xB.end()) - _xB.begin();
+  }
+
+  if(_xB[r] < -zero_tol){
+    // z0 enters, the most negative basic variable leaves; inv(B)(-d) = -1
+    std::fill(_u.begin(),_u.end(),-1.0);
+    unsigned leaving = _basis[r];
+    lemke_pivot(r,Z0);
+
+    unsigned entering = (leaving < n)? leaving + n : leaving - n;
+    for(;;){
+      if(_lemke_stats.pivots++ >= MAX_PIV)
+        return false;
+
+      if(_updates >= REFACTOR_EVERY && !lemke_refactor(M,q))
+        return false;
+
+      // u = inv(B) a
+      lemke_column(M,entering,&_col[0]);
+      std::fill(_u.begin(),_u.end(),0.0);
+      for(unsigned k=0;k<n;k++){
+        const double ak = _col[k];
+        if(ak == 0)
+          continue;
+        const double* Xk = &_Binv[k*n];
+        for(unsigned i=0;i<n;i++)
+          _u[i] += Xk[i] * ak;
+      }
+
+      // ratio test, ties go to z0 (terminates) and then to the largest pivot
+      r = n;
+      double ratio = std::numeric_limits<double>::infinity();
+      for(unsigned i=0;i<n;i++){
+        if(_u[i] <= piv_tol)
+          continue;
+        const double t = std::max(_xB[i],0.0) / _u[i];
+        if(r == n || t < ratio - zero_tol){
+          r = i;
+          ratio = t;
+        } else if(t < ratio + zero_tol && _basis[r] != Z0
+                  && (_basis[i] == Z0 || _u[i] > _u[r])){
+          r = i;
+          ratio = std::min(ratio,t);
+        }
+      }
+
+      // ray termination
+      if(r == n)
+        return false;
+
+      leaving = _basis[r];
+      lemke_pivot(r,entering);
+      if(leaving == Z0)
+        break;
+      entering = (leaving < n)? leaving + n : leaving - n;
+    }
+  }
+
+  z.set_zero(n);
+  for(unsigned i=0;i<n;i++)
+    if(_basis[i] >= n && _basis[i] < Z0)
+      z[_basis[i]-n] = std::max(_xB[i],0.0);
+
+  // w = Mz + q >= 0 (into _u)
+  double q_max = 0;
+  for(unsigned i=0;i<n;i++)
+    q_max = std::max(q_max,std::fabs(q[i]));
+  const double feas_tol = std::sqrt(std::numeric_limits<double>::epsilon()) * (1.0 + q_max);
+  for(unsigned i=0;i<n;i++){
+    double w = q[i];
+    for(unsigned j=0;j<n;j++)
+      w += M(i,j) * z[j];
+    if(w < -feas_tol)
+      return false;
+    _u[i] = w;
+  }
+  // complementarity: w_i = 0 where z_i is basic (a stale warm basis may not be)
+  for(unsigned i=0;i<n;i++)
+    if(_basis[i] >= n && _basis[i] < Z0 && std::fabs(_u[_basis[i]-n]) > feas_tol)
+      return false;
+
+  _lemke_basis = _basis;
+  return Utility::isvalid(z);
+}
+
+bool LCPSolver::lcp_lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double piv_tol, double zero_tol){
+  const unsigned n = q.rows();
+  _lemke_stats.calls++;
+  _lemke_stats.pivots = 0;
+
+  if(n == 0){
+    z.set_zero(0);
+    return true;
+  }
+
+  double M_max = 0;
+  for(unsigned j=0;j<n;j++)
+    for(unsigned i=0;i<n;i++)
+      M_max = std::max(M_max,std::fabs(M(i,j)));
+  if(piv_tol < 0.0)
+    piv_tol = n * std::max(M_max,1.0) * std::numeric_limits<double>::epsilon() * 1e2;
+  if(zero_tol < 0.0)
+    zero_tol = n * std::max(M_max,1.0) * std::numeric_limits<double>::epsilon();
+
+  // trivial solution
+  double q_min = *std::min_element(q.begin(),q.end());
+  if(q_min > -zero_tol){
+    z.set_zero(n);
+    return true;
+  }
+
+  // keep the basis of the last solution only for problems of the same size
+  if(n != _n)
+    _lemke_basis.clear();
+  _n = n;
+
+  bool SOLVE_FLAG = false;
+  if(_lemke_basis.size() == n){
+    _lemke_stats.warm_starts++;
+    SOLVE_FLAG = lemke(M,q,z,true,piv_tol,zero_tol);
+    if(SOLVE_FLAG && _lemke_stats.pivots == 0)
+      _lemke_stats.warm_hits++;
+  }
+  if(!SOLVE_FLAG)
+    SOLVE_FLAG = lemke(M,q,z,false,piv_tol,zero_tol);
+  if(!SOLVE_FLAG)
+    _lemke_basis.clear();
+
+  _lemke_stats.total_pivots += _lemke_stats.pivots;
+
+  if(compare_moby){
+    _lemke_stats.moby_checks++;
+    const bool MOBY_FLAG = _moby.lcp_lemke(M,q,_z_moby);
+    if(MOBY_FLAG != SOLVE_FLAG){
+      _lemke_stats.moby_mismatches++;
+      OUT_LOG(logERROR) << "lcp_lemke: " << (SOLVE_FLAG? "solved" : "failed") << " (" << _lemke_stats.pivots
+                        << " pivots), Moby " << (MOBY_FLAG? "solved" : "failed") << " an LCP of size " << n;
+    } else if(SOLVE_FLAG){
+      double dz = 0;
+      for(unsigned i=0;i<n;i++)
+        dz = std::max(dz,std::fabs(z[i] - _z_moby[i]));
+      OUT_LOG(logDEBUG1) << "lcp_lemke: max |z - z_moby| = " << dz << " (solutions need not be unique)";
+    }
+  }
+  return SOLVE_FLAG;
+}
+
+bool LCPSolver::lcp_lemke_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp, unsigned step_exp, int max_exp, double piv_tol, double zero_tol){
+  // a failed lcp_lemke() drops its basis, each retry restores the one kept before the first attempt
+  _lemke_start = _lemke_basis;
+  if(lcp_lemke(M,q,z,piv_tol,zero_tol))
+    return true;
+
+  const unsigned n = q.rows();
+  _MR = M;
+  for(int e=min_exp;e<=max_exp;e+=(int) step_exp){
+    const double eps = std::pow(10.0,(double) e);
+    for(unsigned i=0;i<n;i++)
+      _MR(i,i) = M(i,i) + eps;
+    _lemke_basis = _lemke_start;
+    if(lcp_lemke(_MR,q,z,piv_tol,zero_tol))
+      return true;
+  }
+  return false;
+}
+
+bool Utility::lcp_lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double piv_tol, double zero_tol)
+{
+  return LCPSolver::local().lcp_lemke(M,q,z,piv_tol,zero_tol);
+}
+
+bool Utility::lcp_lemke_regularized(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, int min_exp, unsigned step_exp, int max_exp, double piv_tol, double zero_tol)
+{
+  return LCPSolver::local().lcp_lemke_regularized(M,q,z,min_exp,step_exp,max_exp,piv_tol,zero_tol);
+}
@@ -0,0 +1,136 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <cmath>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+using Pacer::LCPSolver;
+
+// sweeps between complementarity error checks
+static const unsigned CHECK_EVERY = 4;
+// relaxation factor bounds and adaptation
+static const double OMEGA_MIN = 0.1, OMEGA_MAX = 1.9;
+static const double OMEGA_SHRINK = 0.5, OMEGA_GROW = 1.1;
+
+/// a'b over n (a multiple of 4) entries
+static inline double dot4(const double* a, const double* b, unsigned n){
+#ifdef __AVX__
+  __m256d s = _mm256_setzero_pd();
+  for(unsigned i=0;i<n;i+=4)
+    s = _mm256_add_pd(s,_mm256_mul_pd(_mm256_loadu_pd(a+i),_mm256_loadu_pd(b+i)));
+  double t[4];
+  _mm256_storeu_pd(t,s);
+  return (t[0] + t[1]) + (t[2] + t[3]);
+#else
+  // independent partial sums so the compiler can keep them in vector lanes
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for(unsigned i=0;i<n;i+=4){
+    s0 += a[i]   * b[i];
+    s1 += a[i+1] * b[i+1];
+    s2 += a[i+2] * b[i+2];
+    s3 += a[i+3] * b[i+3];
+  }
+  return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+/// max_i |min(z_i, w_i)|, w = Mz + q
+double LCPSolver::pgs_error(const Ravelin::VectorNd& q) const {
+  const unsigned n = q.rows();
+  const double* z = &_zpad[0];
+  double error = 0;
+  for(unsigned i=0;i<n;i++){
+    double w = q[i] + dot4(&_Mrow[i*_ld],z,_ld);
+    error = std::max(error,std::fabs(std::min(z[i],w)));
+  }
+  return error;
+}
+
+bool LCPSolver::lcp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double tol, unsigned max_iter, double omega)
+{
+  const unsigned n = q.rows();
+  _pgs_stats = pgs_stats_t();
+
+  if(n == 0){
+    z.set_zero(0);
+    return true;
+  }
+
+  // row major copy of M, rows padded with zeros to a multiple of 4
+  _ld = (n + 3) & ~3u;
+  _Mrow.assign(n*_ld,0);
+  _idiag.resize(n);
+  for(unsigned i=0;i<n;i++){
+    double* Mi = &_Mrow[i*_ld];
+    for(unsigned j=0;j<n;j++)
+      Mi[j] = M(i,j);
+    // a nonpositive diagonal can not be relaxed on
+    if(!(M(i,i) > 0))
+      return false;
+    _idiag[i] = 1.0 / M(i,i);
+  }
+
+  _zpad.assign(_ld,0);
+  if(z.rows() == n)
+    for(unsigned i=0;i<n;i++)
+      _zpad[i] = std::max(z[i],0.0);
+
+  double q_max = 0;
+  for(unsigned i=0;i<n;i++)
+    q_max = std::max(q_max,std::fabs(q[i]));
+  const double tolerance = tol * (1.0 + q_max);
+
+  double* zp = &_zpad[0];
+  double last_error = pgs_error(q);
+  bool converged = (last_error <= tolerance);
+  unsigned iter = 0;
+  while(!converged && iter < max_iter){
+    // projected Gauss-Seidel sweep:
+    // z_i = max(0, z_i - omega (M_i z + q_i) / M_ii)
+    for(unsigned i=0;i<n;i++){
+      double w = q[i] + dot4(&_Mrow[i*_ld],zp,_ld);
+      zp[i] = std::max(zp[i] - omega * w * _idiag[i],0.0);
+    }
+    iter++;
+
+    if(iter % CHECK_EVERY != 0 && iter != max_iter)
+      continue;
+
+    double error = pgs_error(q);
+    if(!std::isfinite(error))
+      break;
+    converged = (error <= tolerance);
+
+    // adapt relaxation: back off if the error grew, speed up while it falls
+    if(error > last_error)
+      omega = std::max(omega * OMEGA_SHRINK,OMEGA_MIN);
+    else
+      omega = std::min(omega * OMEGA_GROW,OMEGA_MAX);
+    last_error = error;
+  }
+
+  z.resize(n);
+  for(unsigned i=0;i<n;i++)
+    z[i] = zp[i];
+
+  _pgs_stats.iterations = iter;
+  _pgs_stats.error = last_error;
+  _pgs_stats.omega = omega;
+
+#ifndef NDEBUG
+  OUT_LOG(logDEBUG1) << "lcp_pgs: iterations: " << iter << ", error: " << last_error << ", omega: " << omega;
+#endif
+  return converged;
+}
+
+bool Utility::lcp_pgs(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double tol, unsigned max_iter)
+{
+  return LCPSolver::local().lcp_pgs(M,q,z,tol,max_iter);
+}
@@ -3,43 +3,70 @@
  * This library is distributed under the terms of the Apache V2.0
  * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
  ****************************************************************************/
+#include <Pacer/solvers.h>
 #include <Pacer/utilities.h>
-#include <Ravelin/LinAlgd.h>
-#include <Moby/LCP.h>
+#include <limits>
 
-extern bool lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER);
-Moby::LCP lcp_;
+using namespace Pacer;
 
 const int MAX_ITER = 1000;
-const double NEAR_ZERO = sqrt(std::numeric_limits<double>::epsilon());
-const double NEAR_INF = 1.0/NEAR_ZERO;
 
 //#define SPLITTING_METHOD
+#ifdef USE_SPLITTING_METHOD
+#define SPLITTING_METHOD
+#endif
 
-bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, Ravelin::VectorNd& v, bool warm_start, bool regularize)
+QPSolver& QPSolver::local(){
+  static thread_local QPSolver solver;
+  return solver;
+}
+
+/// Lemke's method: Pacer's updating solver (warm started from its last basis) first, Moby's as fallback
+bool QPSolver::lemke(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, bool regularize, double zero_tol)
+{
+  if(regularize){
+    if(_lcp_solver.lcp_lemke_regularized(M,q,z,-20,4,0,-1.0,zero_tol))
+      return true;
+    return _lcp.lcp_lemke_regularized(M,q,z,-20,4,0,-1.0,zero_tol);
+  }
+  if(_lcp_solver.lcp_lemke(M,q,z,-1.0,zero_tol))
+    return true;
+  return _lcp.lcp_lemke(M,q,z,-1.0,zero_tol);
+}
+
+bool QPSolver::solve_lcp(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z)
+{
+#ifndef SPLITTING_METHOD
+  double zero_tol = M.norm_inf()*M.rows()*std::numeric_limits<double>::epsilon() * 1e4;
+  if(!lemke(M,q,z,true,zero_tol))
+    return false;
+  return Utility::isvalid(z);
+#else
+  return _lcp_solver.lcp_pgs(M, q, z, 1e-8, MAX_ITER);
+#endif
+}
+
+bool QPSolver::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, Ravelin::VectorNd& v, bool warm_start, bool regularize)
 {
   const int n = Q.rows();
   const int m = A.rows();
   
-  Ravelin::MatrixNd MMM;
-  MMM.set_zero(n + m,n + m);
-  
-  Ravelin::VectorNd zzz(n + m),qqq(n + m);
-  qqq.set_zero();
-  zzz.set_zero();
-  // init and setup MMM
-  Ravelin::MatrixNd nAT = A;
-  nAT.transpose();
-  nAT.negate();
-  MMM.set_sub_mat(0,0,Q);
-  MMM.set_sub_mat(0,n,nAT);
-  MMM.set_sub_mat(n,0,A);
-  
-  // setup qqq
-  qqq.set_sub_vec(0,c);
-  Ravelin::VectorNd nb = b;
-  nb.negate();
-  qqq.set_sub_vec(n,nb);
+  // setup the LCP matrix
+  // MMM = |  Q -A' |
+  //       |  A  0  |
+  _MMM.set_zero(n + m,n + m);
+  _MMM.set_sub_mat(0,0,Q);
+  _MMM.set_sub_mat(n,0,A);
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++)
+      _MMM(j,n+i) = -A(i,j);
+  
+  // setup LCP vector qqq = [c;-b]
+  _qqq.resize(n + m);
+  _qqq.set_sub_vec(0,c);
+  for(int i=0;i<m;i++)
+    _qqq[n+i] = -b[i];
+  _zzz.set_zero(n + m);
   
   // solve the LCP
   bool SOLVE_FLAG = true;
@@ -51,23 +78,20 @@ bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd&
   OUTLOG(c,"qp_c",logDEBUG1);
   OUTLOG(A,"qp_A",logDEBUG1);
   OUTLOG(b,"qp_b",logDEBUG1);
-  //OUT_LOG(logINFO)  << "LCP variables" << std::endl;
-  //OUTLOG(MMM,"MM",logDEBUG1);
-  //OUTLOG(qqq,"qq",logDEBUG1);
 #endif
   
 #ifndef SPLITTING_METHOD
-  double zero_tol = MMM.norm_inf()*MMM.rows()*std::numeric_limits<double>::epsilon() * 1e4;
+  double zero_tol = _MMM.norm_inf()*_MMM.rows()*std::numeric_limits<double>::epsilon() * 1e4;
   if (warm_start) {
-    zzz = v;
-    if(!lcp_.lcp_fast(MMM,qqq,zzz)){
+    _zzz = v;
+    if(!_lcp.lcp_fast(_MMM,_qqq,_zzz)){
       if(regularize){
-        if(!lcp_.lcp_lemke_regularized(MMM,qqq,zzz,-20,4,0,-1.0,zero_tol))
+        if(!lemke(_MMM,_qqq,_zzz,true,zero_tol))
           SOLVE_FLAG = false;
         else
-          SOLVE_FLAG = isvalid(zzz);
+          SOLVE_FLAG = Utility::isvalid(_zzz);
       } else {
-        if(!lcp_.lcp_lemke(MMM,qqq,zzz,-1.0,zero_tol))
+        if(!lemke(_MMM,_qqq,_zzz,false,zero_tol))
           SOLVE_FLAG = false;
       }
     } else {
@@ -75,67 +99,59 @@ bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd&
     }
   } else {
     if(regularize){
-      if(!lcp_.lcp_lemke_regularized(MMM,qqq,zzz,-20,4,0,-1.0,zero_tol))
+      if(!lemke(_MMM,_qqq,_zzz,true,zero_tol))
         SOLVE_FLAG = false;
       else
-        SOLVE_FLAG = isvalid(zzz);
+        SOLVE_FLAG = Utility::isvalid(_zzz);
     } else {
-      if(!lcp_.lcp_lemke(MMM,qqq,zzz,-1.0,zero_tol))
+      if(!lemke(_MMM,_qqq,_zzz,false,zero_tol))
         SOLVE_FLAG = false;
     }
   }
   
-  
   if (SOLVE_FLAG) {
-    v = zzz;
+    v = _zzz;
   }
 #else
-  lcp_symm_iter(MMM, qqq, zzz, 0.5, 1.0, MAX_ITER);
+  // [Q -A'; A 0] has a zero diagonal block, out of reach of lcp_pgs()
+  _lcp_solver.lcp_symm_iter(_MMM, _qqq, _zzz, 0.5, 1.0, MAX_ITER);
 #endif
   // extract x
   for(int i=0;i<n;i++)
-    x[i] = zzz[i];
+    x[i] = _zzz[i];
 #ifndef NDEBUG
   OUT_LOG(logDEBUG1)  << "%Solutions" ;
-  //  OUTLOG(zzz,"zz");
   OUTLOG(x,"xx",logDEBUG1);
   OUT_LOG(logDEBUG1)  << "% << solve qp positive" ;
 #endif
   return SOLVE_FLAG;
 }
-//bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x)
 
-bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, Ravelin::VectorNd& x, bool warm_start)
+bool QPSolver::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, Ravelin::VectorNd& x, bool warm_start)
 {
-  const int n = Q.rows();
-  const int m = 0;
-  
   // solve the LCP
   x.set_zero();
   bool SOLVE_FLAG = true;
   
 #ifndef NDEBUG
   OUT_LOG(logDEBUG1)  << " >> solve qp positive" ;
-  //  OUT_LOG(logINFO)  << "LCP variables" << std::endl;
-  //  OUTLOG(Q,"MM");
-  //  OUTLOG(c,"qq");
 #endif
   
   double zero_tol = Q.norm_inf()*Q.rows()*std::numeric_limits<double>::epsilon() * 1e4;
   if (warm_start) {
-    if(!lcp_.lcp_fast(Q,c,x)){
-      if(!lcp_.lcp_lemke_regularized(Q,c,x,-20,4,0,-1.0,zero_tol))
+    if(!_lcp.lcp_fast(Q,c,x)){
+      if(!lemke(Q,c,x,true,zero_tol))
         SOLVE_FLAG = false;
       else
-        SOLVE_FLAG = isvalid(x);
+        SOLVE_FLAG = Utility::isvalid(x);
     } else {
       SOLVE_FLAG = false;
     }
   } else {
-    if(!lcp_.lcp_lemke_regularized(Q,c,x,-20,4,0,-1.0,zero_tol))
+    if(!lemke(Q,c,x,true,zero_tol))
       SOLVE_FLAG = false;
     else
-      SOLVE_FLAG = isvalid(x);
+      SOLVE_FLAG = Utility::isvalid(x);
   }
   
 #ifndef NDEBUG
@@ -146,85 +162,104 @@ bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd&
   return SOLVE_FLAG;
 }
 
-bool Utility::solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x)
+bool QPSolver::solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x)
 {
   const int n = Q.rows();
   const int m = A.rows();
   
-  // setup the LCP matrix
-  // MMM = |  Q -Q -A' |
-  //       | -Q  Q  A' |
-  //       |  A -A  0  |
-  Ravelin::MatrixNd MMM,AT = A, nA = A, nQ = Q;
-  MMM.set_zero(Q.rows()*2 + A.rows(), Q.rows()*2 + A.rows());
+  _Q_chol = Q;
+  if(!_LA.factor_chol(_Q_chol)){
+    OUT_LOG(logDEBUG1) << "solve_qp: Q is not positive definite, splitting free variables";
+    return solve_qp_split(Q,c,A,b,x);
+  }
   
-  nA.negate();
-  AT.transpose();
-  nQ.negate();
+  // inv(Q) c, inv(Q) A'
+  _LA.solve_chol_fast(_Q_chol,_iQc = c);
+  x.resize(n);
+  if(m == 0){
+    (x = _iQc).negate();
+    return true;
+  }
+  Ravelin::MatrixNd::transpose(A,_AT);
+  _LA.solve_chol_fast(_Q_chol,_iQAT = _AT);
   
-  Ravelin::VectorNd zzz,qqq, nc=c, nb=b;
-  qqq.set_zero(MMM.rows());
-  zzz.set_zero(MMM.rows());
+  // setup the LCP in the multipliers
+  // MMM = A inv(Q) A',  qqq = -(A inv(Q) c + b)
+  A.mult(_iQAT,_MMM);
+  A.mult(_iQc,_qqq) += b;
+  _qqq.negate();
+  _zzz.set_zero(m);
   
-  nc.negate();
-  nb.negate();
+  bool SOLVE_FLAG = solve_lcp(_MMM,_qqq,_zzz);
   
-  MMM.set_sub_mat(0,0,Q);
-  MMM.set_sub_mat(n,n,Q);
-  MMM.set_sub_mat(0,n,nQ);
-  MMM.set_sub_mat(n,0,nQ);
+  // x = inv(Q) (A' lambda - c)
+  _iQAT.mult(_zzz,x) -= _iQc;
   
-  // setup linear inequality constraints in LCP matrix
-  MMM.set_sub_mat(n,n*2,AT);
-  AT.negate();
-  MMM.set_sub_mat(0,n*2,AT);
+#ifndef NDEBUG
+  OUTLOG(_zzz,"qp_lambda",logDEBUG1);
+  OUTLOG(x,"xx",logDEBUG1);
+#endif
+  return SOLVE_FLAG;
+}
+
+bool QPSolver::solve_qp_split(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x)
+{
+  const int n = Q.rows();
+  const int m = A.rows();
   
-  MMM.set_sub_mat(n*2,0,A);
-  MMM.set_sub_mat(n*2,n,nA);
+  // setup the LCP matrix
+  // MMM = |  Q -Q -A' |
+  //       | -Q  Q  A' |
+  //       |  A -A  0  |
+  _MMM.set_zero(n*2 + m, n*2 + m);
+  for(int i=0;i<n;i++)
+    for(int j=0;j<n;j++){
+      _MMM(i,j) = _MMM(n+i,n+j) = Q(i,j);
+      _MMM(i,n+j) = _MMM(n+i,j) = -Q(i,j);
+    }
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++){
+      _MMM(n*2+i,j) = A(i,j);
+      _MMM(n*2+i,n+j) = -A(i,j);
+      _MMM(j,n*2+i) = -A(i,j);
+      _MMM(n+j,n*2+i) = A(i,j);
+    }
   
   // setup LCP vector qqq = [c;-c;-b]
-  qqq.set_sub_vec(0,c);
-  qqq.set_sub_vec(n,nc);
-  qqq.set_sub_vec(2*n,nb);
-  
-#ifndef NDEBUG
-  //  OUT_LOG(logDEBUG1)  << "% >> solve qp" << std::endl;
-  //  OUT_LOG(logDEBUG1)  << "%QP variables" << std::endl;
-  //  OUTLOG(Q,"Q",logDEBUG1);
-  //  OUTLOG(c,"c",logDEBUG1);
-  //  OUTLOG(A,"AA",logDEBUG1);
-  //  OUTLOG(b,"bb",logDEBUG1);
-  //  OUT_LOG(logDEBUG1)  << "LCP variables" << std::endl;
-  //  OUTLOG(MMM,"MMM",logDEBUG1);
-  //  OUTLOG(qqq,"qqq",logDEBUG1);
-#endif
+  _qqq.resize(n*2 + m);
+  for(int i=0;i<n;i++){
+    _qqq[i] = c[i];
+    _qqq[n+i] = -c[i];
+  }
+  for(int i=0;i<m;i++)
+    _qqq[n*2+i] = -b[i];
+  _zzz.set_zero(n*2 + m);
   
   // solve the LCP
-  bool SOLVE_FLAG = true;
-#ifndef SPLITTING_METHOD
-  double zero_tol = MMM.norm_inf()*MMM.rows()*std::numeric_limits<double>::epsilon() * 1e4;
-  if(!lcp_.lcp_lemke_regularized(MMM,qqq,zzz,-20,4,0,-1.0,zero_tol))
-    //  if(!lcp_.lcp_lemke(MMM,qqq,zzz))
-    SOLVE_FLAG = false;
-  else
-    SOLVE_FLAG = isvalid(zzz);
-#else
-  lcp_symm_iter(MMM, qqq, zzz, 0.5, 1.0, MAX_ITER);
-#endif
+  bool SOLVE_FLAG = solve_lcp(_MMM,_qqq,_zzz);
   
   // extract x
   for(int i=0;i<n;i++)
-    x[i] = zzz[i] - zzz[n+i];
+    x[i] = _zzz[i] - _zzz[n+i];
   
-#ifndef NDEBUG
-  //  OUT_LOG(logDEBUG1)  << "%Solutions" << std::endl;
-  //  OUTLOG(zzz,"zzz",logDEBUG1);
-  //  OUTLOG(x,"xx",logDEBUG1);
-  //  OUT_LOG(logDEBUG1)  << "% << solve qp" << std::endl;
-#endif
   return SOLVE_FLAG;
 }
 
+bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x, Ravelin::VectorNd& v, bool warm_start, bool regularize)
+{
+  return QPSolver::local().solve_qp_pos(Q,c,A,b,x,v,warm_start,regularize);
+}
+
+bool Utility::solve_qp_pos(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, Ravelin::VectorNd& x, bool warm_start)
+{
+  return QPSolver::local().solve_qp_pos(Q,c,x,warm_start);
+}
+
+bool Utility::solve_qp(const Ravelin::MatrixNd& Q, const Ravelin::VectorNd& c, const Ravelin::MatrixNd& A, const Ravelin::VectorNd& b, Ravelin::VectorNd& x)
+{
+  return QPSolver::local().solve_qp(Q,c,A,b,x);
+}
+
 /*
  #include <Opt/QPActiveSet.h>
  
@@ -342,7 +377,7 @@ using namespace Moby;
  * \note this method is via [Murty 1988]
  */
 
-bool Utility::lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER)
+bool Pacer::LCPSolver::lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER)
 {
   unsigned n = q.size();
   
@@ -354,10 +389,13 @@ bool Utility::lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd&
   // NOTE: we use E as identity
   // NOTE: we use L/U alternately as K
   
-  // setup work vectors and matrices
-  static VectorNd row, znew, w;
-  static vector<VectorNd> m;
-  static MatrixNd L, G, U;
+  // work vectors and matrices
+  VectorNd& row = _row;
+  VectorNd& znew = _znew;
+  vector<VectorNd>& m = _rows;
+  MatrixNd& L = _L;
+  MatrixNd& G = _G;
+  MatrixNd& U = _U;
   
   // get rows of M
   m.resize(n);
@@ -412,3 +450,8 @@ bool Utility::lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd&
   
   return true;
 }
+
+bool Utility::lcp_symm_iter(const Ravelin::MatrixNd& M, const Ravelin::VectorNd& q, Ravelin::VectorNd& z, double lambda, double omega, unsigned MAX_ITER)
+{
+  return Pacer::LCPSolver::local().lcp_symm_iter(M, q, z, lambda, omega, MAX_ITER);
+}
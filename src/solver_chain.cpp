@@ -0,0 +1,87 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/solvers.h>
+#include <Pacer/utilities.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+using Pacer::SolverChain;
+
+// success rate floor in the expected cost, so a method that always fails still sorts
+static const double MIN_SUCCESS_RATE = 1e-2;
+
+void SolverChain::set_names(const std::vector<std::string>& names){
+  _names = names;
+  _stats.assign(names.size(),stats_t());
+  _order.resize(names.size());
+  for(unsigned i=0;i<names.size();i++)
+    _order[i] = i;
+  _last = -1;
+  _solves = 0;
+  _last_attempt.assign(names.size(),0);
+}
+
+bool SolverChain::run(double tol){
+  _last = -1;
+  _solves++;
+
+  // reorder by expected cost once every method has been tried, so a method
+  // with no record never jumps ahead of the configured order
+  bool all_called = true;
+  for(unsigned i=0;i<_stats.size();i++)
+    all_called = all_called && _stats[i].calls > 0;
+  for(unsigned i=0;i<_order.size();i++)
+    _order[i] = i;
+  if(adaptive && all_called){
+    std::vector<double> cost(_stats.size());
+    for(unsigned i=0;i<_stats.size();i++)
+      cost[i] = _stats[i].latency / std::max(_stats[i].success_rate,MIN_SUCCESS_RATE);
+    std::stable_sort(_order.begin(),_order.end(),
+                     [&cost](unsigned a, unsigned b){ return cost[a] < cost[b]; });
+  }
+  
+  // explore: try the non-leading method attempted longest ago first
+  if(adaptive && explore_interval > 0 && _order.size() > 1 && _solves % explore_interval == 0){
+    unsigned k_oldest = 1;
+    for(unsigned k=2;k<_order.size();k++)
+      if(_last_attempt[_order[k]] < _last_attempt[_order[k_oldest]])
+        k_oldest = k;
+    std::rotate(_order.begin(),_order.begin()+k_oldest,_order.begin()+k_oldest+1);
+  }
+
+  for(unsigned k=0;k<_order.size();k++){
+    const unsigned i = _order[k];
+    stats_t& stats = _stats[i];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      stats.error = attempt(i);
+    } catch(std::exception& e){
+      OUT_LOG(logERROR) << _label << ": " << _names[i] << " threw: " << e.what();
+      stats.error = std::numeric_limits<double>::infinity();
+    }
+    const bool SOLVE_FLAG = stats.error <= tol;
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats.calls++;
+    stats.time += time;
+    if(SOLVE_FLAG)
+      stats.successes++;
+    _last_attempt[i] = _solves;
+    // the first latency is taken as is, the success rate starts from its prior (1)
+    stats.latency += ((stats.calls == 1)? 1.0 : smoothing) * (time - stats.latency);
+    stats.success_rate += smoothing * ((SOLVE_FLAG? 1.0 : 0.0) - stats.success_rate);
+
+    if(SOLVE_FLAG){
+      _last = i;
+      return true;
+    }
+    OUT_LOG(logINFO) << _label << ": " << _names[i] << " failed (error " << stats.error << "), trying the next method";
+  }
+  return false;
+}
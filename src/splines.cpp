@@ -10,10 +10,6 @@
 #include <cmath>
 #include <Pacer/utilities.h>
 
-static Ravelin::VectorNd workv_;
-static Ravelin::Vector3d workv3_;
-static Ravelin::MatrixNd workM_;
-
 void Utility::evalBernstein(const Ravelin::Vector3d& A, const Ravelin::Vector3d& B, const Ravelin::Vector3d& C, const Ravelin::Vector3d& D, double t,Ravelin::Vector3d& P,Ravelin::Vector3d& dP,Ravelin::Vector3d& ddP) {
 
   // Position
@@ -104,10 +100,11 @@ bool Utility::eval_cubic_spline(const Ravelin::VectorNd& coefs,const Ravelin::Ve
 
 void Utility::calc_cubic_spline_coefs(const Ravelin::VectorNd& T_,const Ravelin::VectorNd& X,
                                            const Ravelin::Vector2d& Xd, Ravelin::VectorNd& B){
-  static Ravelin::MatrixNd A;
+  Pacer::Workspace& ws = Pacer::Workspace::local();
+  Ravelin::MatrixNd& A = ws.M;
 
   // Spline always solves from t[0] = 0 in interval
-  static Ravelin::VectorNd T;
+  Ravelin::VectorNd& T = ws.v1;
   T = T_;
   for(int i=0;i<T.rows();i++)
     T[i] -= T_[0];
@@ -246,13 +243,13 @@ void Utility::calc_cubic_spline_coefs(const Ravelin::VectorNd& T_,const Ravelin:
     A(5 + 4*i + 4,3 + 4*(i+1) + 4) = 1;
   }
 
-  workv_ = B;
+  ws.v = B;
 
-  // Solve linear system (A is corrupted and workv_ has result)
-  LA_.solve_fast(A,workv_);
+  // Solve linear system (A is corrupted and ws.v has result)
+  ws.LA.solve_fast(A,ws.v);
 
   // Exclude virtual points from returned spline coeficients
-  workv_.get_sub_vec(4,workv_.size()-4,B);
+  ws.v.get_sub_vec(4,ws.v.size()-4,B);
 }
 
 //int test_spline(){
@@ -0,0 +1,289 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/telemetry.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace Pacer;
+
+static const char MAGIC[8] = {'P','A','C','E','R','T','L','M'};
+static const size_t HEADER_BYTES = 16;
+// address space mapped once up front, so the mapping never moves
+static const size_t MAP_BYTES = (sizeof(void*) == 8)? ((size_t) 1 << 36) : ((size_t) 1 << 30);
+// initial (sparse) file length, the file is extended by this much each time it is half full
+static const size_t CHUNK_BYTES = (size_t) 1 << 30;
+
+static inline size_t pad8(size_t n){ return (n + 7) & ~((size_t) 7); }
+
+// ============================================================================
+// ============================  TELEMETRY WRITER  ============================
+
+Telemetry& Telemetry::instance(){
+  static Telemetry telemetry;
+  return telemetry;
+}
+
+TLogLevel& Telemetry::ReportingLevel(){
+  static TLogLevel reportingLevel = logDEBUG4;
+  return reportingLevel;
+}
+
+Telemetry::Telemetry() : _fd(-1), _data(NULL), _size(0), _capacity(0), _tick(0), _time(0), _full(false){
+#ifdef USE_THREADS
+  pthread_mutex_init(&_mutex,NULL);
+  pthread_cond_init(&_grow,NULL);
+  _growing = false;
+  _stop = false;
+#endif
+  char buffer[9];
+  sprintf(buffer,"%06d",getpid());
+  std::string name("telemetry-"+std::string(buffer)+".bin");
+  _fd = open(name.c_str(),O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(_fd < 0)
+    throw std::runtime_error("Could not open telemetry file: " + name);
+  if(!grow(CHUNK_BYTES))
+    throw std::runtime_error("Could not grow telemetry file");
+  // pages past the end of the file are never touched, they only reserve address space
+  void* data = mmap(NULL,MAP_BYTES,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_NORESERVE,_fd,0);
+  if(data == MAP_FAILED)
+    throw std::runtime_error("Could not map telemetry file");
+  _data = static_cast<char*>(data);
+
+  memcpy(_data,MAGIC,8);
+  uint32_t* version = reinterpret_cast<uint32_t*>(_data+8);
+  version[0] = VERSION;
+  version[1] = 0;
+  _size = HEADER_BYTES;
+
+#ifdef USE_THREADS
+  if(pthread_create(&_grower,NULL,&Telemetry::grower_thread,this) != 0)
+    throw std::runtime_error("Could not start telemetry thread");
+#endif
+}
+
+bool Telemetry::grow(size_t capacity){
+  capacity = std::min(capacity,MAP_BYTES);
+  if(capacity <= _capacity)
+    return false;
+  if(ftruncate(_fd,capacity) != 0){
+    perror("telemetry");
+    return false;
+  }
+  _capacity = capacity;
+  return true;
+}
+
+#ifdef USE_THREADS
+void* Telemetry::grower_thread(void* arg){
+  Telemetry* t = static_cast<Telemetry*>(arg);
+  pthread_mutex_lock(&t->_mutex);
+  while(!t->_stop){
+    if(!t->_growing){
+      pthread_cond_wait(&t->_grow,&t->_mutex);
+      continue;
+    }
+    // the writer keeps filling the mapped part of the file meanwhile
+    const size_t capacity = std::min(t->_capacity + CHUNK_BYTES,MAP_BYTES);
+    pthread_mutex_unlock(&t->_mutex);
+    const bool grown = (ftruncate(t->_fd,capacity) == 0);
+    if(!grown)
+      perror("telemetry");
+    pthread_mutex_lock(&t->_mutex);
+    if(grown)
+      t->_capacity = std::max(t->_capacity,capacity);
+    t->_growing = false;
+  }
+  pthread_mutex_unlock(&t->_mutex);
+  return NULL;
+}
+#endif
+
+char* Telemetry::reserve(size_t bytes){
+#ifdef USE_THREADS
+  // have the file extended off this thread well before it fills up
+  if(!_growing && _capacity < MAP_BYTES && _size + bytes > _capacity - CHUNK_BYTES / 2){
+    _growing = true;
+    pthread_cond_signal(&_grow);
+  }
+#endif
+  if(_size + bytes > _capacity){
+#ifdef USE_THREADS
+    // the grower is behind (or the mapping is exhausted): drop rather than block
+    {
+#else
+    // once per CHUNK_BYTES without a grower thread
+    if(!grow(std::max(_capacity + CHUNK_BYTES,_size + bytes)) || _size + bytes > _capacity){
+#endif
+      if(!_full)
+        fprintf(stderr,"telemetry: file is full at %lu bytes, dropping samples\n",(unsigned long) _capacity);
+      _full = true;
+      return NULL;
+    }
+  }
+  char* ptr = _data + _size;
+  _size += bytes;
+  return ptr;
+}
+
+int Telemetry::register_series(const std::string& name, unsigned width){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  std::pair<std::string,unsigned> key(name,width);
+  std::map<std::pair<std::string,unsigned>,int>::iterator it = _series_id.find(key);
+  int id;
+  if(it != _series_id.end()){
+    id = (*it).second;
+  } else {
+    // registered only once its schema is in the stream, so no DATA record precedes it
+    char* ptr = reserve(16 + pad8(name.size()));
+    if(ptr){
+      id = _series_width.size();
+      _series_id[key] = id;
+      _series_width.push_back(width);
+      uint32_t* head = reinterpret_cast<uint32_t*>(ptr);
+      head[0] = SCHEMA;
+      head[1] = id;
+      head[2] = width;
+      head[3] = name.size();
+      memcpy(ptr+16,name.data(),name.size());
+    } else {
+      id = -1;
+    }
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+  return id;
+}
+
+void Telemetry::record(int id, const double* data){
+  if(id < 0)
+    return;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+#endif
+  const unsigned width = _series_width[id];
+  char* ptr = reserve(24 + width*sizeof(double));
+  if(ptr){
+    uint32_t* head = reinterpret_cast<uint32_t*>(ptr);
+    head[1] = id;
+    memcpy(ptr+8,&_tick,sizeof(uint64_t));
+    memcpy(ptr+16,&_time,sizeof(double));
+    memcpy(ptr+24,data,width*sizeof(double));
+    // tag last: a torn record reads as the end of the stream
+    head[0] = DATA;
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_mutex);
+#endif
+}
+
+void Telemetry::close(){
+  if(!_data)
+    return;
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_mutex);
+  _stop = true;
+  pthread_cond_signal(&_grow);
+  pthread_mutex_unlock(&_mutex);
+  pthread_join(_grower,NULL);
+#endif
+  munmap(_data,MAP_BYTES);
+  _data = NULL;
+  if(ftruncate(_fd,_size) != 0)
+    perror("telemetry");
+  ::close(_fd);
+  _fd = -1;
+}
+
+// ============================================================================
+// ============================  TELEMETRY READER  ============================
+
+TelemetryReader::TelemetryReader(const std::string& filename) : _fd(-1), _data(NULL), _size(0), _pos(0), _start(HEADER_BYTES), _scanned(false){
+  _fd = open(filename.c_str(),O_RDONLY);
+  if(_fd < 0)
+    throw std::runtime_error("Could not open telemetry file: " + filename);
+  struct stat st;
+  fstat(_fd,&st);
+  _size = st.st_size;
+  if(_size < HEADER_BYTES)
+    throw std::runtime_error("Not a telemetry file: " + filename);
+  void* data = mmap(NULL,_size,PROT_READ,MAP_SHARED,_fd,0);
+  if(data == MAP_FAILED)
+    throw std::runtime_error("Could not map telemetry file: " + filename);
+  _data = static_cast<const char*>(data);
+  if(memcmp(_data,MAGIC,8) != 0)
+    throw std::runtime_error("Not a telemetry file: " + filename);
+  if(reinterpret_cast<const uint32_t*>(_data+8)[0] != Telemetry::VERSION)
+    throw std::runtime_error("Unsupported telemetry version in: " + filename);
+  _pos = _start;
+}
+
+TelemetryReader::~TelemetryReader(){
+  if(_data)
+    munmap(const_cast<char*>(_data),_size);
+  if(_fd >= 0)
+    ::close(_fd);
+}
+
+bool TelemetryReader::next(sample_t& s){
+  while(_pos + 16 <= _size){
+    const uint32_t* head = reinterpret_cast<const uint32_t*>(_data+_pos);
+    if(head[0] == Telemetry::SCHEMA){
+      const int id = head[1];
+      const size_t bytes = 16 + pad8(head[3]);
+      if(_pos + bytes > _size)
+        return false;
+      if(id >= (int) _series.size()){
+        series_t series;
+        series.id = id;
+        series.width = head[2];
+        series.name = std::string(_data+_pos+16,head[3]);
+        series.samples = 0;
+        _series.push_back(series);
+      }
+      _pos += bytes;
+    } else if(head[0] == Telemetry::DATA){
+      const int id = head[1];
+      if(id >= (int) _series.size())
+        throw std::runtime_error("Telemetry record for undeclared series");
+      const size_t bytes = 24 + _series[id].width*sizeof(double);
+      if(_pos + bytes > _size)
+        return false;
+      s.id = id;
+      memcpy(&s.tick,_data+_pos+8,sizeof(uint64_t));
+      memcpy(&s.time,_data+_pos+16,sizeof(double));
+      s.data = reinterpret_cast<const double*>(_data+_pos+24);
+      _pos += bytes;
+      return true;
+    } else {
+      // END (unused space at the end of a file that was not closed)
+      return false;
+    }
+  }
+  return false;
+}
+
+const std::vector<TelemetryReader::series_t>& TelemetryReader::get_series(){
+  if(!_scanned){
+    size_t pos = _pos;
+    sample_t s;
+    _pos = _start;
+    while(next(s))
+      _series[s.id].samples++;
+    _scanned = true;
+    _pos = pos;
+  }
+  return _series;
+}
@@ -5,21 +5,26 @@
  ****************************************************************************/
 #include <Pacer/utilities.h>
 
-static Ravelin::VectorNd workv_;
-static Ravelin::Vector3d workv3_;
-static Ravelin::MatrixNd workM_;
-
 std::vector<Pacer::VisualizablePtr> Utility::visualize;
 
+Pacer::Workspace& Pacer::Workspace::local(){
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
 /// Calculates The null pace for matrix M and places it in Vk
 /// returns the number of columns in Vk
 unsigned Utility::kernal( Ravelin::MatrixNd& M,Ravelin::MatrixNd& null_M){
+  return kernal(M,null_M,Pacer::Workspace::local());
+}
+
+unsigned Utility::kernal( Ravelin::MatrixNd& M,Ravelin::MatrixNd& null_M, Pacer::Workspace& ws){
   unsigned size_null_space = 0;
   Ravelin::MatrixNd U,V;
   Ravelin::VectorNd S;
 
   // SVD decomp to retrieve nullspace of Z'AZ
-  LA_.svd(M,U,S,V);
+  ws.LA.svd(M,U,S,V);
   if(S.rows() != 0){
     // Calculate the tolerance for ruling that a singular value is supposed to be zero
     double ZERO_TOL = std::numeric_limits<double>::epsilon() * M.rows() * S[0];
@@ -66,10 +71,14 @@ Ravelin::Vector3d Utility::lerp( const Ravelin::Vector3d& v0,const Ravelin::Vect
 }
 
 void Utility::solve(Ravelin::MatrixNd& M,Ravelin::VectorNd& bx){
+  solve(M,bx,Pacer::Workspace::local());
+}
+
+void Utility::solve(Ravelin::MatrixNd& M,Ravelin::VectorNd& bx, Pacer::Workspace& ws){
   if(M.rows() == M.columns())
-    LA_.solve_fast(M,bx);
+    ws.LA.solve_fast(M,bx);
   else{
-    LA_.pseudo_invert(workM_ = M);
-    workM_.mult(workv_ = bx,bx);
+    ws.LA.pseudo_invert(ws.solve_M = M);
+    ws.solve_M.mult(ws.solve_v = bx,bx);
   }
 }
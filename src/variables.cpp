@@ -178,41 +178,43 @@ void Pacer::Controller::load_variables(std::string fname, std::string root){
   process_tag(this->ptr(),root,root_tree);
 }
 
-bool Pacer::Robot::set_data_internal(const std::string& n, boost::any to_append){
-  bool new_var = true;
-#ifdef LOG_TO_FILE
-  OUT_LOG(logINFO) << "\t" << n << " has type '" << to_append.type().name() << "'";
-#endif
-  
+Pacer::data_slot_ptr Pacer::Robot::find_data_slot(const std::string& n){
+  Pacer::data_slot_ptr slot;
+  std::map<std::string,Pacer::data_slot_ptr >::iterator it;
 #ifdef USE_THREADS
   pthread_mutex_lock(&_data_map_mutex);
 #endif
-  int map_size = _data_map.size();
-  _data_map[n] = to_append;
-  new_var = (map_size != _data_map.size());
+  it = _data_map.find(n);
+  if(it != _data_map.end()){
+    slot = (*it).second;
+  }
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_data_map_mutex);
 #endif
-  return new_var;
+  return slot;
 }
 
-// Returns 'true' if new key was created in map
-bool Pacer::Robot::get_data_internal(const std::string& n, boost::any& operand){
-  bool RETURN_FLAG = false;
-  std::map<std::string,boost::any >::iterator it;
+Pacer::data_slot_ptr Pacer::Robot::insert_data_slot(const std::string& n, const Pacer::data_slot_ptr& slot){
+#ifdef LOG_TO_FILE
+  OUT_LOG(logINFO) << "\t" << n << " has type '" << slot->type().name() << "'";
+#endif
+  
 #ifdef USE_THREADS
   pthread_mutex_lock(&_data_map_mutex);
 #endif
-  it = _data_map.find(n);
-  if(it != _data_map.end()){
-    operand = (*it).second;
-    
-    RETURN_FLAG = true;
-  } // else RETURN_FLAG = false;
+  Pacer::data_slot_ptr& stored = _data_map[n];
+  if(!stored){
+    stored = slot;
+  } else if(stored->type() != slot->type()){
+    // Variable changes type: handles to the old slot no longer see it
+    stored->clear();
+    stored = slot;
+  } // else another caller declared it first, use that slot
+  Pacer::data_slot_ptr result = stored;
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_data_map_mutex);
 #endif
-  return RETURN_FLAG;
+  return result;
 }
 
 void Pacer::Robot::remove_data(std::string n){
@@ -222,10 +224,45 @@ void Pacer::Robot::remove_data(std::string n){
 #ifdef LOG_TO_FILE
   OUT_LOG(logINFO) << "Remove: " << n;
 #endif
-  std::map<std::string,boost::any >::iterator it
+  // Keep the slot so resolved handles see the variable if it is set again
+  std::map<std::string,Pacer::data_slot_ptr >::iterator it
   =_data_map.find(n);
   if (it != _data_map.end()){
-    _data_map.erase(it);
+    (*it).second->clear();
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_data_map_mutex);
+#endif
+}
+
+void Pacer::Robot::clone_data(std::vector<Pacer::data_slot_ptr>& slots, const boost::function<bool (const std::string&)>& select){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_data_map_mutex);
+#endif
+  std::map<std::string,Pacer::data_slot_ptr >::const_iterator it;
+  for(it=_data_map.begin();it!=_data_map.end();it++){
+    if(select.empty() || select((*it).first))
+      slots.push_back(Pacer::data_slot_ptr((*it).second->clone()));
+  }
+#ifdef USE_THREADS
+  pthread_mutex_unlock(&_data_map_mutex);
+#endif
+}
+
+void Pacer::Robot::publish_data(const std::vector<Pacer::data_slot_ptr>& slots){
+#ifdef USE_THREADS
+  pthread_mutex_lock(&_data_map_mutex);
+#endif
+  for(int i=0;i<slots.size();i++){
+    Pacer::data_slot_ptr& stored = _data_map[slots[i]->name];
+    if(stored && stored->type() == slots[i]->type()){
+      // keep the slot, resolved handles see the new value
+      stored->assign(*slots[i]);
+    } else {
+      if(stored)
+        stored->clear();
+      stored = Pacer::data_slot_ptr(slots[i]->clone());
+    }
   }
 #ifdef USE_THREADS
   pthread_mutex_unlock(&_data_map_mutex);
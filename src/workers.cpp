@@ -0,0 +1,158 @@
+/****************************************************************************
+ * Copyright 2014 Samuel Zapolsky
+ * This library is distributed under the terms of the Apache V2.0
+ * License (obtainable from http://www.apache.org/licenses/LICENSE-2.0).
+ ****************************************************************************/
+#include <Pacer/workers.h>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+using namespace Pacer;
+
+void WorkerPool::run_serial(std::vector<dag_task_t>& tasks){
+  for(int i=0;i<tasks.size();i++)
+    tasks[i].run();
+}
+
+#ifndef USE_THREADS
+
+WorkerPool::WorkerPool(int num_workers) : _num_workers(0) {}
+
+WorkerPool::~WorkerPool() {}
+
+void WorkerPool::run_graph(std::vector<dag_task_t>& tasks){
+  run_serial(tasks);
+}
+
+#else
+
+WorkerPool::WorkerPool(int num_workers) : _num_workers(std::max(num_workers,0)), _tasks(NULL),
+  _remaining(0), _running(0), _abort(false), _shutdown(false)
+{
+  pthread_mutex_init(&_mutex,NULL);
+  pthread_cond_init(&_work_cond,NULL);
+  pthread_cond_init(&_done_cond,NULL);
+
+  _threads.resize(_num_workers);
+  for(int i=0;i<_num_workers;i++)
+    if(pthread_create(&_threads[i],NULL,&WorkerPool::worker_thread,this) != 0)
+      throw std::runtime_error("WorkerPool: could not create worker thread");
+}
+
+WorkerPool::~WorkerPool(){
+  pthread_mutex_lock(&_mutex);
+  _shutdown = true;
+  pthread_cond_broadcast(&_work_cond);
+  pthread_mutex_unlock(&_mutex);
+  for(int i=0;i<_threads.size();i++)
+    pthread_join(_threads[i],NULL);
+  pthread_cond_destroy(&_work_cond);
+  pthread_cond_destroy(&_done_cond);
+  pthread_mutex_destroy(&_mutex);
+}
+
+void* WorkerPool::worker_thread(void* arg){
+  WorkerPool* pool = static_cast<WorkerPool*>(arg);
+  pthread_mutex_lock(&pool->_mutex);
+  while(pool->work(false));
+  pthread_mutex_unlock(&pool->_mutex);
+  return NULL;
+}
+
+// Runs task 'i' with the pool mutex released, then releases its successors
+void WorkerPool::run_task(int i){
+  dag_task_t& task = (*_tasks)[i];
+  _running++;
+  pthread_mutex_unlock(&_mutex);
+  std::exception_ptr error;
+  try {
+    task.run();
+  } catch(...) {
+    error = std::current_exception();
+  }
+  pthread_mutex_lock(&_mutex);
+  _running--;
+  _remaining--;
+  if(error){
+    _errors[i] = error;
+    _abort = true;
+  }
+  for(int j=0;j<task.successors.size();j++){
+    const int s = task.successors[j];
+    if(--_waiting_on[s] == 0){
+      _ready.push_back(s);
+      std::push_heap(_ready.begin(),_ready.end(),std::greater<int>());
+    }
+  }
+  if(_ready.size() > 1)
+    pthread_cond_broadcast(&_work_cond);
+  else if(!_ready.empty())
+    pthread_cond_signal(&_work_cond);
+  // the caller of run_graph() waits on _done_cond: wake it for the end of the graph
+  // and for released tasks, which it runs alongside the workers
+  if(_remaining == 0 || (_abort && _running == 0) || !_ready.empty())
+    pthread_cond_broadcast(&_done_cond);
+}
+
+// Called with the pool mutex held
+bool WorkerPool::work(bool caller){
+  for(;;){
+    if(_shutdown)
+      return false;
+    const bool finished = (_tasks == NULL || _remaining == 0 || (_abort && _running == 0));
+    if(caller && finished)
+      return true;
+    if(!finished && !_abort && !_ready.empty()){
+      std::pop_heap(_ready.begin(),_ready.end(),std::greater<int>());
+      int i = _ready.back();
+      _ready.pop_back();
+      run_task(i);
+      continue;
+    }
+    if(caller){
+      // woken at the end of the graph or when a finishing task released work
+      pthread_cond_wait(&_done_cond,&_mutex);
+    } else {
+      pthread_cond_wait(&_work_cond,&_mutex);
+    }
+  }
+}
+
+void WorkerPool::run_graph(std::vector<dag_task_t>& tasks){
+  if(_num_workers == 0 || tasks.size() < 2){
+    run_serial(tasks);
+    return;
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _tasks = &tasks;
+  _remaining = tasks.size();
+  _running = 0;
+  _abort = false;
+  _errors.assign(tasks.size(),std::exception_ptr());
+  _waiting_on.resize(tasks.size());
+  _ready.clear();
+  for(int i=0;i<tasks.size();i++){
+    _waiting_on[i] = tasks[i].num_predecessors;
+    if(_waiting_on[i] == 0)
+      _ready.push_back(i);
+  }
+  std::make_heap(_ready.begin(),_ready.end(),std::greater<int>());
+  pthread_cond_broadcast(&_work_cond);
+
+  work(true);
+
+  _tasks = NULL;
+  _ready.clear();
+  std::exception_ptr error;
+  for(int i=0;i<_errors.size() && !error;i++)
+    error = _errors[i];
+  pthread_mutex_unlock(&_mutex);
+
+  if(error)
+    std::rethrow_exception(error);
+}
+
+#endif